@@ -0,0 +1,624 @@
+#ifndef _RFID_HPP
+#define _RFID_HPP
+
+/* C++20 interface to librfid.
+ *
+ * reader, layer2 and protocol own their C handles and close them on
+ * destruction.  Transceive functions work on caller supplied std::span
+ * buffers, nothing is copied.  The asynchronous transceive functions return
+ * awaitables: co_await suspends the coroutine while the reader waits for the
+ * card, an event_loop resumes it once the response is there.  The typed
+ * protocol classes (Tcl, MifareClassic, MifareUltralight) check the protocol
+ * type once when they are constructed and then call straight into the
+ * protocol functions.  Errors are thrown as std::system_error with the
+ * (positive) errno value.
+ *
+ * Header only; link against librfid as usual. */
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+
+extern "C" {
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+#include <librfid/rfid_protocol_tcl.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
+#include <librfid/rfid_protocol_mifare_ul.h>
+#include <librfid/rfid_scan.h>
+}
+
+namespace rfid {
+
+using bytes = std::span<unsigned char>;
+using const_bytes = std::span<const unsigned char>;
+
+/* librfid returns negative errno values */
+inline int check(int ret, const char *what = "librfid")
+{
+	if (ret < 0)
+		throw std::system_error(-ret, std::generic_category(), what);
+	return ret;
+}
+
+class reader;
+class event_loop;
+
+namespace detail {
+
+/* Awaitable for a submit / complete pair of the C API.  If the submit
+ * fails, the coroutine isn't suspended and the error is thrown from
+ * co_await. */
+template <class Submit, class Complete>
+class transceive_awaiter {
+public:
+	transceive_awaiter(reader &r, Submit s, Complete c)
+		: r_(r), submit_(std::move(s)), complete_(std::move(c)) {}
+
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> h);
+	std::size_t await_resume()
+	{
+		unsigned int len = 0;
+
+		check(ret_, "submit");
+		check(complete_(&len), "complete");
+		return len;
+	}
+
+private:
+	reader &r_;
+	Submit submit_;
+	Complete complete_;
+	int ret_ = 0;
+};
+
+} /* namespace detail */
+
+class layer2;
+class protocol;
+struct card;
+
+/* An opened reader.  Not movable: layer2 / protocol objects and the
+ * event_loop refer to it. */
+class reader {
+public:
+	explicit reader(unsigned int id, void *data = nullptr)
+		: rh_(rfid_reader_open(data, id))
+	{
+		if (!rh_)
+			throw std::system_error(ENODEV, std::generic_category(),
+						"rfid_reader_open");
+	}
+	~reader() { rfid_reader_close(rh_); }
+
+	reader(const reader &) = delete;
+	reader &operator=(const reader &) = delete;
+
+	rfid_reader_handle *native() const noexcept { return rh_; }
+
+	void rf(bool on)
+	{
+		unsigned int opt = on ? 0 : 1;
+
+		check(rfid_reader_setopt(rh_, RFID_OPT_RDR_RF_KILL, &opt,
+					 sizeof(opt)), "rf_kill");
+	}
+
+	/* rfid_scan(): the card in the field, if any */
+	std::optional<card> scan();
+
+	int fd() { return check(rfid_reader_get_fd(rh_), "get_fd"); }
+
+	/* Drive the operation in flight.  Resumes the coroutine that waits
+	 * for it once it is complete. */
+	void process_events()
+	{
+		if (check(rfid_reader_process_events(rh_)) && waiter_)
+			std::exchange(waiter_, {}).resume();
+	}
+
+	bool waiting() const noexcept { return bool(waiter_); }
+
+private:
+	template <class, class> friend class detail::transceive_awaiter;
+
+	rfid_reader_handle *rh_;
+	std::coroutine_handle<> waiter_;
+};
+
+template <class Submit, class Complete>
+bool detail::transceive_awaiter<Submit, Complete>::await_suspend(
+						std::coroutine_handle<> h)
+{
+	ret_ = submit_();
+	if (ret_ < 0)
+		return false;
+
+	r_.waiter_ = h;
+	return true;
+}
+
+class layer2 {
+public:
+	/* select a card using layer2 'id' (enum rfid_layer2_id) */
+	layer2(reader &r, unsigned int id)
+		: r_(&r), l2h_(rfid_layer2_init(r.native(), id))
+	{
+		int ret;
+
+		if (!l2h_)
+			throw std::system_error(ENOMEM, std::generic_category(),
+						"rfid_layer2_init");
+		ret = rfid_layer2_open(l2h_);
+		if (ret < 0) {
+			rfid_layer2_fini(l2h_);
+			check(ret, "rfid_layer2_open");
+		}
+	}
+	/* take over an opened handle */
+	layer2(reader &r, rfid_layer2_handle *l2h) noexcept
+		: r_(&r), l2h_(l2h) {}
+	~layer2() { reset(); }
+
+	layer2(layer2 &&o) noexcept
+		: r_(o.r_), l2h_(std::exchange(o.l2h_, nullptr)) {}
+	layer2 &operator=(layer2 &&o) noexcept
+	{
+		if (this != &o) {
+			reset();
+			r_ = o.r_;
+			l2h_ = std::exchange(o.l2h_, nullptr);
+		}
+		return *this;
+	}
+
+	rfid_layer2_handle *native() const noexcept { return l2h_; }
+	reader &get_reader() const noexcept { return *r_; }
+	const char *name() const { return rfid_layer2_name(l2h_); }
+
+	/* returns the number of bytes received into 'rx' */
+	std::size_t transceive(enum rfid_frametype frametype, const_bytes tx,
+			       bytes rx, std::uint64_t timeout,
+			       unsigned int flags = 0)
+	{
+		unsigned int len = rx.size();
+
+		check(rfid_layer2_transceive(l2h_, frametype, tx.data(),
+					     tx.size(), rx.data(), &len,
+					     timeout, flags), "transceive");
+		return len;
+	}
+
+	/* co_await yields the number of bytes received.  tx and rx must stay
+	 * valid until then. */
+	auto async_transceive(enum rfid_frametype frametype, const_bytes tx,
+			      bytes rx, std::uint64_t timeout,
+			      unsigned int flags = 0)
+	{
+		rfid_layer2_handle *l2h = l2h_;
+
+		auto submit = [=] {
+			return rfid_layer2_transceive_submit(l2h, frametype,
+							     tx.data(), tx.size(),
+							     rx.data(), rx.size(),
+							     timeout, flags);
+		};
+		auto complete = [=](unsigned int *len) {
+			return rfid_layer2_transceive_complete(l2h, len);
+		};
+		return detail::transceive_awaiter<decltype(submit),
+						  decltype(complete)>(*r_,
+							submit, complete);
+	}
+
+	/* UID of the selected card, returns its length */
+	std::size_t uid(bytes out) const
+	{
+		unsigned int len = out.size();
+
+		check(rfid_layer2_getopt(l2h_, RFID_OPT_LAYER2_UID, out.data(),
+					 &len), "uid");
+		return len;
+	}
+
+	bool present() { return check(rfid_layer2_presence(l2h_)) == 1; }
+
+private:
+	void reset() noexcept
+	{
+		if (!l2h_)
+			return;
+		rfid_layer2_close(l2h_);
+		rfid_layer2_fini(l2h_);
+		l2h_ = nullptr;
+	}
+
+	reader *r_;
+	rfid_layer2_handle *l2h_;
+};
+
+/* An opened protocol of any type, see the typed classes below for the
+ * protocol specific calls. */
+class protocol {
+public:
+	/* open protocol 'id' (enum rfid_protocol_id) on 'l2' */
+	protocol(layer2 &l2, unsigned int id)
+		: r_(&l2.get_reader()), ph_(rfid_protocol_init(l2.native(), id))
+	{
+		int ret;
+
+		if (!ph_)
+			throw std::system_error(ENOMEM, std::generic_category(),
+						"rfid_protocol_init");
+		ret = rfid_protocol_open(ph_);
+		if (ret < 0) {
+			rfid_protocol_fini(ph_);
+			check(ret, "rfid_protocol_open");
+		}
+	}
+	/* take over an opened handle */
+	protocol(reader &r, rfid_protocol_handle *ph) noexcept
+		: r_(&r), ph_(ph) {}
+	~protocol() { reset(); }
+
+	protocol(protocol &&o) noexcept
+		: r_(o.r_), ph_(std::exchange(o.ph_, nullptr)) {}
+	protocol &operator=(protocol &&o) noexcept
+	{
+		if (this != &o) {
+			reset();
+			r_ = o.r_;
+			ph_ = std::exchange(o.ph_, nullptr);
+		}
+		return *this;
+	}
+
+	rfid_protocol_handle *native() const noexcept { return ph_; }
+	reader &get_reader() const noexcept { return *r_; }
+	const char *name() const { return rfid_protocol_name(ph_); }
+
+	/* enum rfid_protocol_id */
+	unsigned int id() const
+	{
+		unsigned int id, len = sizeof(id);
+
+		check(rfid_protocol_getopt(ph_, RFID_OPT_PROTO_ID, &id, &len),
+		      "protocol id");
+		return id;
+	}
+
+	bool present() { return check(rfid_protocol_presence(ph_)) == 1; }
+
+private:
+	void reset() noexcept
+	{
+		if (!ph_)
+			return;
+		rfid_protocol_close(ph_);
+		rfid_protocol_fini(ph_);
+		ph_ = nullptr;
+	}
+
+	reader *r_;
+	rfid_protocol_handle *ph_;
+};
+
+/* A card found by reader::scan().  'proto' is declared last, so it is
+ * closed before the layer2 it runs on. */
+struct card {
+	layer2 l2;
+	std::optional<protocol> proto;
+};
+
+inline std::optional<card> reader::scan()
+{
+	rfid_layer2_handle *l2h = nullptr;
+	rfid_protocol_handle *ph = nullptr;
+	int rc;
+
+	rc = rfid_scan(rh_, &l2h, &ph);
+	if (rc < 2)
+		return std::nullopt;
+
+	card c{layer2(*this, l2h), std::nullopt};
+	if (rc == 3)
+		c.proto.emplace(*this, ph);
+
+	return c;
+}
+
+/* Typed view of a protocol.  Does not own the handle; the protocol object
+ * has to outlive it. */
+template <enum rfid_protocol_id Id>
+class typed_protocol;
+
+namespace detail {
+
+template <enum rfid_protocol_id Id>
+class typed_base {
+public:
+	explicit typed_base(protocol &p) : p_(&p)
+	{
+		if (p.id() != Id)
+			throw std::system_error(EPROTONOSUPPORT,
+						std::generic_category(),
+						"protocol type");
+	}
+
+	rfid_protocol_handle *native() const noexcept { return p_->native(); }
+	reader &get_reader() const noexcept { return p_->get_reader(); }
+
+private:
+	protocol *p_;
+};
+
+} /* namespace detail */
+
+template <>
+class typed_protocol<RFID_PROTOCOL_TCL>
+	: public detail::typed_base<RFID_PROTOCOL_TCL> {
+public:
+	using typed_base::typed_base;
+
+	/* returns the number of bytes received into 'rx' */
+	std::size_t transceive(const_bytes tx, bytes rx,
+			       unsigned int timeout = 0)
+	{
+		unsigned int len = rx.size();
+
+		check(rfid_protocol_transceive(native(), tx.data(), tx.size(),
+					       rx.data(), &len, timeout, 0),
+		      "tcl transceive");
+		return len;
+	}
+
+	/* co_await yields the number of bytes received.  tx and rx must stay
+	 * valid until then. */
+	auto async_transceive(const_bytes tx, bytes rx,
+			      unsigned int timeout = 0)
+	{
+		rfid_protocol_handle *ph = native();
+
+		auto submit = [=] {
+			return rfid_protocol_transceive_submit(ph, tx.data(),
+							       tx.size(),
+							       rx.data(),
+							       rx.size(),
+							       timeout, 0);
+		};
+		auto complete = [=](unsigned int *len) {
+			return rfid_protocol_transceive_complete(ph, len);
+		};
+		return detail::transceive_awaiter<decltype(submit),
+						  decltype(complete)>(
+							get_reader(),
+							submit, complete);
+	}
+
+	/* tcl_transceive_batch(): returns the number of APDUs that were
+	 * executed with the expected status */
+	std::size_t batch(std::span<rfid_tcl_apdu> apdus, bytes arena,
+			  unsigned int timeout = 0)
+	{
+		unsigned int len = arena.size();
+
+		return check(tcl_transceive_batch(native(), apdus.data(),
+						  apdus.size(), arena.data(),
+						  &len, timeout), "tcl batch");
+	}
+
+	std::size_t ats(bytes out) const
+	{
+		unsigned int len = out.size();
+
+		check(rfid_protocol_getopt(native(), RFID_OPT_P_TCL_ATS,
+					   out.data(), &len), "ats");
+		return len;
+	}
+};
+
+template <>
+class typed_protocol<RFID_PROTOCOL_MIFARE_CLASSIC>
+	: public detail::typed_base<RFID_PROTOCOL_MIFARE_CLASSIC> {
+public:
+	using typed_base::typed_base;
+
+	static constexpr std::size_t key_len = MIFARE_CL_KEY_LEN;
+	static constexpr std::size_t block_size = MIFARE_CL_PAGE_SIZE;
+
+	enum class key_type : std::uint8_t {
+		A = RFID_CMD_MIFARE_AUTH1A,
+		B = RFID_CMD_MIFARE_AUTH1B,
+	};
+
+	void set_key(std::span<const unsigned char, key_len> key)
+	{
+		check(mfcl_set_key(native(),
+				   const_cast<unsigned char *>(key.data())),
+		      "mfcl set_key");
+	}
+
+	void auth(key_type type, unsigned int block)
+	{
+		check(mfcl_auth(native(), static_cast<u_int8_t>(type), block),
+		      "mfcl auth");
+	}
+
+	void read_block(unsigned int block,
+			std::span<unsigned char, block_size> out)
+	{
+		unsigned int len = out.size();
+
+		check(rfid_protocol_read(native(), block, out.data(), &len),
+		      "mfcl read");
+		if (len != block_size)
+			throw std::system_error(EIO, std::generic_category(),
+						"mfcl read");
+	}
+
+	void write_block(unsigned int block,
+			 std::span<const unsigned char, block_size> data)
+	{
+		check(rfid_protocol_write(native(), block,
+				const_cast<unsigned char *>(data.data()),
+				data.size()), "mfcl write");
+	}
+
+	/* authenticate to 'sector' and read all of its blocks into 'out'.
+	 * Returns the number of bytes read. */
+	std::size_t read_sector(unsigned int sector,
+				std::span<const unsigned char, key_len> key,
+				key_type type, bytes out)
+	{
+		unsigned int first = check(mfcl_sector2block(sector));
+		unsigned int num = check(mfcl_sector_blocks(sector));
+
+		if (out.size() < num * block_size)
+			throw std::system_error(E2BIG, std::generic_category(),
+						"mfcl read_sector");
+
+		set_key(key);
+		auth(type, first);
+		for (unsigned int i = 0; i < num; i++)
+			read_block(first + i, out.subspan(i * block_size)
+						.template first<block_size>());
+
+		return num * block_size;
+	}
+
+	/* card size in bytes */
+	unsigned int size() const
+	{
+		unsigned int size, len = sizeof(size);
+
+		check(rfid_protocol_getopt(native(), RFID_OPT_P_MFCL_SIZE,
+					   &size, &len), "mfcl size");
+		return size;
+	}
+};
+
+template <>
+class typed_protocol<RFID_PROTOCOL_MIFARE_UL>
+	: public detail::typed_base<RFID_PROTOCOL_MIFARE_UL> {
+public:
+	using typed_base::typed_base;
+
+	static constexpr std::size_t page_size = 4;
+
+	/* READ returns four pages starting at 'page'.  Returns the number
+	 * of bytes stored in 'out'. */
+	std::size_t read(unsigned int page, bytes out)
+	{
+		unsigned int len = out.size();
+
+		check(rfid_protocol_read(native(), page, out.data(), &len),
+		      "mful read");
+		return len;
+	}
+
+	void write_page(unsigned int page,
+			std::span<const unsigned char, page_size> data)
+	{
+		check(rfid_protocol_write(native(), page,
+				const_cast<unsigned char *>(data.data()),
+				data.size()), "mful write");
+	}
+
+	void lock_page(unsigned int page)
+	{
+		check(rfid_mful_lock_page(native(), page), "mful lock_page");
+	}
+
+	void lock_otp() { check(rfid_mful_lock_otp(native()), "mful lock_otp"); }
+};
+
+using Tcl = typed_protocol<RFID_PROTOCOL_TCL>;
+using MifareClassic = typed_protocol<RFID_PROTOCOL_MIFARE_CLASSIC>;
+using MifareUltralight = typed_protocol<RFID_PROTOCOL_MIFARE_UL>;
+
+/* Waits on the descriptors of a set of readers and resumes the coroutines
+ * whose operation has completed. */
+class event_loop {
+public:
+	void add(reader &r)
+	{
+		r.fd();
+		readers_.push_back(&r);
+	}
+
+	void remove(reader &r)
+	{
+		std::erase(readers_, &r);
+	}
+
+	/* one round of waiting and dispatching.  Returns false if no
+	 * coroutine is waiting on any of the readers. */
+	bool run_once(int timeout_ms = -1)
+	{
+		pfd_.clear();
+		waiting_.clear();
+		for (reader *r : readers_) {
+			if (!r->waiting())
+				continue;
+			pfd_.push_back({ r->fd(), POLLIN, 0 });
+			waiting_.push_back(r);
+		}
+		if (pfd_.empty())
+			return false;
+
+		if (::poll(pfd_.data(), pfd_.size(), timeout_ms) < 0) {
+			if (errno == EINTR)
+				return true;
+			throw std::system_error(errno, std::generic_category(),
+						"poll");
+		}
+
+		for (std::size_t i = 0; i < pfd_.size(); i++) {
+			if (pfd_[i].revents & POLLIN)
+				waiting_[i]->process_events();
+		}
+
+		return true;
+	}
+
+	/* until all operations are complete */
+	void run()
+	{
+		while (run_once())
+			;
+	}
+
+private:
+	std::vector<reader *> readers_;
+	std::vector<pollfd> pfd_;
+	std::vector<reader *> waiting_;
+};
+
+/* Minimal fire-and-forget coroutine type for code using the awaitables:
+ * it starts running immediately and frees itself at the end.  Exceptions
+ * must be caught inside the coroutine. */
+struct task {
+	struct promise_type {
+		task get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+} /* namespace rfid */
+
+#endif /* _RFID_HPP */
@@ -40,6 +40,9 @@ struct rfid_asic_handle {
 		//struct rfid_asic_rc531_handle rc531;
 	} priv;
 	struct rfid_asic *asic;
+	struct rfid_trace *trace;	/* of the reader */
+	u_int64_t deadline;		/* of the reader's current operation,
+					 * usec CLOCK_MONOTONIC, 0 = none */
 };
 
 
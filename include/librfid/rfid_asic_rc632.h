@@ -22,6 +22,11 @@ struct rfid_asic_rc632_transport {
 		int (*fifo_read)(struct rfid_asic_transport_handle *rath,
 				 u_int8_t len,
 				 u_int8_t *buf);
+		/* optional: block until the reader signals an event or
+		 * timeout_ms passed.  Returns RFID_READER_EV_* bits, 0 on
+		 * timeout */
+		int (*wait_irq)(struct rfid_asic_transport_handle *rath,
+				unsigned int timeout_ms);
 	} fn;
 };
 
@@ -31,6 +36,7 @@ struct iso14443a_atqa;
 struct iso14443a_anticol_cmd;
 struct iso15693_anticol_cmd;
 struct iso15693_anticol_resp;
+struct mfcl_ee_key;
 
 struct rfid_asic_rc632 {
 	struct {
@@ -45,6 +51,17 @@ struct rfid_asic_rc632 {
 				  unsigned int *rx_len,
 				  u_int64_t timeout,
 				  unsigned int flags);
+		/* transceive split in two: start the frame, then poll for
+		 * the response until -EINPROGRESS is no longer returned */
+		int (*transceive_submit)(struct rfid_asic_handle *h,
+					 enum rfid_frametype,
+					 const u_int8_t *tx_buf,
+					 unsigned int tx_len,
+					 u_int64_t timeout,
+					 unsigned int flags);
+		int (*transceive_complete)(struct rfid_asic_handle *h,
+					   u_int8_t *rx_buf,
+					   unsigned int *rx_len);
 		struct {
 			int (*transceive_sf)(struct rfid_asic_handle *h,
 					     u_int8_t cmd,
@@ -68,6 +85,9 @@ struct rfid_asic_rc632 {
 				      const unsigned char *key);
 			int (*setkey_ee)(struct rfid_asic_handle *h,
 				      const unsigned int addr);
+			int (*load_keys_ee)(struct rfid_asic_handle *h,
+					    struct mfcl_ee_key *keys,
+					    unsigned int num);
 			int (*auth)(struct rfid_asic_handle *h, u_int8_t cmd, 
 				    u_int32_t serno, u_int8_t block);
 		} mifare_classic;
@@ -77,25 +97,51 @@ struct rfid_asic_rc632 {
 struct rc632_transport_handle {
 };
 
-/* A handle to a specific RC632 chip */
-struct rfid_asic_rc632_handle {
-	struct rc632_transport_handle th;
-};
-
+/* RF front end settings of one layer2 */
 struct rfid_asic_rc632_impl_proto {
 	u_int8_t mod_conductance;
 	u_int8_t cw_conductance;
 	u_int8_t bitphase;
 	u_int8_t threshold;
+	u_int8_t rx_wait;	/* 0 = leave RxWait alone */
 };
 
+/* what a specific reader (antenna, transport) can do with its RC632 */
 struct rfid_asic_rc632_impl {
 	u_int32_t mru;		/* maximum receive unit (PICC->PCD) */
 	u_int32_t mtu;		/* maximum transmit unit (PCD->PICC) */
-	//struct rfid_asic_rc632_impl_proto proto[NUM_RFID_PROTOCOLS];
+	struct rfid_asic_rc632_impl_proto iso14443a;
+	struct rfid_asic_rc632_impl_proto iso14443b;
+	struct rfid_asic_rc632_impl_proto iso15693;
+};
+
+/* what is in the crypto1 key buffer */
+enum rc632_key_src {
+	RC632_KEY_NONE,
+	RC632_KEY_HOST,		/* LoadKey of key[] */
+	RC632_KEY_EE,		/* LoadKeyE2 from key_ee_addr */
+};
+
+/* A handle to a specific RC632 chip */
+struct rfid_asic_rc632_handle {
+	struct rc632_transport_handle th;
+	const struct rfid_asic_rc632_impl *impl;
+	/* RF tuning, written by the ISO14443A layer2 init.  Starts out as
+	 * impl->iso14443a, see RFID_OPT_RDR_TUNING */
+	struct rfid_asic_rc632_impl_proto iso14443a;
+	u_int8_t err_flags;	/* ERROR_FLAG after the last transceive */
+	u_int8_t key_src;	/* enum rc632_key_src */
+	u_int8_t key[12];	/* coded */
+	u_int16_t key_ee_addr;
+	/* coded keys this handle wrote to the EEPROM key area, which can't
+	 * be read back.  Bit n of ee_keys_known set if slot n is valid */
+	u_int32_t ee_keys_known;
+	u_int8_t ee_keys[32][12];
 };
 
-extern struct rfid_asic_handle * rc632_open(struct rfid_asic_transport_handle *th);
+extern struct rfid_asic_handle *
+rc632_open(struct rfid_asic_transport_handle *th,
+	   const struct rfid_asic_rc632_impl *impl);
 extern void rc632_close(struct rfid_asic_handle *h);
 extern int rc632_register_dump(struct rfid_asic_handle *handle, u_int8_t *buf);
 
@@ -0,0 +1,57 @@
+#ifndef _RFID_BUF_H
+#define _RFID_BUF_H
+
+/* librfid packet buffers, similar to the Linux sk_buff.
+ *
+ * A frame is built back to front: the payload is put into the buffer
+ * behind some reserved headroom, and every layer then pushes its own
+ * header (T=CL PCB/CID/NAD, ISO15693 flags/command/UID, ...) in front of
+ * it.  On receive, each layer pulls its header off again.  This way the
+ * payload is never copied between layers. */
+
+#ifdef __LIBRFID__
+
+#define RFID_BUF_HEADROOM	16	/* flags + cmd + UID + prologue */
+#define RFID_BUF_TAILROOM	4	/* CRC */
+#define RFID_BUF_DATALEN	256
+#define RFID_BUF_SIZE		(RFID_BUF_HEADROOM + RFID_BUF_DATALEN \
+				 + RFID_BUF_TAILROOM)
+
+/* number of pre-allocated buffers */
+#ifndef RFID_BUF_POOL_SIZE
+#define RFID_BUF_POOL_SIZE	4
+#endif
+
+enum rfid_buf_flags {
+	RFID_BUF_F_POOL		= 0x0001,	/* belongs to the pool */
+	RFID_BUF_F_HEAP		= 0x0002,	/* malloc()ed on pool overflow */
+};
+
+struct rfid_buf {
+	struct rfid_buf *next;		/* free list */
+	unsigned int flags;
+	unsigned char *data;		/* start of valid data */
+	unsigned char *tail;		/* end of valid data */
+	unsigned char head[RFID_BUF_SIZE];
+};
+
+#define rfid_buf_end(b)		((b)->head + RFID_BUF_SIZE)
+#define rfid_buf_len(b)		((unsigned int)((b)->tail - (b)->data))
+#define rfid_buf_headroom(b)	((unsigned int)((b)->data - (b)->head))
+#define rfid_buf_tailroom(b)	((unsigned int)(rfid_buf_end(b) - (b)->tail))
+
+/* Buffers come from a pool per thread, and have to be freed by the thread
+ * that allocated them */
+struct rfid_buf *rfid_buf_alloc(void);
+void rfid_buf_free(struct rfid_buf *b);
+
+void rfid_buf_init(struct rfid_buf *b);
+void rfid_buf_reserve(struct rfid_buf *b, unsigned int len);
+unsigned char *rfid_buf_push(struct rfid_buf *b, unsigned int len);
+unsigned char *rfid_buf_pull(struct rfid_buf *b, unsigned int len);
+unsigned char *rfid_buf_put(struct rfid_buf *b, unsigned int len);
+void rfid_buf_trim(struct rfid_buf *b, unsigned int len);
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_BUF_H */
@@ -0,0 +1,45 @@
+#ifndef _RFID_CALIBRATE_H
+#define _RFID_CALIBRATE_H
+
+/* ISO14443A antenna auto-calibration.
+ *
+ * With a single PICC left on the reader, rfid_reader_calibrate() sweeps the
+ * bit phase, the receiver threshold and the modulation conductance one after
+ * the other, each time keeping the best values found so far for the others.
+ * Every setting gets 'rounds' WUPA/anticollision/select/HLTA cycles and is
+ * scored by the number of successful selects, then by their average latency.
+ * The best setting is left active (see RFID_OPT_RDR_TUNING).
+ *
+ * To keep it, save it to a tuning file.  rfid_reader_open() loads the file
+ * named by the LIBRFID_TUNING environment variable, if set, so the next
+ * ISO14443A layer2 init of any application uses it.  The values belong to
+ * the antenna they were found with, so keep one file per reader. */
+
+#include <librfid/rfid_reader.h>
+
+struct rfid_calib_result {
+	struct rfid_reader_tuning tuning;
+	unsigned int rounds;
+	unsigned int ok;		/* successful selects */
+	unsigned int latency;		/* their average, usec */
+};
+
+/* 'cb' (may be NULL) is called after every setting that was tried.
+ * Returns -ENOENT if no setting selected the card at all, in which case the
+ * previous tuning is restored. */
+extern int rfid_reader_calibrate(struct rfid_reader_handle *rh,
+				 unsigned int rounds,
+				 struct rfid_calib_result *best,
+				 void (*cb)(const struct rfid_calib_result *res,
+					    void *data),
+				 void *data);
+
+/* Tuning files hold one "name value" pair per line for mod_conductance,
+ * bitphase and threshold; '#' starts a comment.  Loading applies the file
+ * to the reader, names missing from it keep their current value. */
+extern int rfid_reader_tuning_save(struct rfid_reader_handle *rh,
+				   const char *path);
+extern int rfid_reader_tuning_load(struct rfid_reader_handle *rh,
+				   const char *path);
+
+#endif /* _RFID_CALIBRATE_H */
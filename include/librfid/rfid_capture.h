@@ -0,0 +1,106 @@
+#ifndef _RFID_CAPTURE_H
+#define _RFID_CAPTURE_H
+
+/* pcapng capture of RF frames.
+ *
+ * rfid_capture_start() writes every frame a reader exchanges with the
+ * card (regular frames, REQA/WUPA, anticollision, ISO15693 inventory and
+ * Mifare authentication) to a file descriptor in pcapng format.  Frames are
+ * queued in memory and written by a separate thread; if the writer can't
+ * keep up they are dropped and counted in the final interface statistics
+ * block instead of delaying the RF path.
+ *
+ * Link layer: LINKTYPE_USER0 (147).  Every packet starts with the pseudo
+ * header below (multi-byte fields in network byte order), followed by the
+ * frame as passed to/from the reader, i.e. without CRC bytes, which the
+ * RC632 appends and checks itself.  utils/wireshark/librfid.lua is a
+ * Wireshark dissector for it. */
+
+#include <librfid/rfid.h>
+
+struct rfid_reader_handle;
+struct rfid_capture;
+
+#define RFID_CAPTURE_LINKTYPE	147	/* LINKTYPE_USER0 */
+#define RFID_CAPTURE_VERSION	1
+
+enum rfid_capture_dir {
+	RFID_CAPTURE_PCD_TO_PICC	= 0,
+	RFID_CAPTURE_PICC_TO_PCD	= 1,
+};
+
+enum rfid_capture_event {
+	RFID_CAPTURE_EV_FRAME		= 0,	/* rfid_reader transceive */
+	RFID_CAPTURE_EV_REQ		= 1,	/* ISO14443A REQA/WUPA */
+	RFID_CAPTURE_EV_ANTICOL		= 2,	/* ISO14443A anticol/select */
+	RFID_CAPTURE_EV_15693_AC	= 3,	/* ISO15693 inventory */
+	RFID_CAPTURE_EV_MIFARE_AUTH	= 4,	/* cmd, block, 4 UID bytes */
+};
+
+/* RFID_CAPTURE_PICC_TO_PCD: errors the ASIC reported for the frame */
+#define RFID_CAPTURE_F_COLLISION	0x01
+#define RFID_CAPTURE_F_PARITY_ERR	0x02
+#define RFID_CAPTURE_F_FRAMING_ERR	0x04
+#define RFID_CAPTURE_F_CRC_ERR		0x08
+
+struct rfid_capture_hdr {
+	u_int8_t version;		/* RFID_CAPTURE_VERSION */
+	u_int8_t dir;			/* enum rfid_capture_dir */
+	u_int8_t event;			/* enum rfid_capture_event */
+	u_int8_t frametype;		/* enum rfid_frametype */
+	u_int16_t kbps;			/* nominal bit rate, 0 if unknown */
+	u_int8_t flags;			/* RFID_CAPTURE_F_* */
+	u_int8_t reserved;
+	int32_t status;			/* PICC_TO_PCD: result, -errno */
+} __attribute__((packed));
+
+/* start capturing the frames of 'rh' into 'fd', which stays owned by the
+ * caller.  Writes the pcapng section and interface headers right away. */
+extern int rfid_capture_start(struct rfid_reader_handle *rh, int fd);
+
+/* write all queued frames and stop, not while the reader is in use.
+ * Returns the first write error, if any.  Called by rfid_reader_close(). */
+extern int rfid_capture_stop(struct rfid_reader_handle *rh);
+
+#ifdef __LIBRFID__
+
+/* frametype of the last PCD_TO_PICC frame */
+#define RFID_CAPTURE_FRAMETYPE_TX	0xff
+
+#ifdef ENABLE_CAPTURE
+
+void __rfid_capture(struct rfid_capture *cap, unsigned int dir,
+		    unsigned int event, unsigned int frametype, int status,
+		    unsigned int flags, const void *data, unsigned int len);
+void rfid_capture_speed(struct rfid_capture *cap, unsigned int tx,
+			unsigned int kbps);
+
+static inline void rfid_capture(struct rfid_capture *cap, unsigned int dir,
+				unsigned int event, unsigned int frametype,
+				int status, unsigned int flags,
+				const void *data, unsigned int len)
+{
+	if (cap)
+		__rfid_capture(cap, dir, event, frametype, status, flags,
+			       data, len);
+}
+
+#else
+
+static inline void rfid_capture(struct rfid_capture *cap, unsigned int dir,
+				unsigned int event, unsigned int frametype,
+				int status, unsigned int flags,
+				const void *data, unsigned int len)
+{
+}
+
+static inline void rfid_capture_speed(struct rfid_capture *cap,
+				      unsigned int tx, unsigned int kbps)
+{
+}
+
+#endif /* ENABLE_CAPTURE */
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_CAPTURE_H */
@@ -0,0 +1,82 @@
+#ifndef _RFID_ISO7816_H
+#define _RFID_ISO7816_H
+
+/* ISO 7816-4 file system access on top of a T=CL protocol handle */
+
+#include <librfid/rfid_protocol.h>
+
+#define ISO7816_SW_OK		0x9000
+#define ISO7816_FID_MF		0x3f00
+#define ISO7816_AID_MAX		16
+
+/* maximum Le of a short APDU (encoded as 0x00) */
+#define ISO7816_LE_MAX		256
+
+enum iso7816_read_flags {
+	ISO7816_READ_F_CACHE	= 0x0001,	/* EF is immutable, may be cached */
+};
+
+struct iso7816_handle;
+struct iso7816_cache;
+
+extern struct iso7816_handle *iso7816_init(struct rfid_protocol_handle *ph);
+extern void iso7816_fini(struct iso7816_handle *ih);
+
+extern struct iso7816_cache *iso7816_cache_init(unsigned int num_entries);
+extern void iso7816_cache_fini(struct iso7816_cache *cache);
+extern void iso7816_set_cache(struct iso7816_handle *ih,
+			      struct iso7816_cache *cache);
+
+extern int iso7816_select_mf(struct iso7816_handle *ih);
+extern int iso7816_select_application(struct iso7816_handle *ih,
+				      const unsigned char *aid,
+				      unsigned int aid_len);
+extern int iso7816_select_ef(struct iso7816_handle *ih, u_int16_t fid);
+extern int iso7816_read_binary(struct iso7816_handle *ih, unsigned int offset,
+			       unsigned char *buf, unsigned int *len);
+extern int iso7816_read_ef(struct iso7816_handle *ih, u_int16_t fid,
+			   unsigned char *buf, unsigned int *len,
+			   unsigned int flags);
+extern int iso7816_get_challenge(struct iso7816_handle *ih,
+				 unsigned char *buf, unsigned int len);
+
+#ifdef __LIBRFID__
+
+struct iso7816_handle {
+	struct rfid_protocol_handle *ph;
+	struct iso7816_cache *cache;
+
+	/* currently selected DF (application) and EF, so we can skip
+	 * redundant SELECT commands */
+	unsigned int df_valid:1,
+		     ef_valid:1;
+	unsigned char df_aid[ISO7816_AID_MAX];
+	unsigned int df_aid_len;	/* 0 == MF */
+	u_int16_t ef_fid;
+};
+
+struct iso7816_cache_entry {
+	unsigned int valid;
+	unsigned int last_use;
+
+	/* key: card identity (UID + ATS), DF and EF */
+	unsigned char uid[10];
+	unsigned int uid_len;
+	u_int32_t ats_hash;
+	unsigned char df_aid[ISO7816_AID_MAX];
+	unsigned int df_aid_len;
+	u_int16_t fid;
+
+	unsigned char *data;
+	unsigned int len;
+};
+
+struct iso7816_cache {
+	unsigned int num_entries;
+	unsigned int use_count;
+	struct iso7816_cache_entry entry[0];
+};
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_ISO7816_H */
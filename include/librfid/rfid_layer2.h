@@ -30,7 +30,20 @@ int rfid_layer2_transceive(struct rfid_layer2_handle *l2h,
 			   const unsigned char *tx_buf, unsigned int tx_len,
 			   unsigned char *rx_buf, unsigned int *rx_len,
 			   u_int64_t timeout, unsigned int flags);
+/* Non-blocking transceive: start the frame, then call
+ * rfid_reader_process_events() until rfid_layer2_transceive_complete() no
+ * longer returns -EINPROGRESS.  tx_buf and rx_buf have to stay valid in
+ * between, 'rx_len' is the size of rx_buf. */
+int rfid_layer2_transceive_submit(struct rfid_layer2_handle *l2h,
+				  enum rfid_frametype frametype,
+				  const unsigned char *tx_buf,
+				  unsigned int tx_len,
+				  unsigned char *rx_buf, unsigned int rx_len,
+				  u_int64_t timeout, unsigned int flags);
+int rfid_layer2_transceive_complete(struct rfid_layer2_handle *l2h,
+				    unsigned int *rx_len);
 int rfid_layer2_close(struct rfid_layer2_handle *l2h);
+int rfid_layer2_presence(struct rfid_layer2_handle *l2h);
 int rfid_layer2_fini(struct rfid_layer2_handle *l2h);
 int rfid_layer2_getopt(struct rfid_layer2_handle *l2h, int optname,
 			void *optval, unsigned int *optlen);
@@ -58,6 +71,9 @@ struct rfid_layer2 {
 				  unsigned int *rx_len, u_int64_t timeout,
 				  unsigned int flags);
 		int (*close)(struct rfid_layer2_handle *h);
+		/* check whether the selected card is still in the field,
+		 * returns 1 if present, 0 if not */
+		int (*presence)(struct rfid_layer2_handle *h);
 		int (*fini)(struct rfid_layer2_handle *h);
 		int (*getopt)(struct rfid_layer2_handle *h,
 			      int optname, void *optval, unsigned int *optlen);
@@ -67,6 +83,24 @@ struct rfid_layer2 {
 	} fn;
 };
 
+struct rfid_buf;
+int rfid_layer2_transceive_buf(struct rfid_layer2_handle *l2h,
+			       enum rfid_frametype frametype,
+			       struct rfid_buf *tx, struct rfid_buf *rx,
+			       u_int64_t timeout, unsigned int flags);
+
+/* continuation of a multi-frame exchange, called from
+ * rfid_reader_process_events() once a frame is complete.  It may submit
+ * the next frame. */
+typedef void rfid_async_cont(int status, unsigned int rx_len, void *data);
+
+int rfid_layer2_async_submit(struct rfid_layer2_handle *l2h,
+			     enum rfid_frametype frametype,
+			     const unsigned char *tx_buf, unsigned int tx_len,
+			     unsigned char *rx_buf, unsigned int rx_len,
+			     u_int64_t timeout, unsigned int flags,
+			     rfid_async_cont *cont, void *data);
+
 struct rfid_layer2_handle {
 	struct rfid_reader_handle *rh;
 	unsigned char uid[10];	/* triple size 14443a id is 10 bytes */
@@ -63,12 +63,24 @@ enum iso14443a_anticol_sel_code {
 
 #define	ISO14443A_BITOFCOL_NONE		0xffffffff
 
+/* card type identification by ATQA and SAK */
+struct iso14443a_fingerprint {
+	u_int16_t atqa_mask;	/* ATQA as received, first byte is LSB */
+	u_int16_t atqa;
+	u_int8_t sak_mask;
+	u_int8_t sak;
+	unsigned int proto_supported;
+	unsigned int size;	/* memory size in bytes, 0 if unknown */
+	const char *name;
+};
+
 struct iso14443a_handle {
 	unsigned int state;
 	unsigned int level;
 	unsigned int tcl_capable;
 	struct iso14443a_atqa atqa;
 	u_int8_t sak;
+	const struct iso14443a_fingerprint *fp;	/* NULL if unknown */
 };
 
 enum iso14443a_level {
@@ -0,0 +1,123 @@
+#ifndef _RFID_MANAGER_H
+#define _RFID_MANAGER_H
+
+/* Multi-reader manager.
+ *
+ * The manager drives a number of readers from a small pool of worker
+ * threads.  Every reader is scanned and presence-checked like by a
+ * rfid_monitor, and jobs (e.g. T=CL transactions) can be submitted for a
+ * reader.  Work on one reader is always serialized, work on different
+ * readers runs in parallel.  A worker executes one job or scan step of a
+ * reader at a time; idle workers steal readers from busy ones, so a reader
+ * stuck in a long exchange doesn't hold up the others.  Card events of all
+ * readers end up in a single queue, with rfid_monitor_event.reader telling
+ * where they came from. */
+
+#include <librfid/rfid_monitor.h>
+
+#define RFID_MANAGER_READERS_MAX	32
+#define RFID_MANAGER_WORKERS_MAX	16
+
+struct rfid_manager;
+
+/* called from a worker thread, possibly from several at the same time
+ * for different readers */
+typedef void rfid_manager_cb(struct rfid_manager *mgr,
+			     const struct rfid_monitor_event *ev, void *data);
+
+/* Runs with exclusive access to the reader.  l2h/ph are the handles of
+ * the card currently in the field, or NULL. */
+typedef void rfid_manager_job_fn(struct rfid_reader_handle *rh,
+				 struct rfid_layer2_handle *l2h,
+				 struct rfid_protocol_handle *ph, void *data);
+
+/* 'params' may be NULL for defaults */
+extern struct rfid_manager *
+rfid_manager_create(unsigned int num_workers,
+		    const struct rfid_monitor_params *params);
+extern void rfid_manager_destroy(struct rfid_manager *mgr);
+
+/* add an already opened reader, returns its index.  Only allowed while
+ * the manager is stopped. */
+extern int rfid_manager_add_reader(struct rfid_manager *mgr,
+				   struct rfid_reader_handle *rh);
+
+extern void rfid_manager_set_callback(struct rfid_manager *mgr,
+				      rfid_manager_cb *cb, void *data);
+
+extern int rfid_manager_start(struct rfid_manager *mgr);
+extern int rfid_manager_stop(struct rfid_manager *mgr);
+
+/* queue 'fn' for execution on reader 'reader' */
+extern int rfid_manager_submit(struct rfid_manager *mgr, unsigned int reader,
+			       rfid_manager_job_fn *fn, void *data);
+
+/* same semantics as rfid_monitor_get_fd() / rfid_monitor_read_event() */
+extern int rfid_manager_get_fd(struct rfid_manager *mgr);
+extern int rfid_manager_read_event(struct rfid_manager *mgr,
+				   struct rfid_monitor_event *ev);
+
+#ifdef __LIBRFID__
+
+#define RFID_MANAGER_QUEUE_LEN	64
+
+struct rfid_manager_job {
+	struct rfid_manager_job *next;
+	rfid_manager_job_fn *fn;
+	void *data;
+};
+
+struct rfid_manager_reader {
+	struct rfid_reader_handle *rh;
+	unsigned int idx;
+
+	/* protected by the manager lock */
+	struct rfid_manager_job *jobs, **jobs_tail;
+	unsigned int queued:1;		/* in a worker deque or running */
+	struct timespec next_scan;
+
+	/* card state, only touched by the worker running the reader */
+	struct rfid_layer2_handle *l2h;
+	struct rfid_protocol_handle *ph;
+	struct rfid_monitor_event cur;
+	unsigned int present:1,
+		     rf_off:1;
+	struct timespec empty_since;
+};
+
+/* Runnable readers of a worker.  The owner takes them from the head and
+ * re-queues them at the tail, so its readers are served round-robin;
+ * thieves take from the tail. */
+struct rfid_manager_worker {
+	struct rfid_manager *mgr;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	unsigned int head, len;
+	struct rfid_manager_reader *dq[RFID_MANAGER_READERS_MAX];
+};
+
+struct rfid_manager {
+	struct rfid_monitor_params params;
+
+	rfid_manager_cb *cb;
+	void *cb_data;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* work available / stop */
+	unsigned int running:1,		/* written under lock */
+		     stopping:1;
+	unsigned int next_worker;
+	unsigned int runnable;		/* readers in all deques, __atomic_* only */
+
+	unsigned int num_readers;
+	struct rfid_manager_reader reader[RFID_MANAGER_READERS_MAX];
+
+	unsigned int num_workers;
+	struct rfid_manager_worker worker[RFID_MANAGER_WORKERS_MAX];
+
+	struct rfid_event_queue queue;
+};
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_MANAGER_H */
@@ -0,0 +1,130 @@
+#ifndef _RFID_MONITOR_H
+#define _RFID_MONITOR_H
+
+/* Card arrival / removal monitor.
+ *
+ * A monitor runs rfid_scan() and presence checks on a reader from a
+ * background thread and reports card_arrived / card_removed events, either
+ * through a callback (called from the monitor thread) or through a queue
+ * that is signalled by a pollable eventfd.  While the monitor is running,
+ * the reader must not be used by anybody else.  The callback must not call
+ * rfid_monitor_stop() or rfid_monitor_destroy(). */
+
+#include <sys/time.h>
+
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+
+enum rfid_monitor_event_type {
+	RFID_MONITOR_EV_ARRIVED		= 1,
+	RFID_MONITOR_EV_REMOVED		= 2,
+};
+
+struct rfid_monitor_event {
+	unsigned int type;
+	struct timeval tv;
+	unsigned int reader;		/* reader index in a rfid_manager */
+
+	unsigned char uid[10];
+	unsigned int uid_len;
+	unsigned int layer2;		/* enum rfid_layer2_id */
+	int protocol;			/* enum rfid_protocol_id, -1 if none */
+
+	/* only valid inside the callback of an ARRIVED event, NULL
+	 * otherwise */
+	struct rfid_layer2_handle *l2h;
+	struct rfid_protocol_handle *ph;
+};
+
+enum rfid_monitor_flags {
+	RFID_MONITOR_F_EVENTFD	= 0x0001,	/* queue events, signal eventfd */
+	RFID_MONITOR_F_RF_KILL	= 0x0002,	/* RF off between idle scans */
+};
+
+struct rfid_monitor_params {
+	unsigned int flags;
+	unsigned int scan_interval;	/* ms between scans, empty field */
+	unsigned int presence_interval;	/* ms between presence checks */
+	unsigned int idle_after;	/* ms of empty field before backoff */
+	unsigned int idle_interval;	/* ms between scans after backoff */
+};
+
+struct rfid_monitor;
+
+typedef void rfid_monitor_cb(struct rfid_monitor *mon,
+			     const struct rfid_monitor_event *ev, void *data);
+
+/* 'params' may be NULL for defaults */
+extern struct rfid_monitor *
+rfid_monitor_create(struct rfid_reader_handle *rh,
+		    const struct rfid_monitor_params *params);
+extern void rfid_monitor_destroy(struct rfid_monitor *mon);
+
+extern void rfid_monitor_set_callback(struct rfid_monitor *mon,
+				      rfid_monitor_cb *cb, void *data);
+
+extern int rfid_monitor_start(struct rfid_monitor *mon);
+extern int rfid_monitor_stop(struct rfid_monitor *mon);
+
+/* eventfd that becomes readable when events are queued (needs
+ * RFID_MONITOR_F_EVENTFD) */
+extern int rfid_monitor_get_fd(struct rfid_monitor *mon);
+
+/* fetch the oldest queued event.  Returns 1 if one was fetched, 0 if the
+ * queue is empty */
+extern int rfid_monitor_read_event(struct rfid_monitor *mon,
+				   struct rfid_monitor_event *ev);
+
+#ifdef __LIBRFID__
+
+#include <time.h>
+#include <pthread.h>
+
+#define RFID_MONITOR_QUEUE_LEN	16
+
+/* Event queue, shared with the multi-reader manager.  The eventfd is a
+ * semaphore that counts the queued events.  The caller does the locking. */
+struct rfid_event_queue {
+	int fd;
+	unsigned int head, len, size;
+	unsigned int dropped;
+	struct rfid_monitor_event *ev;
+};
+
+int rfid_event_queue_init(struct rfid_event_queue *q, unsigned int size);
+void rfid_event_queue_fini(struct rfid_event_queue *q);
+void rfid_event_queue_push(struct rfid_event_queue *q,
+			   const struct rfid_monitor_event *ev);
+int rfid_event_queue_pop(struct rfid_event_queue *q,
+			 struct rfid_monitor_event *ev);
+
+void rfid_monitor_params_init(struct rfid_monitor_params *dst,
+			      const struct rfid_monitor_params *src);
+void rfid_monitor_fill_event(struct rfid_monitor_event *ev, unsigned int type,
+			     struct rfid_layer2_handle *l2h,
+			     struct rfid_protocol_handle *ph);
+void rfid_monitor_release(struct rfid_layer2_handle *l2h,
+			  struct rfid_protocol_handle *ph, int close);
+void rfid_monitor_rf(struct rfid_reader_handle *rh, int on);
+unsigned int rfid_monitor_ms_since(const struct timespec *start);
+
+struct rfid_monitor {
+	struct rfid_reader_handle *rh;
+	struct rfid_monitor_params params;
+
+	rfid_monitor_cb *cb;
+	void *cb_data;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* wakes the thread up on stop */
+	unsigned int running:1,
+		     stopping:1;
+
+	struct rfid_event_queue queue;
+};
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_MONITOR_H */
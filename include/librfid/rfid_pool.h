@@ -0,0 +1,73 @@
+#ifndef _RFID_POOL_H
+#define _RFID_POOL_H
+
+/* Fixed-capacity object pools for the library handles.
+ *
+ * Every handle type has a pool of RFID_POOL_* statically allocated
+ * objects.  Allocation takes the head of a free list, or the next never
+ * used object, so it is O(1) and doesn't touch malloc() as long as the
+ * pool isn't exhausted.  With LIBRFID_STATIC an exhausted pool fails the
+ * allocation, otherwise it falls back to malloc(). */
+
+#ifdef __LIBRFID__
+
+/* handles of each type, can be set with --with-handle-pool-size */
+#ifndef RFID_HANDLE_POOL_SIZE
+#ifdef LIBRFID_FIRMWARE
+#define RFID_HANDLE_POOL_SIZE	1
+#else
+#define RFID_HANDLE_POOL_SIZE	4
+#endif
+#endif
+
+#ifndef RFID_POOL_ASIC
+#define RFID_POOL_ASIC		RFID_HANDLE_POOL_SIZE
+#endif
+#ifndef RFID_POOL_RAT
+#define RFID_POOL_RAT		RFID_HANDLE_POOL_SIZE
+#endif
+#ifndef RFID_POOL_READER
+#define RFID_POOL_READER	RFID_HANDLE_POOL_SIZE
+#endif
+#ifndef RFID_POOL_LAYER2
+#define RFID_POOL_LAYER2	RFID_HANDLE_POOL_SIZE
+#endif
+#ifndef RFID_POOL_PROTOCOL
+#define RFID_POOL_PROTOCOL	RFID_HANDLE_POOL_SIZE
+#endif
+
+struct rfid_pool_obj {
+	struct rfid_pool_obj *next;
+};
+
+struct rfid_pool {
+	const char *name;
+	unsigned char *mem;
+	unsigned int obj_size;
+	unsigned int num;
+	unsigned int used;		/* objects ever taken from mem */
+	struct rfid_pool_obj *freelist;
+	volatile int lock;
+};
+
+#define RFID_POOL_DEFINE(pool, type, n)					\
+	static type pool##_mem[n];					\
+	struct rfid_pool pool = {					\
+		.name		= #pool,				\
+		.mem		= (unsigned char *)pool##_mem,		\
+		.obj_size	= sizeof(type),				\
+		.num		= n,					\
+	}
+
+void *rfid_pool_alloc(struct rfid_pool *pool, size_t size);
+void rfid_pool_free(struct rfid_pool *pool, void *obj);
+
+extern struct rfid_pool rfid_asic_pool;
+extern struct rfid_pool rfid_rat_pool;
+extern struct rfid_pool rfid_reader_pool;
+extern struct rfid_pool rfid_layer2_pool;
+extern struct rfid_pool rfid_protocol_pool;
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_POOL_H */
@@ -12,6 +12,14 @@ int rfid_protocol_transceive(struct rfid_protocol_handle *ph,
 			     const unsigned char *tx_buf, unsigned int tx_len,
 			     unsigned char *rx_buf, unsigned int *rx_len,
 			     unsigned int timeout, unsigned int flags);
+/* non-blocking transceive, see rfid_layer2_transceive_submit() */
+int rfid_protocol_transceive_submit(struct rfid_protocol_handle *ph,
+				    const unsigned char *tx_buf,
+				    unsigned int tx_len,
+				    unsigned char *rx_buf, unsigned int rx_len,
+				    unsigned int timeout, unsigned int flags);
+int rfid_protocol_transceive_complete(struct rfid_protocol_handle *ph,
+				      unsigned int *rx_len);
 int
 rfid_protocol_read(struct rfid_protocol_handle *ph,
 	 	   unsigned int page,
@@ -26,6 +34,7 @@ rfid_protocol_write(struct rfid_protocol_handle *ph,
 
 int rfid_protocol_fini(struct rfid_protocol_handle *ph);
 int rfid_protocol_close(struct rfid_protocol_handle *ph);
+int rfid_protocol_presence(struct rfid_protocol_handle *ph);
 
 int rfid_protocol_getopt(struct rfid_protocol_handle *ph, int optname,
 			 void *optval, unsigned int *optlen);
@@ -55,11 +64,17 @@ enum rfid_protocol_opt {
 struct rfid_protocol {
 	unsigned int id;
 	char *name;
+	/* a failed read/write loses the session (Mifare Classic halts
+	 * until it is selected and authenticated again), don't retry */
+	unsigned int no_rw_retry:1;
 	struct {
 		struct rfid_protocol_handle *(*init)(struct rfid_layer2_handle *l2h);
 		int (*open)(struct rfid_protocol_handle *ph);
 		int (*close)(struct rfid_protocol_handle *ph);
 		int (*fini)(struct rfid_protocol_handle *ph);
+		/* check whether the card is still in the field, without
+		 * changing the protocol state.  1 if present, 0 if not */
+		int (*presence)(struct rfid_protocol_handle *ph);
 		/* transceive for session based transport protocols */
 		int (*transceive)(struct rfid_protocol_handle *ph,
 				  const unsigned char *tx_buf,
@@ -68,6 +83,15 @@ struct rfid_protocol {
 				  unsigned int *rx_len,
 				  unsigned int timeout,
 				  unsigned int flags);
+		int (*transceive_submit)(struct rfid_protocol_handle *ph,
+					 const unsigned char *tx_buf,
+					 unsigned int tx_len,
+					 unsigned char *rx_buf,
+					 unsigned int rx_len,
+					 unsigned int timeout,
+					 unsigned int flags);
+		int (*transceive_complete)(struct rfid_protocol_handle *ph,
+					   unsigned int *rx_len);
 		/* read/write for synchronous memory cards */
 		int (*read)(struct rfid_protocol_handle *ph,
 			    unsigned int page,
@@ -95,6 +119,7 @@ struct rfid_protocol_handle {
 	const struct rfid_protocol *proto;
 	union {
 		struct tcl_handle tcl;
+		struct mfcl_handle mfcl;
 	} priv;				/* priv has to be last, since
 					 * it could contain additional
 					 * private data over the end of
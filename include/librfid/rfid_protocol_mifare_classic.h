@@ -1,6 +1,14 @@
 #ifndef _MIFARE_CLASSIC_H
 #define _MIFARE_CLASSIC_H
 
+#ifdef __LIBRFID__
+/* before rfid_protocol.h, which has it in the rfid_protocol_handle */
+struct mfcl_handle {
+	unsigned int auth_block;	/* block of the last successful AUTH */
+	unsigned int authenticated:1;	/* Crypto1 session is up */
+};
+#endif
+
 #include <librfid/rfid_protocol.h>
 
 #define MIFARE_CL_KEYA_DEFAULT	"\xa0\xa1\xa2\xa3\xa4\xa5"
@@ -22,6 +30,22 @@
 #define MIFARE_CL_SMALL_SECTORS		32
 #define MIFARE_CL_LARGE_SECTORS		4
 
+/* key area in the reader ASIC's EEPROM: 32 slots of 12 byte (coded) keys,
+ * to be used with mfcl_set_key_ee(MIFARE_CL_EE_KEY_ADDR(slot)) */
+#define MIFARE_CL_EE_KEY_BASE		0x80
+#define MIFARE_CL_EE_KEY_SLOTS		32
+#define MIFARE_CL_EE_KEY_ADDR(slot)	(MIFARE_CL_EE_KEY_BASE + (slot) * 12)
+
+/* mfcl_ee_key.status */
+#define MIFARE_CL_EE_KEY_WRITTEN	0
+#define MIFARE_CL_EE_KEY_UNCHANGED	1
+
+struct mfcl_ee_key {
+	unsigned int slot;
+	unsigned char key[MIFARE_CL_KEY_LEN];
+	int status;		/* MIFARE_CL_EE_KEY_* or -errno */
+};
+
 enum rfid_proto_mfcl_opt {
 	RFID_OPT_P_MFCL_SIZE	=	0x10000001,
 };
@@ -35,13 +59,26 @@ extern const struct rfid_protocol rfid_protocol_mfcl;
 #define MIFARE_CL_CMD_WRITE4	0xA2
 #define MIFARE_CL_CMD_READ	0x30
 
+#define MIFARE_CL_READ_FWT	250
+#define MIFARE_CL_WRITE_FWT	600
+
 #define MIFARE_CL_RESP_ACK	0x0a
 #define MIFARE_CL_RESP_NAK	0x00
 
 #endif /* __LIBRFID__ */
 
 extern int mfcl_set_key(struct rfid_protocol_handle *ph, unsigned char *key);
+extern int mfcl_set_key_ee(struct rfid_protocol_handle *ph, unsigned int addr);
+/* provision keys into the EEPROM key area, no card needed.  The key area
+ * can't be read, so only slots this reader handle already wrote with the
+ * same key are skipped.  Returns 0 or the first error, the result of every
+ * slot is in its status. */
+extern int mfcl_ee_load_keys(struct rfid_reader_handle *rh,
+			     struct mfcl_ee_key *keys, unsigned int num);
 extern int mfcl_auth(struct rfid_protocol_handle *ph, u_int8_t cmd, u_int8_t block);				
+extern int mfcl_auth_read(struct rfid_protocol_handle *ph, u_int8_t cmd,
+			  u_int8_t block, unsigned char *buf,
+			  unsigned int *len);
 extern int mfcl_sector2block(u_int8_t sector);
 extern int mfcl_block2sector(u_int8_t block);
 extern int mfcl_sector_blocks(u_int8_t sector);
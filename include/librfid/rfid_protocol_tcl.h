@@ -6,8 +6,25 @@ enum rfid_proto_tcl_opt {
 	RFID_OPT_P_TCL_ATS_LEN	=	0x00010002,
 };
 
+/* one command APDU of a batch, see tcl_transceive_batch() */
+struct rfid_tcl_apdu {
+	const unsigned char *cmd;
+	unsigned int cmd_len;
+
+	/* expected status: (sw & sw_mask) == sw_expect, mask 0 accepts any */
+	u_int16_t sw_mask;
+	u_int16_t sw_expect;
+
+	/* filled in by tcl_transceive_batch() */
+	unsigned int resp_offset;	/* start of response within arena */
+	unsigned int resp_len;		/* length of response incl. SW1/SW2 */
+	u_int16_t sw;
+};
+
 #ifdef __LIBRFID__
 
+#include <librfid/rfid_buf.h>
+
 enum tcl_transport_rate {
 	TCL_RATE_106	= 0x01,
 	TCL_RATE_212	= 0x02,
@@ -20,6 +37,26 @@ enum tcl_transport_transceive_flags {
 	TCL_TRANSP_F_RX_CRC	= 0x02, 
 };
 
+struct rfid_protocol_handle;
+
+struct tcl_tx_context {
+	const unsigned char *tx;
+	unsigned char *rx;
+	const unsigned char *next_tx_byte;
+	unsigned char *next_rx_byte;
+	unsigned int rx_len;
+	unsigned int tx_len;
+	struct rfid_protocol_handle *h;
+};
+
+/* state of an asynchronous transceive */
+struct tcl_async {
+	struct tcl_tx_context ctx;
+	struct rfid_buf tx, rx;
+	unsigned int busy:1;
+	int status;
+};
+
 struct tcl_handle {
 	/* derived from ats */
 	unsigned char *historical_bytes; /* points into ats */
@@ -40,6 +77,8 @@ struct tcl_handle {
 
 	unsigned int toggle;	/* send toggle with next frame */
 
+	struct tcl_async async;
+
 	unsigned int ats_len;
 	unsigned char ats[256];	/* ATS cannot be bigger than FSD-2 bytes,
 				   according to ISO 14443-4 5.2.2 */
@@ -73,4 +112,11 @@ extern const struct rfid_protocol rfid_protocol_tcl;
 
 #endif /* __LIBRFID__ */
 
+struct rfid_protocol_handle;
+extern int tcl_transceive_batch(struct rfid_protocol_handle *ph,
+				struct rfid_tcl_apdu *apdus,
+				unsigned int num_apdus,
+				unsigned char *arena, unsigned int *arena_len,
+				unsigned int timeout);
+
 #endif
@@ -6,12 +6,45 @@
 #include <librfid/rfid_layer2_iso15693.h>
 
 struct rfid_reader_handle;
+struct mfcl_ee_key;
 
 /* 0...0xffff = global options, 0x10000...0x1ffff = private options */
 #define RFID_OPT_RDR_PRIV		0x00010000
 enum rfid_reader_opt {
 	RFID_OPT_RDR_FW_VERSION		= 0x0001,
 	RFID_OPT_RDR_RF_KILL		= 0x0002,
+	RFID_OPT_RDR_STATS		= 0x0003,	/* setopt resets */
+	RFID_OPT_RDR_TRACE		= 0x0004,	/* struct rfid_trace_conf */
+	RFID_OPT_RDR_TUNING		= 0x0005,	/* struct rfid_reader_tuning */
+	RFID_OPT_RDR_RETRY		= 0x0006,	/* struct rfid_retry_policy */
+};
+
+/* RF front end settings for ISO14443A, used from the next layer2 init on.
+ * See rfid_reader_calibrate() */
+struct rfid_reader_tuning {
+	u_int8_t mod_conductance;
+	u_int8_t bitphase;
+	u_int8_t threshold;
+};
+
+/* rfid_reader_wait_event() */
+#define RFID_READER_EV_SLOT_CHANGE	0x01	/* card entered/left the field */
+#define RFID_READER_EV_CARD_PRESENT	0x02	/* card in the field now */
+#define RFID_READER_EV_HW_ERROR		0x04
+
+/* hot path counters, see RFID_OPT_RDR_STATS */
+struct rfid_reader_stats {
+	u_int32_t transceive;		/* frames exchanged */
+	u_int32_t transceive_err;	/* ... of which failed */
+	u_int32_t timeouts;		/* ... of which timed out */
+	u_int32_t tx_bytes;
+	u_int32_t rx_bytes;
+	u_int32_t anticol;		/* REQA/WUPA/anticollision frames */
+	u_int32_t scans;		/* rfid_scan() calls */
+	u_int32_t scan_hits;		/* ... which found a card */
+	u_int32_t retries;		/* see RFID_OPT_RDR_RETRY */
+	u_int32_t rf_resets;
+	u_int32_t deadline_miss;	/* operations over their deadline */
 };
 
 
@@ -46,6 +79,21 @@ struct rfid_reader {
 			  unsigned char *rx_buf, unsigned int *rx_len,
 			  u_int64_t timeout, unsigned int flags);
 
+	/* asynchronous transceive, see rfid_reader_process_events() */
+	int (*transceive_submit)(struct rfid_reader_handle *h,
+				 enum rfid_frametype frametype,
+				 const unsigned char *tx_buf,
+				 unsigned int tx_len,
+				 u_int64_t timeout, unsigned int flags);
+	/* -EINPROGRESS while the response has not arrived yet */
+	int (*transceive_complete)(struct rfid_reader_handle *h,
+				   unsigned char *rx_buf,
+				   unsigned int *rx_len);
+
+	/* optional, see rfid_reader_wait_event() */
+	int (*wait_event)(struct rfid_reader_handle *h,
+			  unsigned int timeout_ms);
+
 	struct rfid_14443a_reader {
 		int (*transceive_sf)(struct rfid_reader_handle *h,
 				     unsigned char cmd,
@@ -56,6 +104,11 @@ struct rfid_reader {
 		int (*set_speed)(struct rfid_reader_handle *h,
 				 unsigned int tx,
 				 unsigned int speed);
+		/* optional: REQA/WUPA, anticollision and select in one go.
+		 * -ENOTSUP falls back to the transceive_sf/acf path */
+		int (*select)(struct rfid_reader_handle *h, unsigned int wupa,
+			      struct iso14443a_atqa *atqa, u_int8_t *sak,
+			      unsigned char *uid, unsigned int *uid_len);
 		unsigned int speed;
 	} iso14443a;
 	struct rfid_14443b_reader {
@@ -71,8 +124,15 @@ struct rfid_reader {
 	struct rfid_mifare_classic_reader {
 		int (*setkey)(struct rfid_reader_handle *h, const unsigned char *key);
 		int (*setkey_ee)(struct rfid_reader_handle *h, const unsigned int addr);
+		int (*load_keys_ee)(struct rfid_reader_handle *h,
+				    struct mfcl_ee_key *keys, unsigned int num);
 		int (*auth)(struct rfid_reader_handle *h, u_int8_t cmd,
 			    u_int32_t serno, u_int8_t block);
+		/* optional: auth with the loaded key and read the block.
+		 * -ENOTSUP falls back to auth + read */
+		int (*auth_read)(struct rfid_reader_handle *h, u_int8_t cmd,
+				 u_int32_t serno, u_int8_t block,
+				 unsigned char *buf, unsigned int *len);
 	} mifare_classic;
 };
 
@@ -83,8 +143,22 @@ enum rfid_reader_id {
 	RFID_READER_SPIDEV,
 };
 
+struct rfid_scan_plan;
+struct rfid_reader_async;
+struct rfid_trace;
+struct rfid_capture;
+struct rfid_retry;
+struct rfid_sightings;
+
 struct rfid_reader_handle {
 	struct rfid_asic_handle *ah;
+	struct rfid_scan_plan *scan_plan;
+	struct rfid_reader_async *async;
+	struct rfid_reader_stats stats;
+	struct rfid_trace *trace;
+	struct rfid_capture *capture;
+	struct rfid_retry *retry;
+	struct rfid_sightings *sightings;
 
 	union {
 
@@ -102,4 +176,62 @@ extern int rfid_reader_getopt(struct rfid_reader_handle *rh, int optname,
 extern int rfid_reader_setopt(struct rfid_reader_handle *rh, int optname,
 			      const void *optval, unsigned int optlen);
 
+/* Asynchronous operation.  The fd becomes readable whenever
+ * rfid_reader_process_events() should be called to drive a transceive that
+ * was started with rfid_layer2_transceive_submit() or
+ * rfid_protocol_transceive_submit().  It is a timer, not an interrupt: the
+ * reader is polled at intervals derived from the frame timeout, so a
+ * response is noticed some time after it arrived.  Returns 1 if the
+ * operation has completed and its result can be fetched with the matching
+ * _complete(), 0 if it is still in progress. */
+extern int rfid_reader_get_fd(struct rfid_reader_handle *rh);
+extern int rfid_reader_process_events(struct rfid_reader_handle *rh);
+
+/* Block until the reader firmware signals an RF event (CM5121: CCID slot
+ * change notification on the interrupt endpoint) or 'timeout_ms' passed.
+ * Returns RFID_READER_EV_* bits, 0 on timeout, -ENOTSUP if the reader has
+ * no such notifications and has to be polled. */
+extern int rfid_reader_wait_event(struct rfid_reader_handle *rh,
+				  unsigned int timeout_ms);
+
+/* The same for event loops: the eventfd becomes readable when events are
+ * pending, rfid_reader_read_events() fetches and clears them.  A helper
+ * thread waits for the reader meanwhile.  Returns -ENOTSUP, like
+ * rfid_reader_wait_event(), if the reader can't notify us. */
+extern int rfid_reader_get_event_fd(struct rfid_reader_handle *rh);
+extern int rfid_reader_read_events(struct rfid_reader_handle *rh);
+
+#ifdef __LIBRFID__
+
+#ifdef ENABLE_ASYNC
+#include <pthread.h>
+#endif
+
+struct rfid_reader_async {
+	int fd;				/* timerfd */
+	unsigned int busy:1;
+	int status;			/* of the last completed frame */
+
+	unsigned char *rx_buf;
+	unsigned int rx_len;
+
+	u_int64_t timeout;		/* usec, of the frame in flight */
+	u_int64_t poll;			/* usec until the next poll */
+
+	rfid_async_cont *cont;
+	void *cont_data;
+
+#ifdef ENABLE_ASYNC
+	/* rfid_reader_get_event_fd() */
+	int event_fd;			/* eventfd, -1 if not used */
+	unsigned int events;		/* RFID_READER_EV_* not read yet */
+	int event_stop;
+	pthread_t event_thread;
+#endif
+};
+
+void rfid_reader_async_fini(struct rfid_reader_handle *rh);
+
+#endif /* __LIBRFID__ */
+
 #endif
@@ -32,6 +32,8 @@ enum openpcd_cmd_class {
 	OPENPCD_CMD_CLS_SSC		= 0x3,
 	OPENPCD_CMD_CLS_PWM		= 0x4,
 	OPENPCD_CMD_CLS_ADC		= 0x5,
+	/* whole transactions run by librfid inside the reader */
+	OPENPCD_CMD_CLS_LIBRFID		= 0x6,
 	/* PICC (transponder) side */
 	OPENPCD_CMD_CLS_PICC		= 0xe,
 
@@ -83,6 +85,26 @@ enum openpcd_cmd_class {
 /* CMD_CLS_ADC */
 #define OPENPCD_CMD_ADC_READ		(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_ADC))
 
+/* CMD_CLS_LIBRFID, firmware API version OPENPCD_API_LIBRFID and later.
+ * hdr.val of the reply is 0 or a positive errno. */
+
+/* REQA (val 0) or WUPA (val 1), anticollision and select.
+ * reply data: struct openpcd_14443a_select */
+#define OPENPCD_CMD_14443A_SELECT	(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_LIBRFID))
+/* Mifare auth (val: RFID_CMD_MIFARE_AUTH1A/B, reg: block, data: 4 byte
+ * serial number) with the key loaded into the RC632, then read the block.
+ * reply data: the block */
+#define OPENPCD_CMD_MIFARE_AUTH_READ	(0x2|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_LIBRFID))
+
+#define OPENPCD_API_LIBRFID	0x02
+
+struct openpcd_14443a_select {
+	u_int8_t atqa[2];
+	u_int8_t sak;
+	u_int8_t uid_len;
+	u_int8_t uid[10];
+} __attribute__ ((packed));
+
 /* CMD_CLS_USBTEST */
 #define OPENPCD_CMD_USBTEST_IN		(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
 #define OPENPCD_CMD_USBTEST_OUT		(0x2|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
@@ -99,6 +121,17 @@ enum openpcd_cmd_class {
 
 extern const struct rfid_reader rfid_reader_openpcd;
 
+struct rfid_reader_handle;
+
+/* run a CMD_CLS_LIBRFID command, for the firmware's USB command dispatcher.
+ * 'resp' has room for the header plus *resp_len bytes of data, *resp_len
+ * is updated to the data length of the reply. */
+extern int openpcd_librfid_cmd(struct rfid_reader_handle *rh,
+			       const struct openpcd_hdr *req,
+			       unsigned int req_len,
+			       struct openpcd_hdr *resp,
+			       unsigned int *resp_len);
+
 /* 0...0xffff = global options, 0x10000...0x1ffff = private options */
 enum rfid_reader_openpcd_opt {
 	RFID_OPT_RDR_ENVIRONMENT	= 0x10001,
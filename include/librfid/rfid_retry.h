@@ -0,0 +1,126 @@
+#ifndef _RFID_RETRY_H
+#define _RFID_RETRY_H
+
+/* Retry and deadline policy.
+ *
+ * Set with RFID_OPT_RDR_RETRY, the policy applies to every operation
+ * started through the generic layer2 and protocol entry points of that
+ * reader.  Idempotent operations (rfid_layer2_open(), rfid_protocol_open(),
+ * rfid_protocol_read() and rfid_protocol_write()) are retried on the
+ * selected error classes with exponential backoff.  Transceives are never
+ * retried, since the card state may already have changed, but they honour
+ * the deadline.  Neither are Mifare Classic reads and writes: after a
+ * failed frame the card halts, and only a new select and authentication
+ * get it back.  For the same reason a failed Mifare authentication is not
+ * retried either.
+ *
+ * The field reset of rf_reset drops every card in the field, also those
+ * opened through other layer2 handles of the same reader, which then have
+ * to be opened again.  Only use it while one card at a time is handled.
+ *
+ * The deadline covers the whole outermost operation including its retries
+ * and the frames it exchanges: the timeout of every frame, anticollision
+ * and authentication included, is cut to what is left of it, and once it
+ * has passed the operation fails with -ETIMEDOUT.  Field resets are
+ * skipped when they wouldn't end before it.
+ *
+ * Retries, field resets and missed deadlines are counted in the reader
+ * statistics, see RFID_OPT_RDR_STATS. */
+
+#include <librfid/rfid.h>
+
+struct rfid_reader_handle;
+
+/* error classes */
+#define RFID_RETRY_TIMEOUT	0x01	/* -ETIMEDOUT: no answer */
+#define RFID_RETRY_RF		0x02	/* -EIO, -ECOLLISION: garbled answer */
+
+struct rfid_retry_policy {
+	unsigned int tries;		/* attempts per operation, 0 = 1 */
+	unsigned int errors;		/* RFID_RETRY_* worth another try */
+	unsigned int backoff;		/* usec before the first retry */
+	unsigned int backoff_max;	/* usec, the backoff doubles up to it */
+	unsigned int deadline;		/* msec per operation, 0 = none */
+	unsigned int rf_reset;		/* reset the field before every n-th
+					 * rfid_layer2_open() retry, 0 = never.
+					 * Affects all cards, see above */
+};
+
+#ifdef __LIBRFID__
+
+/* one operation of the caller */
+struct rfid_retry_op {
+	unsigned int outer:1;		/* owns the deadline, may retry */
+	unsigned int flags;
+	unsigned int tries;
+	unsigned int backoff;
+};
+
+/* rfid_retry_begin() flags */
+#define RFID_RETRY_OP_IDEMPOTENT	0x01
+#define RFID_RETRY_OP_RF_RESET		0x02	/* field reset is harmless */
+
+#ifdef ENABLE_RETRY
+
+struct rfid_retry {
+	struct rfid_retry_policy policy;
+	unsigned int depth;		/* nesting of operations */
+	unsigned int missed:1;		/* deadline passed */
+	u_int64_t deadline;		/* usec, CLOCK_MONOTONIC, 0 = none */
+	u_int64_t outer_deadline;	/* of the ASIC before the operation */
+};
+
+void __rfid_retry_begin(struct rfid_reader_handle *rh,
+			struct rfid_retry_op *op, unsigned int flags);
+int __rfid_retry_again(struct rfid_reader_handle *rh,
+		       struct rfid_retry_op *op, int *ret);
+void __rfid_retry_end(struct rfid_reader_handle *rh,
+		      struct rfid_retry_op *op);
+int __rfid_retry_timeout(struct rfid_reader_handle *rh, u_int64_t *timeout);
+
+int rfid_retry_setconf(struct rfid_reader_handle *rh,
+		       const struct rfid_retry_policy *policy);
+void rfid_retry_getconf(struct rfid_reader_handle *rh,
+			struct rfid_retry_policy *policy);
+void rfid_retry_fini(struct rfid_reader_handle *rh);
+
+/* usage:
+ *	rfid_retry_begin(rh, &op, flags);
+ *	do {
+ *		ret = ...;
+ *	} while (rfid_retry_again(rh, &op, &ret));
+ *	rfid_retry_end(rh, &op);
+ */
+#define rfid_retry_begin(rh, op, flags)				\
+	do {							\
+		(op)->outer = 0;				\
+		if ((rh)->retry)				\
+			__rfid_retry_begin(rh, op, flags);	\
+	} while (0)
+
+#define rfid_retry_again(rh, op, ret)				\
+	(*(ret) < 0 && (op)->outer && __rfid_retry_again(rh, op, ret))
+
+#define rfid_retry_end(rh, op)					\
+	do {							\
+		if ((op)->outer)				\
+			__rfid_retry_end(rh, op);		\
+	} while (0)
+
+/* cut a frame timeout (usec) to the deadline, -ETIMEDOUT if it passed */
+#define rfid_retry_timeout(rh, timeout)				\
+	((rh)->retry && (rh)->retry->deadline ?			\
+		__rfid_retry_timeout(rh, timeout) : 0)
+
+#else
+
+#define rfid_retry_begin(rh, op, flags)	do { (void)(rh); (void)(op); } while (0)
+#define rfid_retry_again(rh, op, ret)	0
+#define rfid_retry_end(rh, op)		do { } while (0)
+#define rfid_retry_timeout(rh, timeout)	0
+
+#endif /* ENABLE_RETRY */
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_RETRY_H */
@@ -15,4 +15,61 @@ int rfid_scan(struct rfid_reader_handle *rh,
 	      struct rfid_layer2_handle **l2h,
 	      struct rfid_protocol_handle **ph);
 
+/* A scan plan determines which layer2s / protocols are probed in which
+ * order.  Each entry keeps a decaying hit score; with RFID_SCAN_F_ADAPTIVE
+ * the entries are re-sorted after every scan, so the most likely type is
+ * probed first.  Entries that haven't seen a hit for a while ('cold') are
+ * only probed every 'interval' scan cycles, so that an empty field doesn't
+ * always cost the timeouts of all layer2s.  Every entry starts out just
+ * warm enough to be probed in the first cycle.
+ *
+ * With a 'timeout', opening the layer2 or protocol of an entry is given up
+ * after that many msec, all frames included (hosted builds only, see
+ * rfid_retry.h). */
+
+#define RFID_SCAN_PLAN_MAX	8
+
+#define RFID_SCAN_SCORE_HIT	256	/* added to the score on a hit */
+#define RFID_SCAN_SCORE_COLD	16	/* below this an entry is 'cold' */
+#define RFID_SCAN_INTERVAL_COLD	4	/* default layer2 'interval' */
+
+enum rfid_scan_plan_flags {
+	RFID_SCAN_F_ADAPTIVE	= 0x0001,	/* reorder by hit score */
+};
+
+struct rfid_scan_entry {
+	unsigned int id;		/* layer2 or protocol id */
+	unsigned int enabled;
+	unsigned int interval;		/* layer2 only: probe cold entry
+					 * every n cycles */
+	unsigned int timeout;		/* msec to open it, 0 = no limit */
+
+	/* statistics, maintained by the scan functions */
+	unsigned int score;
+	unsigned int hits;
+	unsigned int probes;
+};
+
+struct rfid_scan_plan {
+	unsigned int flags;
+	unsigned int cycle;
+
+	unsigned int num_l2;
+	struct rfid_scan_entry l2[RFID_SCAN_PLAN_MAX];
+
+	unsigned int num_proto;
+	struct rfid_scan_entry proto[RFID_SCAN_PLAN_MAX];
+};
+
+int rfid_scan_plan_init(struct rfid_scan_plan *plan,
+			struct rfid_reader_handle *rh);
+struct rfid_scan_entry *rfid_scan_plan_l2(struct rfid_scan_plan *plan,
+					  unsigned int l2);
+struct rfid_scan_entry *rfid_scan_plan_proto(struct rfid_scan_plan *plan,
+					     unsigned int proto);
+
+/* make rfid_scan() and friends follow 'plan' (NULL: probe everything) */
+void rfid_scan_set_plan(struct rfid_reader_handle *rh,
+			struct rfid_scan_plan *plan);
+
 #endif /* _RFID_SCAN_H */
@@ -0,0 +1,102 @@
+#ifndef _RFID_SIGHTING_H
+#define _RFID_SIGHTING_H
+
+/* UID sighting table.
+ *
+ * Collapses a high rate of repeated reads of the same cards, e.g. from
+ * several readers at a portal, into arrivals and departures.  A card
+ * (layer2 + UID) arrives with its first sighting; further sightings less
+ * than 'window' ms apart only update its last-seen time and count.  Once
+ * it hasn't been seen for 'window' ms it departs and is forgotten.
+ *
+ * The table is an open addressing hash of fixed size, allocated on
+ * creation; adding a sighting and expiring a card are O(1) and don't
+ * allocate.  Attached to readers with rfid_sightings_attach(), it is fed
+ * by every card rfid_scan() finds on them.  All functions may be called
+ * from several threads. */
+
+#include <librfid/rfid.h>
+
+struct rfid_reader_handle;
+struct rfid_sightings;
+
+enum rfid_sighting_event_type {
+	RFID_SIGHTING_ARRIVED		= 1,
+	RFID_SIGHTING_DEPARTED		= 2,
+};
+
+struct rfid_sighting_event {
+	unsigned int type;
+	unsigned int layer2;		/* enum rfid_layer2_id */
+	unsigned char uid[10];
+	unsigned int uid_len;
+
+	/* msec, CLOCK_MONOTONIC.  last_seen - first_seen is the dwell time
+	 * of a DEPARTED card */
+	u_int64_t first_seen;
+	u_int64_t last_seen;
+	unsigned int count;		/* sightings */
+};
+
+struct rfid_sighting_params {
+	unsigned int max_uids;		/* cards present at once */
+	unsigned int window;		/* msec */
+};
+
+struct rfid_sighting_stats {
+	unsigned int present;
+	unsigned int sightings;
+	unsigned int arrivals;
+	unsigned int departures;
+	unsigned int full;		/* new cards dropped, table full */
+	unsigned int dropped;		/* events lost, not read in time */
+};
+
+/* 'params' may be NULL for defaults (4096 cards, 1000ms) */
+extern struct rfid_sightings *
+rfid_sightings_create(const struct rfid_sighting_params *params);
+extern void rfid_sightings_destroy(struct rfid_sightings *st);
+
+/* feed the cards rfid_scan() finds on 'rh' into 'st' (NULL: stop).  A
+ * table may be attached to several readers; detach it before destroying */
+extern void rfid_sightings_attach(struct rfid_reader_handle *rh,
+				  struct rfid_sightings *st);
+
+/* record a sighting.  Returns 1 if the card arrived, 0 if it was already
+ * present, -ENOSPC if the table is full */
+extern int rfid_sightings_add(struct rfid_sightings *st, unsigned int layer2,
+			      const unsigned char *uid, unsigned int uid_len);
+
+/* expire cards not seen for 'window' ms, then fetch the oldest queued
+ * event.  Returns 1 if one was fetched, 0 if there is none */
+extern int rfid_sightings_read_event(struct rfid_sightings *st,
+				     struct rfid_sighting_event *ev);
+
+extern void rfid_sightings_get_stats(struct rfid_sightings *st,
+				     struct rfid_sighting_stats *stats);
+
+#ifdef __LIBRFID__
+
+#ifdef ENABLE_SIGHTING
+
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_layer2.h>
+
+static inline void rfid_sightings_feed(struct rfid_layer2_handle *l2h)
+{
+	if (l2h->rh->sightings)
+		rfid_sightings_add(l2h->rh->sightings, l2h->l2->id, l2h->uid,
+				   l2h->uid_len);
+}
+
+#else
+
+static inline void rfid_sightings_feed(struct rfid_layer2_handle *l2h)
+{
+}
+
+#endif /* ENABLE_SIGHTING */
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_SIGHTING_H */
@@ -3,55 +3,36 @@
 /* build for openpcd firmware */
 //#define LIBRFID_FIRMWARE
 
-/* build without dynamic allocations */
+/* build without dynamic allocations: handles only come from the pools */
 //#define LIBRFID_STATIC
 
 #ifdef __LIBRFID__
 
-#ifndef LIBRFID_STATIC
-/* If we're not doing a firmware compile, then we just use the regular
- * malloc()/free() functions as expected */
-
-#define malloc_asic_handle(x)	malloc(x)
-#define free_asic_handle(x)	free(x)
-
-#define malloc_layer2_handle(x)	malloc(x)
-#define free_layer2_handle(x)	free(x)
-
-#define malloc_protocol_handle(x)	malloc(x)
-#define free_protocol_handle(x)	free(x)
-
-#define malloc_rat_handle(x)	malloc(x)
-#define free_rat_handle(x)	free(x)
-
-#define malloc_reader_handle(x)	malloc(x)
-#define free_reader_handle(x)	free(x)
-
+/* Scratch buffers that are handed out to the caller (rfid_hexdump(), ...)
+ * are per thread.  Static builds only have the fixed handle pools and are not
+ * meant to be used from multiple threads anyway. */
+#ifdef LIBRFID_STATIC
+#define __rfid_tls
 #else
-/* If we're actually doing a firmware compile, then we use pre-allocated
- * handles in order to avoid dynamic memory allocation. */
+#define __rfid_tls	__thread
+#endif
 
-#define EMPTY_STATEMENT	do {} while(0)
-extern struct rfid_asic_handle rfid_ah;
-#define malloc_asic_handle(x)	&rfid_ah
-#define free_asic_handle(x)	EMPTY_STATEMENT
+/* all handles come from fixed-capacity pools */
+#include <librfid/rfid_pool.h>
 
-extern struct rfid_layer2_handle rfid_l2h;
-#define malloc_layer2_handle(x)	&rfid_l2h
-#define free_layer2_handle(x)	EMPTY_STATEMENT
+#define malloc_asic_handle(x)	rfid_pool_alloc(&rfid_asic_pool, x)
+#define free_asic_handle(x)	rfid_pool_free(&rfid_asic_pool, x)
 
-extern struct rfid_protocol_handle rfid_ph;
-#define malloc_protocol_handle(x)	&rfid_ph
-#define free_protocol_handle(x)		EMPTY_STATEMENT
+#define malloc_layer2_handle(x)	rfid_pool_alloc(&rfid_layer2_pool, x)
+#define free_layer2_handle(x)	rfid_pool_free(&rfid_layer2_pool, x)
 
-extern struct rfid_asic_transport_handle rfid_ath;
-#define malloc_rat_handle(x)	&rfid_ath
-#define free_rat_handle(x)	EMPTY_STATEMENT
+#define malloc_protocol_handle(x)	rfid_pool_alloc(&rfid_protocol_pool, x)
+#define free_protocol_handle(x)	rfid_pool_free(&rfid_protocol_pool, x)
 
-extern struct rfid_reader_handle rfid_rh;
-#define malloc_reader_handle(x)	&rfid_rh
-#define free_reader_handle(x)	EMPTY_STATEMENT
+#define malloc_rat_handle(x)	rfid_pool_alloc(&rfid_rat_pool, x)
+#define free_rat_handle(x)	rfid_pool_free(&rfid_rat_pool, x)
 
-#endif /* LIBRFID_STATIC */
+#define malloc_reader_handle(x)	rfid_pool_alloc(&rfid_reader_pool, x)
+#define free_reader_handle(x)	rfid_pool_free(&rfid_reader_pool, x)
 
 #endif /* __LIBRFID__ */
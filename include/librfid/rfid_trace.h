@@ -0,0 +1,137 @@
+#ifndef _RFID_TRACE_H
+#define _RFID_TRACE_H
+
+/* Binary trace flight recorder.
+ *
+ * Every reader has a ring of fixed size trace records (frames, register
+ * accesses, timeouts, error flags), which is always on and cheap enough
+ * for production use.  The last records can be fetched at any time with
+ * rfid_trace_snapshot(), written to a file with rfid_trace_dump(), or
+ * dumped for all readers when the process crashes.  utils/librfid-trace
+ * decodes the dumps.
+ *
+ * There is one writer per reader (the thread currently using it); readers
+ * of the ring don't take any locks and skip records that are overwritten
+ * while being copied. */
+
+#include <librfid/rfid.h>
+
+struct rfid_reader_handle;
+
+enum rfid_trace_type {
+	RFID_TRACE_TX		= 1,	/* arg: frametype */
+	RFID_TRACE_RX		= 2,	/* arg: status */
+	RFID_TRACE_CONT		= 3,	/* more data of the last TX/RX */
+	RFID_TRACE_ANTICOL	= 4,	/* arg: status, data: command/answer */
+	RFID_TRACE_REG_WRITE	= 5,	/* arg: register << 8 | value */
+	RFID_TRACE_REG_READ	= 6,	/* arg: register << 8 | value */
+	RFID_TRACE_TIMEOUT	= 7,	/* arg: timeout in usec, 0 unknown */
+	RFID_TRACE_ERROR	= 8,	/* arg: ASIC error flags */
+};
+
+#define RFID_TRACE_F(type)	(1 << (type))
+
+/* everything except register accesses */
+#define RFID_TRACE_MASK_DEFAULT	(RFID_TRACE_F(RFID_TRACE_TX) |		\
+				 RFID_TRACE_F(RFID_TRACE_RX) |		\
+				 RFID_TRACE_F(RFID_TRACE_CONT) |	\
+				 RFID_TRACE_F(RFID_TRACE_ANTICOL) |	\
+				 RFID_TRACE_F(RFID_TRACE_TIMEOUT) |	\
+				 RFID_TRACE_F(RFID_TRACE_ERROR))
+
+#define RFID_TRACE_RECORDS	2048
+/* largest ring rfid_trace_setconf() accepts, a power of two */
+#define RFID_TRACE_RECORDS_MAX	(1 << 20)
+#define RFID_TRACE_DATA		12
+/* frames are cut after this many bytes */
+#define RFID_TRACE_FRAME_MAX	64
+
+struct rfid_trace_rec {
+	u_int64_t ts;			/* CLOCK_MONOTONIC, nsec */
+	u_int32_t seq;			/* sequence number + 1, 0 = invalid */
+	u_int8_t type;
+	u_int8_t len;			/* bytes of data in this record */
+	u_int16_t total;		/* length of the whole TX/RX frame */
+	int32_t arg;			/* CONT: offset into the frame */
+	u_int8_t data[RFID_TRACE_DATA];
+};
+
+/* RFID_OPT_RDR_TRACE */
+struct rfid_trace_conf {
+	unsigned int records;		/* ring size, 0 disables tracing, at most
+					 * RFID_TRACE_RECORDS_MAX */
+	unsigned int mask;		/* RFID_TRACE_F() bits */
+};
+
+/* Dump file: one rfid_trace_file_hdr, then for every reader a
+ * rfid_trace_ring_hdr followed by its records, oldest first */
+#define RFID_TRACE_MAGIC	"RFIDTRC1"
+
+struct rfid_trace_file_hdr {
+	char magic[8];
+	u_int32_t rec_size;
+	u_int32_t num_rings;		/* 0 if unknown (crash dump) */
+};
+
+struct rfid_trace_ring_hdr {
+	u_int32_t ring;			/* ring number within the process */
+	u_int32_t reader;		/* enum rfid_reader_id */
+	u_int32_t num_recs;
+	u_int32_t lost;			/* records overwritten by the writer */
+};
+
+/* copy up to 'num' of the newest records, oldest first.  Returns the
+ * number of records copied. */
+extern int rfid_trace_snapshot(struct rfid_reader_handle *rh,
+			       struct rfid_trace_rec *recs, unsigned int num);
+
+/* write the ring of one reader, or of all readers, to 'fd' */
+extern int rfid_trace_dump(struct rfid_reader_handle *rh, int fd);
+extern int rfid_trace_dump_all(int fd);
+
+/* dump all rings to 'fd' when the process dies from a fatal signal */
+extern int rfid_trace_crash_handler(int fd);
+
+#ifdef __LIBRFID__
+
+struct rfid_trace {
+	struct rfid_trace *next;	/* list of all rings */
+	unsigned int ring;
+	unsigned int reader;
+	unsigned int mask;
+	unsigned int num;		/* power of two */
+	u_int32_t head;			/* next sequence number */
+	struct rfid_trace_rec *rec;
+};
+
+#ifdef ENABLE_TRACE
+
+void __rfid_trace(struct rfid_trace *tr, unsigned int type, int arg,
+		  const void *data, unsigned int len);
+
+static inline void rfid_trace(struct rfid_trace *tr, unsigned int type,
+			      int arg, const void *data, unsigned int len)
+{
+	if (tr && (tr->mask & RFID_TRACE_F(type)))
+		__rfid_trace(tr, type, arg, data, len);
+}
+
+int rfid_trace_init(struct rfid_reader_handle *rh);
+void rfid_trace_fini(struct rfid_reader_handle *rh);
+int rfid_trace_setconf(struct rfid_reader_handle *rh,
+		       const struct rfid_trace_conf *conf);
+int rfid_trace_getconf(struct rfid_reader_handle *rh,
+		       struct rfid_trace_conf *conf);
+
+#else
+
+static inline void rfid_trace(struct rfid_trace *tr, unsigned int type,
+			      int arg, const void *data, unsigned int len)
+{
+}
+
+#endif /* ENABLE_TRACE */
+
+#endif /* __LIBRFID__ */
+
+#endif /* _RFID_TRACE_H */
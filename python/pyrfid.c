@@ -1,8 +1,8 @@
-/* Python bindings for librfid 
+/* Python bindings for librfid
  *  (C) 2007-2008 by Kushal Das <kushal@openpcd.org>
  *
  *  This program is free software; you can redistribute it and/or modify
- *  it under the terms of the GNU General Public License version 2 
+ *  it under the terms of the GNU General Public License version 2
  *  as published by the Free Software Foundation
  *
  *  This program is distributed in the hope that it will be useful,
@@ -15,12 +15,22 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
-#include <stdio.h>
-#include <unistd.h>
-#include <stdlib.h>
+/* All calls that talk to a reader run without the GIL, serialized by a
+ * per-reader lock, so several readers can be driven from several Python
+ * threads in parallel.  Handle pointers and open counts are only touched
+ * with that lock held.  Transmit data is taken from any object supporting
+ * the buffer protocol, received data is written straight into the
+ * resulting bytes object, or into a caller supplied writable buffer by
+ * the *_into() variants. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
-#include <libgen.h>
+#include <unistd.h>
 
 #include <librfid/rfid.h>
 #include <librfid/rfid_scan.h>
@@ -30,99 +40,1255 @@
 
 #include <librfid/rfid_protocol_mifare_classic.h>
 #include <librfid/rfid_protocol_mifare_ul.h>
-/*#include <common.h>*/
-#include "openpcd.h"
-#include <Python.h>
-static PyObject *pyi_open(PyObject *self, PyObject *args);
-static PyObject *pyi_close(PyObject *self, PyObject *args);
-static PyObject *pyi_select_card(PyObject *self, PyObject *args);
-static PyObject *pyi_deselect_card(PyObject *self, PyObject *args);
-static PyObject *pyi_get_card_id(PyObject *self, PyObject *args);
-static PyObject *pyi_openpcd_read(PyObject *self, PyObject *args);
-static PyObject *pyi_openpcd_write(PyObject *self, PyObject *args);
-static PyObject *pyi_set_key(PyObject *self, PyObject *args);
+
+#define PYRFID_RX_MAX		256
+#define PYRFID_TIMEOUT		10000	/* usec */
+#define PYRFID_UID_MAX		10
+#define PYRFID_15693_UID_LEN	8
+#define PYRFID_INVENTORY_MAX	16
+#define PYRFID_RF_RESET_USEC	5000
+
+typedef struct {
+	PyObject_HEAD
+	struct rfid_reader_handle *rh;
+	PyThread_type_lock lock;
+	unsigned int nopen;		/* open layer2 handles */
+} ReaderObject;
+
+typedef struct {
+	PyObject_HEAD
+	ReaderObject *reader;
+	struct rfid_layer2_handle *l2h;
+	unsigned int nopen;		/* open protocol handles */
+} Layer2Object;
+
+typedef struct {
+	PyObject_HEAD
+	Layer2Object *layer2;
+	struct rfid_protocol_handle *ph;
+	unsigned int id;
+} ProtocolObject;
+
+static PyTypeObject ReaderType, Layer2Type, ProtocolType;
 
 static PyObject *pyi_Error;
-MIFARE_HANDLE handle;
 
-static PyMethodDef pyi_Methods[] = {
-    {"open_reader", pyi_open, METH_VARARGS,
-        "This will initialise the RFID reader"},
-    {"close_reader", pyi_close, METH_VARARGS,
-        "This will close the RFID reader"},
-    {"select_card", pyi_select_card, METH_VARARGS,
-        "This will select any card"},
-    {"read",pyi_openpcd_read, METH_VARARGS,
-        "This will read the card with given page number"},
-    {"write",pyi_openpcd_write, METH_VARARGS,
-        "This will write the card with given page number"},
-    {"set_key",pyi_set_key, METH_VARARGS,
-        "This will set the key with given key"},
-    {"deselect_card", pyi_deselect_card, METH_VARARGS,
-        "This will deselect any card"},
-    {"get_card_id", pyi_get_card_id, METH_VARARGS,
-        "This will get the card id"},
-    {NULL, NULL, 0, NULL}
+/* rfid_reader_open() isn't thread safe (usb bus scan) */
+static PyThread_type_lock open_lock;
+
+/* run 'stmt' without the GIL, but with exclusive access to the reader */
+#define RDR_CALL(rdr, stmt)						\
+	do {								\
+		Py_BEGIN_ALLOW_THREADS					\
+		PyThread_acquire_lock((rdr)->lock, WAIT_LOCK);		\
+		stmt;							\
+		PyThread_release_lock((rdr)->lock);			\
+		Py_END_ALLOW_THREADS					\
+	} while (0)
+
+static PyObject *rfid_error(int ret)
+{
+	int err = -ret;
+	PyObject *v;
+
+	/* lots of code paths just return -1 */
+	if (ret >= 0 || ret == -1)
+		err = EIO;
+
+	v = Py_BuildValue("(is)", err, strerror(err));
+	if (v) {
+		PyErr_SetObject(pyi_Error, v);
+		Py_DECREF(v);
+	}
+	return NULL;
+}
+
+static int check_key(Py_buffer *key)
+{
+	if (key->len != MIFARE_CL_KEY_LEN) {
+		PyErr_Format(PyExc_ValueError, "key must be %d bytes",
+			     (int)MIFARE_CL_KEY_LEN);
+		return -1;
+	}
+	return 0;
+}
+
+/* Reader */
+
+static void rf_power(struct rfid_reader_handle *rh, int on)
+{
+	unsigned int opt = on ? 0 : 1;
+
+	rfid_reader_setopt(rh, RFID_OPT_RDR_RF_KILL, &opt, sizeof(opt));
+}
+
+static int reader_close(ReaderObject *self)
+{
+	if (!self->rh)
+		return 0;
+	if (self->nopen)
+		return -EBUSY;
+
+	rfid_reader_close(self->rh);
+	self->rh = NULL;
+
+	return 0;
+}
+
+static int layer2_open(ReaderObject *rdr, unsigned int id,
+		       struct rfid_layer2_handle **l2h)
+{
+	int ret;
+
+	if (!rdr->rh)
+		return -EBADF;
+
+	*l2h = rfid_layer2_init(rdr->rh, id);
+	if (!*l2h)
+		return -EINVAL;
+
+	ret = rfid_layer2_open(*l2h);
+	if (ret < 0) {
+		rfid_layer2_fini(*l2h);
+		return ret;
+	}
+
+	rdr->nopen++;
+	return 0;
+}
+
+static int reader_scan(ReaderObject *rdr, struct rfid_layer2_handle **l2h,
+		       struct rfid_protocol_handle **ph)
+{
+	int ret;
+
+	if (!rdr->rh)
+		return -EBADF;
+
+	ret = rfid_scan(rdr->rh, l2h, ph);
+	if (ret >= 2)
+		rdr->nopen++;
+
+	return ret;
+}
+
+/* ISO15693 anticollision resolves one VICC per layer2 open, and closing
+ * the handle sends it to quiet state.  So keep opening until nobody
+ * answers any more, then reset the field to wake them all up again. */
+static int reader_inventory(ReaderObject *rdr,
+			    unsigned char (*uid)[PYRFID_15693_UID_LEN],
+			    unsigned int max)
+{
+	struct rfid_layer2_handle *l2h;
+	unsigned int n, len;
+
+	if (!rdr->rh)
+		return -EBADF;
+	if (rdr->nopen)
+		return -EBUSY;
+
+	for (n = 0; n < max; n++) {
+		l2h = rfid_layer2_init(rdr->rh, RFID_LAYER2_ISO15693);
+		if (!l2h)
+			return -EINVAL;
+		if (rfid_layer2_open(l2h) < 0) {
+			rfid_layer2_fini(l2h);
+			break;
+		}
+
+		len = PYRFID_15693_UID_LEN;
+		rfid_layer2_getopt(l2h, RFID_OPT_LAYER2_UID, uid[n], &len);
+
+		rfid_layer2_close(l2h);
+		rfid_layer2_fini(l2h);
+	}
+
+	rf_power(rdr->rh, 0);
+	usleep(PYRFID_RF_RESET_USEC);
+	rf_power(rdr->rh, 1);
+
+	return n;
+}
+
+static int reader_rf(ReaderObject *rdr, int on)
+{
+	unsigned int opt = on ? 0 : 1;
+
+	if (!rdr->rh)
+		return -EBADF;
+
+	return rfid_reader_setopt(rdr->rh, RFID_OPT_RDR_RF_KILL, &opt,
+				  sizeof(opt));
+}
+
+static int reader_stats(ReaderObject *rdr, struct rfid_reader_stats *st,
+			int reset)
+{
+	unsigned int len = sizeof(*st);
+
+	if (!rdr->rh)
+		return -EBADF;
+	if (reset)
+		return rfid_reader_setopt(rdr->rh, RFID_OPT_RDR_STATS,
+					  NULL, 0);
+
+	return rfid_reader_getopt(rdr->rh, RFID_OPT_RDR_STATS, st, &len);
+}
+
+/* undo a reader_scan() / layer2_open() */
+static void layer2_release(ReaderObject *rdr, struct rfid_layer2_handle *l2h,
+			   struct rfid_protocol_handle *ph)
+{
+	if (ph) {
+		rfid_protocol_close(ph);
+		rfid_protocol_fini(ph);
+	}
+	rfid_layer2_close(l2h);
+	rfid_layer2_fini(l2h);
+	rdr->nopen--;
+}
+
+static PyObject *layer2_new(ReaderObject *rdr, struct rfid_layer2_handle *l2h);
+static PyObject *protocol_new(Layer2Object *l2, struct rfid_protocol_handle *ph);
+
+static PyObject *Reader_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+	ReaderObject *self;
+
+	self = (ReaderObject *)type->tp_alloc(type, 0);
+	if (!self)
+		return NULL;
+
+	self->lock = PyThread_allocate_lock();
+	if (!self->lock) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+
+	return (PyObject *)self;
+}
+
+static int Reader_init(ReaderObject *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "id", "device", NULL };
+	unsigned int id = RFID_READER_OPENPCD;
+	const char *device = NULL;
+	struct rfid_reader_handle *rh;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Iz", kwlist,
+					 &id, &device))
+		return -1;
+
+	if (self->rh) {
+		PyErr_SetString(PyExc_RuntimeError, "reader already open");
+		return -1;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	PyThread_acquire_lock(open_lock, WAIT_LOCK);
+	rh = rfid_reader_open((void *)device, id);
+	PyThread_release_lock(open_lock);
+	Py_END_ALLOW_THREADS
+
+	if (!rh) {
+		rfid_error(-ENODEV);
+		return -1;
+	}
+	self->rh = rh;
+
+	return 0;
+}
+
+static void Reader_dealloc(ReaderObject *self)
+{
+	/* layer2 objects hold a reference, so nothing can be open */
+	if (self->rh) {
+		Py_BEGIN_ALLOW_THREADS
+		rfid_reader_close(self->rh);
+		Py_END_ALLOW_THREADS
+	}
+	if (self->lock)
+		PyThread_free_lock(self->lock);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *Reader_close(ReaderObject *self, PyObject *unused)
+{
+	int ret;
+
+	RDR_CALL(self, ret = reader_close(self));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Reader_scan(ReaderObject *self, PyObject *unused)
+{
+	struct rfid_layer2_handle *l2h = NULL;
+	struct rfid_protocol_handle *ph = NULL;
+	PyObject *l2, *proto;
+	int ret;
+
+	RDR_CALL(self, ret = reader_scan(self, &l2h, &ph));
+	if (ret < 0)
+		return rfid_error(ret);
+	if (ret < 2)
+		Py_RETURN_NONE;
+
+	l2 = layer2_new(self, l2h);
+	if (!l2) {
+		RDR_CALL(self, layer2_release(self, l2h, ph));
+		return NULL;
+	}
+
+	if (ret == 3) {
+		/* not visible to anybody else yet, no need for the lock */
+		((Layer2Object *)l2)->nopen++;
+		proto = protocol_new((Layer2Object *)l2, ph);
+		if (!proto) {
+			Py_DECREF(l2);
+			return NULL;
+		}
+	} else {
+		proto = Py_None;
+		Py_INCREF(proto);
+	}
+
+	return Py_BuildValue("(NN)", l2, proto);
+}
+
+static PyObject *Reader_layer2(ReaderObject *self, PyObject *args)
+{
+	struct rfid_layer2_handle *l2h;
+	unsigned int id;
+	PyObject *l2;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "I", &id))
+		return NULL;
+
+	RDR_CALL(self, ret = layer2_open(self, id, &l2h));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	l2 = layer2_new(self, l2h);
+	if (!l2)
+		RDR_CALL(self, layer2_release(self, l2h, NULL));
+
+	return l2;
+}
+
+static PyObject *Reader_inventory(ReaderObject *self, PyObject *args)
+{
+	unsigned char uid[PYRFID_INVENTORY_MAX][PYRFID_15693_UID_LEN];
+	unsigned int max = PYRFID_INVENTORY_MAX;
+	PyObject *list, *item;
+	int i, ret;
+
+	if (!PyArg_ParseTuple(args, "|I", &max))
+		return NULL;
+	if (max > PYRFID_INVENTORY_MAX)
+		max = PYRFID_INVENTORY_MAX;
+
+	RDR_CALL(self, ret = reader_inventory(self, uid, max));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	list = PyList_New(ret);
+	if (!list)
+		return NULL;
+	for (i = 0; i < ret; i++) {
+		item = PyBytes_FromStringAndSize((char *)uid[i],
+						 PYRFID_15693_UID_LEN);
+		if (!item) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	return list;
+}
+
+static PyObject *Reader_rf(ReaderObject *self, PyObject *args)
+{
+	int on, ret;
+
+	if (!PyArg_ParseTuple(args, "p", &on))
+		return NULL;
+
+	RDR_CALL(self, ret = reader_rf(self, on));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static const struct {
+	const char *name;
+	size_t offset;
+} stats_fields[] = {
+#define STAT(x)	{ #x, offsetof(struct rfid_reader_stats, x) }
+	STAT(transceive),
+	STAT(transceive_err),
+	STAT(timeouts),
+	STAT(tx_bytes),
+	STAT(rx_bytes),
+	STAT(anticol),
+	STAT(scans),
+	STAT(scan_hits),
+#undef STAT
+};
+
+static PyObject *Reader_stats(ReaderObject *self, PyObject *unused)
+{
+	struct rfid_reader_stats st;
+	PyObject *dict, *v;
+	unsigned int i;
+	int ret;
+
+	RDR_CALL(self, ret = reader_stats(self, &st, 0));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	dict = PyDict_New();
+	if (!dict)
+		return NULL;
+	for (i = 0; i < sizeof(stats_fields)/sizeof(stats_fields[0]); i++) {
+		v = PyLong_FromUnsignedLong(*(u_int32_t *)
+				((char *)&st + stats_fields[i].offset));
+		if (!v || PyDict_SetItemString(dict, stats_fields[i].name,
+					       v) < 0) {
+			Py_XDECREF(v);
+			Py_DECREF(dict);
+			return NULL;
+		}
+		Py_DECREF(v);
+	}
+
+	return dict;
+}
+
+static PyObject *Reader_reset_stats(ReaderObject *self, PyObject *unused)
+{
+	int ret;
+
+	RDR_CALL(self, ret = reader_stats(self, NULL, 1));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef Reader_methods[] = {
+	{ "close", (PyCFunction)Reader_close, METH_NOARGS,
+	  "close the reader, all layer2 handles must be closed" },
+	{ "scan", (PyCFunction)Reader_scan, METH_NOARGS,
+	  "scan for a card, returns None or (Layer2, Protocol or None)" },
+	{ "layer2", (PyCFunction)Reader_layer2, METH_VARARGS,
+	  "layer2(id) -> Layer2, open a card using layer2 'id'" },
+	{ "inventory", (PyCFunction)Reader_inventory, METH_VARARGS,
+	  "inventory([max]) -> list of ISO15693 UIDs in the field" },
+	{ "rf", (PyCFunction)Reader_rf, METH_VARARGS,
+	  "rf(on), switch the RF field on or off" },
+	{ "stats", (PyCFunction)Reader_stats, METH_NOARGS,
+	  "hot path counters of the reader as a dict" },
+	{ "reset_stats", (PyCFunction)Reader_reset_stats, METH_NOARGS,
+	  "reset the hot path counters" },
+	{ NULL }
+};
+
+static PyTypeObject ReaderType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name	= "pyrfid.Reader",
+	.tp_doc		= "Reader([id[, device]]), an open RFID reader",
+	.tp_basicsize	= sizeof(ReaderObject),
+	.tp_flags	= Py_TPFLAGS_DEFAULT,
+	.tp_new		= Reader_new,
+	.tp_init	= (initproc)Reader_init,
+	.tp_dealloc	= (destructor)Reader_dealloc,
+	.tp_methods	= Reader_methods,
+};
+
+/* Layer2 */
+
+static int layer2_close(Layer2Object *l2)
+{
+	if (!l2->l2h)
+		return 0;
+	if (l2->nopen)
+		return -EBUSY;
+
+	rfid_layer2_close(l2->l2h);
+	rfid_layer2_fini(l2->l2h);
+	l2->l2h = NULL;
+	l2->reader->nopen--;
+
+	return 0;
+}
+
+static int protocol_open(Layer2Object *l2, unsigned int id,
+			 struct rfid_protocol_handle **ph)
+{
+	int ret;
+
+	if (!l2->l2h)
+		return -EBADF;
+
+	*ph = rfid_protocol_init(l2->l2h, id);
+	if (!*ph)
+		return -EINVAL;
+
+	ret = rfid_protocol_open(*ph);
+	if (ret < 0) {
+		rfid_protocol_fini(*ph);
+		return ret;
+	}
+
+	l2->nopen++;
+	return 0;
+}
+
+/* 'l2h' is open and accounted for in rdr->nopen.  The caller releases it
+ * on failure. */
+static PyObject *layer2_new(ReaderObject *rdr, struct rfid_layer2_handle *l2h)
+{
+	Layer2Object *l2;
+
+	l2 = PyObject_New(Layer2Object, &Layer2Type);
+	if (!l2)
+		return NULL;
+
+	Py_INCREF(rdr);
+	l2->reader = rdr;
+	l2->l2h = l2h;
+	l2->nopen = 0;
+
+	return (PyObject *)l2;
+}
+
+static void Layer2_dealloc(Layer2Object *self)
+{
+	RDR_CALL(self->reader, layer2_close(self));
+	Py_DECREF(self->reader);
+	PyObject_Del(self);
+}
+
+static PyObject *Layer2_close(Layer2Object *self, PyObject *unused)
+{
+	int ret;
+
+	RDR_CALL(self->reader, ret = layer2_close(self));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Layer2_transceive(Layer2Object *self, PyObject *args,
+				   PyObject *kwds)
+{
+	static char *kwlist[] = { "frametype", "data", "rx_size", "timeout",
+				  "flags", NULL };
+	unsigned int frametype, rx_size = PYRFID_RX_MAX, flags = 0;
+	unsigned long long timeout = PYRFID_TIMEOUT;
+	unsigned int rx_len;
+	Py_buffer tx;
+	PyObject *rx;
+	int ret;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "Iy*|IKI", kwlist,
+					 &frametype, &tx, &rx_size, &timeout,
+					 &flags))
+		return NULL;
+
+	rx = PyBytes_FromStringAndSize(NULL, rx_size);
+	if (!rx) {
+		PyBuffer_Release(&tx);
+		return NULL;
+	}
+	rx_len = rx_size;
+
+	RDR_CALL(self->reader, ret = !self->l2h ? -EBADF :
+		 rfid_layer2_transceive(self->l2h, frametype, tx.buf, tx.len,
+					(unsigned char *)PyBytes_AS_STRING(rx),
+					&rx_len, timeout, flags));
+	PyBuffer_Release(&tx);
+
+	if (ret < 0) {
+		Py_DECREF(rx);
+		return rfid_error(ret);
+	}
+	if (rx_len < rx_size)
+		_PyBytes_Resize(&rx, rx_len);
+
+	return rx;
+}
+
+static PyObject *Layer2_transceive_into(Layer2Object *self, PyObject *args,
+					PyObject *kwds)
+{
+	static char *kwlist[] = { "frametype", "data", "buffer", "timeout",
+				  "flags", NULL };
+	unsigned int frametype, flags = 0;
+	unsigned long long timeout = PYRFID_TIMEOUT;
+	unsigned int rx_len;
+	Py_buffer tx, rx;
+	int ret;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "Iy*w*|KI", kwlist,
+					 &frametype, &tx, &rx, &timeout,
+					 &flags))
+		return NULL;
+
+	rx_len = rx.len;
+	RDR_CALL(self->reader, ret = !self->l2h ? -EBADF :
+		 rfid_layer2_transceive(self->l2h, frametype, tx.buf, tx.len,
+					rx.buf, &rx_len, timeout, flags));
+	PyBuffer_Release(&tx);
+	PyBuffer_Release(&rx);
+
+	if (ret < 0)
+		return rfid_error(ret);
+
+	return PyLong_FromUnsignedLong(rx_len);
+}
+
+static PyObject *Layer2_protocol(Layer2Object *self, PyObject *args)
+{
+	struct rfid_protocol_handle *ph;
+	unsigned int id;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "I", &id))
+		return NULL;
+
+	RDR_CALL(self->reader, ret = protocol_open(self, id, &ph));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	return protocol_new(self, ph);
+}
+
+static PyObject *Layer2_present(Layer2Object *self, PyObject *unused)
+{
+	int ret;
+
+	RDR_CALL(self->reader, ret = !self->l2h ? -EBADF :
+		 rfid_layer2_presence(self->l2h));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *Layer2_get_uid(Layer2Object *self, void *closure)
+{
+	unsigned char uid[PYRFID_UID_MAX];
+	unsigned int len = sizeof(uid);
+	int ret;
+
+	RDR_CALL(self->reader, ret = !self->l2h ? -EBADF :
+		 rfid_layer2_getopt(self->l2h, RFID_OPT_LAYER2_UID, uid,
+				    &len));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	return PyBytes_FromStringAndSize((char *)uid, len);
+}
+
+static PyObject *Layer2_get_name(Layer2Object *self, void *closure)
+{
+	const char *name = NULL;
+
+	RDR_CALL(self->reader, name = self->l2h ?
+		 rfid_layer2_name(self->l2h) : NULL);
+	if (!name)
+		return rfid_error(-EBADF);
+
+	return PyUnicode_FromString(name);
+}
+
+static PyMethodDef Layer2_methods[] = {
+	{ "close", (PyCFunction)Layer2_close, METH_NOARGS,
+	  "close the handle, all protocol handles must be closed" },
+	{ "transceive", (PyCFunction)Layer2_transceive,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "transceive(frametype, data[, rx_size, timeout, flags]) -> bytes" },
+	{ "transceive_into", (PyCFunction)Layer2_transceive_into,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "transceive_into(frametype, data, buffer[, timeout, flags]) -> "
+	  "number of bytes received into 'buffer'" },
+	{ "protocol", (PyCFunction)Layer2_protocol, METH_VARARGS,
+	  "protocol(id) -> Protocol, open protocol 'id' on top" },
+	{ "present", (PyCFunction)Layer2_present, METH_NOARGS,
+	  "check whether the card is still in the field" },
+	{ NULL }
+};
+
+static PyGetSetDef Layer2_getset[] = {
+	{ "uid", (getter)Layer2_get_uid, NULL, "UID of the card", NULL },
+	{ "name", (getter)Layer2_get_name, NULL, "name of the layer2", NULL },
+	{ NULL }
 };
 
-PyMODINIT_FUNC initpyrfid() {
-    PyObject *m;
+static PyTypeObject Layer2Type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name	= "pyrfid.Layer2",
+	.tp_doc		= "open layer2 handle, see Reader.scan()/layer2()",
+	.tp_basicsize	= sizeof(Layer2Object),
+	.tp_flags	= Py_TPFLAGS_DEFAULT,
+	.tp_dealloc	= (destructor)Layer2_dealloc,
+	.tp_methods	= Layer2_methods,
+	.tp_getset	= Layer2_getset,
+};
+
+/* Protocol */
+
+#define PROTO_RDR(p)	((p)->layer2->reader)
+
+static int protocol_close(ProtocolObject *p)
+{
+	if (!p->ph)
+		return 0;
+
+	rfid_protocol_close(p->ph);
+	rfid_protocol_fini(p->ph);
+	p->ph = NULL;
+	p->layer2->nopen--;
 
-    m = Py_InitModule("pyrfid", pyi_Methods);
-    pyi_Error = PyErr_NewException("pyrfid.error", NULL, NULL);
-    Py_INCREF(pyi_Error);
-    PyModule_AddObject(m, "error", pyi_Error);
-    return;
+	return 0;
 }
 
-static PyObject *pyi_open(PyObject *self, PyObject *args) {
-        return Py_BuildValue("i",openpcd_open_reader(&handle));
+/* 'ph' is open and accounted for in l2->nopen, released on failure */
+static PyObject *protocol_new(Layer2Object *l2, struct rfid_protocol_handle *ph)
+{
+	ProtocolObject *p;
+	unsigned int id = RFID_PROTOCOL_UNKNOWN, len = sizeof(id);
+
+	p = PyObject_New(ProtocolObject, &ProtocolType);
+	if (!p) {
+		RDR_CALL(l2->reader, rfid_protocol_close(ph);
+				     rfid_protocol_fini(ph);
+				     l2->nopen--);
+		return NULL;
+	}
+
+	rfid_protocol_getopt(ph, RFID_OPT_PROTO_ID, &id, &len);
+
+	Py_INCREF(l2);
+	p->layer2 = l2;
+	p->ph = ph;
+	p->id = id;
+
+	return (PyObject *)p;
 }
 
-static PyObject *pyi_close(PyObject *self, PyObject *args) {
-        return Py_BuildValue("i", openpcd_close_reader(handle));
+static void Protocol_dealloc(ProtocolObject *self)
+{
+	RDR_CALL(PROTO_RDR(self), protocol_close(self));
+	Py_DECREF(self->layer2);
+	PyObject_Del(self);
 }
 
-static PyObject *pyi_select_card(PyObject *self, PyObject *args) {
-        return Py_BuildValue("i", openpcd_select_card(handle));
+static int check_proto(ProtocolObject *p, unsigned int id)
+{
+	if (p->id != id) {
+		PyErr_SetString(PyExc_TypeError,
+				"not supported by this protocol");
+		return -1;
+	}
+	return 0;
 }
 
-static PyObject *pyi_deselect_card(PyObject *self, PyObject *args) {
-        return Py_BuildValue("i", openpcd_deselect_card(handle));
+static PyObject *Protocol_close(ProtocolObject *self, PyObject *unused)
+{
+	RDR_CALL(PROTO_RDR(self), protocol_close(self));
+
+	Py_RETURN_NONE;
 }
 
-static PyObject *pyi_openpcd_read(PyObject *self, PyObject *args) {
-        int ok, page;
-        char s[16];
-        ok = PyArg_ParseTuple(args, "i", &page);
-        openpcd_read(handle, page, s, 16);
-        return Py_BuildValue("s", s);
+static PyObject *Protocol_transceive(ProtocolObject *self, PyObject *args,
+				     PyObject *kwds)
+{
+	static char *kwlist[] = { "data", "rx_size", "timeout", "flags",
+				  NULL };
+	unsigned int rx_size = PYRFID_RX_MAX, timeout = PYRFID_TIMEOUT;
+	unsigned int flags = 0, rx_len;
+	Py_buffer tx;
+	PyObject *rx;
+	int ret;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|III", kwlist,
+					 &tx, &rx_size, &timeout, &flags))
+		return NULL;
+
+	rx = PyBytes_FromStringAndSize(NULL, rx_size);
+	if (!rx) {
+		PyBuffer_Release(&tx);
+		return NULL;
+	}
+	rx_len = rx_size;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_protocol_transceive(self->ph, tx.buf, tx.len,
+					  (unsigned char *)PyBytes_AS_STRING(rx),
+					  &rx_len, timeout, flags));
+	PyBuffer_Release(&tx);
+
+	if (ret < 0) {
+		Py_DECREF(rx);
+		return rfid_error(ret);
+	}
+	if (rx_len < rx_size)
+		_PyBytes_Resize(&rx, rx_len);
+
+	return rx;
 }
 
+static PyObject *Protocol_transceive_into(ProtocolObject *self, PyObject *args,
+					  PyObject *kwds)
+{
+	static char *kwlist[] = { "data", "buffer", "timeout", "flags", NULL };
+	unsigned int timeout = PYRFID_TIMEOUT, flags = 0, rx_len;
+	Py_buffer tx, rx;
+	int ret;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*w*|II", kwlist,
+					 &tx, &rx, &timeout, &flags))
+		return NULL;
+
+	rx_len = rx.len;
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_protocol_transceive(self->ph, tx.buf, tx.len, rx.buf,
+					  &rx_len, timeout, flags));
+	PyBuffer_Release(&tx);
+	PyBuffer_Release(&rx);
+
+	if (ret < 0)
+		return rfid_error(ret);
 
-static PyObject *pyi_openpcd_write(PyObject *self, PyObject *args) {
-        int ok, page, result;
-        char *s = "indianindianindi";
-        ok = PyArg_ParseTuple(args, "is", &page, &s);
-        result = openpcd_write(handle, page, s, 16);
-        return Py_BuildValue("i", result);
+	return PyLong_FromUnsignedLong(rx_len);
 }
 
-static PyObject *pyi_set_key(PyObject *self, PyObject *args) {
-        int ok, key, result;
-        char *s = "keykeykey";
-        ok = PyArg_ParseTuple(args, "is", &key, &s);
-        result = openpcd_set_key(handle, key, s);
-        return Py_BuildValue("i", result);
+static PyObject *Protocol_read(ProtocolObject *self, PyObject *args)
+{
+	unsigned int page, size = MIFARE_CL_PAGE_SIZE, rx_len;
+	PyObject *rx;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "I|I", &page, &size))
+		return NULL;
+
+	rx = PyBytes_FromStringAndSize(NULL, size);
+	if (!rx)
+		return NULL;
+	rx_len = size;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_protocol_read(self->ph, page,
+				    (unsigned char *)PyBytes_AS_STRING(rx),
+				    &rx_len));
+	if (ret < 0) {
+		Py_DECREF(rx);
+		return rfid_error(ret);
+	}
+	if (rx_len < size)
+		_PyBytes_Resize(&rx, rx_len);
+
+	return rx;
 }
 
-static PyObject *pyi_get_card_id(PyObject *self, PyObject *args) {
-	unsigned int uid;
-	int result;
-	result = openpcd_get_card_id(handle, &uid);
-        if (result == 0)
-		return Py_BuildValue("I", uid);
-	else
-		return Py_BuildValue("i", result);
+static PyObject *Protocol_read_into(ProtocolObject *self, PyObject *args)
+{
+	unsigned int page, rx_len;
+	Py_buffer rx;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "Iw*", &page, &rx))
+		return NULL;
+
+	rx_len = rx.len;
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_protocol_read(self->ph, page, rx.buf, &rx_len));
+	PyBuffer_Release(&rx);
+
+	if (ret < 0)
+		return rfid_error(ret);
+
+	return PyLong_FromUnsignedLong(rx_len);
 }
 
+static PyObject *Protocol_write(ProtocolObject *self, PyObject *args)
+{
+	unsigned int page;
+	Py_buffer tx;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "Iy*", &page, &tx))
+		return NULL;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_protocol_write(self->ph, page, tx.buf, tx.len));
+	PyBuffer_Release(&tx);
+
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Protocol_present(ProtocolObject *self, PyObject *unused)
+{
+	int ret;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_protocol_presence(self->ph));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *Protocol_mifare_set_key(ProtocolObject *self, PyObject *args)
+{
+	Py_buffer key;
+	int ret;
+
+	if (check_proto(self, RFID_PROTOCOL_MIFARE_CLASSIC) < 0 ||
+	    !PyArg_ParseTuple(args, "y*", &key))
+		return NULL;
+	if (check_key(&key) < 0) {
+		PyBuffer_Release(&key);
+		return NULL;
+	}
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 mfcl_set_key(self->ph, key.buf));
+	PyBuffer_Release(&key);
+
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Protocol_mifare_auth(ProtocolObject *self, PyObject *args)
+{
+	unsigned int key_type, block;
+	int ret;
+
+	if (check_proto(self, RFID_PROTOCOL_MIFARE_CLASSIC) < 0 ||
+	    !PyArg_ParseTuple(args, "II", &key_type, &block))
+		return NULL;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 mfcl_auth(self->ph, key_type, block));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+/* authenticate and read all blocks of a sector in one go */
+static int mifare_read_sector(struct rfid_protocol_handle *ph,
+			      unsigned int sector, unsigned char *key,
+			      unsigned int key_type, unsigned char *buf,
+			      unsigned int *len)
+{
+	unsigned int i, block, nblocks, rx_len;
+	int ret;
+
+	if (!ph)
+		return -EBADF;
+
+	block = mfcl_sector2block(sector);
+	nblocks = mfcl_sector_blocks(sector);
+	if (nblocks * MIFARE_CL_PAGE_SIZE > *len)
+		return -EINVAL;
+
+	if (key) {
+		ret = mfcl_set_key(ph, key);
+		if (ret < 0)
+			return ret;
+	}
+	ret = mfcl_auth(ph, key_type, block);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < nblocks; i++) {
+		rx_len = MIFARE_CL_PAGE_SIZE;
+		ret = rfid_protocol_read(ph, block + i,
+					 buf + i * MIFARE_CL_PAGE_SIZE,
+					 &rx_len);
+		if (ret < 0)
+			return ret;
+	}
+	*len = nblocks * MIFARE_CL_PAGE_SIZE;
+
+	return 0;
+}
+
+static PyObject *Protocol_mifare_read_sector(ProtocolObject *self,
+					     PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "sector", "key", "key_type", NULL };
+	unsigned int sector, key_type = RFID_CMD_MIFARE_AUTH1A, len;
+	Py_buffer key = { .buf = NULL };
+	PyObject *rx;
+	int ret;
+
+	if (check_proto(self, RFID_PROTOCOL_MIFARE_CLASSIC) < 0 ||
+	    !PyArg_ParseTupleAndKeywords(args, kwds, "I|z*I", kwlist,
+					 &sector, &key, &key_type))
+		return NULL;
+	if (key.buf && check_key(&key) < 0) {
+		PyBuffer_Release(&key);
+		return NULL;
+	}
+
+	len = MIFARE_CL_BLOCKS_P_SECTOR_4k * MIFARE_CL_PAGE_SIZE;
+	rx = PyBytes_FromStringAndSize(NULL, len);
+	if (!rx) {
+		PyBuffer_Release(&key);
+		return NULL;
+	}
+
+	RDR_CALL(PROTO_RDR(self), ret = mifare_read_sector(self->ph, sector,
+			key.buf, key_type,
+			(unsigned char *)PyBytes_AS_STRING(rx), &len));
+	PyBuffer_Release(&key);
+
+	if (ret < 0) {
+		Py_DECREF(rx);
+		return rfid_error(ret);
+	}
+	_PyBytes_Resize(&rx, len);
+
+	return rx;
+}
+
+static PyObject *Protocol_mful_lock_page(ProtocolObject *self, PyObject *args)
+{
+	unsigned int page;
+	int ret;
+
+	if (check_proto(self, RFID_PROTOCOL_MIFARE_UL) < 0 ||
+	    !PyArg_ParseTuple(args, "I", &page))
+		return NULL;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_mful_lock_page(self->ph, page));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Protocol_mful_lock_otp(ProtocolObject *self, PyObject *unused)
+{
+	int ret;
+
+	if (check_proto(self, RFID_PROTOCOL_MIFARE_UL) < 0)
+		return NULL;
+
+	RDR_CALL(PROTO_RDR(self), ret = !self->ph ? -EBADF :
+		 rfid_mful_lock_otp(self->ph));
+	if (ret < 0)
+		return rfid_error(ret);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Protocol_get_id(ProtocolObject *self, void *closure)
+{
+	return PyLong_FromUnsignedLong(self->id);
+}
+
+static PyObject *Protocol_get_name(ProtocolObject *self, void *closure)
+{
+	const char *name = NULL;
+
+	RDR_CALL(PROTO_RDR(self), name = self->ph ?
+		 rfid_protocol_name(self->ph) : NULL);
+	if (!name)
+		return rfid_error(-EBADF);
+
+	return PyUnicode_FromString(name);
+}
+
+static PyObject *Protocol_get_layer2(ProtocolObject *self, void *closure)
+{
+	Py_INCREF(self->layer2);
+	return (PyObject *)self->layer2;
+}
+
+static PyMethodDef Protocol_methods[] = {
+	{ "close", (PyCFunction)Protocol_close, METH_NOARGS,
+	  "close the handle" },
+	{ "transceive", (PyCFunction)Protocol_transceive,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "transceive(data[, rx_size, timeout, flags]) -> bytes" },
+	{ "transceive_into", (PyCFunction)Protocol_transceive_into,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "transceive_into(data, buffer[, timeout, flags]) -> "
+	  "number of bytes received into 'buffer'" },
+	{ "read", (PyCFunction)Protocol_read, METH_VARARGS,
+	  "read(page[, size]) -> bytes" },
+	{ "read_into", (PyCFunction)Protocol_read_into, METH_VARARGS,
+	  "read_into(page, buffer) -> number of bytes read into 'buffer'" },
+	{ "write", (PyCFunction)Protocol_write, METH_VARARGS,
+	  "write(page, data)" },
+	{ "present", (PyCFunction)Protocol_present, METH_NOARGS,
+	  "check whether the card is still in the field" },
+	{ "mifare_set_key", (PyCFunction)Protocol_mifare_set_key,
+	  METH_VARARGS, "mifare_set_key(key), Mifare Classic only" },
+	{ "mifare_auth", (PyCFunction)Protocol_mifare_auth, METH_VARARGS,
+	  "mifare_auth(key_type, block), Mifare Classic only" },
+	{ "mifare_read_sector", (PyCFunction)Protocol_mifare_read_sector,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "mifare_read_sector(sector[, key, key_type]) -> bytes, "
+	  "authenticate and read a whole sector, Mifare Classic only" },
+	{ "mful_lock_page", (PyCFunction)Protocol_mful_lock_page,
+	  METH_VARARGS, "mful_lock_page(page), Mifare Ultralight only" },
+	{ "mful_lock_otp", (PyCFunction)Protocol_mful_lock_otp, METH_NOARGS,
+	  "lock the OTP page, Mifare Ultralight only" },
+	{ NULL }
+};
+
+static PyGetSetDef Protocol_getset[] = {
+	{ "id", (getter)Protocol_get_id, NULL, "PROTOCOL_* id", NULL },
+	{ "name", (getter)Protocol_get_name, NULL, "name of the protocol",
+	  NULL },
+	{ "layer2", (getter)Protocol_get_layer2, NULL, "underlying Layer2",
+	  NULL },
+	{ NULL }
+};
+
+static PyTypeObject ProtocolType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name	= "pyrfid.Protocol",
+	.tp_doc		= "open protocol handle, see Reader.scan() and "
+			  "Layer2.protocol()",
+	.tp_basicsize	= sizeof(ProtocolObject),
+	.tp_flags	= Py_TPFLAGS_DEFAULT,
+	.tp_dealloc	= (destructor)Protocol_dealloc,
+	.tp_methods	= Protocol_methods,
+	.tp_getset	= Protocol_getset,
+};
+
+/* module */
+
+static PyObject *pyi_sector2block(PyObject *self, PyObject *args)
+{
+	unsigned char sector;
+
+	if (!PyArg_ParseTuple(args, "b", &sector))
+		return NULL;
+
+	return PyLong_FromLong(mfcl_sector2block(sector));
+}
+
+static PyObject *pyi_block2sector(PyObject *self, PyObject *args)
+{
+	unsigned char block;
+
+	if (!PyArg_ParseTuple(args, "b", &block))
+		return NULL;
+
+	return PyLong_FromLong(mfcl_block2sector(block));
+}
+
+static PyObject *pyi_sector_blocks(PyObject *self, PyObject *args)
+{
+	unsigned char sector;
+
+	if (!PyArg_ParseTuple(args, "b", &sector))
+		return NULL;
+
+	return PyLong_FromLong(mfcl_sector_blocks(sector));
+}
+
+static PyMethodDef pyi_Methods[] = {
+	{ "mifare_sector2block", pyi_sector2block, METH_VARARGS,
+	  "first block of a Mifare Classic sector" },
+	{ "mifare_block2sector", pyi_block2sector, METH_VARARGS,
+	  "sector of a Mifare Classic block" },
+	{ "mifare_sector_blocks", pyi_sector_blocks, METH_VARARGS,
+	  "number of blocks in a Mifare Classic sector" },
+	{ NULL }
+};
+
+static struct PyModuleDef pyi_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name		= "pyrfid",
+	.m_doc		= "Python bindings for librfid",
+	.m_size		= -1,
+	.m_methods	= pyi_Methods,
+};
+
+static const struct {
+	const char *name;
+	long value;
+} pyi_constants[] = {
+#define C(name, value)	{ name, value }
+	C("READER_CM5121",		RFID_READER_CM5121),
+	C("READER_OPENPCD",		RFID_READER_OPENPCD),
+	C("READER_SPIDEV",		RFID_READER_SPIDEV),
+	C("LAYER2_ISO14443A",		RFID_LAYER2_ISO14443A),
+	C("LAYER2_ISO14443B",		RFID_LAYER2_ISO14443B),
+	C("LAYER2_ISO15693",		RFID_LAYER2_ISO15693),
+	C("LAYER2_ICODE1",		RFID_LAYER2_ICODE1),
+	C("PROTOCOL_TCL",		RFID_PROTOCOL_TCL),
+	C("PROTOCOL_MIFARE_UL",		RFID_PROTOCOL_MIFARE_UL),
+	C("PROTOCOL_MIFARE_CLASSIC",	RFID_PROTOCOL_MIFARE_CLASSIC),
+	C("PROTOCOL_ICODE_SLI",		RFID_PROTOCOL_ICODE_SLI),
+	C("PROTOCOL_TAGIT",		RFID_PROTOCOL_TAGIT),
+	C("FRAME_14443A",		RFID_14443A_FRAME_REGULAR),
+	C("FRAME_14443B",		RFID_14443B_FRAME_REGULAR),
+	C("FRAME_MIFARE",		RFID_MIFARE_FRAME),
+	C("FRAME_15693",		RFID_15693_FRAME),
+	C("FRAME_ICODE1",		RFID_15693_FRAME_ICODE1),
+	C("MIFARE_KEY_A",		RFID_CMD_MIFARE_AUTH1A),
+	C("MIFARE_KEY_B",		RFID_CMD_MIFARE_AUTH1B),
+#undef C
+};
+
+PyMODINIT_FUNC PyInit_pyrfid(void)
+{
+	PyObject *m;
+	unsigned int i;
+
+	if (PyType_Ready(&ReaderType) < 0 ||
+	    PyType_Ready(&Layer2Type) < 0 ||
+	    PyType_Ready(&ProtocolType) < 0)
+		return NULL;
+
+	open_lock = PyThread_allocate_lock();
+	if (!open_lock)
+		return PyErr_NoMemory();
+
+	m = PyModule_Create(&pyi_module);
+	if (!m)
+		return NULL;
+
+	pyi_Error = PyErr_NewException("pyrfid.error", PyExc_OSError, NULL);
+	Py_INCREF(pyi_Error);
+	PyModule_AddObject(m, "error", pyi_Error);
+
+	Py_INCREF(&ReaderType);
+	PyModule_AddObject(m, "Reader", (PyObject *)&ReaderType);
+	Py_INCREF(&Layer2Type);
+	PyModule_AddObject(m, "Layer2", (PyObject *)&Layer2Type);
+	Py_INCREF(&ProtocolType);
+	PyModule_AddObject(m, "Protocol", (PyObject *)&ProtocolType);
+
+	for (i = 0; i < sizeof(pyi_constants)/sizeof(pyi_constants[0]); i++)
+		PyModule_AddIntConstant(m, pyi_constants[i].name,
+					pyi_constants[i].value);
+
+	rfid_init();
+
+	return m;
+}
@@ -1,4 +1,4 @@
-#!/usr/bin/env python
+#!/usr/bin/env python3
   #Python bindings test file 
   #(C) 2007-2008 by Kushal Das <kushal@openpcd.org>
 
@@ -17,8 +17,17 @@
 
 import pyrfid
 
-pyrfid.open_reader()
-pyrfid.select_card()
-print "%08X" % (pyrfid.get_card_id())
-pyrfid.deselect_card()
-pyrfid.close_reader()
\ No newline at end of file
+reader = pyrfid.Reader(pyrfid.READER_OPENPCD)
+card = reader.scan()
+if card:
+	l2, proto = card
+	print("%s UID %s" % (l2.name, l2.uid.hex()))
+	if proto:
+		print("protocol %s" % proto.name)
+		if proto.id == pyrfid.PROTOCOL_MIFARE_CLASSIC:
+			data = proto.mifare_read_sector(0, b"\xff" * 6)
+			print(data.hex())
+		proto.close()
+	l2.close()
+print(reader.stats())
+reader.close()
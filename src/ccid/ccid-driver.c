@@ -228,6 +228,8 @@ struct ccid_driver_s
   int powered_off;
   int has_pinpad;
   int apdu_level;     /* Reader supports short APDU level exchange.  */
+  size_t max_msglen;  /* dwMaxCCIDMessageLength.  */
+  unsigned char *escape_buf; /* Escape messages, MAX_MSGLEN bytes.  */
 };
 
 
@@ -460,6 +462,15 @@ parse_ccid_descriptor (ccid_driver_t handle,
 
   us = convert_le_u32(buf+44);
   DEBUGOUT_1 ("  dwMaxCCIDMsgLen     %5u\n", us);
+  /* The spec requires at least a short APDU plus the header.  */
+  if (us < 271)
+    us = 271;
+  if (handle->escape_buf && us != handle->max_msglen)
+    {
+      free (handle->escape_buf);
+      handle->escape_buf = NULL;
+    }
+  handle->max_msglen = us;
 
   DEBUGOUT (  "  bClassGetResponse    ");
   if (buf[48] == 0xff)
@@ -1137,6 +1148,7 @@ ccid_close_reader (ccid_driver_t handle)
     return 0;
 
   do_close_reader (handle);
+  free (handle->escape_buf);
   free (handle->rid);
   free (handle);
   return 0;
@@ -1270,16 +1282,25 @@ send_escape_cmd (ccid_driver_t handle,
                  unsigned char *result, size_t resultmax, size_t *resultlen)
 {
   int i, rc;
-  unsigned char msg[100];
+  unsigned char *msg;
   size_t msglen;
   unsigned char seqno;
 
   if (resultlen)
     *resultlen = 0;
 
-  if (datalen > sizeof msg - 10)
+  if (datalen > handle->max_msglen - 10)
     return CCID_DRIVER_ERR_INV_VALUE; /* Escape data too large.  */
 
+  /* Allocated once, the escapes are used for every register access.  */
+  if (!handle->escape_buf)
+    {
+      handle->escape_buf = malloc (handle->max_msglen);
+      if (!handle->escape_buf)
+        return CCID_DRIVER_ERR_OUT_OF_CORE;
+    }
+  msg = handle->escape_buf;
+
   msg[0] = PC_to_RDR_Escape;
   msg[5] = 0; /* slot */
   msg[6] = seqno = handle->seqno++;
@@ -1297,7 +1318,7 @@ send_escape_cmd (ccid_driver_t handle,
   rc = bulk_out (handle, msg, msglen);
   if (rc)
     return rc;
-  rc = bulk_in (handle, msg, sizeof msg, &msglen, RDR_to_PC_Escape,
+  rc = bulk_in (handle, msg, handle->max_msglen, &msglen, RDR_to_PC_Escape,
                 seqno, 5000, 0);
   if (result)
     switch (rc)
@@ -1334,6 +1355,14 @@ ccid_transceive_escape (ccid_driver_t handle,
 }
 
 
+/* Return the largest payload of an escape command or its response.  */
+size_t
+ccid_escape_max (ccid_driver_t handle)
+{
+  return handle->max_msglen - 10;
+}
+
+
 
 /* experimental */
 int
@@ -1390,6 +1419,55 @@ ccid_poll (ccid_driver_t handle)
 }
 
 
+/* Wait up to TIMEOUT milliseconds for a message on the interrupt
+   endpoint.  Returns 0 on timeout, CCID_NOTIFY_SLOT_CHANGE with the
+   bmSlotICCState bits of the first four slots (present, changed) in
+   SLOTBITS, CCID_NOTIFY_HW_ERROR, or a CCID_DRIVER_ERR_ code.  */
+int
+ccid_wait_notify (ccid_driver_t handle, int timeout, unsigned int *slotbits)
+{
+  int rc, i;
+  unsigned char msg[10];
+  size_t msglen;
+
+  *slotbits = 0;
+
+  rc = usb_interrupt_read (handle->idev, 
+                           handle->ep_intr,
+                           (char*)msg, sizeof msg,
+                           timeout > 0? timeout : 1);
+  if (rc < 0 && (rc == -ETIMEDOUT || errno == ETIMEDOUT))
+    return 0;
+
+  if (rc < 0)
+    {
+      DEBUGOUT_1 ("usb_intr_read error: %s\n", strerror (errno));
+      return CCID_DRIVER_ERR_CARD_IO_ERROR;
+    }
+
+  msglen = rc;
+  if (msglen < 1)
+    {
+      DEBUGOUT ("intr-in msg too short\n");
+      return CCID_DRIVER_ERR_INV_VALUE;
+    }
+
+  switch (msg[0])
+    {
+    case RDR_to_PC_NotifySlotChange:
+      for (i=1; i < msglen && i < 5; i++)
+        *slotbits |= msg[i] << ((i-1)*8);
+      return CCID_NOTIFY_SLOT_CHANGE;
+    case RDR_to_PC_HardwareError:
+      DEBUGOUT ("hardware error occured\n");
+      return CCID_NOTIFY_HW_ERROR;
+    }
+
+  DEBUGOUT_1 ("unknown intr-in msg of type %02X\n", msg[0]);
+  return 0;
+}
+
+
 /* Note that this fucntion won't return the error codes NO_CARD or
    CARD_INACTIVE */
 int 
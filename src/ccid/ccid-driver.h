@@ -87,6 +87,10 @@ int ccid_close_reader (ccid_driver_t handle);
 int ccid_get_atr (ccid_driver_t handle,
                   unsigned char *atr, size_t maxatrlen, size_t *atrlen);
 int ccid_slot_status (ccid_driver_t handle, int *statusbits);
+#define CCID_NOTIFY_SLOT_CHANGE 1
+#define CCID_NOTIFY_HW_ERROR    2
+int ccid_wait_notify (ccid_driver_t handle, int timeout,
+                      unsigned int *slotbits);
 int ccid_transceive (ccid_driver_t handle,
                      const unsigned char *apdu, size_t apdulen,
                      unsigned char *resp, size_t maxresplen, size_t *nresp);
@@ -99,6 +103,7 @@ int ccid_transceive_escape (ccid_driver_t handle,
                             const unsigned char *data, size_t datalen,
                             unsigned char *resp, size_t maxresplen,
                             size_t *nresp);
+size_t ccid_escape_max (ccid_driver_t handle);
 
 
 
@@ -2,15 +2,20 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
 
 #include <librfid/rfid.h>
 
 #ifndef LIBRFID_FIRMWARE
 
 #include <librfid/rfid_asic.h>
+#include <librfid/rfid_reader.h>
 
 #include "ccid-driver.h"
 
+/* the contactless interface is CCID slot 1 */
+#define CM5121_RF_SLOT	1
+
 /* this is the sole function required by rfid_reader_cm5121.c */
 int 
 PC_to_RDR_Escape(void *handle, 
@@ -39,4 +44,34 @@ int cm5121_source_init(struct rfid_asic_transport_handle *rath)
 	return 0;
 }
 
+size_t cm5121_source_max_xfer(struct rfid_asic_transport_handle *rath)
+{
+	return ccid_escape_max(rath->data);
+}
+
+/* slot change notifications on the interrupt endpoint */
+int cm5121_source_wait_irq(struct rfid_asic_transport_handle *rath,
+			   unsigned int timeout_ms)
+{
+	unsigned int slots;
+	int rc;
+
+	rc = ccid_wait_notify(rath->data, timeout_ms, &slots);
+	switch (rc) {
+	case 0:
+		return 0;
+	case CCID_NOTIFY_SLOT_CHANGE:
+		/* two bits per slot: card present, state changed */
+		slots >>= CM5121_RF_SLOT * 2;
+		if (!(slots & 2))
+			return 0;
+		return RFID_READER_EV_SLOT_CHANGE |
+		       (slots & 1 ? RFID_READER_EV_CARD_PRESENT : 0);
+	case CCID_NOTIFY_HW_ERROR:
+		return RFID_READER_EV_HW_ERROR;
+	default:
+		return -EIO;
+	}
+}
+
 #endif /* LIBRFID_FIRMWARE */
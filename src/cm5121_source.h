@@ -1,2 +1,7 @@
 
 extern int cm5121_source_init(struct rfid_asic_transport_handle *rath);
+/* largest PC_to_RDR_Escape payload in either direction */
+extern size_t cm5121_source_max_xfer(struct rfid_asic_transport_handle *rath);
+/* RFID_READER_EV_* bits, 0 on timeout, -ENOTSUP */
+extern int cm5121_source_wait_irq(struct rfid_asic_transport_handle *rath,
+				  unsigned int timeout_ms);
@@ -24,19 +24,11 @@
 #include <librfid/rfid_protocol_mifare_ul.h>
 #include <librfid/rfid_protocol_mifare_classic.h>
 
-#ifdef LIBRFID_STATIC
-struct rfid_asic_handle rfid_ah;
-struct rfid_layer2_handle rfid_l2h;
-struct rfid_protocol_handle rfid_ph;
-struct rfid_asic_transport_handle rfid_ath;
-struct rfid_reader_handle rfid_rh;
-#endif
-
 #ifndef LIBRFID_FIRMWARE
 const char *
 rfid_hexdump(const void *data, unsigned int len)
 {
-	static char string[1024];
+	static __rfid_tls char string[1024];
 	unsigned char *d = (unsigned char *) data;
 	unsigned int i, left;
 
@@ -204,9 +204,9 @@ void mfcl_access_to_exp(struct mfcl_access_exp_sect *exp,
 
 char *mfcl_access_exp_stringify(const struct mfcl_access_exp_block *exp)
 {
-	static char buf[80];
+	static __rfid_tls char buf[80];
 
-	sprintf(buf, "READ: %s, WRITE: %s, INC: %s, DEC: %s",
+	snprintf(buf, sizeof(buf), "READ: %s, WRITE: %s, INC: %s, DEC: %s",
 		mfcl_access_str[exp->read],
 		mfcl_access_str[exp->write],
 		mfcl_access_str[exp->inc],
@@ -216,9 +216,10 @@ char *mfcl_access_exp_stringify(const struct mfcl_access_exp_block *exp)
 
 char *mfcl_access_exp_acc_stringify(const struct mfcl_access_exp_acc *acc)
 {
-	static char buf[80];
+	static __rfid_tls char buf[128];
 
-	sprintf(buf, "KEY_A_RD: %s, KEY_A_WR: %s, ACC_RD: %s, ACC_WR: %s, "
+	snprintf(buf, sizeof(buf),
+		"KEY_A_RD: %s, KEY_A_WR: %s, ACC_RD: %s, ACC_WR: %s, "
 		"KEY_B_RD: %s, KEY_B_WR: %s",
 		mfcl_access_str[acc->key_a_rd],
 		mfcl_access_str[acc->key_a_wr],
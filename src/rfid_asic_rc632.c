@@ -24,24 +24,27 @@
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <time.h>
 #include <sys/types.h>
 
 #include <librfid/rfid.h>
 #include <librfid/rfid_asic.h>
 #include <librfid/rfid_asic_rc632.h>
-#include <librfid/rfid_reader_cm5121.h>
 #include <librfid/rfid_layer2_iso14443a.h>
 #include <librfid/rfid_layer2_iso15693.h>
 #include <librfid/rfid_protocol_mifare_classic.h>
+#include <librfid/rfid_trace.h>
 
 #include "rfid_iso14443_common.h"
 #include "rc632.h"
+#include "rfid_probes.h"
 
 #ifdef  __MINGW32__
 #include "usleep.h"
 #endif/*__MINGW32__*/
 
 #define RC632_TMO_AUTH1	140
+#define RC632_TMO_FIFO	10000	/* usec for the FIFO to drain */
 
 #define TIMER_RELAX_FACTOR	10
 
@@ -59,6 +62,8 @@ rc632_reg_write(struct rfid_asic_handle *handle,
 		u_int8_t reg,
 		u_int8_t val)
 {
+	rfid_trace(handle->trace, RFID_TRACE_REG_WRITE, reg << 8 | val, NULL, 0);
+
 	return handle->rath->rat->priv.rc632.fn.reg_write(handle->rath, reg, val);
 }
 
@@ -67,7 +72,17 @@ rc632_reg_read(struct rfid_asic_handle *handle,
 	       u_int8_t reg,
 	       u_int8_t *val)
 {
-	return handle->rath->rat->priv.rc632.fn.reg_read(handle->rath, reg, val);
+	int ret;
+
+	RFID_PROBE2(rc632__reg_read__entry, handle, reg);
+	ret = handle->rath->rat->priv.rc632.fn.reg_read(handle->rath, reg, val);
+	RFID_PROBE4(rc632__reg_read__return, handle, reg,
+		    ret < 0 ? 0 : *val, ret);
+	if (ret >= 0)
+		rfid_trace(handle->trace, RFID_TRACE_REG_READ, reg << 8 | *val,
+			   NULL, 0);
+
+	return ret;
 }
 
 static int 
@@ -85,7 +100,13 @@ rc632_fifo_read(struct rfid_asic_handle *handle,
 		u_int8_t len,
 		u_int8_t *buf)
 {
-	return handle->rath->rat->priv.rc632.fn.fifo_read(handle->rath, len, buf);
+	int ret;
+
+	RFID_PROBE2(rc632__fifo_read__entry, handle, len);
+	ret = handle->rath->rat->priv.rc632.fn.fifo_read(handle->rath, len, buf);
+	RFID_PROBE3(rc632__fifo_read__return, handle, len, ret);
+
+	return ret;
 }
 
 
@@ -170,6 +191,7 @@ static int
 rc632_power(struct rfid_asic_handle *handle, int on)
 {
 	ENTER();
+	handle->priv.rc632.key_src = RC632_KEY_NONE;
 	if (on)
 		return rc632_clear_bits(handle, RC632_REG_CONTROL, 
 					RC632_CONTROL_POWERDOWN);
@@ -235,6 +257,28 @@ static int best_prescaler(u_int64_t timeout, u_int8_t *prescaler,
 	return 0;
 }
 
+/* cut a timeout (usec) to what is left of the deadline of the reader's
+ * operation, see rfid_retry.h.  -ETIMEDOUT once it has passed */
+static int rc632_deadline_cut(struct rfid_asic_handle *handle,
+			      u_int64_t *timeout)
+{
+#ifdef ENABLE_RETRY
+	struct timespec ts;
+	u_int64_t now;
+
+	if (!handle->deadline)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	if (now >= handle->deadline)
+		return -ETIMEDOUT;
+	if (*timeout > handle->deadline - now)
+		*timeout = handle->deadline - now;
+#endif
+	return 0;
+}
+
 static int
 rc632_timer_set(struct rfid_asic_handle *handle,
 		u_int64_t timeout)
@@ -242,6 +286,10 @@ rc632_timer_set(struct rfid_asic_handle *handle,
 	int ret;
 	u_int8_t prescaler, divisor, irq;
 
+	ret = rc632_deadline_cut(handle, &timeout);
+	if (ret < 0)
+		return ret;
+
 	timeout *= TIMER_RELAX_FACTOR;
 
 	ret = best_prescaler(timeout, &prescaler, &divisor);
@@ -265,66 +313,95 @@ rc632_timer_set(struct rfid_asic_handle *handle,
 	return ret;
 }
 
-/* Wait until RC632 is idle or TIMER IRQ has happened */
-static int rc632_wait_idle_timer(struct rfid_asic_handle *handle)
+/* enable the interrupts rc632_idle_timer_poll() is looking at */
+static int rc632_idle_timer_start(struct rfid_asic_handle *handle)
 {
 	int ret;
-	u_int8_t stat, irq, cmd;
+	u_int8_t irq;
 
 	ret = rc632_reg_read(handle, RC632_REG_INTERRUPT_EN, &irq);
 	if (ret < 0)
 		return ret;
 	DEBUGP_INTERRUPT_FLAG("irq_en",irq);
 
-	ret = rc632_reg_write(handle, RC632_REG_INTERRUPT_EN, RC632_IRQ_SET
+	return rc632_reg_write(handle, RC632_REG_INTERRUPT_EN, RC632_IRQ_SET
 				| RC632_IRQ_TIMER
 				| RC632_IRQ_IDLE
 				| RC632_IRQ_RX );
-	if (ret < 0)
-		return ret;
-
-	while (1) {
-		rc632_reg_read(handle, RC632_REG_PRIMARY_STATUS, &stat);
-		DEBUGP_STATUS_FLAG(stat);
-		if (stat & RC632_STAT_ERR) {
-			u_int8_t err;
-			ret = rc632_reg_read(handle, RC632_REG_ERROR_FLAG, &err);
-			if (ret < 0)
-				return ret;
-			DEBUGP_ERROR_FLAG(err);
-			if (err & (RC632_ERR_FLAG_COL_ERR |
-				   RC632_ERR_FLAG_PARITY_ERR |
-				   RC632_ERR_FLAG_FRAMING_ERR |
-				/* FIXME: why get we CRC errors in CL2 anticol at iso14443a operation with mifare UL? */
-				/*   RC632_ERR_FLAG_CRC_ERR | */
-				   0))
-				return -EIO;
-		}
-		if (stat & RC632_STAT_IRQ) {
-			ret = rc632_reg_read(handle, RC632_REG_INTERRUPT_RQ, &irq);
-			if (ret < 0)
-				return ret;
-			DEBUGP_INTERRUPT_FLAG("irq_rq",irq);
+}
 
-			if (irq & RC632_IRQ_TIMER && !(irq & RC632_IRQ_RX)) {
-				DEBUGP("timer expired before RX!!\n");
-				rc632_clear_irqs(handle, RC632_IRQ_TIMER);
-				return -ETIMEDOUT;
-			}
-		}
+/* Check once whether RC632 is idle or TIMER IRQ has happened.  Returns
+ * -EINPROGRESS if the command is still running */
+static int rc632_idle_timer_poll(struct rfid_asic_handle *handle)
+{
+	int ret;
+	u_int8_t stat, irq, cmd;
 
-		ret = rc632_reg_read(handle, RC632_REG_COMMAND, &cmd);
+	rc632_reg_read(handle, RC632_REG_PRIMARY_STATUS, &stat);
+	DEBUGP_STATUS_FLAG(stat);
+	if (stat & RC632_STAT_ERR) {
+		u_int8_t err;
+		ret = rc632_reg_read(handle, RC632_REG_ERROR_FLAG, &err);
+		if (ret < 0)
+			return ret;
+		DEBUGP_ERROR_FLAG(err);
+		rfid_trace(handle->trace, RFID_TRACE_ERROR, err, NULL, 0);
+		handle->priv.rc632.err_flags = err;
+		if (err & (RC632_ERR_FLAG_COL_ERR |
+			   RC632_ERR_FLAG_PARITY_ERR |
+			   RC632_ERR_FLAG_FRAMING_ERR |
+			/* FIXME: why get we CRC errors in CL2 anticol at iso14443a operation with mifare UL? */
+			/*   RC632_ERR_FLAG_CRC_ERR | */
+			   0))
+			return -EIO;
+	}
+	if (stat & RC632_STAT_IRQ) {
+		ret = rc632_reg_read(handle, RC632_REG_INTERRUPT_RQ, &irq);
 		if (ret < 0)
 			return ret;
+		DEBUGP_INTERRUPT_FLAG("irq_rq",irq);
 
-		if (cmd == 0) {
-			rc632_clear_irqs(handle, RC632_IRQ_RX);
-			return 0;
+		if (irq & RC632_IRQ_TIMER && !(irq & RC632_IRQ_RX)) {
+			DEBUGP("timer expired before RX!!\n");
+			rfid_trace(handle->trace, RFID_TRACE_TIMEOUT, 0, NULL, 0);
+			rc632_clear_irqs(handle, RC632_IRQ_TIMER);
+			return -ETIMEDOUT;
 		}
+	}
 
-		/* poll every millisecond */
-		usleep(1000);
+	ret = rc632_reg_read(handle, RC632_REG_COMMAND, &cmd);
+	if (ret < 0)
+		return ret;
+
+	if (cmd == 0) {
+		rc632_clear_irqs(handle, RC632_IRQ_RX);
+		return 0;
 	}
+
+	return -EINPROGRESS;
+}
+
+static int rc632_idle_timer_wait(struct rfid_asic_handle *handle)
+{
+	int ret;
+
+	/* poll every millisecond */
+	while ((ret = rc632_idle_timer_poll(handle)) == -EINPROGRESS)
+		usleep(1000);
+
+	return ret;
+}
+
+/* Wait until RC632 is idle or TIMER IRQ has happened */
+static int rc632_wait_idle_timer(struct rfid_asic_handle *handle)
+{
+	int ret;
+
+	ret = rc632_idle_timer_start(handle);
+	if (ret < 0)
+		return ret;
+
+	return rc632_idle_timer_wait(handle);
 }
 
 /* Stupid RC632 implementations don't evaluate interrupts but poll the
@@ -336,6 +413,10 @@ rc632_wait_idle(struct rfid_asic_handle *handle, u_int64_t timeout)
 	int ret, cycles = 0;
 #define USLEEP_PER_CYCLE	128
 
+	ret = rc632_deadline_cut(handle, &timeout);
+	if (ret < 0)
+		return ret;
+
 	timeout *= TIMER_RELAX_FACTOR;
 
 	while (cmd != 0) {
@@ -371,6 +452,8 @@ rc632_wait_idle(struct rfid_asic_handle *handle, u_int64_t timeout)
 		/* Abort after some timeout */
 		if (cycles > timeout/USLEEP_PER_CYCLE) {
 			DEBUGP("timeout...\n");
+			rfid_trace(handle->trace, RFID_TRACE_TIMEOUT,
+				   timeout / TIMER_RELAX_FACTOR, NULL, 0);
 			return -ETIMEDOUT;
 		}
 
@@ -430,20 +513,46 @@ tcl_toggle_pcb(struct rfid_asic_handle *handle)
 	return 0;
 }
 
+/* Wait until the transmitter made room in the FIFO for the rest of a
+ * frame.  Sending the 64 bytes of a full FIFO takes about 6ms at 106kbps,
+ * so if no space frees up in RC632_TMO_FIFO the chip is stuck. */
 static int
-rc632_transceive(struct rfid_asic_handle *handle,
-		 const u_int8_t *tx_buf,
-		 u_int8_t tx_len,
-		 u_int8_t *rx_buf,
-		 u_int8_t *rx_len,
-		 u_int64_t timer,
-		 unsigned int toggle)
+rc632_fifo_wait_space(struct rfid_asic_handle *handle, int *space)
 {
-	int ret, cur_tx_len, i;
-	u_int8_t rx_avail;
+	unsigned int waited = 0;
+	u_int8_t fifo_fill;
+	int ret;
+
+	while (1) {
+		ret = rc632_reg_read(handle, RC632_REG_FIFO_LENGTH,
+				     &fifo_fill);
+		if (ret < 0)
+			return ret;
+		if (fifo_fill < 64) {
+			*space = 64 - fifo_fill;
+			return 0;
+		}
+		if (waited >= RC632_TMO_FIFO) {
+			DEBUGP("FIFO stays full\n");
+			return -ETIMEDOUT;
+		}
+		usleep(100);
+		waited += 100;
+	}
+}
+
+/* load the FIFO and start a TRANSCEIVE command */
+static int
+rc632_transceive_start(struct rfid_asic_handle *handle,
+		       const u_int8_t *tx_buf,
+		       u_int8_t tx_len,
+		       u_int64_t timer,
+		       unsigned int toggle)
+{
+	int ret, cur_tx_len;
 	const u_int8_t *cur_tx_buf = tx_buf;
 
-	DEBUGP("timeout=%u, rx_len=%u, tx_len=%u\n", timer, *rx_len, tx_len);
+	DEBUGP("timeout=%u, tx_len=%u\n", timer, tx_len);
 
 	if (tx_len > 64)
 		cur_tx_len = 64;
@@ -451,6 +560,8 @@ rc632_transceive(struct rfid_asic_handle *handle,
 		cur_tx_len = tx_len;
 
 
+	handle->priv.rc632.err_flags = 0;
+
 	ret = rc632_reg_write(handle, RC632_REG_COMMAND, RC632_CMD_IDLE);
 	/* clear all interrupts */
 	ret = rc632_reg_write(handle, RC632_REG_INTERRUPT_RQ, 0x7f);
@@ -480,13 +591,14 @@ rc632_transceive(struct rfid_asic_handle *handle,
 
 		cur_tx_buf += cur_tx_len;
 		if (cur_tx_buf < tx_buf + tx_len) {
-			u_int8_t fifo_fill;
-			ret = rc632_reg_read(handle, RC632_REG_FIFO_LENGTH,
-					     &fifo_fill);
-			if (ret < 0)
+			ret = rc632_fifo_wait_space(handle, &cur_tx_len);
+			if (ret < 0) {
+				rc632_reg_write(handle, RC632_REG_COMMAND,
+						RC632_CMD_IDLE);
 				return ret;
-
-			cur_tx_len = 64 - fifo_fill;
+			}
+			if (cur_tx_len > tx_buf + tx_len - cur_tx_buf)
+				cur_tx_len = tx_buf + tx_len - cur_tx_buf;
 		} else
 			cur_tx_len = 0;
 
@@ -495,12 +607,17 @@ rc632_transceive(struct rfid_asic_handle *handle,
 	if (toggle == 1)
 		tcl_toggle_pcb(handle);
 
-	ret = rc632_wait_idle_timer(handle);
-	//ret = rc632_wait_idle(handle, timer);
+	return rc632_idle_timer_start(handle);
+}
 
-	DEBUGP("rc632_wait_idle >> ret=%d %s\n",ret,(ret==-ETIMEDOUT)?"ETIMEDOUT":"");
-	if (ret < 0)
-		return ret;
+/* fetch the response of a completed TRANSCEIVE from the FIFO */
+static int
+rc632_transceive_finish(struct rfid_asic_handle *handle,
+			u_int8_t *rx_buf,
+			u_int8_t *rx_len)
+{
+	int ret, i;
+	u_int8_t rx_avail;
 
 	ret = rc632_reg_read(handle, RC632_REG_FIFO_LENGTH, &rx_avail);
 	if (ret < 0)
@@ -532,6 +649,37 @@ rc632_transceive(struct rfid_asic_handle *handle,
 	/* FIXME: discard addidional bytes in FIFO */
 }
 
+static int
+rc632_transceive(struct rfid_asic_handle *handle,
+		 const u_int8_t *tx_buf,
+		 u_int8_t tx_len,
+		 u_int8_t *rx_buf,
+		 u_int8_t *rx_len,
+		 u_int64_t timer,
+		 unsigned int toggle)
+{
+	int ret;
+
+	DEBUGP("timeout=%u, rx_len=%u, tx_len=%u\n", timer, *rx_len, tx_len);
+	RFID_PROBE4(rc632__transceive__entry, handle, tx_len, *rx_len, timer);
+
+	ret = rc632_transceive_start(handle, tx_buf, tx_len, timer, toggle);
+	if (ret < 0)
+		goto out;
+
+	ret = rc632_idle_timer_wait(handle);
+	//ret = rc632_wait_idle(handle, timer);
+
+	DEBUGP("rc632_wait_idle >> ret=%d %s\n",ret,(ret==-ETIMEDOUT)?"ETIMEDOUT":"");
+	if (ret < 0)
+		goto out;
+
+	ret = rc632_transceive_finish(handle, rx_buf, rx_len);
+out:
+	RFID_PROBE3(rc632__transceive__return, handle, ret,
+		    ret < 0 ? 0 : *rx_len);
+	return ret;
+}
 
 static int
 rc632_receive(struct rfid_asic_handle *handle,
@@ -808,7 +956,8 @@ rc632_fini(struct rfid_asic_handle *ah)
 }
 
 struct rfid_asic_handle *
-rc632_open(struct rfid_asic_transport_handle *th)
+rc632_open(struct rfid_asic_transport_handle *th,
+	   const struct rfid_asic_rc632_impl *impl)
 {
 	struct rfid_asic_handle *h;
 
@@ -820,9 +969,11 @@ rc632_open(struct rfid_asic_transport_handle *th)
 	h->asic = (void*)&rc632;
 	h->rath = th;
 	h->fc = h->asic->fc;
-	/* FIXME: this is only cm5121 specific, since the latency
-	 * down to the RC632 FIFO is too long to refill during TX/RX */
-	h->mtu = h->mru = 64;
+	h->mtu = impl->mtu;
+	h->mru = impl->mru;
+
+	h->priv.rc632.impl = impl;
+	h->priv.rc632.iso14443a = impl->iso14443a;
 
 	if (rc632_init(h) < 0) {
 		free_asic_handle(h);
@@ -852,12 +1003,6 @@ static struct register_file iso14443a_script[] = {
 			  RC632_TXCTRL_FORCE_100_ASK |
 			  RC632_TXCTRL_TX2_RF_EN |
 			  RC632_TXCTRL_TX1_RF_EN,
-	}, {
-		.reg	= RC632_REG_CW_CONDUCTANCE,
-		.val	= CM5121_CW_CONDUCTANCE,
-	}, {
-		.reg	= RC632_REG_MOD_CONDUCTANCE,
-		.val	= CM5121_MOD_CONDUCTANCE,
 	}, {
 		.reg	= RC632_REG_CODER_CONTROL,
 		.val	= (RC632_CDRCTRL_TXCD_14443A |
@@ -880,12 +1025,6 @@ static struct register_file iso14443a_script[] = {
 		.reg	= RC632_REG_DECODER_CONTROL,
 		.val	= (RC632_DECCTRL_MANCHESTER |
 			   RC632_DECCTRL_RXFR_14443A),
-	}, {
-		.reg	= RC632_REG_BIT_PHASE,
-		.val	= CM5121_14443A_BITPHASE,
-	}, {
-		.reg	= RC632_REG_RX_THRESHOLD,
-		.val	= CM5121_14443A_THRESHOLD,
 	}, {
 		.reg	= RC632_REG_BPSK_DEM_CONTROL,
 		.val	= 0x00,
@@ -893,10 +1032,6 @@ static struct register_file iso14443a_script[] = {
 		.reg	= RC632_REG_RX_CONTROL2,
 		.val	= (RC632_RXCTRL2_DECSRC_INT |
 			   RC632_RXCTRL2_CLK_Q),
-	}, {
-		.reg	= RC632_REG_RX_WAIT,
-		//.val	= 0x03, /* default value */
-		.val	= 0x06,	/* omnikey */
 	}, {
 		.reg	= RC632_REG_CHANNEL_REDUNDANCY,
 		.val	= (RC632_CR_PARITY_ENABLE |
@@ -910,6 +1045,37 @@ static struct register_file iso14443a_script[] = {
 	},
 };
 
+/* the reader specific part of a layer2 setup */
+static int
+rc632_tune(struct rfid_asic_handle *handle,
+	   const struct rfid_asic_rc632_impl_proto *t)
+{
+	int ret;
+
+	ret = rc632_reg_write(handle, RC632_REG_CW_CONDUCTANCE,
+			      t->cw_conductance);
+	if (ret < 0)
+		return ret;
+
+	ret = rc632_reg_write(handle, RC632_REG_MOD_CONDUCTANCE,
+			      t->mod_conductance);
+	if (ret < 0)
+		return ret;
+
+	ret = rc632_reg_write(handle, RC632_REG_BIT_PHASE, t->bitphase);
+	if (ret < 0)
+		return ret;
+
+	ret = rc632_reg_write(handle, RC632_REG_RX_THRESHOLD, t->threshold);
+	if (ret < 0)
+		return ret;
+
+	if (!t->rx_wait)
+		return 0;
+
+	return rc632_reg_write(handle, RC632_REG_RX_WAIT, t->rx_wait);
+}
+
 static int
 rc632_iso14443a_init(struct rfid_asic_handle *handle)
 {
@@ -924,7 +1090,7 @@ rc632_iso14443a_init(struct rfid_asic_handle *handle)
 	if (ret < 0)
 		return ret;
 
-	return 0;
+	return rc632_tune(handle, &handle->priv.rc632.iso14443a);
 }
 
 static int
@@ -1015,25 +1181,12 @@ rc632_iso14443a_transceive_sf(struct rfid_asic_handle *handle,
 	return 0;
 }
 
-/* transceive regular frame */
+/* set up CRC and parity for a regular frame of type 'frametype' */
 static int
-rc632_iso14443ab_transceive(struct rfid_asic_handle *handle,
-			   unsigned int frametype,
-			   const u_int8_t *tx_buf, unsigned int tx_len,
-			   u_int8_t *rx_buf, unsigned int *rx_len,
-			   u_int64_t timeout, unsigned int flags)
+rc632_set_channel_red(struct rfid_asic_handle *handle, unsigned int frametype)
 {
-	int ret;
-	u_int8_t rxl;
 	u_int8_t channel_red;
 
-	if (*rx_len > 0xff)
-		rxl = 0xff;
-	else
-		rxl = *rx_len;
-
-	memset(rx_buf, 0, *rx_len);
-
 	switch (frametype) {
 	case RFID_14443A_FRAME_REGULAR:
 	case RFID_MIFARE_FRAME:
@@ -1059,8 +1212,29 @@ rc632_iso14443ab_transceive(struct rfid_asic_handle *handle,
 		return -EINVAL;
 		break;
 	}
-	ret = rc632_reg_write(handle, RC632_REG_CHANNEL_REDUNDANCY,
-			      channel_red);
+	return rc632_reg_write(handle, RC632_REG_CHANNEL_REDUNDANCY,
+			       channel_red);
+}
+
+/* transceive regular frame */
+static int
+rc632_iso14443ab_transceive(struct rfid_asic_handle *handle,
+			   unsigned int frametype,
+			   const u_int8_t *tx_buf, unsigned int tx_len,
+			   u_int8_t *rx_buf, unsigned int *rx_len,
+			   u_int64_t timeout, unsigned int flags)
+{
+	int ret;
+	u_int8_t rxl;
+
+	if (*rx_len > 0xff)
+		rxl = 0xff;
+	else
+		rxl = *rx_len;
+
+	memset(rx_buf, 0, *rx_len);
+
+	ret = rc632_set_channel_red(handle, frametype);
 	if (ret < 0)
 		return ret;
 	DEBUGP("tx_len=%u\n",tx_len);
@@ -1073,6 +1247,50 @@ rc632_iso14443ab_transceive(struct rfid_asic_handle *handle,
 	return 0; 
 }
 
+/* start transceiving a regular frame, without waiting for the response */
+static int
+rc632_iso14443ab_transceive_submit(struct rfid_asic_handle *handle,
+				   unsigned int frametype,
+				   const u_int8_t *tx_buf, unsigned int tx_len,
+				   u_int64_t timeout, unsigned int flags)
+{
+	int ret;
+
+	ret = rc632_set_channel_red(handle, frametype);
+	if (ret < 0)
+		return ret;
+
+	return rc632_transceive_start(handle, tx_buf, tx_len, timeout, 0);
+}
+
+/* check for the response of a submitted frame.  -EINPROGRESS if it has not
+ * been received yet */
+static int
+rc632_iso14443ab_transceive_complete(struct rfid_asic_handle *handle,
+				     u_int8_t *rx_buf, unsigned int *rx_len)
+{
+	int ret;
+	u_int8_t rxl;
+
+	ret = rc632_idle_timer_poll(handle);
+	if (ret < 0)
+		return ret;
+
+	if (*rx_len > 0xff)
+		rxl = 0xff;
+	else
+		rxl = *rx_len;
+
+	memset(rx_buf, 0, *rx_len);
+
+	ret = rc632_transceive_finish(handle, rx_buf, &rxl);
+	*rx_len = rxl;
+	if (ret < 0)
+		return ret;
+
+	return 0;
+}
+
 /* transceive anti collission bitframe */
 static int
 rc632_iso14443a_transceive_acf(struct rfid_asic_handle *handle,
@@ -1275,79 +1493,6 @@ static int rc632_iso14443a_set_speed(struct rfid_asic_handle *handle,
 	return 0;
 }
 
-#if 0
-static struct register_file iso14443b_script[] = {
-	{
-		.reg	= RC632_REG_TX_CONTROL,
-		.val	= (RC632_TXCTRL_TX1_RF_EN |
-			   RC632_TXCTRL_TX2_RF_EN |
-			   RC632_TXCTRL_TX2_INV |
-			   RC632_TXCTRL_MOD_SRC_INT),
-	}, {
-		.reg	= RC632_REG_CW_CONDUCTANCE,
-		.val	= 0x3f,
-	}, {
-		.reg	= RC632_REG_MOD_CONDUCTANCE,
-		.val	= 0x04,
-	}, {
-		.reg	= RC632_REG_CODER_CONTROL,
-		.val	= (RC632_CDRCTRL_TXCD_NRZ |
-			   RC632_CDRCTRL_RATE_14443B),
-	}, {
-		.reg	= RC632_REG_MOD_WIDTH,
-		.val	= 0x13,
-	}, {
-		.reg	= RC632_REG_MOD_WIDTH_SOF,
-		.val	= 0x3f,
-	}, {
-		.reg	= RC632_REG_TYPE_B_FRAMING,
-		.val	= (RC632_TBFRAMING_SOF_11L_3H |
-			   (6 << RC632_TBFRAMING_SPACE_SHIFT) |
-			   RC632_TBFRAMING_EOF_11);
-	}, {
-		.reg	= RC632_REG_RX_CONTROL1,
-		.val	= (RC632_RXCTRL1_GAIN_35DB |
-			   RC632_RXCTRL1_ISO14443,
-			   RC632_RXCTRL1_SUBCP_8),
-	}, {
-		.reg	= RC632_REG_DECODER_CONTROL,
-		.val	= (RC632_DECCTRL_BPSK |
-			   RC632_DECCTRL_RXFR_14443B),
-	}, {
-		.reg	= RC632_REG_BIT_PHASE,
-		.val	= CM5121_14443B_BITPHASE,
-	}, {
-		.reg	= RC632_REG_RX_THRESHOLD,
-		.val	= CM5121_14443B_THRESHOLD,
-	}, {
-		.reg	= RC632_REG_BPSK_DEM_CONTROL,
-		.val	= ((0x2 & RC632_BPSKD_TAUB_MASK)<<RC632_BPSKD_TAUB_SHIFT |
-			   (0x3 & RC632_BPSKD_TAUD_MASK)<<RC632_BPSKD_TAUD_SHIFT |
-			   RC632_BPSKD_FILTER_AMP_DETECT |
-			   RC632_BPSKD_NO_RX_EOF |
-			   RC632_BPSKD_NO_RX_EGT),
-	}, {
-		.reg	= RC632_REG_RX_CONTROL2,
-		.val	= (RC632_RXCTRL2_AUTO_PD |
-			   RC632_RXCTRL2_DECSRC_INT),
-	}, {
-		.reg	= RC632_REG_RX_WAIT,
-		.val	= 0x03,
-	}, {
-		.reg	= RC632_REG_CHANNEL_REDUNDANCY,
-		.val	= (RC632_CR_TX_CRC_ENABLE |
-			   RC632_CR_RX_CRC_ENABLE |
-			   RC632_CR_CRC3309),
-	}, {
-		.reg	= RC632_REG_CRC_PRESET_LSB,
-		.val	= 0xff,
-	}, { 
-		.reg	= RC632_REG_CRC_PRESET_MSB,
-		.val	= 0xff,
-	},
-};
-#endif
-
 static int rc632_iso14443b_init(struct rfid_asic_handle *handle)
 {
 	int ret;
@@ -1368,14 +1513,6 @@ static int rc632_iso14443b_init(struct rfid_asic_handle *handle)
 	if (ret < 0)
 		return ret;
 
-	ret = rc632_reg_write(handle, RC632_REG_CW_CONDUCTANCE, 0x3f);
-	if (ret < 0)
-		return ret;
-
-	ret = rc632_reg_write(handle, RC632_REG_MOD_CONDUCTANCE, 0x04);
-	if (ret < 0)
-		return ret;
-
 	ret = rc632_reg_write(handle, RC632_REG_CODER_CONTROL,
 			      (RC632_CDRCTRL_TXCD_NRZ |
 			       RC632_CDRCTRL_RATE_14443B));
@@ -1410,13 +1547,7 @@ static int rc632_iso14443b_init(struct rfid_asic_handle *handle)
 	if (ret < 0)
 		return ret;
 
-	ret = rc632_reg_write(handle, RC632_REG_BIT_PHASE,
-				CM5121_14443B_BITPHASE);
-	if (ret < 0)
-		return ret;
-
-	ret = rc632_reg_write(handle, RC632_REG_RX_THRESHOLD,
-				CM5121_14443B_THRESHOLD);
+	ret = rc632_tune(handle, &handle->priv.rc632.impl->iso14443b);
 	if (ret < 0)
 		return ret;
 
@@ -1435,10 +1566,6 @@ static int rc632_iso14443b_init(struct rfid_asic_handle *handle)
 	if (ret < 0)
 		return ret;
 
-	ret = rc632_reg_write(handle, RC632_REG_RX_WAIT, 0x03);
-	if (ret < 0)
-		return ret;
-
 	ret = rc632_reg_write(handle, RC632_REG_CHANNEL_REDUNDANCY,
 			      (RC632_CR_TX_CRC_ENABLE |
 			       RC632_CR_RX_CRC_ENABLE |
@@ -1471,14 +1598,6 @@ static struct register_file iso15693_fast_script[] = {
 			  RC632_TXCTRL_TX2_INV |
 			  RC632_TXCTRL_TX2_RF_EN |
 			  RC632_TXCTRL_TX1_RF_EN,
-	}, {
-		.reg	= RC632_REG_CW_CONDUCTANCE,
-		.val	= 0x3f,
-	}, {
-		.reg	= RC632_REG_MOD_CONDUCTANCE,
-		/* FIXME: nxp default for icode1/15693: 0x05 */
-		//.val	= 0x02,
-		.val	= 0x21,	/* omnikey */
 	}, {
 		.reg	= RC632_REG_CODER_CONTROL,
 		.val	= RC632_CDRCTRL_TXCD_15693_FAST |
@@ -1507,16 +1626,6 @@ static struct register_file iso15693_fast_script[] = {
 			  RC632_DECCTRL_RX_INVERT |
 			  RC632_DECCTRL_ZEROAFTERCOL |
 			  RC632_DECCTRL_RXFR_15693,
-	}, {
-		.reg	= RC632_REG_BIT_PHASE,
-		/* FIXME: nxp default for icode1/15693: 0x54 */
-		//.val	= 0x52,
-		.val	= 0xd0,	/* omnikey */
-	}, {
-		.reg	= RC632_REG_RX_THRESHOLD,
-		/* FIXME: nxp default for icode1/15693: 0x68 */
-		//.val	= 0x66,
-		.val	= 0xed,
 	}, {
 		.reg	= RC632_REG_BPSK_DEM_CONTROL,
 		.val	= 0x00,
@@ -1635,7 +1744,7 @@ rc632_iso15693_init(struct rfid_asic_handle *h)
 	if (ret < 0)
 		return ret;
 
-	return 0;
+	return rc632_tune(h, &h->priv.rc632.impl->iso15693);
 }
 
 static int
@@ -1922,6 +2031,12 @@ rc632_mifare_set_key(struct rfid_asic_handle *h, const u_int8_t *key)
 	if (ret < 0)
 		return ret;
 
+	/* still loaded from the last time, e.g. same key for the next sector */
+	if (h->priv.rc632.key_src == RC632_KEY_HOST &&
+	    !memcmp(h->priv.rc632.key, coded_key, sizeof(coded_key)))
+		return 0;
+	h->priv.rc632.key_src = RC632_KEY_NONE;
+
 	/* Terminate probably running command */
 	ret = rc632_reg_write(h, RC632_REG_COMMAND, RC632_CMD_IDLE);	
 	if (ret < 0)
@@ -1951,6 +2066,9 @@ rc632_mifare_set_key(struct rfid_asic_handle *h, const u_int8_t *key)
 	if (reg & RC632_ERR_FLAG_KEY_ERR)
 		return -EINVAL;
 
+	memcpy(h->priv.rc632.key, coded_key, sizeof(coded_key));
+	h->priv.rc632.key_src = RC632_KEY_HOST;
+
 	return 0;
 }
 
@@ -1964,6 +2082,11 @@ rc632_mifare_set_key_ee(struct rfid_asic_handle *h, unsigned int addr)
 	if (addr > 0xffff - RFID_MIFARE_KEY_CODED_LEN)
 		return -EINVAL;
 
+	if (h->priv.rc632.key_src == RC632_KEY_EE &&
+	    h->priv.rc632.key_ee_addr == addr)
+		return 0;
+	h->priv.rc632.key_src = RC632_KEY_NONE;
+
 	cmd_addr[0] = addr & 0xff;		/* LSB */
 	cmd_addr[1] = (addr >> 8) & 0xff;	/* MSB */
 
@@ -1997,12 +2120,200 @@ rc632_mifare_set_key_ee(struct rfid_asic_handle *h, unsigned int addr)
 	if (reg & RC632_ERR_FLAG_KEY_ERR)
 		return -EINVAL;
 
+	h->priv.rc632.key_ee_addr = addr;
+	h->priv.rc632.key_src = RC632_KEY_EE;
+
+	return 0;
+}
+
+#define RC632_E2_PAGE_LEN	16
+#define EE_KEY_AREA_LEN		(MIFARE_CL_EE_KEY_SLOTS * RFID_MIFARE_KEY_CODED_LEN)
+#define EE_KEY_AREA_PAGES	(EE_KEY_AREA_LEN / RC632_E2_PAGE_LEN)
+
+/* bit mask of the EEPROM pages a key slot spans */
+static u_int32_t ee_key_pages(unsigned int slot)
+{
+	unsigned int ofs = slot * RFID_MIFARE_KEY_CODED_LEN;
+
+	return (1U << (ofs / RC632_E2_PAGE_LEN)) |
+	       (1U << ((ofs + RFID_MIFARE_KEY_CODED_LEN - 1) / RC632_E2_PAGE_LEN));
+}
+
+/* bit mask of the key slots overlapping an EEPROM page */
+static u_int32_t ee_page_keys(unsigned int page)
+{
+	unsigned int first = page * RC632_E2_PAGE_LEN / RFID_MIFARE_KEY_CODED_LEN;
+	unsigned int last = ((page + 1) * RC632_E2_PAGE_LEN - 1) /
+						RFID_MIFARE_KEY_CODED_LEN;
+
+	return ((2U << last) - 1) & ~((1U << first) - 1);
+}
+
+/* write 'len' bytes at 'ofs' into the key area, split at page boundaries */
+static int
+rc632_write_ee_keys(struct rfid_asic_handle *h, unsigned int ofs,
+		    u_int8_t *data, unsigned int len)
+{
+	unsigned int cur;
+	int ret;
+
+	while (len) {
+		cur = RC632_E2_PAGE_LEN - ofs % RC632_E2_PAGE_LEN;
+		if (cur > len)
+			cur = len;
+
+		ret = rc632_write_eeprom(h, MIFARE_CL_EE_KEY_BASE + ofs,
+					 data, cur);
+		if (ret < 0) {
+			DEBUGP("writing %u bytes at 0x%03x failed: %d\n",
+			       cur, MIFARE_CL_EE_KEY_BASE + ofs, ret);
+			return ret;
+		}
+
+		ofs += cur;
+		data += cur;
+		len -= cur;
+	}
+
 	return 0;
 }
 
+/* The key area of the EEPROM is write-only, ReadE2 fails with AccessErr
+ * there.  So what is in it is only known for the slots this handle wrote,
+ * and those are the only ones skipped if the key is unchanged.
+ *
+ * Keys are 12 bytes, the EEPROM is written in 16 byte pages.  A page
+ * whose every slot is known, from this table or from before, is written
+ * whole and only once.  Other keys are written on their own, in one
+ * partial write per page they span.  Every written slot is then checked
+ * with a LoadKeyE2, which fails with KeyErr unless the slot holds a
+ * correctly coded key.  That catches a failed write, but can't tell one
+ * valid key from another. */
 static int
-rc632_mifare_auth(struct rfid_asic_handle *h, u_int8_t cmd, u_int32_t serno,
-		  u_int8_t block)
+rc632_mifare_load_keys_ee(struct rfid_asic_handle *h, struct mfcl_ee_key *keys,
+			  unsigned int num)
+{
+	struct rfid_asic_rc632_handle *rc = &h->priv.rc632;
+	u_int8_t new[EE_KEY_AREA_LEN];
+	u_int32_t known = rc->ee_keys_known, dirty = 0, whole = 0;
+	u_int32_t failed_pages = 0;
+	unsigned int i, page, slot, ofs;
+	int ret, err = 0, werr = 0;
+
+	memcpy(new, rc->ee_keys, sizeof(new));
+
+	for (i = 0; i < num; i++) {
+		u_int8_t coded[RFID_MIFARE_KEY_CODED_LEN];
+
+		slot = keys[i].slot;
+		if (slot >= MIFARE_CL_EE_KEY_SLOTS) {
+			keys[i].status = -EINVAL;
+			continue;
+		}
+		ofs = slot * RFID_MIFARE_KEY_CODED_LEN;
+		rc632_mifare_transform_key(keys[i].key, coded);
+
+		if (rc->ee_keys_known & (1U << slot) &&
+		    !memcmp(rc->ee_keys[slot], coded, sizeof(coded)) &&
+		    !(dirty & (1U << slot))) {
+			keys[i].status = MIFARE_CL_EE_KEY_UNCHANGED;
+			continue;
+		}
+
+		memcpy(new + ofs, coded, sizeof(coded));
+		known |= 1U << slot;
+		dirty |= 1U << slot;
+		keys[i].status = MIFARE_CL_EE_KEY_WRITTEN;
+	}
+
+	if (!dirty)
+		goto out;
+
+	ret = rc632_reg_write(h, RC632_REG_COMMAND, RC632_CMD_IDLE);
+	if (ret < 0)
+		return ret;
+
+	/* a LoadKeyE2 from one of these slots would be stale now */
+	if (rc->key_src == RC632_KEY_EE)
+		rc->key_src = RC632_KEY_NONE;
+
+	for (page = 0; page < EE_KEY_AREA_PAGES; page++) {
+		if ((ee_page_keys(page) & known) == ee_page_keys(page))
+			whole |= 1U << page;
+	}
+
+	for (page = 0; page < EE_KEY_AREA_PAGES; page++) {
+		if (!(whole & (1U << page) && ee_page_keys(page) & dirty))
+			continue;
+		ofs = page * RC632_E2_PAGE_LEN;
+		ret = rc632_write_ee_keys(h, ofs, new + ofs, RC632_E2_PAGE_LEN);
+		if (ret < 0) {
+			failed_pages |= 1U << page;
+			if (!werr)
+				werr = ret;
+		}
+	}
+
+	for (slot = 0; slot < MIFARE_CL_EE_KEY_SLOTS; slot++) {
+		if (!(dirty & (1U << slot)) ||
+		    (ee_key_pages(slot) & whole) == ee_key_pages(slot))
+			continue;
+		ofs = slot * RFID_MIFARE_KEY_CODED_LEN;
+		ret = rc632_write_ee_keys(h, ofs, new + ofs,
+					  RFID_MIFARE_KEY_CODED_LEN);
+		if (ret < 0) {
+			failed_pages |= ee_key_pages(slot);
+			if (!werr)
+				werr = ret;
+		}
+	}
+
+	/* a failed write may have left any slot of its pages half written */
+	for (page = 0; page < EE_KEY_AREA_PAGES; page++) {
+		if (failed_pages & (1U << page))
+			rc->ee_keys_known &= ~ee_page_keys(page);
+	}
+
+	for (slot = 0; slot < MIFARE_CL_EE_KEY_SLOTS; slot++) {
+		if (!(dirty & (1U << slot)))
+			continue;
+
+		rc->ee_keys_known &= ~(1U << slot);
+		if (failed_pages & ee_key_pages(slot))
+			ret = werr;
+		else {
+			ret = rc632_mifare_set_key_ee(h,
+						MIFARE_CL_EE_KEY_ADDR(slot));
+			if (ret == -EINVAL)
+				ret = -EIO;	/* KeyErr */
+		}
+
+		if (ret == 0) {
+			ofs = slot * RFID_MIFARE_KEY_CODED_LEN;
+			memcpy(rc->ee_keys[slot], new + ofs,
+			       RFID_MIFARE_KEY_CODED_LEN);
+			rc->ee_keys_known |= 1U << slot;
+		}
+
+		for (i = 0; i < num; i++) {
+			if (keys[i].slot == slot &&
+			    keys[i].status == MIFARE_CL_EE_KEY_WRITTEN && ret < 0)
+				keys[i].status = ret;
+		}
+	}
+
+out:
+	for (i = 0; i < num && !err; i++)
+		if (keys[i].status < 0)
+			err = keys[i].status;
+
+	return err;
+}
+
+/* AUTHENT1 + AUTHENT2 with the key loaded before */
+static int
+rc632_mifare_authent(struct rfid_asic_handle *h, u_int8_t cmd,
+		     u_int32_t serno, u_int8_t block)
 {
 	int ret;
 	struct mifare_authcmd acmd;
@@ -2096,6 +2407,20 @@ rc632_mifare_auth(struct rfid_asic_handle *h, u_int8_t cmd, u_int32_t serno,
 	return 0;
 }
 
+static int
+rc632_mifare_auth(struct rfid_asic_handle *h, u_int8_t cmd, u_int32_t serno,
+		  u_int8_t block)
+{
+	int ret;
+
+	RFID_PROBE4(rc632__mifare_auth__entry, h, cmd, serno, block);
+	h->priv.rc632.err_flags = 0;
+	ret = rc632_mifare_authent(h, cmd, serno, block);
+	RFID_PROBE3(rc632__mifare_auth__return, h, cmd, ret);
+
+	return ret;
+}
+
 /* transceive regular frame */
 static int
 rc632_mifare_transceive(struct rfid_asic_handle *handle,
@@ -2157,6 +2482,8 @@ const struct rfid_asic rc632 = {
 			.power = &rc632_power,
 			.rf_power = &rc632_rf_power,
 			.transceive = &rc632_iso14443ab_transceive,
+			.transceive_submit = &rc632_iso14443ab_transceive_submit,
+			.transceive_complete = &rc632_iso14443ab_transceive_complete,
 			.init = &rc632_layer2_init,
 			.iso14443a = {
 				.transceive_sf = &rc632_iso14443a_transceive_sf,
@@ -2169,6 +2496,7 @@ const struct rfid_asic rc632 = {
 			.mifare_classic = {
 				.setkey = &rc632_mifare_set_key,
 				.setkey_ee = &rc632_mifare_set_key_ee,
+				.load_keys_ee = &rc632_mifare_load_keys_ee,
 				.auth = &rc632_mifare_auth,
 			},
 		},
@@ -0,0 +1,332 @@
+/* librfid - asynchronous transceive
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+
+/* None of the readers gives us something to wait on: libusb-0.1 has no
+ * pollable descriptors, and the RC632 IRQ pin isn't wired to the host.  So
+ * the reader fd is a timerfd and the chip is still polled, but paced by
+ * the frame timeout instead of every millisecond: first after a fraction
+ * of it, then at doubling intervals up to the timeout itself.  A quick
+ * answer is picked up after a short delay, and a frame that takes its
+ * full timeout costs a few polls instead of one per millisecond. */
+#define RFID_ASYNC_POLL_STEPS		8	/* first poll at timeout/8 */
+#define RFID_ASYNC_POLL_MIN_USEC	250
+
+/* the event thread waits in slices this long, to notice when it is
+ * stopped */
+#define RFID_EVENT_WAIT_MS	100
+
+static struct rfid_reader_async *reader_async(struct rfid_reader_handle *rh)
+{
+	struct rfid_reader_async *ra = rh->async;
+
+	if (ra)
+		return ra;
+
+	ra = malloc(sizeof(*ra));
+	if (!ra)
+		return NULL;
+	memset(ra, 0, sizeof(*ra));
+
+	ra->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (ra->fd < 0) {
+		free(ra);
+		return NULL;
+	}
+	ra->event_fd = -1;
+
+	rh->async = ra;
+
+	return ra;
+}
+
+/* schedule the next poll of the reader, ra->poll usec from now */
+static void reader_async_arm(struct rfid_reader_async *ra)
+{
+	struct itimerspec its;
+
+	if (ra->poll < RFID_ASYNC_POLL_MIN_USEC)
+		ra->poll = RFID_ASYNC_POLL_MIN_USEC;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = ra->poll / 1000000;
+	its.it_value.tv_nsec = (ra->poll % 1000000) * 1000;
+
+	timerfd_settime(ra->fd, 0, &its, NULL);
+}
+
+void rfid_reader_async_fini(struct rfid_reader_handle *rh)
+{
+	struct rfid_reader_async *ra = rh->async;
+
+	if (!ra)
+		return;
+
+	if (ra->event_fd >= 0) {
+		__atomic_store_n(&ra->event_stop, 1, __ATOMIC_RELEASE);
+		pthread_join(ra->event_thread, NULL);
+		close(ra->event_fd);
+	}
+
+	close(rh->async->fd);
+	free(rh->async);
+	rh->async = NULL;
+}
+
+int rfid_reader_get_fd(struct rfid_reader_handle *rh)
+{
+	struct rfid_reader_async *ra = reader_async(rh);
+
+	if (!ra)
+		return -ENOMEM;
+
+	return ra->fd;
+}
+
+static void *reader_event_thread(void *arg)
+{
+	struct rfid_reader_handle *rh = arg;
+	struct rfid_reader_async *ra = rh->async;
+	u_int64_t one = 1;
+	int ret;
+
+	while (!__atomic_load_n(&ra->event_stop, __ATOMIC_ACQUIRE)) {
+		ret = rh->reader->wait_event(rh, RFID_EVENT_WAIT_MS);
+		if (ret < 0) {
+			/* don't spin on a reader that went away */
+			usleep(RFID_EVENT_WAIT_MS * 1000);
+			continue;
+		}
+		if (!ret)
+			continue;
+
+		__atomic_fetch_or(&ra->events, ret, __ATOMIC_RELEASE);
+		if (write(ra->event_fd, &one, sizeof(one)) != sizeof(one)) {
+			/* the bits stay pending and go out with the next
+			 * event that can be signalled */
+			DEBUGP("can't signal reader event: %s\n",
+				strerror(errno));
+		}
+	}
+
+	return NULL;
+}
+
+int rfid_reader_get_event_fd(struct rfid_reader_handle *rh)
+{
+	struct rfid_reader_async *ra;
+	int ret;
+
+	if (!rh->reader->wait_event)
+		return -ENOTSUP;
+
+	ra = reader_async(rh);
+	if (!ra)
+		return -ENOMEM;
+	if (ra->event_fd >= 0)
+		return ra->event_fd;
+
+	/* Not every backend of a reader can wait (CM5121 via OpenCT), so
+	 * ask once before starting a thread that would wait for nothing.
+	 * Anything this already picked up is pending right away. */
+	ret = rh->reader->wait_event(rh, 0);
+	if (ret < 0)
+		return ret;
+	ra->events = ret;
+
+	ret = eventfd(ra->events ? 1 : 0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ret < 0)
+		return -errno;
+	ra->event_fd = ret;
+	ra->event_stop = 0;
+
+	ret = pthread_create(&ra->event_thread, NULL, &reader_event_thread, rh);
+	if (ret) {
+		close(ra->event_fd);
+		ra->event_fd = -1;
+		return -ret;
+	}
+
+	return ra->event_fd;
+}
+
+int rfid_reader_read_events(struct rfid_reader_handle *rh)
+{
+	struct rfid_reader_async *ra = rh->async;
+	u_int64_t cnt;
+
+	if (!ra || ra->event_fd < 0)
+		return 0;
+
+	/* nothing to consume if the event thread couldn't signal, the
+	 * pending bits are returned all the same */
+	if (read(ra->event_fd, &cnt, sizeof(cnt)) != sizeof(cnt) &&
+	    errno != EAGAIN)
+		DEBUGP("can't consume reader event: %s\n", strerror(errno));
+
+	return __atomic_exchange_n(&ra->events, 0, __ATOMIC_ACQUIRE);
+}
+
+int rfid_reader_process_events(struct rfid_reader_handle *rh)
+{
+	struct rfid_reader_async *ra = rh->async;
+	rfid_async_cont *cont;
+	u_int64_t expired;
+	int ret;
+
+	if (!ra)
+		return 0;
+
+	/* called before the timer expired, the reader is just polled early */
+	if (read(ra->fd, &expired, sizeof(expired)) != sizeof(expired) &&
+	    errno != EAGAIN)
+		DEBUGP("can't read poll timer: %s\n", strerror(errno));
+
+	if (!ra->busy)
+		return 0;
+
+	ret = rh->reader->transceive_complete(rh, ra->rx_buf, &ra->rx_len);
+	if (ret == -EINPROGRESS) {
+		ra->poll *= 2;
+		if (ra->poll > ra->timeout)
+			ra->poll = ra->timeout;
+		reader_async_arm(ra);
+		return 0;
+	}
+
+	ra->busy = 0;
+	ra->status = ret;
+
+	cont = ra->cont;
+	if (cont) {
+		ra->cont = NULL;
+		cont(ret, ra->rx_len, ra->cont_data);
+		/* next frame of the exchange is on its way */
+		if (ra->busy)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Start a frame on the reader of 'l2h'.  'cont' (may be NULL) is called
+ * when the response has been received. */
+int rfid_layer2_async_submit(struct rfid_layer2_handle *l2h,
+			     enum rfid_frametype frametype,
+			     const unsigned char *tx_buf, unsigned int tx_len,
+			     unsigned char *rx_buf, unsigned int rx_len,
+			     u_int64_t timeout, unsigned int flags,
+			     rfid_async_cont *cont, void *data)
+{
+	struct rfid_reader_handle *rh = l2h->rh;
+	struct rfid_reader_async *ra;
+	int ret;
+
+	/* all layer2 transceive() functions hand the frame to the reader
+	 * unmodified, so there is nothing layer2 specific to do here */
+	if (!l2h->l2->fn.transceive)
+		return -EIO;
+	if (!rh->reader->transceive_submit)
+		return -ENOTSUP;
+
+	ra = reader_async(rh);
+	if (!ra)
+		return -ENOMEM;
+	if (ra->busy)
+		return -EBUSY;
+
+	ret = rh->reader->transceive_submit(rh, frametype, tx_buf, tx_len,
+					    timeout, flags);
+	if (ret < 0)
+		return ret;
+
+	ra->busy = 1;
+	ra->status = -EINPROGRESS;
+	ra->rx_buf = rx_buf;
+	ra->rx_len = rx_len;
+	ra->cont = cont;
+	ra->cont_data = data;
+
+	ra->timeout = timeout;
+	ra->poll = timeout / RFID_ASYNC_POLL_STEPS;
+	reader_async_arm(ra);
+
+	return 0;
+}
+
+int rfid_layer2_transceive_submit(struct rfid_layer2_handle *l2h,
+				  enum rfid_frametype frametype,
+				  const unsigned char *tx_buf,
+				  unsigned int tx_len,
+				  unsigned char *rx_buf, unsigned int rx_len,
+				  u_int64_t timeout, unsigned int flags)
+{
+	return rfid_layer2_async_submit(l2h, frametype, tx_buf, tx_len,
+					rx_buf, rx_len, timeout, flags,
+					NULL, NULL);
+}
+
+int rfid_layer2_transceive_complete(struct rfid_layer2_handle *l2h,
+				    unsigned int *rx_len)
+{
+	struct rfid_reader_async *ra = l2h->rh->async;
+
+	if (!ra)
+		return -EINVAL;
+	if (ra->busy)
+		return -EINPROGRESS;
+
+	*rx_len = ra->rx_len;
+
+	return ra->status;
+}
+
+int rfid_protocol_transceive_submit(struct rfid_protocol_handle *ph,
+				    const unsigned char *tx_buf,
+				    unsigned int tx_len,
+				    unsigned char *rx_buf, unsigned int rx_len,
+				    unsigned int timeout, unsigned int flags)
+{
+	if (!ph->proto->fn.transceive_submit)
+		return -ENOTSUP;
+
+	return ph->proto->fn.transceive_submit(ph, tx_buf, tx_len, rx_buf,
+					       rx_len, timeout, flags);
+}
+
+int rfid_protocol_transceive_complete(struct rfid_protocol_handle *ph,
+				      unsigned int *rx_len)
+{
+	if (!ph->proto->fn.transceive_complete)
+		return -ENOTSUP;
+
+	return ph->proto->fn.transceive_complete(ph, rx_len);
+}
@@ -0,0 +1,158 @@
+/* librfid - packet buffer handling
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_buf.h>
+
+/* The pool is per thread, so a buffer has to be freed by the thread that
+ * allocated it.  rfid_buf_free() refuses pool buffers of other threads. */
+static __rfid_tls struct rfid_buf rfid_buf_pool[RFID_BUF_POOL_SIZE];
+static __rfid_tls struct rfid_buf *rfid_buf_freelist;
+static __rfid_tls int rfid_buf_pool_initialized;
+
+static inline int rfid_buf_pool_owns(struct rfid_buf *b)
+{
+	return b >= rfid_buf_pool && b < rfid_buf_pool + RFID_BUF_POOL_SIZE;
+}
+
+static void rfid_buf_pool_init(void)
+{
+	int i;
+
+	for (i = 0; i < RFID_BUF_POOL_SIZE; i++) {
+		rfid_buf_pool[i].flags = RFID_BUF_F_POOL;
+		rfid_buf_pool[i].next = rfid_buf_freelist;
+		rfid_buf_freelist = &rfid_buf_pool[i];
+	}
+	rfid_buf_pool_initialized = 1;
+}
+
+/* get an empty buffer with RFID_BUF_HEADROOM already reserved */
+struct rfid_buf *rfid_buf_alloc(void)
+{
+	struct rfid_buf *b;
+
+	if (!rfid_buf_pool_initialized)
+		rfid_buf_pool_init();
+
+	b = rfid_buf_freelist;
+	if (b)
+		rfid_buf_freelist = b->next;
+	else {
+#ifdef LIBRFID_STATIC
+		DEBUGP("rfid_buf pool exhausted\n");
+		return NULL;
+#else
+		b = malloc(sizeof(*b));
+		if (!b)
+			return NULL;
+		b->flags = RFID_BUF_F_HEAP;
+#endif
+	}
+
+	b->next = NULL;
+	rfid_buf_init(b);
+	rfid_buf_reserve(b, RFID_BUF_HEADROOM);
+
+	return b;
+}
+
+void rfid_buf_free(struct rfid_buf *b)
+{
+	if (!b)
+		return;
+
+	if (b->flags & RFID_BUF_F_POOL) {
+		/* it would end up in our pool, and be used by two threads
+		 * at once.  Better leak it */
+		if (!rfid_buf_pool_owns(b)) {
+			DEBUGP("rfid_buf %p of another thread\n", b);
+			return;
+		}
+		b->next = rfid_buf_freelist;
+		rfid_buf_freelist = b;
+	}
+#ifndef LIBRFID_STATIC
+	else if (b->flags & RFID_BUF_F_HEAP)
+		free(b);
+#endif
+}
+
+/* (re-)initialize a buffer to be empty, without any headroom */
+void rfid_buf_init(struct rfid_buf *b)
+{
+	b->data = b->tail = b->head;
+}
+
+/* reserve headroom in an empty buffer */
+void rfid_buf_reserve(struct rfid_buf *b, unsigned int len)
+{
+	if (len > rfid_buf_tailroom(b))
+		len = rfid_buf_tailroom(b);
+
+	b->data += len;
+	b->tail += len;
+}
+
+/* prepend len bytes of header, returns pointer to it */
+unsigned char *rfid_buf_push(struct rfid_buf *b, unsigned int len)
+{
+	if (len > rfid_buf_headroom(b)) {
+		DEBUGP("not enough headroom (%u < %u)\n",
+			rfid_buf_headroom(b), len);
+		return NULL;
+	}
+
+	b->data -= len;
+	return b->data;
+}
+
+/* strip len bytes of header, returns pointer to the new start of data */
+unsigned char *rfid_buf_pull(struct rfid_buf *b, unsigned int len)
+{
+	if (len > rfid_buf_len(b))
+		return NULL;
+
+	b->data += len;
+	return b->data;
+}
+
+/* append len bytes of data, returns pointer to them */
+unsigned char *rfid_buf_put(struct rfid_buf *b, unsigned int len)
+{
+	unsigned char *tmp = b->tail;
+
+	if (len > rfid_buf_tailroom(b)) {
+		DEBUGP("not enough tailroom (%u < %u)\n",
+			rfid_buf_tailroom(b), len);
+		return NULL;
+	}
+
+	b->tail += len;
+	return tmp;
+}
+
+/* cut the buffer down to len bytes of data */
+void rfid_buf_trim(struct rfid_buf *b, unsigned int len)
+{
+	if (len < rfid_buf_len(b))
+		b->tail = b->data + len;
+}
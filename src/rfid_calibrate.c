@@ -0,0 +1,256 @@
+/* librfid - ISO14443A antenna auto-calibration
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef LIBRFID_FIRMWARE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_layer2_iso14443a.h>
+#include <librfid/rfid_calibrate.h>
+
+enum calib_param {
+	CALIB_BITPHASE,
+	CALIB_THRESHOLD,
+	CALIB_MOD_CONDUCTANCE,
+	CALIB_NUM_PARAMS,
+};
+
+/* number of candidates and the i-th one; the threshold sweep only moves
+ * MinLevel (high nibble), CollLevel stays as it was */
+static unsigned int calib_num(enum calib_param p)
+{
+	switch (p) {
+	case CALIB_BITPHASE:
+		return 16;
+	case CALIB_THRESHOLD:
+		return 12;
+	case CALIB_MOD_CONDUCTANCE:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static void calib_set(struct rfid_reader_tuning *t, enum calib_param p,
+		      unsigned int i)
+{
+	switch (p) {
+	case CALIB_BITPHASE:
+		t->bitphase = 0x80 + i * 8;
+		break;
+	case CALIB_THRESHOLD:
+		t->threshold = ((4 + i) << 4) | (t->threshold & 0x0f);
+		break;
+	case CALIB_MOD_CONDUCTANCE:
+		t->mod_conductance = 0x3f - i * 8;
+		break;
+	default:
+		break;
+	}
+}
+
+static int calib_better(const struct rfid_calib_result *a,
+			const struct rfid_calib_result *b)
+{
+	if (a->ok != b->ok)
+		return a->ok > b->ok;
+	return a->ok && a->latency < b->latency;
+}
+
+static int calib_try(struct rfid_reader_handle *rh, unsigned int rounds,
+		     struct rfid_calib_result *res)
+{
+	struct rfid_layer2_handle *l2h;
+	struct timeval start, end;
+	unsigned long usec = 0;
+	unsigned int i, wupa = 1;
+	int ret;
+
+	ret = rfid_reader_setopt(rh, RFID_OPT_RDR_TUNING, &res->tuning,
+				 sizeof(res->tuning));
+	if (ret < 0)
+		return ret;
+
+	/* applies the tuning */
+	l2h = rfid_layer2_init(rh, RFID_LAYER2_ISO14443A);
+	if (!l2h)
+		return -EIO;
+
+	/* the card is halted after every round */
+	rfid_layer2_setopt(l2h, RFID_OPT_14443A_WUPA, &wupa, sizeof(wupa));
+
+	res->rounds = rounds;
+	res->ok = 0;
+	for (i = 0; i < rounds; i++) {
+		gettimeofday(&start, NULL);
+		ret = rfid_layer2_open(l2h);
+		gettimeofday(&end, NULL);
+		if (ret < 0)
+			continue;
+		rfid_layer2_close(l2h);
+
+		res->ok++;
+		usec += (end.tv_sec - start.tv_sec) * 1000000 +
+			end.tv_usec - start.tv_usec;
+	}
+	res->latency = res->ok ? usec / res->ok : 0;
+
+	rfid_layer2_fini(l2h);
+
+	return 0;
+}
+
+int rfid_reader_calibrate(struct rfid_reader_handle *rh, unsigned int rounds,
+			  struct rfid_calib_result *best,
+			  void (*cb)(const struct rfid_calib_result *res,
+				     void *data),
+			  void *data)
+{
+	struct rfid_reader_tuning orig;
+	struct rfid_calib_result res;
+	unsigned int optlen = sizeof(orig);
+	enum calib_param p;
+	unsigned int i;
+	int ret;
+
+	if (!rounds)
+		return -EINVAL;
+
+	ret = rfid_reader_getopt(rh, RFID_OPT_RDR_TUNING, &orig, &optlen);
+	if (ret < 0)
+		return ret;
+
+	memset(best, 0, sizeof(*best));
+	best->tuning = orig;
+
+	for (p = 0; p < CALIB_NUM_PARAMS; p++) {
+		/* sweep one parameter around the best of the others */
+		res.tuning = best->tuning;
+		for (i = 0; i < calib_num(p); i++) {
+			calib_set(&res.tuning, p, i);
+			ret = calib_try(rh, rounds, &res);
+			if (ret < 0)
+				goto out_restore;
+			if (cb)
+				cb(&res, data);
+			if (calib_better(&res, best))
+				*best = res;
+		}
+	}
+
+	if (!best->ok) {
+		ret = -ENOENT;
+		goto out_restore;
+	}
+
+	return rfid_reader_setopt(rh, RFID_OPT_RDR_TUNING, &best->tuning,
+				  sizeof(best->tuning));
+
+out_restore:
+	rfid_reader_setopt(rh, RFID_OPT_RDR_TUNING, &orig, sizeof(orig));
+	return ret;
+}
+
+int rfid_reader_tuning_save(struct rfid_reader_handle *rh, const char *path)
+{
+	struct rfid_reader_tuning t;
+	unsigned int optlen = sizeof(t);
+	FILE *f;
+	int ret;
+
+	ret = rfid_reader_getopt(rh, RFID_OPT_RDR_TUNING, &t, &optlen);
+	if (ret < 0)
+		return ret;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+
+	fprintf(f, "# librfid ISO14443A tuning, see rfid_reader_calibrate()\n"
+		   "mod_conductance 0x%02x\n"
+		   "bitphase 0x%02x\n"
+		   "threshold 0x%02x\n",
+		t.mod_conductance, t.bitphase, t.threshold);
+
+	if (ferror(f)) {
+		fclose(f);
+		return -EIO;
+	}
+	if (fclose(f))
+		return -errno;
+
+	return 0;
+}
+
+int rfid_reader_tuning_load(struct rfid_reader_handle *rh, const char *path)
+{
+	struct rfid_reader_tuning t;
+	unsigned int optlen = sizeof(t);
+	char line[80], name[32];
+	int val;
+	FILE *f;
+	int ret;
+
+	ret = rfid_reader_getopt(rh, RFID_OPT_RDR_TUNING, &t, &optlen);
+	if (ret < 0)
+		return ret;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+
+	while (fgets(line, sizeof(line), f)) {
+		char *c = strchr(line, '#');
+
+		if (c)
+			*c = '\0';
+		if (sscanf(line, "%31s", name) != 1)
+			continue;
+		if (sscanf(line, "%31s %i", name, &val) != 2 ||
+		    val < 0 || val > 0xff) {
+			DEBUGP("bad tuning line `%s'\n", line);
+			goto out_inval;
+		}
+
+		if (!strcmp(name, "mod_conductance"))
+			t.mod_conductance = val;
+		else if (!strcmp(name, "bitphase"))
+			t.bitphase = val;
+		else if (!strcmp(name, "threshold"))
+			t.threshold = val;
+		else {
+			DEBUGP("unknown tuning `%s'\n", name);
+			goto out_inval;
+		}
+	}
+	fclose(f);
+
+	return rfid_reader_setopt(rh, RFID_OPT_RDR_TUNING, &t, sizeof(t));
+
+out_inval:
+	fclose(f);
+	return -EINVAL;
+}
+
+#endif /* LIBRFID_FIRMWARE */
@@ -0,0 +1,365 @@
+/* librfid - pcapng capture of RF frames
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_capture.h>
+
+/* every buffer holds this many bytes of pcapng blocks */
+#define CAPTURE_BUF_SIZE	65536
+
+#define PCAPNG_SHB		0x0a0d0d0a
+#define PCAPNG_IDB		0x00000001
+#define PCAPNG_ISB		0x00000005
+#define PCAPNG_EPB		0x00000006
+#define PCAPNG_BOM		0x1a2b3c4d
+
+#define PCAPNG_OPT_END		0
+#define PCAPNG_IF_NAME		2
+#define PCAPNG_IF_DESCRIPTION	3
+#define PCAPNG_IF_TSRESOL	9
+#define PCAPNG_EPB_FLAGS	2
+#define PCAPNG_ISB_IFDROP	5
+
+#define PCAPNG_EPB_F_INBOUND	0x1
+#define PCAPNG_EPB_F_OUTBOUND	0x2
+
+#define PAD4(x)			(((x) + 3) & ~3)
+
+struct capture_buf {
+	unsigned char *data;
+	unsigned int len;
+};
+
+struct rfid_capture {
+	int fd;
+	int error;			/* first write error */
+	u_int64_t drops;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int stopping:1;
+
+	/* filled by the RF path, swapped with 'out' by the writer */
+	struct capture_buf in, out;
+
+	unsigned int iso14443a_kbps[2];	/* [tx] */
+	unsigned int tx_frametype;
+};
+
+static unsigned char *put_u16(unsigned char *p, u_int16_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static unsigned char *put_u32(unsigned char *p, u_int32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static unsigned char *put_opt(unsigned char *p, u_int16_t code,
+			      const void *val, u_int16_t len)
+{
+	p = put_u16(p, code);
+	p = put_u16(p, len);
+	memcpy(p, val, len);
+	memset(p + len, 0, PAD4(len) - len);
+	return p + PAD4(len);
+}
+
+static u_int64_t capture_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/* section header and the one interface, written synchronously */
+static int capture_write_header(int fd, const char *reader)
+{
+	unsigned char buf[256], *p = buf;
+	u_int8_t tsresol = 9;		/* nanoseconds */
+	unsigned int len, rlen = reader ? strlen(reader) : 0;
+
+	if (rlen > 128)
+		rlen = 128;
+
+	/* section header block */
+	p = put_u32(p, PCAPNG_SHB);
+	p = put_u32(p, 28);
+	p = put_u32(p, PCAPNG_BOM);
+	p = put_u16(p, 1);
+	p = put_u16(p, 0);
+	p = put_u32(p, 0xffffffff);	/* section length unknown */
+	p = put_u32(p, 0xffffffff);
+	p = put_u32(p, 28);
+
+	/* interface description block */
+	len = 20 + 4 + PAD4(strlen("librfid")) + 8 + 4;
+	if (rlen)
+		len += 4 + PAD4(rlen);
+	p = put_u32(p, PCAPNG_IDB);
+	p = put_u32(p, len);
+	p = put_u16(p, RFID_CAPTURE_LINKTYPE);
+	p = put_u16(p, 0);
+	p = put_u32(p, 0);		/* no snaplen */
+	p = put_opt(p, PCAPNG_IF_NAME, "librfid", strlen("librfid"));
+	if (rlen)
+		p = put_opt(p, PCAPNG_IF_DESCRIPTION, reader, rlen);
+	p = put_opt(p, PCAPNG_IF_TSRESOL, &tsresol, 1);
+	p = put_u32(p, PCAPNG_OPT_END);
+	p = put_u32(p, len);
+
+	return write_all(fd, buf, p - buf);
+}
+
+static void *capture_thread(void *arg)
+{
+	struct rfid_capture *cap = arg;
+	struct capture_buf tmp;
+	int ret;
+
+	pthread_mutex_lock(&cap->lock);
+	while (1) {
+		while (!cap->in.len && !cap->stopping)
+			pthread_cond_wait(&cap->cond, &cap->lock);
+		if (!cap->in.len)
+			break;
+
+		tmp = cap->out;
+		cap->out = cap->in;
+		cap->in = tmp;
+		pthread_mutex_unlock(&cap->lock);
+
+		ret = write_all(cap->fd, cap->out.data, cap->out.len);
+		cap->out.len = 0;
+
+		pthread_mutex_lock(&cap->lock);
+		if (ret < 0 && !cap->error)
+			cap->error = ret;
+	}
+	pthread_mutex_unlock(&cap->lock);
+
+	return NULL;
+}
+
+static unsigned int capture_kbps(struct rfid_capture *cap, unsigned int dir,
+				 unsigned int frametype)
+{
+	switch (frametype) {
+	case RFID_14443A_FRAME_REGULAR:
+	case RFID_MIFARE_FRAME:
+		return cap->iso14443a_kbps[dir == RFID_CAPTURE_PCD_TO_PICC];
+	case RFID_14443B_FRAME_REGULAR:
+		return 106;
+	case RFID_15693_FRAME:
+		return 26;
+	default:
+		return 0;
+	}
+}
+
+void __rfid_capture(struct rfid_capture *cap, unsigned int dir,
+		    unsigned int event, unsigned int frametype, int status,
+		    unsigned int flags, const void *data, unsigned int len)
+{
+	struct rfid_capture_hdr hdr;
+	unsigned int caplen = sizeof(hdr) + len;
+	unsigned int blen = 28 + PAD4(caplen) + 8 + 4 + 4;
+	u_int64_t ts = capture_now();
+	unsigned char *p;
+
+	if (dir == RFID_CAPTURE_PCD_TO_PICC)
+		cap->tx_frametype = frametype;
+	else if (frametype == RFID_CAPTURE_FRAMETYPE_TX)
+		frametype = cap->tx_frametype;
+
+	hdr.version = RFID_CAPTURE_VERSION;
+	hdr.dir = dir;
+	hdr.event = event;
+	hdr.frametype = frametype;
+	hdr.kbps = htons(capture_kbps(cap, dir, frametype));
+	hdr.flags = flags;
+	hdr.reserved = 0;
+	hdr.status = htonl(status);
+
+	pthread_mutex_lock(&cap->lock);
+	if (cap->stopping || cap->error ||
+	    cap->in.len + blen > CAPTURE_BUF_SIZE) {
+		cap->drops++;
+		pthread_mutex_unlock(&cap->lock);
+		return;
+	}
+
+	p = cap->in.data + cap->in.len;
+	p = put_u32(p, PCAPNG_EPB);
+	p = put_u32(p, blen);
+	p = put_u32(p, 0);		/* interface */
+	p = put_u32(p, ts >> 32);
+	p = put_u32(p, ts);
+	p = put_u32(p, caplen);
+	p = put_u32(p, caplen);
+	memcpy(p, &hdr, sizeof(hdr));
+	if (len)
+		memcpy(p + sizeof(hdr), data, len);
+	memset(p + caplen, 0, PAD4(caplen) - caplen);
+	p += PAD4(caplen);
+	p = put_u16(p, PCAPNG_EPB_FLAGS);
+	p = put_u16(p, 4);
+	p = put_u32(p, dir == RFID_CAPTURE_PCD_TO_PICC ?
+			PCAPNG_EPB_F_OUTBOUND : PCAPNG_EPB_F_INBOUND);
+	p = put_u32(p, PCAPNG_OPT_END);
+	p = put_u32(p, blen);
+
+	if (!cap->in.len)
+		pthread_cond_signal(&cap->cond);
+	cap->in.len += blen;
+	pthread_mutex_unlock(&cap->lock);
+}
+
+void rfid_capture_speed(struct rfid_capture *cap, unsigned int tx,
+			unsigned int kbps)
+{
+	if (cap)
+		cap->iso14443a_kbps[!!tx] = kbps;
+}
+
+int rfid_capture_start(struct rfid_reader_handle *rh, int fd)
+{
+	struct rfid_capture *cap;
+	int ret;
+
+	if (rh->capture)
+		return -EBUSY;
+
+	ret = capture_write_header(fd, rh->reader->name);
+	if (ret < 0)
+		return ret;
+
+	cap = malloc(sizeof(*cap));
+	if (!cap)
+		return -ENOMEM;
+	memset(cap, 0, sizeof(*cap));
+
+	cap->in.data = malloc(CAPTURE_BUF_SIZE);
+	cap->out.data = malloc(CAPTURE_BUF_SIZE);
+	if (!cap->in.data || !cap->out.data) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	cap->fd = fd;
+	cap->iso14443a_kbps[0] = cap->iso14443a_kbps[1] = 106;
+	pthread_mutex_init(&cap->lock, NULL);
+	pthread_cond_init(&cap->cond, NULL);
+
+	ret = pthread_create(&cap->thread, NULL, &capture_thread, cap);
+	if (ret) {
+		ret = -ret;
+		pthread_cond_destroy(&cap->cond);
+		pthread_mutex_destroy(&cap->lock);
+		goto out_free;
+	}
+
+	rh->capture = cap;
+
+	return 0;
+
+out_free:
+	free(cap->in.data);
+	free(cap->out.data);
+	free(cap);
+	return ret;
+}
+
+int rfid_capture_stop(struct rfid_reader_handle *rh)
+{
+	struct rfid_capture *cap = rh->capture;
+	unsigned char buf[48], *p = buf;
+	u_int64_t ts;
+	int ret;
+
+	if (!cap)
+		return 0;
+
+	rh->capture = NULL;
+
+	pthread_mutex_lock(&cap->lock);
+	cap->stopping = 1;
+	pthread_cond_signal(&cap->cond);
+	pthread_mutex_unlock(&cap->lock);
+
+	pthread_join(cap->thread, NULL);
+
+	ret = cap->error;
+	if (!ret) {
+		/* interface statistics block with the number of drops */
+		ts = capture_now();
+		p = put_u32(p, PCAPNG_ISB);
+		p = put_u32(p, 40);
+		p = put_u32(p, 0);
+		p = put_u32(p, ts >> 32);
+		p = put_u32(p, ts);
+		p = put_u16(p, PCAPNG_ISB_IFDROP);
+		p = put_u16(p, 8);
+		memcpy(p, &cap->drops, 8);
+		p += 8;
+		p = put_u32(p, PCAPNG_OPT_END);
+		p = put_u32(p, 40);
+		ret = write_all(cap->fd, buf, p - buf);
+	}
+
+	pthread_cond_destroy(&cap->cond);
+	pthread_mutex_destroy(&cap->lock);
+	free(cap->in.data);
+	free(cap->out.data);
+	free(cap);
+
+	return ret;
+}
@@ -0,0 +1,428 @@
+/* ISO 7816-4 file system access (SELECT / READ BINARY) over T=CL
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+#include <librfid/rfid_protocol_tcl.h>
+#include <librfid/rfid_iso7816.h>
+
+#define ISO7816_OFFSET_MAX	0x7fff	/* 15 bit offset in P1/P2 */
+
+static int iso7816_sw_to_errno(unsigned int sw)
+{
+	switch (sw) {
+	case ISO7816_SW_OK:
+		return 0;
+	case 0x6a82:	/* file not found */
+	case 0x6a83:	/* record not found */
+		return -ENOENT;
+	case 0x6982:	/* security status not satisfied */
+	case 0x6985:	/* conditions of use not satisfied */
+		return -EACCES;
+	case 0x6a86:	/* incorrect P1/P2 */
+	case 0x6b00:	/* wrong parameters (offset beyond EF) */
+		return -EINVAL;
+	}
+	return -EIO;
+}
+
+/* send one APDU.  resp has to have room for *resp_len payload bytes plus
+ * SW1/SW2.  Returns the status word or a negative error. */
+static int
+iso7816_xcv(struct iso7816_handle *ih, const unsigned char *cmd,
+	    unsigned int cmd_len, unsigned char *resp, unsigned int *resp_len)
+{
+	unsigned int rx_len = *resp_len + 2;
+	int ret;
+
+	ret = rfid_protocol_transceive(ih->ph, cmd, cmd_len, resp, &rx_len,
+				       0, 0);
+	if (ret < 0)
+		return ret;
+
+	if (rx_len < 2) {
+		DEBUGP("response without status word\n");
+		return -EIO;
+	}
+
+	*resp_len = rx_len - 2;
+
+	return (resp[rx_len-2] << 8) | resp[rx_len-1];
+}
+
+struct iso7816_handle *
+iso7816_init(struct rfid_protocol_handle *ph)
+{
+	struct iso7816_handle *ih;
+
+	if (ph->proto->id != RFID_PROTOCOL_TCL)
+		return NULL;
+
+	ih = malloc(sizeof(*ih));
+	if (!ih)
+		return NULL;
+	memset(ih, 0, sizeof(*ih));
+
+	ih->ph = ph;
+
+	return ih;
+}
+
+void iso7816_fini(struct iso7816_handle *ih)
+{
+	free(ih);
+}
+
+int iso7816_select_mf(struct iso7816_handle *ih)
+{
+	unsigned char cmd[] = { 0x00, 0xa4, 0x00, 0x00, 0x02, 0x3f, 0x00, 0x00 };
+	unsigned char resp[ISO7816_LE_MAX+2];
+	unsigned int rlen = ISO7816_LE_MAX;
+	int sw;
+
+	if (ih->df_valid && ih->df_aid_len == 0 && !ih->ef_valid)
+		return 0;
+
+	ih->df_valid = ih->ef_valid = 0;
+
+	sw = iso7816_xcv(ih, cmd, sizeof(cmd), resp, &rlen);
+	if (sw < 0)
+		return sw;
+	if (sw != ISO7816_SW_OK)
+		return iso7816_sw_to_errno(sw);
+
+	ih->df_aid_len = 0;
+	ih->df_valid = 1;
+
+	return 0;
+}
+
+int
+iso7816_select_application(struct iso7816_handle *ih,
+			   const unsigned char *aid, unsigned int aid_len)
+{
+	unsigned char cmd[5+ISO7816_AID_MAX] = { 0x00, 0xa4, 0x04, 0x0c };
+	unsigned char resp[ISO7816_LE_MAX+2];
+	unsigned int rlen = ISO7816_LE_MAX;
+	int sw;
+
+	if (aid_len == 0 || aid_len > ISO7816_AID_MAX)
+		return -EINVAL;
+
+	if (ih->df_valid && ih->df_aid_len == aid_len &&
+	    !memcmp(ih->df_aid, aid, aid_len))
+		return 0;
+
+	ih->df_valid = ih->ef_valid = 0;
+
+	cmd[4] = aid_len;
+	memcpy(&cmd[5], aid, aid_len);
+
+	sw = iso7816_xcv(ih, cmd, 5+aid_len, resp, &rlen);
+	if (sw < 0)
+		return sw;
+	if (sw != ISO7816_SW_OK)
+		return iso7816_sw_to_errno(sw);
+
+	memcpy(ih->df_aid, aid, aid_len);
+	ih->df_aid_len = aid_len;
+	ih->df_valid = 1;
+
+	return 0;
+}
+
+int iso7816_select_ef(struct iso7816_handle *ih, u_int16_t fid)
+{
+	unsigned char cmd[7] = { 0x00, 0xa4, 0x02, 0x0c, 0x02, 0x00, 0x00 };
+	unsigned char resp[ISO7816_LE_MAX+2];
+	unsigned int rlen = ISO7816_LE_MAX;
+	int sw;
+
+	if (ih->ef_valid && ih->ef_fid == fid)
+		return 0;
+
+	ih->ef_valid = 0;
+
+	cmd[5] = (fid >> 8) & 0xff;
+	cmd[6] = fid & 0xff;
+
+	sw = iso7816_xcv(ih, cmd, sizeof(cmd), resp, &rlen);
+	if (sw < 0)
+		return sw;
+	if (sw != ISO7816_SW_OK)
+		return iso7816_sw_to_errno(sw);
+
+	ih->ef_fid = fid;
+	ih->ef_valid = 1;
+
+	return 0;
+}
+
+/* read up to *len bytes from the current EF, starting at offset.  T=CL
+ * takes care of response chaining, so every READ BINARY asks for the
+ * maximum short Le.  Reading stops at the end of the EF. */
+int
+iso7816_read_binary(struct iso7816_handle *ih, unsigned int offset,
+		    unsigned char *buf, unsigned int *len)
+{
+	unsigned char cmd[] = { 0x00, 0xb0, 0x00, 0x00, 0x00 };
+	unsigned char resp[ISO7816_LE_MAX+2];
+	unsigned int done = 0;
+	unsigned int le, rlen;
+	int sw, retried;
+
+	while (done < *len) {
+		if (offset + done > ISO7816_OFFSET_MAX)
+			break;
+
+		le = *len - done;
+		if (le > ISO7816_LE_MAX)
+			le = ISO7816_LE_MAX;
+		retried = 0;
+retry:
+		cmd[2] = ((offset + done) >> 8) & 0x7f;
+		cmd[3] = (offset + done) & 0xff;
+		cmd[4] = le & 0xff;	/* 256 is encoded as 0x00 */
+
+		rlen = ISO7816_LE_MAX;
+		sw = iso7816_xcv(ih, cmd, sizeof(cmd), resp, &rlen);
+		if (sw < 0)
+			return sw;
+
+		if ((sw & 0xff00) == 0x6c00 && (sw & 0xff) != cmd[4] &&
+		    !retried) {
+			/* wrong Le, card tells us the right one.  Ask for
+			 * exactly that, even if it is more than the caller
+			 * wants: resp has room for it, and only what fits is
+			 * copied below.  Once per chunk, a card that keeps
+			 * answering 6Cxx fails the read. */
+			le = sw & 0xff;
+			if (le == 0)
+				le = ISO7816_LE_MAX;
+			retried = 1;
+			goto retry;
+		}
+
+		if (sw != ISO7816_SW_OK && sw != 0x6282) {
+			/* offset beyond end of EF terminates a read of
+			 * unknown length */
+			if (sw == 0x6b00 && done)
+				break;
+			*len = done;
+			return iso7816_sw_to_errno(sw);
+		}
+
+		if (rlen > *len - done)
+			rlen = *len - done;
+		memcpy(buf + done, resp, rlen);
+		done += rlen;
+
+		/* short read or 'end of file reached before Le bytes' */
+		if (rlen < le || sw == 0x6282)
+			break;
+	}
+
+	*len = done;
+
+	return 0;
+}
+
+int iso7816_get_challenge(struct iso7816_handle *ih, unsigned char *buf,
+			  unsigned int len)
+{
+	unsigned char cmd[] = { 0x00, 0x84, 0x00, 0x00, 0x08 };
+	unsigned char resp[ISO7816_LE_MAX+2];
+	unsigned int rlen = ISO7816_LE_MAX;
+	int sw;
+
+	if (len == 0 || len > ISO7816_LE_MAX)
+		return -EINVAL;
+
+	cmd[4] = len & 0xff;
+
+	sw = iso7816_xcv(ih, cmd, sizeof(cmd), resp, &rlen);
+	if (sw < 0)
+		return sw;
+	if (sw != ISO7816_SW_OK)
+		return iso7816_sw_to_errno(sw);
+
+	if (rlen > len)
+		rlen = len;
+	memcpy(buf, resp, rlen);
+
+	return rlen;
+}
+
+/* EF cache */
+
+struct iso7816_cache *iso7816_cache_init(unsigned int num_entries)
+{
+	struct iso7816_cache *cache;
+	unsigned int size = sizeof(*cache) +
+			num_entries * sizeof(struct iso7816_cache_entry);
+
+	cache = malloc(size);
+	if (!cache)
+		return NULL;
+	memset(cache, 0, size);
+
+	cache->num_entries = num_entries;
+
+	return cache;
+}
+
+void iso7816_cache_fini(struct iso7816_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->num_entries; i++)
+		free(cache->entry[i].data);
+	free(cache);
+}
+
+void iso7816_set_cache(struct iso7816_handle *ih, struct iso7816_cache *cache)
+{
+	ih->cache = cache;
+}
+
+/* FNV-1a over the ATS, which together with the UID identifies the card */
+static u_int32_t iso7816_ats_hash(struct iso7816_handle *ih)
+{
+	const struct tcl_handle *th = &ih->ph->priv.tcl;
+	u_int32_t hash = 2166136261U;
+	unsigned int i;
+
+	for (i = 0; i < th->ats_len && i < sizeof(th->ats); i++) {
+		hash ^= th->ats[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static struct iso7816_cache_entry *
+iso7816_cache_lookup(struct iso7816_handle *ih, u_int16_t fid)
+{
+	struct rfid_layer2_handle *l2h = ih->ph->l2h;
+	struct iso7816_cache *cache = ih->cache;
+	u_int32_t ats_hash = iso7816_ats_hash(ih);
+	unsigned int i;
+
+	for (i = 0; i < cache->num_entries; i++) {
+		struct iso7816_cache_entry *ce = &cache->entry[i];
+
+		if (!ce->valid || ce->fid != fid ||
+		    ce->ats_hash != ats_hash ||
+		    ce->uid_len != l2h->uid_len ||
+		    memcmp(ce->uid, l2h->uid, l2h->uid_len) ||
+		    ce->df_aid_len != ih->df_aid_len ||
+		    memcmp(ce->df_aid, ih->df_aid, ih->df_aid_len))
+			continue;
+
+		ce->last_use = ++cache->use_count;
+		return ce;
+	}
+
+	return NULL;
+}
+
+static void
+iso7816_cache_store(struct iso7816_handle *ih, u_int16_t fid,
+		    const unsigned char *data, unsigned int len)
+{
+	struct rfid_layer2_handle *l2h = ih->ph->l2h;
+	struct iso7816_cache *cache = ih->cache;
+	struct iso7816_cache_entry *ce = NULL;
+	unsigned int i;
+
+	/* take a free entry, or evict the least recently used one */
+	for (i = 0; i < cache->num_entries; i++) {
+		struct iso7816_cache_entry *cur = &cache->entry[i];
+
+		if (!cur->valid) {
+			ce = cur;
+			break;
+		}
+		if (!ce || cur->last_use < ce->last_use)
+			ce = cur;
+	}
+	if (!ce)
+		return;
+
+	free(ce->data);
+	ce->valid = 0;
+
+	ce->data = malloc(len);
+	if (!ce->data)
+		return;
+	memcpy(ce->data, data, len);
+	ce->len = len;
+
+	memcpy(ce->uid, l2h->uid, l2h->uid_len);
+	ce->uid_len = l2h->uid_len;
+	ce->ats_hash = iso7816_ats_hash(ih);
+	memcpy(ce->df_aid, ih->df_aid, ih->df_aid_len);
+	ce->df_aid_len = ih->df_aid_len;
+	ce->fid = fid;
+
+	ce->last_use = ++cache->use_count;
+	ce->valid = 1;
+}
+
+/* wrapper function around SELECT EF and READ BINARY.  With
+ * ISO7816_READ_F_CACHE the EF is considered immutable and served from /
+ * stored in the cache (if one is attached). */
+int
+iso7816_read_ef(struct iso7816_handle *ih, u_int16_t fid,
+		unsigned char *buf, unsigned int *len, unsigned int flags)
+{
+	int use_cache = ih->cache && (flags & ISO7816_READ_F_CACHE) &&
+			ih->df_valid;
+	unsigned int want = *len;
+	int rv;
+
+	if (use_cache) {
+		struct iso7816_cache_entry *ce = iso7816_cache_lookup(ih, fid);
+		if (ce) {
+			DEBUGP("EF %04x served from cache\n", fid);
+			if (ce->len < *len)
+				*len = ce->len;
+			memcpy(buf, ce->data, *len);
+			return 0;
+		}
+	}
+
+	rv = iso7816_select_ef(ih, fid);
+	if (rv < 0)
+		return rv;
+
+	rv = iso7816_read_binary(ih, 0, buf, len);
+	if (rv < 0)
+		return rv;
+
+	/* only cache complete EFs, i.e. if we hit the end of the file */
+	if (use_cache && *len < want)
+		iso7816_cache_store(ih, fid, buf, *len);
+
+	return 0;
+}
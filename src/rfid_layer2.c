@@ -24,6 +24,11 @@
 
 #include <librfid/rfid.h>
 #include <librfid/rfid_layer2.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_buf.h>
+#include <librfid/rfid_retry.h>
+
+#include "rfid_probes.h"
 
 static const struct rfid_layer2 *rfid_layer2s[] = {
 	[RFID_LAYER2_ISO14443A]	= &rfid_layer2_iso14443a,
@@ -48,10 +53,23 @@ rfid_layer2_init(struct rfid_reader_handle *rh, unsigned int id)
 int
 rfid_layer2_open(struct rfid_layer2_handle *ph)
 {
+	struct rfid_retry_op op;
+	int ret;
+
 	if (!ph->l2->fn.open)
 		return 0;
 
-	return ph->l2->fn.open(ph);
+	/* a field reset only puts the cards back into IDLE, which the
+	 * anticollision starts from anyway.  Cards already opened through
+	 * other handles of this reader are lost too, see rfid_retry.h */
+	rfid_retry_begin(ph->rh, &op, RFID_RETRY_OP_IDEMPOTENT |
+				      RFID_RETRY_OP_RF_RESET);
+	do {
+		ret = ph->l2->fn.open(ph);
+	} while (rfid_retry_again(ph->rh, &op, &ret));
+	rfid_retry_end(ph->rh, &op);
+
+	return ret;
 }
 
 int
@@ -61,11 +79,49 @@ rfid_layer2_transceive(struct rfid_layer2_handle *ph,
 			 unsigned char *rx_buf, unsigned int *rx_len,
 			 u_int64_t timeout, unsigned int flags)
 {
+	struct rfid_retry_op op;
+	int ret;
+
 	if (!ph->l2->fn.transceive)
 		return -EIO;
 
-	return ph->l2->fn.transceive(ph, frametype, tx_buf, len, rx_buf,
-				     rx_len, timeout, flags);
+	/* not idempotent, only the deadline applies */
+	rfid_retry_begin(ph->rh, &op, 0);
+	do {
+		ret = rfid_retry_timeout(ph->rh, &timeout);
+		if (ret < 0)
+			break;
+
+		RFID_PROBE5(layer2__transceive__entry, ph, ph->l2->id,
+			    frametype, len, *rx_len);
+		ret = ph->l2->fn.transceive(ph, frametype, tx_buf, len, rx_buf,
+					    rx_len, timeout, flags);
+		RFID_PROBE4(layer2__transceive__return, ph, frametype, ret,
+			    ret < 0 ? 0 : *rx_len);
+	} while (rfid_retry_again(ph->rh, &op, &ret));
+	rfid_retry_end(ph->rh, &op);
+
+	return ret;
+}
+
+/* transceive the frame in 'tx', appending the response to 'rx' */
+int
+rfid_layer2_transceive_buf(struct rfid_layer2_handle *ph,
+			   enum rfid_frametype frametype,
+			   struct rfid_buf *tx, struct rfid_buf *rx,
+			   u_int64_t timeout, unsigned int flags)
+{
+	unsigned int rx_len = rfid_buf_tailroom(rx);
+	int ret;
+
+	ret = rfid_layer2_transceive(ph, frametype, tx->data, rfid_buf_len(tx),
+				     rx->tail, &rx_len, timeout, flags);
+	if (ret < 0)
+		return ret;
+
+	rfid_buf_put(rx, rx_len);
+
+	return ret;
 }
 
 int rfid_layer2_fini(struct rfid_layer2_handle *ph)
@@ -85,6 +141,17 @@ rfid_layer2_close(struct rfid_layer2_handle *ph)
 	return ph->l2->fn.close(ph);
 }
 
+/* cheap liveness check of an already selected card, without a full
+ * anticollision.  Returns 1 if present, 0 if not, negative on error. */
+int
+rfid_layer2_presence(struct rfid_layer2_handle *ph)
+{
+	if (!ph->l2->fn.presence)
+		return -ENOTSUP;
+
+	return ph->l2->fn.presence(ph);
+}
+
 int
 rfid_layer2_getopt(struct rfid_layer2_handle *ph, int optname,
 		   void *optval, unsigned int *optlen)
@@ -35,7 +35,10 @@
 
 #define TIMEOUT 1236
 
-unsigned long randctx[4]={0x22d4a017,0x773a1f44,0xc39e1460,0x9cde8801};
+/* PRNG state for anticollision, per thread */
+static __rfid_tls unsigned long randctx[4] = {
+	0x22d4a017, 0x773a1f44, 0xc39e1460, 0x9cde8801
+};
 
 /* Transceive a 7-bit short frame */
 int
@@ -116,6 +119,48 @@ rnd_toggle_bit_in_field(unsigned char *bitfield, unsigned int size, unsigned int
 }
 
 
+#define PROTO(x)	(1 << RFID_PROTOCOL_##x)
+
+/* According to NXP AN10833 "MIFARE Type Identification Procedure".
+ * First match wins, so more specific entries have to come first. */
+static const struct iso14443a_fingerprint iso14443a_fingerprints[] = {
+	{ 0x0000, 0x0000, 0xff, 0x09, PROTO(MIFARE_CLASSIC), 320,
+	  "Mifare Mini" },
+	{ 0x0000, 0x0000, 0xff, 0x08, PROTO(MIFARE_CLASSIC), 1024,
+	  "Mifare Classic 1K" },
+	{ 0x0000, 0x0000, 0xff, 0x88, PROTO(MIFARE_CLASSIC), 1024,
+	  "Infineon Mifare Classic 1K" },
+	{ 0x0000, 0x0000, 0xff, 0x18, PROTO(MIFARE_CLASSIC), 4096,
+	  "Mifare Classic 4K" },
+	{ 0x0000, 0x0000, 0xff, 0x28, PROTO(TCL) | PROTO(MIFARE_CLASSIC), 1024,
+	  "SmartMX with Mifare Classic 1K" },
+	{ 0x0000, 0x0000, 0xff, 0x38, PROTO(TCL) | PROTO(MIFARE_CLASSIC), 4096,
+	  "SmartMX with Mifare Classic 4K" },
+	{ 0xffff, 0x0044, 0xff, 0x00, PROTO(MIFARE_UL), 64,
+	  "Mifare Ultralight" },
+	{ 0x0000, 0x0000, 0x20, 0x20, PROTO(TCL), 0,
+	  "ISO 14443-4 PICC" },
+};
+
+static const struct iso14443a_fingerprint *
+iso14443a_fingerprint(const struct iso14443a_atqa *atqa, u_int8_t sak)
+{
+	const u_int8_t *aq = (const u_int8_t *) atqa;
+	u_int16_t atqa_val = aq[0] | (aq[1] << 8);
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(iso14443a_fingerprints); i++) {
+		const struct iso14443a_fingerprint *fp =
+						&iso14443a_fingerprints[i];
+
+		if ((atqa_val & fp->atqa_mask) == fp->atqa &&
+		    (sak & fp->sak_mask) == fp->sak)
+			return fp;
+	}
+
+	return NULL;
+}
+
 static int
 iso14443a_anticol(struct rfid_layer2_handle *handle)
 {
@@ -134,6 +179,22 @@ iso14443a_anticol(struct rfid_layer2_handle *handle)
 	memset(atqa, 0, sizeof(&atqa));
 	memset(&acf, 0, sizeof(acf));
 
+	/* let the reader do all of it in one round trip if it can */
+	if (handle->rh->reader->iso14443a.select) {
+		ret = handle->rh->reader->iso14443a.select(handle->rh,
+				handle->flags & RFID_OPT_LAYER2_WUP, atqa,
+				&sak[0], handle->uid, &handle->uid_len);
+		if (ret != -ENOTSUP) {
+			if (ret < 0) {
+				h->state = ISO14443A_STATE_ERROR;
+				return ret;
+			}
+			DEBUGP("UID %s\n", rfid_hexdump(handle->uid,
+							handle->uid_len));
+			goto selected;
+		}
+	}
+
 	if (handle->flags & RFID_OPT_LAYER2_WUP)
 		ret = iso14443a_transceive_sf(handle, ISO14443A_SF_CMD_WUPA, atqa);
 	else
@@ -251,24 +312,96 @@ cascade:
 		DEBUGP("UID %s\n", rfid_hexdump(handle->uid, handle->uid_len));
 	}
 
+selected:
 	h->level = ISO14443A_LEVEL_NONE;
 	h->state = ISO14443A_STATE_SELECTED;
 	h->sak = sak[0];
+	h->tcl_capable = (sak[0] & 0x20) ? 1 : 0;
 
-	if (sak[0] & 0x20) {
+	h->fp = iso14443a_fingerprint(atqa, sak[0]);
+	if (h->fp) {
+		DEBUGP("we have a %s\n", h->fp->name);
+		handle->proto_supported = h->fp->proto_supported;
+	} else if (h->tcl_capable) {
 		DEBUGP("we have a T=CL compliant PICC\n");
 		handle->proto_supported = 1 << RFID_PROTOCOL_TCL;
-		h->tcl_capable = 1;
 	} else {
 		DEBUGP("we have a T!=CL PICC\n");
 		handle->proto_supported = (1 << RFID_PROTOCOL_MIFARE_UL)|
 					  (1 << RFID_PROTOCOL_MIFARE_CLASSIC);
-		h->tcl_capable = 0;
 	}
 
 	return 0;
 }
 
+/* Presence check by WUPA + SELECT with the known UID.  The card ends up
+ * selected again, but any state of higher layers (Crypto1, T=CL) is lost */
+static int
+iso14443a_presence(struct rfid_layer2_handle *handle)
+{
+	static const unsigned char sel_codes[] = {
+		ISO14443A_AC_SEL_CODE_CL1,
+		ISO14443A_AC_SEL_CODE_CL2,
+		ISO14443A_AC_SEL_CODE_CL3,
+	};
+	struct iso14443a_handle *h = &handle->priv.iso14443a;
+	struct iso14443a_anticol_cmd acf;
+	struct iso14443a_atqa atqa;
+	unsigned char sak[3];
+	unsigned int rx_len, level, levels, uid_ofs = 0;
+	int ret;
+
+	if (h->state != ISO14443A_STATE_SELECTED)
+		return -EINVAL;
+
+	if (handle->uid_len == 4)
+		levels = 1;
+	else if (handle->uid_len == 7)
+		levels = 2;
+	else
+		levels = 3;
+
+	/* A card in ACTIVE state doesn't answer the WUPA, but falls back
+	 * to IDLE.  So if the first one is not answered, the second one
+	 * will be. */
+	ret = iso14443a_transceive_sf(handle, ISO14443A_SF_CMD_WUPA, &atqa);
+	if (ret < 0)
+		ret = iso14443a_transceive_sf(handle, ISO14443A_SF_CMD_WUPA,
+					      &atqa);
+	if (ret < 0)
+		return 0;
+
+	for (level = 0; level < levels; level++) {
+		memset(&acf, 0, sizeof(acf));
+		acf.sel_code = sel_codes[level];
+		iso14443a_code_nvb_bits(&acf.nvb, 7*8);
+
+		if (level < levels - 1) {
+			acf.uid_bits[0] = 0x88;		/* cascade tag */
+			memcpy(&acf.uid_bits[1], &handle->uid[uid_ofs], 3);
+			uid_ofs += 3;
+		} else
+			memcpy(&acf.uid_bits[0], &handle->uid[uid_ofs], 4);
+
+		/* BCC */
+		acf.uid_bits[4] = acf.uid_bits[0] ^ acf.uid_bits[1] ^
+				  acf.uid_bits[2] ^ acf.uid_bits[3];
+
+		rx_len = sizeof(sak);
+		ret = iso14443a_transceive(handle, RFID_14443A_FRAME_REGULAR,
+					   (unsigned char *)&acf, 7,
+					   sak, &rx_len, TIMEOUT, 0);
+		if (ret < 0)
+			return 0;
+	}
+
+	/* some other card with the same UID?!? */
+	if (sak[0] != h->sak)
+		return 0;
+
+	return 1;
+}
+
 static int
 iso14443a_hlta(struct rfid_layer2_handle *handle)
 {
@@ -397,6 +530,7 @@ const struct rfid_layer2 rfid_layer2_iso14443a = {
 		.open 		= &iso14443a_anticol,
 		.transceive 	= &iso14443a_transceive,
 		.close 		= &iso14443a_hlta,
+		.presence	= &iso14443a_presence,
 		.fini 		= &iso14443a_fini,
 		.setopt		= &iso14443a_setopt,
 		.getopt		= &iso14443a_getopt,
@@ -173,7 +173,9 @@ transceive_attrib(struct rfid_layer2_handle *h, const unsigned char *inf,
 	int ret = 0;
 	
 	DEBUGP("fsd is %u\n", h->priv.iso14443b.fsd);
-	if (rx_len >= rx_len-1)
+	/* the response is received with its MBLI/CID byte in front */
+	if (*rx_len > sizeof(rx_buf) - 1 ||
+	    inf_len > sizeof(_attrib_buf.buf))
 		return -EINVAL;
 
 	/* initialize attrib frame */
@@ -212,6 +214,11 @@ transceive_attrib(struct rfid_layer2_handle *h, const unsigned char *inf,
 		DEBUGP("transceive problem\n");
 		goto out_rx;
 	}
+	if (*rx_len < 1) {
+		DEBUGP("empty ATTRIB response\n");
+		ret = -EIO;
+		goto out_rx;
+	}
 
 	if ((rx_buf[0] & 0x0f) != h->priv.iso14443b.cid) {
 		DEBUGP("ATTRIB response with invalid CID %u (should be %u)\n",
@@ -222,7 +229,7 @@ transceive_attrib(struct rfid_layer2_handle *h, const unsigned char *inf,
 
 	h->priv.iso14443b.state = ISO14443B_STATE_SELECTED;
 	
-	h->priv.iso14443b.mbl = mbli_to_mbl(h, (rx_data[0] & 0xf0) >> 4);
+	h->priv.iso14443b.mbl = mbli_to_mbl(h, (rx_buf[0] & 0xf0) >> 4);
 
 	*rx_len = *rx_len - 1;
 	memcpy(rx_data, rx_buf+1, *rx_len);
@@ -282,6 +289,42 @@ iso14443b_anticol(struct rfid_layer2_handle *handle)
 	return 0;
 }
 
+/* Presence check by HLTB + WUPB + ATTRIB with the known PUPI.  An ACTIVE
+ * PICC doesn't answer REQB/WUPB, but only ours acknowledges a HLTB with
+ * its PUPI.  It is then woken up and selected again with the same CID, so
+ * the handle stays usable.  Like the 14443A re-select, this loses any T=CL
+ * state, which is why T=CL has a presence check of its own. */
+static int
+iso14443b_presence(struct rfid_layer2_handle *handle)
+{
+	unsigned char pupi[4];
+	unsigned char buf[255];
+	unsigned int buf_len = sizeof(buf);
+	int ret;
+
+	if (handle->priv.iso14443b.state != ISO14443B_STATE_SELECTED)
+		return -EINVAL;
+
+	memcpy(pupi, handle->uid, sizeof(pupi));
+
+	if (iso14443b_hltb(handle) < 0)
+		return 0;
+
+	/* other PICCs in the field may answer the WUPB, too */
+	if (send_reqb(handle, 0, 1, 0) < 0 ||
+	    memcmp(handle->uid, pupi, sizeof(pupi))) {
+		memcpy(handle->uid, pupi, sizeof(pupi));
+		return 0;
+	}
+
+	/* present, but no longer selected */
+	ret = transceive_attrib(handle, NULL, 0, buf, &buf_len);
+	if (ret < 0)
+		return ret;
+
+	return 1;
+}
+
 static struct rfid_layer2_handle *
 iso14443b_init(struct rfid_reader_handle *rh)
 {
@@ -393,6 +436,7 @@ const struct rfid_layer2 rfid_layer2_iso14443b = {
 		.open 		= &iso14443b_anticol,
 		.transceive 	= &iso14443b_transceive,
 		.close 		= &iso14443b_hltb,
+		.presence	= &iso14443b_presence,
 		.fini 		= &iso14443b_fini,
 		.getopt		= &iso14443b_getopt,
 		.setopt		= &iso14443b_setopt,
@@ -29,6 +29,7 @@
 #include <librfid/rfid_layer2.h>
 #include <librfid/rfid_reader.h>
 #include <librfid/rfid_layer2_iso15693.h>
+#include <librfid/rfid_buf.h>
 
 /*struct iso15693_request_read {
 	struct iso15693_request head;
@@ -41,19 +42,6 @@ struct iso15693_request_adressed {
 	u_int64_t uid;
 } __attribute__ ((packed));
 
-struct iso15693_request_block_addressed {
-	struct iso15693_request head;
-	u_int64_t uid;
-	u_int8_t blocknum;
-	u_int8_t data[0];
-} __attribute__ ((packed));
-
-struct iso15693_request_block_selected {
-	struct iso15693_request head;
-	u_int8_t blocknum;
-	u_int8_t data[0];
-} __attribute__ ((packed));
-
 struct iso15693_err_resp {
 	struct iso15693_response head;
 	u_int8_t error;
@@ -67,7 +55,6 @@ struct iso15693_response_sec {
 } __attribute__ ((packed));
 
 #define ISO15693_BLOCK_SIZE_MAX	(256/8)
-#define ISO15693_RESP_SIZE_MAX	(4+ISO15693_BLOCK_SIZE_MAX)
 
 const unsigned int iso15693_timing[2][5] = {
 	[ISO15693_T_SLOW] = {
@@ -140,62 +127,74 @@ iso15693_transceive_acf(struct rfid_layer2_handle *handle,
 }
 
 
+/* prepend UID (unless selected), command and flags to a request whose
+ * parameters are already in 'frame' */
+static int
+iso15693_push_request(struct rfid_layer2_handle *handle,
+		      struct rfid_buf *frame, u_int8_t command, u_int8_t flags)
+{
+	if (rfid_buf_headroom(frame) < ISO15693_UID_LEN + 2)
+		return -ENOMEM;
+
+	if (handle->priv.iso15693.vicc_fast)
+		flags |= RFID_15693_F_RATE_HIGH;
+	if (handle->priv.iso15693.vicc_two_subc)
+		flags |= RFID_15693_F_SUBC_TWO;
+
+	if (handle->priv.iso15693.state == RFID_15693_STATE_SELECTED)
+		flags |= RFID_15693_F4_SELECTED;
+	else {
+		memcpy(rfid_buf_push(frame, ISO15693_UID_LEN), handle->uid,
+		       ISO15693_UID_LEN);
+		flags |= RFID_15693_F4_ADDRESS;
+	}
+
+	*rfid_buf_push(frame, 1) = command;
+	*rfid_buf_push(frame, 1) = flags;
+
+	return 0;
+}
+
 int
 iso15693_read_block(struct rfid_layer2_handle *handle,
 		    u_int8_t blocknr, u_int32_t *data, unsigned int len, 
 		    unsigned char *block_sec_out)
 {
-	union {
-		struct iso15693_request_block_selected sel;
-		struct iso15693_request_block_addressed addr;
-	} tx_req;
-
 	int ret;
 	unsigned char *errstr;
-	unsigned int rx_len, tx_len,timeout;
-	u_int8_t resp[ISO15693_RESP_SIZE_MAX];
+	unsigned int rx_len, timeout;
+	u_int8_t flags = 0;
+	struct rfid_buf *tx, *rx;
 	struct iso15693_err_resp *rx_err;
 	struct iso15693_response *rx_pkt;
-	struct iso15693_response_sec *rx_pkt_sec;
-
-	rx_pkt_sec = (struct iso15693_response_sec *)&resp[0];
-	rx_pkt = (struct iso15693_response *)&resp[0];
-	rx_err = (struct iso15693_err_resp *)&resp[0];
-
-	memset(&tx_req,0,sizeof(tx_req));
-
-	rx_len = sizeof(resp);
 
-	tx_req.sel.head.command = ISO15693_CMD_READ_BLOCK_SINGLE;
+	tx = rfid_buf_alloc();
+	rx = rfid_buf_alloc();
+	if (!tx || !rx) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	rfid_buf_init(rx);
 
-	if (handle->priv.iso15693.vicc_fast){
-		tx_req.sel.head.flags |= RFID_15693_F_RATE_HIGH;
+	if (handle->priv.iso15693.vicc_fast)
 		timeout=iso15693_timing[ISO15693_T_FAST][ISO15693_T4];
-	}else
+	else
 		timeout=iso15693_timing[ISO15693_T_SLOW][ISO15693_T4];
 
-	if (handle->priv.iso15693.vicc_two_subc)
-		tx_req.sel.head.flags |= RFID_15693_F_SUBC_TWO;
-
 	if (block_sec_out!=NULL)
-		tx_req.sel.head.flags |= RFID_15693_F4_CUSTOM;
+		flags |= RFID_15693_F4_CUSTOM;
 
-	if (handle->priv.iso15693.state==RFID_15693_STATE_SELECTED) {
-		tx_len = sizeof(struct iso15693_request_block_selected);
-		tx_req.sel.blocknum = blocknr;
-		tx_req.sel.head.flags |= RFID_15693_F4_SELECTED;
-	} else {
-		tx_len = sizeof(struct iso15693_request_block_addressed);
-		memcpy(&tx_req.addr.uid, handle->uid, ISO15693_UID_LEN);
-		tx_req.addr.head.flags |= RFID_15693_F4_ADDRESS;
-		tx_req.addr.blocknum = blocknr;
-	}
+	*rfid_buf_put(tx, 1) = blocknr;
+	ret = iso15693_push_request(handle, tx, ISO15693_CMD_READ_BLOCK_SINGLE,
+				    flags);
+	if (ret < 0)
+		goto out;
 
-	//DEBUGP("sizeof: addr: %d sel:%d\n",sizeof(struct iso15693_request_read_addressed),sizeof(struct iso15693_request_read_selected));
-	DEBUGP("tx_len=%u", tx_len); DEBUGPC(" rx_len=%u\n",rx_len);
+	DEBUGP("tx_len=%u\n", rfid_buf_len(tx));
 
-	ret = iso15693_transceive(handle, RFID_15693_FRAME, (u_int8_t*)&tx_req,
-				  tx_len, resp, &rx_len, timeout, 0);
+	ret = rfid_layer2_transceive_buf(handle, RFID_15693_FRAME, tx, rx,
+					 timeout, 0);
+	rx_len = rfid_buf_len(rx);
 
 	if (ret==-ETIMEDOUT)
 		errstr="(TIMEOUT)";
@@ -206,82 +205,87 @@ iso15693_read_block(struct rfid_layer2_handle *handle,
 	DEBUGP("length: %d rx_len: %d ret: %d%s\n",len,rx_len,ret,errstr);
 
 	if (ret < 0)
-		return ret;
+		goto out;
+
+	if (rx_len < 1 || rx_len > len+1) {
+		ret = -1;
+		goto out;
+	}
+
+	rx_pkt = (struct iso15693_response *)rx->data;
+	rx_err = (struct iso15693_err_resp *)rx->data;
 
-	if (rx_len > len+1)
-		return -1;
 	DEBUGP("error_flag: %d", rx_pkt->flags&RFID_15693_RF_ERROR);
 	if (rx_pkt->flags & RFID_15693_RF_ERROR) {
 		DEBUGPC(" -> error: %02x '%s'\n", rx_err->error,
 			iso15693_get_response_error_name(rx_err->error));
-		return -1;
+		ret = -1;
+		goto out;
 	} else if (block_sec_out != NULL) {
+#ifdef DEBUG_LIBRFID
+		struct iso15693_response_sec *rx_pkt_sec =
+			(struct iso15693_response_sec *)rx->data;
+
 		DEBUGPC(" block_sec_stat: 0x%02x\n",rx_pkt_sec->block_sec);
-		memcpy(data, rx_pkt_sec->data, rx_len-2);
-		return rx_len-2;
+#endif
+		/* strip flags and block security status */
+		if (!rfid_buf_pull(rx, 2)) {
+			ret = -1;
+			goto out;
+		}
 	} else {
-		memcpy(data, rx_pkt->data, rx_len-1); /* FIXME rc-3 in case of CRC */
-		return rx_len-1;
+		/* FIXME rc-3 in case of CRC */
+		rfid_buf_pull(rx, 1);
 	}
+
+	memcpy(data, rx->data, rfid_buf_len(rx));
+	ret = rfid_buf_len(rx);
+
+out:
+	rfid_buf_free(rx);
+	rfid_buf_free(tx);
+	return ret;
 }
 
 int
 iso15693_write_block(struct rfid_layer2_handle *handle,
 		     u_int8_t blocknr, u_int32_t *data, unsigned int len)
 {
-    int ret;
+	int ret;
 	unsigned char *errstr;
-	unsigned int rx_len, tx_len,timeout;
-
-	union{
-		struct iso15693_request_block_selected sel;
-		struct iso15693_request_block_addressed addr;
-        u_int32_t buf[sizeof(struct iso15693_request_block_addressed)+ISO15693_BLOCK_SIZE_MAX];
-	} tx_req;
-
-	u_int8_t resp[ISO15693_RESP_SIZE_MAX];
+	unsigned int rx_len, timeout;
+	struct rfid_buf *tx, *rx;
 	struct iso15693_response *rx_pkt;
 	struct iso15693_err_resp *rx_err;
 
-	rx_pkt = (struct iso15693_response *)&resp[0];
-	rx_err = (struct iso15693_err_resp *)&resp[0];
-	rx_len = sizeof(resp);
-
 	if (len > ISO15693_BLOCK_SIZE_MAX)
 		return -1;
 
-	//return -1;
-
-	memset(&tx_req,0,sizeof(tx_req));
-	tx_req.sel.head.command = ISO15693_CMD_WRITE_BLOCK_SINGLE;
+	tx = rfid_buf_alloc();
+	rx = rfid_buf_alloc();
+	if (!tx || !rx) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	rfid_buf_init(rx);
 
-	if (handle->priv.iso15693.vicc_fast) {
-		tx_req.sel.head.flags |= RFID_15693_F_RATE_HIGH;
+	if (handle->priv.iso15693.vicc_fast)
 		timeout = iso15693_timing[ISO15693_T_FAST][ISO15693_T4_WRITE];
-	} else
+	else
 		timeout = iso15693_timing[ISO15693_T_SLOW][ISO15693_T4_WRITE];
 
-	if (handle->priv.iso15693.vicc_two_subc)
-		tx_req.sel.head.flags |= RFID_15693_F_SUBC_TWO;
+	*rfid_buf_put(tx, 1) = blocknr;
+	memcpy(rfid_buf_put(tx, len), data, len);
+	ret = iso15693_push_request(handle, tx, ISO15693_CMD_WRITE_BLOCK_SINGLE,
+				    0);
+	if (ret < 0)
+		goto out;
 
-	if (handle->priv.iso15693.state == RFID_15693_STATE_SELECTED) {
-		tx_len=sizeof(struct iso15693_request_block_selected)+len;
-		tx_req.sel.head.flags |= RFID_15693_F4_SELECTED;
-		tx_req.sel.blocknum = blocknr;
-		memcpy(&tx_req.sel.data,data,len);
-	} else {
-		memcpy(&tx_req.addr.uid, handle->uid, ISO15693_UID_LEN);
-		tx_len=sizeof(struct iso15693_request_block_addressed)+len;
-		tx_req.addr.head.flags |= RFID_15693_F4_ADDRESS;
-		tx_req.addr.blocknum = blocknr;
-		memcpy(&tx_req.addr.data,data,len);
-	}
+	DEBUGP("tx_len=%u\n", rfid_buf_len(tx));
 
-	//DEBUGP("sizeof: addr: %d sel:%d\n",sizeof(struct iso15693_request_read_addressed),sizeof(struct iso15693_request_read_selected));
-	DEBUGP("tx_len=%u", tx_len); DEBUGPC(" rx_len=%u\n",rx_len);
-
-	ret = iso15693_transceive(handle, RFID_15693_FRAME, (u_int8_t*)&tx_req,
-				  tx_len, resp, &rx_len, timeout, 0);
+	ret = rfid_layer2_transceive_buf(handle, RFID_15693_FRAME, tx, rx,
+					 timeout, 0);
+	rx_len = rfid_buf_len(rx);
 
 	if (ret == -ETIMEDOUT)
 		errstr = "(TIMEOUT)";
@@ -292,25 +296,70 @@ iso15693_write_block(struct rfid_layer2_handle *handle,
 	DEBUGP("length: %d rx_len: %d ret: %d%s\n",len,rx_len,ret,errstr);
 
 	if (ret < 0)
-		return ret;
+		goto out;
+
+	if (rx_len < 1 || rx_len > len+1) {
+		ret = -1;
+		goto out;
+	}
+
+	rx_pkt = (struct iso15693_response *)rx->data;
+	rx_err = (struct iso15693_err_resp *)rx->data;
 
-	if (rx_len > len+1)
-		return -1;
 	DEBUGP("error_flag: %d", rx_pkt->flags & RFID_15693_RF_ERROR);
 	if (rx_pkt->flags & RFID_15693_RF_ERROR) {
 		DEBUGPC(" -> error: %02x '%s'\n", rx_err->error,
 			iso15693_get_response_error_name(rx_err->error));
-		return -1;
-	} else {
-		//DEBUGPC(" block_sec_stat: 0x%02x\n",rx_pkt->data[0]);
-		//memcpy(data, rx_pkt->data, rx_len-1); /* FIXME rc-3 in case of CRC */
-		//return rx_len-1;
-        return 0;
-	}
+		ret = -1;
+	} else
+		ret = 0;
 
+out:
+	rfid_buf_free(rx);
+	rfid_buf_free(tx);
+	return ret;
 }
 
 
+/* Presence check by an addressed GET SYSTEM INFORMATION.  Any answer,
+ * even an error response, proves that the VICC is still there. */
+static int
+iso15693_presence(struct rfid_layer2_handle *handle)
+{
+	struct rfid_buf *tx, *rx;
+	unsigned int timeout;
+	int ret;
+
+	tx = rfid_buf_alloc();
+	rx = rfid_buf_alloc();
+	if (!tx || !rx) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	rfid_buf_init(rx);
+
+	if (handle->priv.iso15693.vicc_fast)
+		timeout = iso15693_timing[ISO15693_T_FAST][ISO15693_T4];
+	else
+		timeout = iso15693_timing[ISO15693_T_SLOW][ISO15693_T4];
+
+	ret = iso15693_push_request(handle, tx, ISO15693_CMD_GET_SYSINFO, 0);
+	if (ret < 0)
+		goto out;
+
+	ret = rfid_layer2_transceive_buf(handle, RFID_15693_FRAME, tx, rx,
+					 timeout, 0);
+	if (ret < 0 || rfid_buf_len(rx) < 1)
+		ret = 0;
+	else
+		ret = 1;
+
+out:
+	rfid_buf_free(rx);
+	rfid_buf_free(tx);
+	return ret;
+}
+
 #if 0
 
 static int
@@ -804,8 +853,9 @@ const struct rfid_layer2 rfid_layer2_iso15693 = {
 		.init 		= &iso15693_init,
 		.open 		= &iso15693_anticol,
 		//.open		= &iso15693_select,
-		//.transceive 	= &iso15693_transceive,
+		.transceive 	= &iso15693_transceive,
 		.close 		= &iso15693_stay_quiet,
+		.presence	= &iso15693_presence,
 		.fini 		= &iso15693_fini,
 		.setopt		= &iso15693_setopt,
 		.getopt		= &iso15693_getopt,
@@ -0,0 +1,558 @@
+/* librfid - multi-reader manager
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_scan.h>
+#include <librfid/rfid_manager.h>
+
+static void ts_add_ms(struct timespec *ts, unsigned int ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static int ts_before(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec;
+	return a->tv_nsec < b->tv_nsec;
+}
+
+static void reader_schedule_in(struct rfid_manager_reader *r, unsigned int ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, &r->next_scan);
+	ts_add_ms(&r->next_scan, ms);
+}
+
+/* worker deques */
+
+static void dq_push(struct rfid_manager_worker *w,
+		    struct rfid_manager_reader *r)
+{
+	pthread_mutex_lock(&w->lock);
+	w->dq[(w->head + w->len++) % RFID_MANAGER_READERS_MAX] = r;
+	pthread_mutex_unlock(&w->lock);
+	__atomic_fetch_add(&w->mgr->runnable, 1, __ATOMIC_RELAXED);
+}
+
+static struct rfid_manager_reader *dq_take(struct rfid_manager_worker *w)
+{
+	struct rfid_manager_reader *r = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->len) {
+		r = w->dq[w->head];
+		w->head = (w->head + 1) % RFID_MANAGER_READERS_MAX;
+		w->len--;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	if (r)
+		__atomic_fetch_sub(&w->mgr->runnable, 1, __ATOMIC_RELAXED);
+	return r;
+}
+
+static struct rfid_manager_reader *dq_steal(struct rfid_manager_worker *w)
+{
+	struct rfid_manager_reader *r = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->len) {
+		w->len--;
+		r = w->dq[(w->head + w->len) % RFID_MANAGER_READERS_MAX];
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	if (r)
+		__atomic_fetch_sub(&w->mgr->runnable, 1, __ATOMIC_RELAXED);
+	return r;
+}
+
+static struct rfid_manager_reader *
+manager_steal(struct rfid_manager *mgr, struct rfid_manager_worker *self)
+{
+	unsigned int i, me = self - mgr->worker;
+	struct rfid_manager_reader *r;
+
+	for (i = 1; i < mgr->num_workers; i++) {
+		r = dq_steal(&mgr->worker[(me + i) % mgr->num_workers]);
+		if (r)
+			return r;
+	}
+
+	return NULL;
+}
+
+/* call with mgr->lock held.  Queues all readers that are due to 'w'.
+ * Returns the number of queued readers, 'next' is set to the time the
+ * next reader becomes due. */
+static int manager_schedule(struct rfid_manager *mgr,
+			    struct rfid_manager_worker *w,
+			    struct timespec *next)
+{
+	struct timespec now;
+	unsigned int i;
+	int num = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	*next = now;
+	ts_add_ms(next, mgr->params.idle_interval);
+
+	for (i = 0; i < mgr->num_readers; i++) {
+		struct rfid_manager_reader *r = &mgr->reader[i];
+
+		if (r->queued)
+			continue;
+
+		if (ts_before(&now, &r->next_scan)) {
+			if (ts_before(&r->next_scan, next))
+				*next = r->next_scan;
+			continue;
+		}
+
+		r->queued = 1;
+		dq_push(w, r);
+		num++;
+	}
+
+	/* let idle workers steal some of them */
+	if (num > 1)
+		pthread_cond_broadcast(&mgr->cond);
+
+	return num;
+}
+
+static void manager_deliver(struct rfid_manager *mgr,
+			    struct rfid_monitor_event *ev)
+{
+	rfid_manager_cb *cb;
+	void *cb_data;
+
+	pthread_mutex_lock(&mgr->lock);
+	cb = mgr->cb;
+	cb_data = mgr->cb_data;
+	pthread_mutex_unlock(&mgr->lock);
+
+	if (cb)
+		cb(mgr, ev, cb_data);
+
+	if (!(mgr->params.flags & RFID_MONITOR_F_EVENTFD))
+		return;
+
+	pthread_mutex_lock(&mgr->lock);
+	rfid_event_queue_push(&mgr->queue, ev);
+	pthread_mutex_unlock(&mgr->lock);
+}
+
+static void reader_removed(struct rfid_manager *mgr,
+			   struct rfid_manager_reader *r)
+{
+	r->cur.type = RFID_MONITOR_EV_REMOVED;
+	gettimeofday(&r->cur.tv, NULL);
+	manager_deliver(mgr, &r->cur);
+	r->present = 0;
+	clock_gettime(CLOCK_MONOTONIC, &r->empty_since);
+}
+
+/* one step of the rfid_monitor state machine: either a presence check of
+ * the current card, or a scan */
+static void manager_scan_step(struct rfid_manager *mgr,
+			      struct rfid_manager_reader *r)
+{
+	struct rfid_monitor_params *p = &mgr->params;
+	struct rfid_monitor_event ev;
+	int rc, ret;
+
+	if (r->l2h) {
+		if (r->ph)
+			ret = rfid_protocol_presence(r->ph);
+		else
+			ret = rfid_layer2_presence(r->l2h);
+		if (ret == 1) {
+			reader_schedule_in(r, p->presence_interval);
+			return;
+		}
+
+		rfid_monitor_release(r->l2h, r->ph, ret == 0);
+		r->l2h = NULL;
+		r->ph = NULL;
+
+		if (ret < 0) {
+			/* no presence check: reset the card by cycling the
+			 * RF field and scan again */
+			rfid_monitor_rf(r->rh, 0);
+			r->rf_off = 1;
+			reader_schedule_in(r, p->presence_interval);
+			return;
+		}
+
+		reader_removed(mgr, r);
+		reader_schedule_in(r, p->scan_interval);
+		return;
+	}
+
+	if (r->rf_off) {
+		rfid_monitor_rf(r->rh, 1);
+		r->rf_off = 0;
+	}
+
+	rc = rfid_scan(r->rh, &r->l2h, &r->ph);
+	if (rc < 2) {
+		r->l2h = NULL;
+		r->ph = NULL;
+
+		if (r->present)
+			reader_removed(mgr, r);
+
+		if (rfid_monitor_ms_since(&r->empty_since) < p->idle_after) {
+			reader_schedule_in(r, p->scan_interval);
+			return;
+		}
+
+		/* field has been empty for a while: lower duty cycle */
+		if (p->flags & RFID_MONITOR_F_RF_KILL) {
+			rfid_monitor_rf(r->rh, 0);
+			r->rf_off = 1;
+		}
+		reader_schedule_in(r, p->idle_interval);
+		return;
+	}
+	if (rc == 2)
+		r->ph = NULL;
+
+	rfid_monitor_fill_event(&ev, RFID_MONITOR_EV_ARRIVED, r->l2h, r->ph);
+	ev.reader = r->idx;
+	if (r->present && (ev.uid_len != r->cur.uid_len ||
+			   memcmp(ev.uid, r->cur.uid, ev.uid_len)))
+		reader_removed(mgr, r);
+	if (!r->present) {
+		manager_deliver(mgr, &ev);
+		r->cur = ev;
+		r->cur.l2h = NULL;
+		r->cur.ph = NULL;
+		r->present = 1;
+	}
+
+	reader_schedule_in(r, p->presence_interval);
+}
+
+static void manager_run_reader(struct rfid_manager *mgr,
+			       struct rfid_manager_reader *r)
+{
+	struct rfid_manager_job *job;
+	struct timespec now;
+
+	pthread_mutex_lock(&mgr->lock);
+	job = r->jobs;
+	if (job) {
+		r->jobs = job->next;
+		if (!r->jobs)
+			r->jobs_tail = &r->jobs;
+	}
+	pthread_mutex_unlock(&mgr->lock);
+
+	if (job) {
+		job->fn(r->rh, r->l2h, r->ph, job->data);
+		free(job);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!ts_before(&now, &r->next_scan))
+		manager_scan_step(mgr, r);
+}
+
+/* put the reader back into our deque if it has more work to do */
+static void manager_requeue(struct rfid_manager *mgr,
+			    struct rfid_manager_worker *w,
+			    struct rfid_manager_reader *r)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&mgr->lock);
+	if (r->jobs || !ts_before(&now, &r->next_scan)) {
+		dq_push(w, r);
+		if (__atomic_load_n(&mgr->runnable, __ATOMIC_RELAXED) > 1)
+			pthread_cond_signal(&mgr->cond);
+	} else
+		r->queued = 0;
+	pthread_mutex_unlock(&mgr->lock);
+}
+
+static void *manager_worker(void *arg)
+{
+	struct rfid_manager_worker *w = arg;
+	struct rfid_manager *mgr = w->mgr;
+	struct rfid_manager_reader *r;
+	struct timespec next;
+
+	while (1) {
+		r = dq_take(w);
+		if (!r)
+			r = manager_steal(mgr, w);
+		if (r) {
+			manager_run_reader(mgr, r);
+			manager_requeue(mgr, w, r);
+			continue;
+		}
+
+		pthread_mutex_lock(&mgr->lock);
+		if (mgr->stopping) {
+			pthread_mutex_unlock(&mgr->lock);
+			break;
+		}
+		if (!manager_schedule(mgr, w, &next) &&
+		    !__atomic_load_n(&mgr->runnable, __ATOMIC_RELAXED))
+			pthread_cond_timedwait(&mgr->cond, &mgr->lock, &next);
+		pthread_mutex_unlock(&mgr->lock);
+	}
+
+	return NULL;
+}
+
+struct rfid_manager *
+rfid_manager_create(unsigned int num_workers,
+		    const struct rfid_monitor_params *params)
+{
+	struct rfid_manager *mgr;
+	pthread_condattr_t attr;
+	unsigned int i;
+
+	mgr = malloc(sizeof(*mgr));
+	if (!mgr)
+		return NULL;
+	memset(mgr, 0, sizeof(*mgr));
+
+	rfid_monitor_params_init(&mgr->params, params);
+
+	if (num_workers < 1)
+		num_workers = 1;
+	if (num_workers > RFID_MANAGER_WORKERS_MAX)
+		num_workers = RFID_MANAGER_WORKERS_MAX;
+	mgr->num_workers = num_workers;
+
+	if (mgr->params.flags & RFID_MONITOR_F_EVENTFD &&
+	    rfid_event_queue_init(&mgr->queue, RFID_MANAGER_QUEUE_LEN) < 0) {
+		free(mgr);
+		return NULL;
+	}
+
+	pthread_mutex_init(&mgr->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mgr->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	for (i = 0; i < mgr->num_workers; i++) {
+		mgr->worker[i].mgr = mgr;
+		pthread_mutex_init(&mgr->worker[i].lock, NULL);
+	}
+
+	return mgr;
+}
+
+void rfid_manager_destroy(struct rfid_manager *mgr)
+{
+	unsigned int i;
+
+	rfid_manager_stop(mgr);
+
+	for (i = 0; i < mgr->num_readers; i++) {
+		struct rfid_manager_reader *r = &mgr->reader[i];
+
+		while (r->jobs) {
+			struct rfid_manager_job *job = r->jobs;
+
+			r->jobs = job->next;
+			free(job);
+		}
+	}
+
+	for (i = 0; i < mgr->num_workers; i++)
+		pthread_mutex_destroy(&mgr->worker[i].lock);
+	pthread_cond_destroy(&mgr->cond);
+	pthread_mutex_destroy(&mgr->lock);
+	rfid_event_queue_fini(&mgr->queue);
+	free(mgr);
+}
+
+int rfid_manager_add_reader(struct rfid_manager *mgr,
+			    struct rfid_reader_handle *rh)
+{
+	struct rfid_manager_reader *r;
+
+	if (mgr->running)
+		return -EBUSY;
+	if (mgr->num_readers >= RFID_MANAGER_READERS_MAX)
+		return -ENOSPC;
+
+	r = &mgr->reader[mgr->num_readers];
+	memset(r, 0, sizeof(*r));
+	r->rh = rh;
+	r->idx = mgr->num_readers;
+	r->jobs_tail = &r->jobs;
+	clock_gettime(CLOCK_MONOTONIC, &r->empty_since);
+
+	return mgr->num_readers++;
+}
+
+void rfid_manager_set_callback(struct rfid_manager *mgr,
+			       rfid_manager_cb *cb, void *data)
+{
+	pthread_mutex_lock(&mgr->lock);
+	mgr->cb = cb;
+	mgr->cb_data = data;
+	pthread_mutex_unlock(&mgr->lock);
+}
+
+/* 'running' is only changed by the thread controlling the manager, so it
+ * can read it without the lock, but rfid_manager_submit() checks it under
+ * the lock from any thread */
+static void manager_set_running(struct rfid_manager *mgr, int running)
+{
+	pthread_mutex_lock(&mgr->lock);
+	mgr->running = running;
+	pthread_mutex_unlock(&mgr->lock);
+}
+
+int rfid_manager_start(struct rfid_manager *mgr)
+{
+	unsigned int i;
+	int ret;
+
+	if (mgr->running)
+		return -EBUSY;
+
+	mgr->stopping = 0;
+	__atomic_store_n(&mgr->runnable, 0, __ATOMIC_RELAXED);
+	for (i = 0; i < mgr->num_readers; i++) {
+		mgr->reader[i].queued = 0;
+		reader_schedule_in(&mgr->reader[i], 0);
+	}
+
+	for (i = 0; i < mgr->num_workers; i++) {
+		struct rfid_manager_worker *w = &mgr->worker[i];
+
+		w->head = w->len = 0;
+		ret = pthread_create(&w->thread, NULL, &manager_worker, w);
+		if (ret) {
+			mgr->num_workers = i;
+			manager_set_running(mgr, 1);
+			rfid_manager_stop(mgr);
+			return -ret;
+		}
+	}
+	manager_set_running(mgr, 1);
+
+	return 0;
+}
+
+int rfid_manager_stop(struct rfid_manager *mgr)
+{
+	unsigned int i;
+
+	if (!mgr->running)
+		return 0;
+
+	pthread_mutex_lock(&mgr->lock);
+	mgr->stopping = 1;
+	pthread_cond_broadcast(&mgr->cond);
+	pthread_mutex_unlock(&mgr->lock);
+
+	for (i = 0; i < mgr->num_workers; i++)
+		pthread_join(mgr->worker[i].thread, NULL);
+
+	/* all workers are gone, we own the readers again */
+	for (i = 0; i < mgr->num_readers; i++) {
+		struct rfid_manager_reader *r = &mgr->reader[i];
+
+		if (r->l2h)
+			rfid_monitor_release(r->l2h, r->ph, 1);
+		r->l2h = NULL;
+		r->ph = NULL;
+		if (r->rf_off)
+			rfid_monitor_rf(r->rh, 1);
+		r->rf_off = 0;
+	}
+	manager_set_running(mgr, 0);
+
+	return 0;
+}
+
+int rfid_manager_submit(struct rfid_manager *mgr, unsigned int reader,
+			rfid_manager_job_fn *fn, void *data)
+{
+	struct rfid_manager_reader *r;
+	struct rfid_manager_job *job;
+
+	if (reader >= mgr->num_readers || !fn)
+		return -EINVAL;
+	r = &mgr->reader[reader];
+
+	job = malloc(sizeof(*job));
+	if (!job)
+		return -ENOMEM;
+	job->next = NULL;
+	job->fn = fn;
+	job->data = data;
+
+	pthread_mutex_lock(&mgr->lock);
+	*r->jobs_tail = job;
+	r->jobs_tail = &job->next;
+	if (mgr->running && !r->queued) {
+		r->queued = 1;
+		dq_push(&mgr->worker[mgr->next_worker++ % mgr->num_workers],
+			r);
+		pthread_cond_signal(&mgr->cond);
+	}
+	pthread_mutex_unlock(&mgr->lock);
+
+	return 0;
+}
+
+int rfid_manager_get_fd(struct rfid_manager *mgr)
+{
+	if (!mgr->queue.ev)
+		return -EINVAL;
+
+	return mgr->queue.fd;
+}
+
+int rfid_manager_read_event(struct rfid_manager *mgr,
+			    struct rfid_monitor_event *ev)
+{
+	int ret;
+
+	pthread_mutex_lock(&mgr->lock);
+	ret = rfid_event_queue_pop(&mgr->queue, ev);
+	pthread_mutex_unlock(&mgr->lock);
+
+	return ret;
+}
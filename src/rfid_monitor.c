@@ -0,0 +1,456 @@
+/* librfid - card arrival / removal monitor
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_scan.h>
+#include <librfid/rfid_monitor.h>
+
+static const struct rfid_monitor_params rfid_monitor_defaults = {
+	.flags			= 0,
+	.scan_interval		= 100,
+	.presence_interval	= 100,
+	.idle_after		= 5000,
+	.idle_interval		= 500,
+};
+
+/* copy 'src' (may be NULL) to 'dst', filling in defaults for unset
+ * intervals */
+void rfid_monitor_params_init(struct rfid_monitor_params *dst,
+			      const struct rfid_monitor_params *src)
+{
+	*dst = src ? *src : rfid_monitor_defaults;
+
+	if (!dst->scan_interval)
+		dst->scan_interval = rfid_monitor_defaults.scan_interval;
+	if (!dst->presence_interval)
+		dst->presence_interval = rfid_monitor_defaults.presence_interval;
+	if (!dst->idle_interval)
+		dst->idle_interval = rfid_monitor_defaults.idle_interval;
+}
+
+unsigned int rfid_monitor_ms_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000 +
+	       (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* sleep for 'ms' milliseconds, or until the monitor is stopped.  Returns
+ * non-zero if the monitor is to be stopped */
+static int monitor_sleep(struct rfid_monitor *mon, unsigned int ms)
+{
+	struct timespec ts;
+	int stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&mon->lock);
+	while (!mon->stopping) {
+		if (pthread_cond_timedwait(&mon->cond, &mon->lock,
+					   &ts) == ETIMEDOUT)
+			break;
+	}
+	stop = mon->stopping;
+	pthread_mutex_unlock(&mon->lock);
+
+	return stop;
+}
+
+/* like monitor_sleep(), but returns early when the reader signals a card
+ * entering or leaving the field.  Waits in slices to notice a stop. */
+#define MONITOR_EVENT_SLICE	100
+
+static int monitor_wait_event(struct rfid_monitor *mon, unsigned int ms)
+{
+	struct timespec start;
+	unsigned int elapsed, slice;
+	int ret, stop = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (!stop && (elapsed = rfid_monitor_ms_since(&start)) < ms) {
+		slice = ms - elapsed;
+		if (slice > MONITOR_EVENT_SLICE)
+			slice = MONITOR_EVENT_SLICE;
+
+		ret = rfid_reader_wait_event(mon->rh, slice);
+		if (ret < 0)
+			return monitor_sleep(mon, ms - elapsed);
+
+		pthread_mutex_lock(&mon->lock);
+		stop = mon->stopping;
+		pthread_mutex_unlock(&mon->lock);
+
+		if (ret & RFID_READER_EV_SLOT_CHANGE)
+			break;
+	}
+
+	return stop;
+}
+
+void rfid_monitor_rf(struct rfid_reader_handle *rh, int on)
+{
+	unsigned int opt = on ? 0 : 1;
+
+	rfid_reader_setopt(rh, RFID_OPT_RDR_RF_KILL, &opt, sizeof(opt));
+}
+
+int rfid_event_queue_init(struct rfid_event_queue *q, unsigned int size)
+{
+	memset(q, 0, sizeof(*q));
+
+	q->ev = malloc(size * sizeof(*q->ev));
+	if (!q->ev)
+		return -ENOMEM;
+	q->size = size;
+
+	q->fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+	if (q->fd < 0) {
+		free(q->ev);
+		q->ev = NULL;
+		return -errno;
+	}
+
+	return 0;
+}
+
+void rfid_event_queue_fini(struct rfid_event_queue *q)
+{
+	if (!q->ev)
+		return;
+
+	close(q->fd);
+	free(q->ev);
+	q->ev = NULL;
+}
+
+void rfid_event_queue_push(struct rfid_event_queue *q,
+			   const struct rfid_monitor_event *ev)
+{
+	struct rfid_monitor_event *slot;
+	u_int64_t one = 1;
+
+	if (q->len == q->size) {
+		DEBUGP("event queue full, dropping oldest event\n");
+		q->head = (q->head + 1) % q->size;
+		q->len--;
+		q->dropped++;
+	} else if (write(q->fd, &one, sizeof(one)) != sizeof(one)) {
+		/* an event that can't be signalled isn't queued either */
+		DEBUGP("can't signal event: %s\n", strerror(errno));
+		q->dropped++;
+		return;
+	}
+
+	slot = &q->ev[(q->head + q->len++) % q->size];
+	*slot = *ev;
+
+	/* the handles don't survive the callback */
+	slot->l2h = NULL;
+	slot->ph = NULL;
+}
+
+int rfid_event_queue_pop(struct rfid_event_queue *q,
+			 struct rfid_monitor_event *ev)
+{
+	u_int64_t cnt;
+
+	if (!q->len)
+		return 0;
+
+	*ev = q->ev[q->head];
+	q->head = (q->head + 1) % q->size;
+	q->len--;
+	if (read(q->fd, &cnt, sizeof(cnt)) != sizeof(cnt)) {
+		/* the counter is never below the queue length */
+		DEBUGP("can't consume event: %s\n", strerror(errno));
+	}
+
+	return 1;
+}
+
+static void monitor_deliver(struct rfid_monitor *mon,
+			    struct rfid_monitor_event *ev)
+{
+	rfid_monitor_cb *cb;
+	void *cb_data;
+
+	/* rfid_monitor_set_callback() may be called while running */
+	pthread_mutex_lock(&mon->lock);
+	cb = mon->cb;
+	cb_data = mon->cb_data;
+	pthread_mutex_unlock(&mon->lock);
+
+	if (cb)
+		cb(mon, ev, cb_data);
+
+	if (!(mon->params.flags & RFID_MONITOR_F_EVENTFD))
+		return;
+
+	pthread_mutex_lock(&mon->lock);
+	rfid_event_queue_push(&mon->queue, ev);
+	pthread_mutex_unlock(&mon->lock);
+}
+
+void rfid_monitor_fill_event(struct rfid_monitor_event *ev, unsigned int type,
+			     struct rfid_layer2_handle *l2h,
+			     struct rfid_protocol_handle *ph)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	gettimeofday(&ev->tv, NULL);
+
+	ev->uid_len = sizeof(ev->uid);
+	rfid_layer2_getopt(l2h, RFID_OPT_LAYER2_UID, ev->uid, &ev->uid_len);
+	ev->layer2 = l2h->l2->id;
+	ev->protocol = ph ? (int) ph->proto->id : -1;
+	ev->l2h = l2h;
+	ev->ph = ph;
+}
+
+void rfid_monitor_release(struct rfid_layer2_handle *l2h,
+			  struct rfid_protocol_handle *ph, int close)
+{
+	if (ph) {
+		if (close)
+			rfid_protocol_close(ph);
+		rfid_protocol_fini(ph);
+	}
+	if (close)
+		rfid_layer2_close(l2h);
+	rfid_layer2_fini(l2h);
+}
+
+static void *monitor_thread(void *arg)
+{
+	struct rfid_monitor *mon = arg;
+	struct rfid_monitor_params *p = &mon->params;
+	struct rfid_monitor_event cur, ev;
+	struct rfid_layer2_handle *l2h;
+	struct rfid_protocol_handle *ph;
+	struct timespec empty_since;
+	int present = 0, stop = 0;
+	int rc, ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &empty_since);
+
+	while (!stop) {
+		l2h = NULL;
+		ph = NULL;
+
+		rc = rfid_scan(mon->rh, &l2h, &ph);
+		if (rc < 2) {
+			if (present) {
+				cur.type = RFID_MONITOR_EV_REMOVED;
+				gettimeofday(&cur.tv, NULL);
+				monitor_deliver(mon, &cur);
+				present = 0;
+				clock_gettime(CLOCK_MONOTONIC, &empty_since);
+			}
+
+			if (rfid_monitor_ms_since(&empty_since) <
+							p->idle_after) {
+				stop = monitor_sleep(mon, p->scan_interval);
+				continue;
+			}
+
+			/* field has been empty for a while: lower duty cycle.
+			 * Readers with slot change notifications are woken up
+			 * by the firmware as soon as a card shows up, as long
+			 * as the field stays on. */
+			if (p->flags & RFID_MONITOR_F_RF_KILL) {
+				rfid_monitor_rf(mon->rh, 0);
+				stop = monitor_sleep(mon, p->idle_interval);
+				rfid_monitor_rf(mon->rh, 1);
+			} else
+				stop = monitor_wait_event(mon, p->idle_interval);
+			continue;
+		}
+		if (rc == 2)
+			ph = NULL;
+
+		rfid_monitor_fill_event(&ev, RFID_MONITOR_EV_ARRIVED, l2h, ph);
+		if (present && (ev.uid_len != cur.uid_len ||
+				memcmp(ev.uid, cur.uid, ev.uid_len))) {
+			/* card was swapped between two scans */
+			cur.type = RFID_MONITOR_EV_REMOVED;
+			gettimeofday(&cur.tv, NULL);
+			monitor_deliver(mon, &cur);
+			present = 0;
+		}
+		if (!present) {
+			monitor_deliver(mon, &ev);
+			cur = ev;
+			cur.l2h = NULL;
+			cur.ph = NULL;
+			present = 1;
+		}
+
+		/* watch the card until it is gone */
+		ret = 1;
+		while (!(stop = monitor_sleep(mon, p->presence_interval))) {
+			if (ph)
+				ret = rfid_protocol_presence(ph);
+			else
+				ret = rfid_layer2_presence(l2h);
+			if (ret != 1)
+				break;
+		}
+
+		if (ret < 0) {
+			/* No presence check for this card type.  Don't halt
+			 * the card but reset it by cycling the RF field, so
+			 * that the next scan finds it again. */
+			rfid_monitor_release(l2h, ph, 0);
+			rfid_monitor_rf(mon->rh, 0);
+			stop = monitor_sleep(mon, p->presence_interval);
+			rfid_monitor_rf(mon->rh, 1);
+			continue;
+		}
+
+		rfid_monitor_release(l2h, ph, 1);
+		if (ret == 0) {
+			cur.type = RFID_MONITOR_EV_REMOVED;
+			gettimeofday(&cur.tv, NULL);
+			monitor_deliver(mon, &cur);
+			present = 0;
+			clock_gettime(CLOCK_MONOTONIC, &empty_since);
+		}
+	}
+
+	return NULL;
+}
+
+struct rfid_monitor *
+rfid_monitor_create(struct rfid_reader_handle *rh,
+		    const struct rfid_monitor_params *params)
+{
+	struct rfid_monitor *mon;
+	pthread_condattr_t attr;
+
+	mon = malloc(sizeof(*mon));
+	if (!mon)
+		return NULL;
+	memset(mon, 0, sizeof(*mon));
+
+	mon->rh = rh;
+	rfid_monitor_params_init(&mon->params, params);
+
+	if (mon->params.flags & RFID_MONITOR_F_EVENTFD &&
+	    rfid_event_queue_init(&mon->queue, RFID_MONITOR_QUEUE_LEN) < 0) {
+		free(mon);
+		return NULL;
+	}
+
+	pthread_mutex_init(&mon->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mon->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return mon;
+}
+
+void rfid_monitor_destroy(struct rfid_monitor *mon)
+{
+	rfid_monitor_stop(mon);
+
+	pthread_cond_destroy(&mon->cond);
+	pthread_mutex_destroy(&mon->lock);
+	rfid_event_queue_fini(&mon->queue);
+	free(mon);
+}
+
+void rfid_monitor_set_callback(struct rfid_monitor *mon,
+			       rfid_monitor_cb *cb, void *data)
+{
+	pthread_mutex_lock(&mon->lock);
+	mon->cb = cb;
+	mon->cb_data = data;
+	pthread_mutex_unlock(&mon->lock);
+}
+
+int rfid_monitor_start(struct rfid_monitor *mon)
+{
+	int ret;
+
+	if (mon->running)
+		return -EBUSY;
+
+	mon->stopping = 0;
+	ret = pthread_create(&mon->thread, NULL, &monitor_thread, mon);
+	if (ret)
+		return -ret;
+	mon->running = 1;
+
+	return 0;
+}
+
+/* must not be called from the callback */
+int rfid_monitor_stop(struct rfid_monitor *mon)
+{
+	if (!mon->running)
+		return 0;
+
+	pthread_mutex_lock(&mon->lock);
+	mon->stopping = 1;
+	pthread_cond_signal(&mon->cond);
+	pthread_mutex_unlock(&mon->lock);
+
+	pthread_join(mon->thread, NULL);
+	mon->running = 0;
+
+	return 0;
+}
+
+int rfid_monitor_get_fd(struct rfid_monitor *mon)
+{
+	if (!mon->queue.ev)
+		return -EINVAL;
+
+	return mon->queue.fd;
+}
+
+int rfid_monitor_read_event(struct rfid_monitor *mon,
+			    struct rfid_monitor_event *ev)
+{
+	int ret;
+
+	pthread_mutex_lock(&mon->lock);
+	ret = rfid_event_queue_pop(&mon->queue, ev);
+	pthread_mutex_unlock(&mon->lock);
+
+	return ret;
+}
@@ -0,0 +1,110 @@
+/* librfid - fixed-capacity handle pools
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_asic.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+
+RFID_POOL_DEFINE(rfid_asic_pool, struct rfid_asic_handle, RFID_POOL_ASIC);
+RFID_POOL_DEFINE(rfid_rat_pool, struct rfid_asic_transport_handle,
+		 RFID_POOL_RAT);
+RFID_POOL_DEFINE(rfid_reader_pool, struct rfid_reader_handle,
+		 RFID_POOL_READER);
+RFID_POOL_DEFINE(rfid_layer2_pool, struct rfid_layer2_handle,
+		 RFID_POOL_LAYER2);
+RFID_POOL_DEFINE(rfid_protocol_pool, struct rfid_protocol_handle,
+		 RFID_POOL_PROTOCOL);
+
+/* Handles of one reader may be allocated and freed by different threads
+ * (monitor, manager workers), so the hosted library needs a lock.  The
+ * critical sections are a couple of instructions, spinning is cheaper than
+ * pulling in pthreads.  Static builds are single threaded. */
+#ifdef LIBRFID_STATIC
+#define pool_lock(p)	do {} while (0)
+#define pool_unlock(p)	do {} while (0)
+#else
+static inline void pool_lock(struct rfid_pool *p)
+{
+	while (__sync_lock_test_and_set(&p->lock, 1))
+		while (p->lock)
+			;
+}
+
+static inline void pool_unlock(struct rfid_pool *p)
+{
+	__sync_lock_release(&p->lock);
+}
+#endif
+
+static inline int pool_owns(struct rfid_pool *p, void *obj)
+{
+	unsigned char *o = obj;
+
+	return o >= p->mem && o < p->mem + p->num * p->obj_size;
+}
+
+void *rfid_pool_alloc(struct rfid_pool *p, size_t size)
+{
+	struct rfid_pool_obj *obj;
+
+	if (size > p->obj_size)
+		return NULL;
+
+	pool_lock(p);
+	obj = p->freelist;
+	if (obj)
+		p->freelist = obj->next;
+	else if (p->used < p->num)
+		obj = (struct rfid_pool_obj *)
+				(p->mem + p->used++ * p->obj_size);
+	pool_unlock(p);
+
+	if (obj)
+		return obj;
+
+#ifdef LIBRFID_STATIC
+	DEBUGP("%s exhausted\n", p->name);
+	return NULL;
+#else
+	return malloc(size);
+#endif
+}
+
+void rfid_pool_free(struct rfid_pool *p, void *ptr)
+{
+	struct rfid_pool_obj *obj = ptr;
+
+	if (!obj)
+		return;
+
+	if (!pool_owns(p, obj)) {
+#ifndef LIBRFID_STATIC
+		free(obj);
+#endif
+		return;
+	}
+
+	pool_lock(p);
+	obj->next = p->freelist;
+	p->freelist = obj;
+	pool_unlock(p);
+}
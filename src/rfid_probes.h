@@ -0,0 +1,35 @@
+#ifndef __RFID_PROBES_H
+#define __RFID_PROBES_H
+
+/* USDT (sys/sdt.h) probes of provider "librfid", for attaching bpftrace or
+ * perf to a running process, see utils/bpftrace/.  A probe is a single nop
+ * plus an ELF note, and nothing at all if sys/sdt.h is missing.
+ *
+ * Entry/return pairs are named <function>__entry / <function>__return. */
+
+#if defined(HAVE_SYS_SDT_H) && !defined(LIBRFID_FIRMWARE)
+
+#include <sys/sdt.h>
+
+#define RFID_PROBE1(name, a)			\
+	DTRACE_PROBE1(librfid, name, a)
+#define RFID_PROBE2(name, a, b)			\
+	DTRACE_PROBE2(librfid, name, a, b)
+#define RFID_PROBE3(name, a, b, c)		\
+	DTRACE_PROBE3(librfid, name, a, b, c)
+#define RFID_PROBE4(name, a, b, c, d)		\
+	DTRACE_PROBE4(librfid, name, a, b, c, d)
+#define RFID_PROBE5(name, a, b, c, d, e)	\
+	DTRACE_PROBE5(librfid, name, a, b, c, d, e)
+
+#else
+
+#define RFID_PROBE1(name, a)			do { } while (0)
+#define RFID_PROBE2(name, a, b)			do { } while (0)
+#define RFID_PROBE3(name, a, b, c)		do { } while (0)
+#define RFID_PROBE4(name, a, b, c, d)		do { } while (0)
+#define RFID_PROBE5(name, a, b, c, d, e)	do { } while (0)
+
+#endif
+
+#endif
@@ -38,9 +38,6 @@
 #define MIFARE_UL_CMD_WRITE	0xA2
 #define MIFARE_UL_CMD_READ	0x30
 
-#define MIFARE_CL_READ_FWT	250
-#define MIFARE_CL_WRITE_FWT	600
-
 static int
 mfcl_read(struct rfid_protocol_handle *ph, unsigned int page,
 	  unsigned char *rx_data, unsigned int *rx_len)
@@ -60,11 +57,16 @@ mfcl_read(struct rfid_protocol_handle *ph, unsigned int page,
 				     sizeof(tx), rx_buf, &real_rx_len,
 				     MIFARE_CL_READ_FWT, 0);
 
-	if (ret < 0)
+	/* any failed frame halts the card and ends the Crypto1 session */
+	if (ret < 0) {
+		ph->priv.mfcl.authenticated = 0;
 		return ret;
+	}
 
-	if (real_rx_len == 1 && *rx_buf == 0x04)
+	if (real_rx_len == 1 && *rx_buf == 0x04) {
+		ph->priv.mfcl.authenticated = 0;
 		return -EPERM;
+	}
 
 	if (real_rx_len < *rx_len)
 		*rx_len = real_rx_len;
@@ -95,17 +97,23 @@ mfcl_write(struct rfid_protocol_handle *ph, unsigned int page,
 	ret = rfid_layer2_transceive(ph->l2h, RFID_MIFARE_FRAME, tx, 2, rx,
 				     &rx_len, MIFARE_CL_WRITE_FWT, 0);
 	if (ret < 0)
-		return ret;
+		goto out_halted;
 
 	ret = rfid_layer2_transceive(ph->l2h, RFID_MIFARE_FRAME, tx_data,
 				     tx_len, rx, &rx_len,
 				     MIFARE_CL_WRITE_FWT, 0);
 	if (ret < 0)
-		return ret;
+		goto out_halted;
 
-	if (rx[0] != MIFARE_UL_RESP_ACK)
-		return -EIO;
+	if (rx[0] != MIFARE_UL_RESP_ACK) {
+		ret = -EIO;
+		goto out_halted;
+	}
+
+	return ret;
 
+out_halted:
+	ph->priv.mfcl.authenticated = 0;
 	return ret;
 }
 
@@ -114,6 +122,7 @@ mfcl_getopt(struct rfid_protocol_handle *ph, int optname, void *optval,
 	    unsigned int *optlen)
 {
 	int ret = -EINVAL;
+	const struct iso14443a_fingerprint *fp = ph->l2h->priv.iso14443a.fp;
 	u_int8_t atqa[2];
 	u_int8_t sak;
 	unsigned int atqa_size = sizeof(atqa);
@@ -125,6 +134,13 @@ mfcl_getopt(struct rfid_protocol_handle *ph, int optname, void *optval,
 		if (*optlen < sizeof(*size))
 			return -EINVAL;
 		*optlen = sizeof(*size);
+		/* determined from ATQA/SAK during anticollision */
+		if (fp && fp->size) {
+			*size = fp->size;
+			ret = 0;
+			break;
+		}
+		/* SAK not in the table, go by the ATQA as we always did */
 		ret = 0;
 		rfid_layer2_getopt(ph->l2h, RFID_OPT_14443A_ATQA,
 				   atqa, &atqa_size);
@@ -158,9 +174,39 @@ mfcl_init(struct rfid_layer2_handle *l2h)
 		return NULL;
 
 	ph = malloc_protocol_handle(sizeof(struct rfid_protocol_handle));
+	if (!ph)
+		return NULL;
+
+	ph->priv.mfcl.authenticated = 0;
+
 	return ph;
 }
 
+/* Presence check.  Within a Crypto1 session, READ the block the session
+ * was authenticated for, which keeps the card selected and authenticated.
+ * Without a session there is nothing a Mifare Classic answers short of a
+ * re-select, so fall back to the layer2 check. */
+static int
+mfcl_presence(struct rfid_protocol_handle *ph)
+{
+	unsigned char buf[MIFARE_CL_PAGE_SIZE];
+	unsigned int len = sizeof(buf);
+	int ret;
+
+	if (!ph->priv.mfcl.authenticated)
+		return rfid_layer2_presence(ph->l2h);
+
+	ret = mfcl_read(ph, ph->priv.mfcl.auth_block, buf, &len);
+	if (ret == -EPERM) {
+		/* the card NAKed, so it is there, but the session is gone */
+		return 1;
+	}
+	if (ret < 0)
+		return 0;
+
+	return 1;
+}
+
 static int mfcl_fini(struct rfid_protocol_handle *ph)
 {
 	free_protocol_handle(ph);
@@ -170,12 +216,14 @@ static int mfcl_fini(struct rfid_protocol_handle *ph)
 const struct rfid_protocol rfid_protocol_mfcl = {
 	.id	= RFID_PROTOCOL_MIFARE_CLASSIC,
 	.name	= "Mifare Classic",
+	.no_rw_retry = 1,
 	.fn	= {
 		.init 		= &mfcl_init,
 		.read		= &mfcl_read,
 		.write 		= &mfcl_write,
 		.fini		= &mfcl_fini,
 		.getopt		= &mfcl_getopt,
+		.presence	= &mfcl_presence,
 	},
 };
 
@@ -195,15 +243,59 @@ int mfcl_set_key_ee(struct rfid_protocol_handle *ph, unsigned int addr)
 	return ph->l2h->rh->reader->mifare_classic.setkey_ee(ph->l2h->rh, addr);
 }
 
+int mfcl_ee_load_keys(struct rfid_reader_handle *rh, struct mfcl_ee_key *keys,
+		      unsigned int num)
+{
+	if (!rh->reader->mifare_classic.load_keys_ee)
+		return -ENODEV;
+
+	return rh->reader->mifare_classic.load_keys_ee(rh, keys, num);
+}
+
 int mfcl_auth(struct rfid_protocol_handle *ph, u_int8_t cmd, u_int8_t block)
 {
 	u_int32_t serno = *((u_int32_t *)ph->l2h->uid);
 
+	int ret;
+
 	if (!ph->l2h->rh->reader->mifare_classic.auth)
 		return -ENODEV;
 
-	return ph->l2h->rh->reader->mifare_classic.auth(ph->l2h->rh, cmd,
-						       serno, block);
+	ret = ph->l2h->rh->reader->mifare_classic.auth(ph->l2h->rh, cmd,
+						      serno, block);
+	ph->priv.mfcl.authenticated = ret >= 0;
+	ph->priv.mfcl.auth_block = block;
+
+	return ret;
+}
+
+/* authenticate and read one block, in a single round trip if the reader
+ * can do that by itself */
+int mfcl_auth_read(struct rfid_protocol_handle *ph, u_int8_t cmd,
+		   u_int8_t block, unsigned char *buf, unsigned int *len)
+{
+	const struct rfid_reader *rdr = ph->l2h->rh->reader;
+	u_int32_t serno = *((u_int32_t *)ph->l2h->uid);
+	int ret;
+
+	if (block > MIFARE_CL_PAGE_MAX)
+		return -EINVAL;
+
+	if (rdr->mifare_classic.auth_read) {
+		ret = rdr->mifare_classic.auth_read(ph->l2h->rh, cmd, serno,
+						    block, buf, len);
+		if (ret != -ENOTSUP) {
+			ph->priv.mfcl.authenticated = ret >= 0;
+			ph->priv.mfcl.auth_block = block;
+			return ret;
+		}
+	}
+
+	ret = mfcl_auth(ph, cmd, block);
+	if (ret < 0)
+		return ret;
+
+	return mfcl_read(ph, block, buf, len);
 }
 
 int mfcl_block2sector(u_int8_t block)
@@ -104,13 +104,18 @@ mful_getopt(struct rfid_protocol_handle *ph, int optname, void *optval,
 	    unsigned int *optlen)
 {
 	int ret = -EINVAL;
+	const struct iso14443a_fingerprint *fp = ph->l2h->priv.iso14443a.fp;
 	unsigned int *size = optval;
 
 	switch (optname) {
 	case RFID_OPT_PROTO_SIZE:
 		ret = 0;
-		/* we have to return the size in bytes, not bits */
-		*size = 512/8;
+		if (fp && fp->size)
+			*size = fp->size;
+		else {
+			/* we have to return the size in bytes, not bits */
+			*size = 512/8;
+		}
 		break;
 	}
 
@@ -142,6 +147,19 @@ mful_init(struct rfid_layer2_handle *l2h)
 	return ph;
 }
 
+/* the card is there if it still answers a READ of page 0 */
+static int
+mful_presence(struct rfid_protocol_handle *ph)
+{
+	unsigned char buf[4];
+	unsigned int len = sizeof(buf);
+
+	if (mful_read(ph, 0, buf, &len) < 0)
+		return 0;
+
+	return 1;
+}
+
 static int mful_fini(struct rfid_protocol_handle *ph)
 {
 	free_protocol_handle(ph);
@@ -157,6 +175,7 @@ const struct rfid_protocol rfid_protocol_mful = {
 		.write 		= &mful_write,
 		.fini		= &mful_fini,
 		.getopt		= &mful_getopt,
+		.presence	= &mful_presence,
 	},
 };
 
@@ -30,14 +30,13 @@
 #include <librfid/rfid_protocol.h>
 #include <librfid/rfid_layer2.h>
 #include <librfid/rfid_layer2_iso14443b.h>
+#include <librfid/rfid_buf.h>
 
 #include <librfid/rfid_asic.h>
 #include <librfid/rfid_reader.h>
 
 #include "rfid_iso14443_common.h"
 
-#define RFID_MAX_FRAMELEN	256
-
 #define is_s_block(x) ((x & 0xc0) == 0xc0)
 #define is_r_block(x) ((x & 0xc0) == 0x80)
 #define is_i_block(x) ((x & 0xc0) == 0x00)
@@ -223,7 +222,7 @@ tcl_request_ats(struct rfid_protocol_handle *h)
 #define PPS_DIV_1	0
 static unsigned char d_to_di(struct rfid_protocol_handle *h, unsigned char D)
 {
-	static char DI;
+	unsigned char DI;
 	unsigned int speed = h->l2h->rh->reader->iso14443a.speed;
 	
 	if ((D & ATS_TA_DIV_8) && (speed & RFID_14443A_SPEED_848K))
@@ -323,14 +322,13 @@ tcl_do_pps(struct rfid_protocol_handle *h)
 }
 
 
+/* prepend the prologue field to the information field in 'frame' */
 static int
-tcl_build_prologue2(struct tcl_handle *th, 
-		    unsigned char *prlg, unsigned int *prlg_len, 
-		    unsigned char pcb)
+tcl_push_prologue2(struct tcl_handle *th, struct rfid_buf *frame,
+		   unsigned char pcb)
 {
-	*prlg_len = 1;
-
-	*prlg = pcb;
+	if (rfid_buf_headroom(frame) < 3)
+		return -ENOMEM;
 
 	if (!is_s_block(pcb)) {
 		if (th->toggle) {
@@ -339,41 +337,47 @@ tcl_build_prologue2(struct tcl_handle *th,
 		} else {
 			/* we've not sent a toggle last time: send one */
 			th->toggle = 1;
-			*prlg |= 0x01;
+			pcb |= 0x01;
 		}
 	}
 
-	if (th->flags & TCL_HANDLE_F_CID_USED) {
-		/* ISO 14443-4:2000(E) Section 7.1.1.2 */
-		*prlg |= TCL_PCB_CID_FOLLOWING;
-		(*prlg_len)++;
-		prlg[*prlg_len] = th->cid & 0x0f;
-	}
+	/* the fields are pushed in reverse order: NAD, CID, PCB */
 
 	/* nad only for I-block */
 	if ((th->flags & TCL_HANDLE_F_NAD_USED) && is_i_block(pcb)) {
 		/* ISO 14443-4:2000(E) Section 7.1.1.3 */
 		/* FIXME: in case of chaining only for first frame */
-		*prlg |= TCL_PCB_NAD_FOLLOWING;
-		prlg[*prlg_len] = th->nad;
-		(*prlg_len)++;
+		pcb |= TCL_PCB_NAD_FOLLOWING;
+		*rfid_buf_push(frame, 1) = th->nad;
 	}
 
+	if (th->flags & TCL_HANDLE_F_CID_USED) {
+		/* ISO 14443-4:2000(E) Section 7.1.1.2 */
+		pcb |= TCL_PCB_CID_FOLLOWING;
+		*rfid_buf_push(frame, 1) = th->cid & 0x0f;
+	}
+
+	*rfid_buf_push(frame, 1) = pcb;
+
 	return 0;
 }
 
 static int
-tcl_build_prologue_i(struct tcl_handle *th,
-		     unsigned char *prlg, unsigned int *prlg_len)
+tcl_push_prologue_i(struct tcl_handle *th, struct rfid_buf *frame,
+		    unsigned int chaining)
 {
+	unsigned char pcb = 0x02;
 	/* ISO 14443-4:2000(E) Section 7.1.1.1 */
-	return tcl_build_prologue2(th, prlg, prlg_len, 0x02);
+
+	if (chaining)
+		pcb |= 0x10;
+
+	return tcl_push_prologue2(th, frame, pcb);
 }
 
 static int
-tcl_build_prologue_r(struct tcl_handle *th,
-		     unsigned char *prlg, unsigned int *prlg_len,
-		     unsigned int nak)
+tcl_push_prologue_r(struct tcl_handle *th, struct rfid_buf *frame,
+		    unsigned int nak)
 {
 	unsigned char pcb = 0xa2;
 	/* ISO 14443-4:2000(E) Section 7.1.1.1 */
@@ -381,18 +385,17 @@ tcl_build_prologue_r(struct tcl_handle *th,
 	if (nak)
 		pcb |= 0x10;
 
-	return tcl_build_prologue2(th, prlg, prlg_len, pcb);
+	return tcl_push_prologue2(th, frame, pcb);
 }
 
 static int
-tcl_build_prologue_s(struct tcl_handle *th,
-		     unsigned char *prlg, unsigned int *prlg_len)
+tcl_push_prologue_s(struct tcl_handle *th, struct rfid_buf *frame)
 {
 	/* ISO 14443-4:2000(E) Section 7.1.1.1 */
 
 	/* the only S-block from PCD->PICC is DESELECT,
 	 * well, actually there is the S(WTX) response. */
-	return tcl_build_prologue2(th, prlg, prlg_len, 0xc2);
+	return tcl_push_prologue2(th, frame, 0xc2);
 }
 
 /* FIXME: WTXM implementation */
@@ -480,10 +483,7 @@ tcl_deselect(struct rfid_protocol_handle *h)
 {
 	/* ISO 14443-4:2000(E) Section 8 */
 	int ret;
-	unsigned char frame[3];		/* 3 bytes prologue, no information */
-	unsigned char rx[3];
-	unsigned int rx_len = sizeof(rx);
-	unsigned int prlg_len;
+	struct rfid_buf frame, rx;
 	struct tcl_handle *th = &h->priv.tcl;
 
 	if (th->state != TCL_STATE_ESTABLISHED) {
@@ -491,15 +491,18 @@ tcl_deselect(struct rfid_protocol_handle *h)
 		 * probably better send a HLTA? */
 	}
 
-	/* build DESELECT S-block */
-	ret = tcl_build_prologue_s(th, frame, &prlg_len);
+	rfid_buf_init(&frame);
+	rfid_buf_reserve(&frame, RFID_BUF_HEADROOM);
+	rfid_buf_init(&rx);
+
+	/* build DESELECT S-block, no information field */
+	ret = tcl_push_prologue_s(th, &frame);
 	if (ret < 0)
 		return ret;
 
-	ret = rfid_layer2_transceive(h->l2h, RFID_14443A_FRAME_REGULAR,
-				     frame, prlg_len, rx,
-				     &rx_len, deactivation_fwt(h),
-				     TCL_TRANSP_F_TX_CRC);
+	ret = rfid_layer2_transceive_buf(h->l2h, RFID_14443A_FRAME_REGULAR,
+					 &frame, &rx, deactivation_fwt(h),
+					 TCL_TRANSP_F_TX_CRC);
 	if (ret < 0) {
 		/* FIXME: retransmit, HLT(A|B) */
 		return ret;
@@ -510,230 +513,419 @@ tcl_deselect(struct rfid_protocol_handle *h)
 	return 0;
 }
 
-struct fr_buff {
-	unsigned int frame_len;		/* length of frame */
-	unsigned int hdr_len;		/* length of header within frame */
-	unsigned char data[RFID_MAX_FRAMELEN];
-};
-
-#define frb_payload(x)	(x.data + x.hdr_len)
-
-
-/* RFID transceive buffer. */
-struct rfid_xcvb {
-	struct rfix_xcvb *next;		/* next in queue of buffers */
-
-	u_int64_t timeout;		/* timeout to wait for reply */
-	struct fr_buff tx;
-	struct fr_buff rx;
-
-	//struct rfid_protocol_handle *h;	/* connection to which we belong */
-};
-
-struct tcl_tx_context {
-	const unsigned char *tx;
-	unsigned char *rx;
-	const unsigned char *next_tx_byte;
-	unsigned char *next_rx_byte;
-	unsigned int rx_len;
-	unsigned int tx_len;
-	struct rfid_protocol_handle *h;
-};
-
 #define tcl_ctx_todo(ctx) (ctx->tx_len - (ctx->next_tx_byte - ctx->tx))
 
+/* build the next I-block of a (possibly chained) transmission */
 static int 
-tcl_refill_xcvb(struct rfid_xcvb *xcvb, struct tcl_tx_context *ctx)
+tcl_refill_frame(struct rfid_buf *frame, struct tcl_tx_context *ctx)
 {
 	struct tcl_handle *th = &ctx->h->priv.tcl;
+	unsigned char *payload;
+	unsigned int len;
 
 	if (ctx->next_tx_byte >= ctx->tx + ctx->tx_len) {
-		DEBUGP("tyring to refill tx xcvb but no data left!\n");
+		DEBUGP("tyring to refill tx frame but no data left!\n");
 		return -1;
 	}
 
-	if (tcl_build_prologue_i(th, xcvb->tx.data, 
-				 &xcvb->tx.hdr_len) < 0)
-		return -1;
-
-	if (tcl_ctx_todo(ctx) > th->fsc - xcvb->tx.hdr_len)
-		xcvb->tx.frame_len = max_net_tx_framesize(th);
-	else
-		xcvb->tx.frame_len = tcl_ctx_todo(ctx);
-
-	memcpy(frb_payload(xcvb->tx), ctx->next_tx_byte,
-		xcvb->tx.frame_len);
-
-	ctx->next_tx_byte += xcvb->tx.frame_len;
+	rfid_buf_init(frame);
+	rfid_buf_reserve(frame, RFID_BUF_HEADROOM);
 
-	/* check whether we need to set the chaining bit */
-	if (ctx->next_tx_byte < ctx->tx + ctx->tx_len)
-		xcvb->tx.data[0] |= 0x10;
+	len = tcl_ctx_todo(ctx);
+	if (len > max_net_tx_framesize(th))
+		len = max_net_tx_framesize(th);
 
-	/* add hdr_len after copying the net payload */
-	xcvb->tx.frame_len += xcvb->tx.hdr_len;
+	payload = rfid_buf_put(frame, len);
+	if (!payload)
+		return -1;
+	memcpy(payload, ctx->next_tx_byte, len);
 
-	xcvb->timeout = th->fwt;
+	ctx->next_tx_byte += len;
 
-	return 0;
+	/* the prologue goes in front of the payload, with the chaining
+	 * bit set unless this is the last frame */
+	return tcl_push_prologue_i(th, frame,
+				   ctx->next_tx_byte < ctx->tx + ctx->tx_len);
 }
 
-static void fill_xcvb_wtxm(struct tcl_handle *th, struct rfid_xcvb *xcvb,
-			  unsigned char inf)
+static int tcl_fill_wtxm(struct tcl_handle *th, struct rfid_buf *frame,
+			 unsigned char inf)
 {
-	/* Acknowledge WTXM */
-	tcl_build_prologue_s(th, xcvb->tx.data, &xcvb->tx.hdr_len);
-	/* set two bits that make this block a wtx */
-	xcvb->tx.data[0] |= 0x30;
-	xcvb->tx.data[xcvb->tx.hdr_len] = inf;
-	xcvb->tx.frame_len = xcvb->tx.hdr_len+1;
-	xcvb->timeout = th->fwt * inf;
+	rfid_buf_init(frame);
+	rfid_buf_reserve(frame, RFID_BUF_HEADROOM);
+	*rfid_buf_put(frame, 1) = inf;
+
+	/* Acknowledge WTXM: S-block with the two bits that make it a wtx */
+	return tcl_push_prologue2(th, frame, 0xc2 | 0x30);
 }
 
-static int check_cid(struct tcl_handle *th, struct rfid_xcvb *xcvb)
+static int check_cid(struct tcl_handle *th, struct rfid_buf *frame)
 {
-	if (xcvb->rx.data[0] & TCL_PCB_CID_FOLLOWING) {
-		if (xcvb->rx.data[1] != th->cid) {
+	if (frame->data[0] & TCL_PCB_CID_FOLLOWING) {
+		if (rfid_buf_len(frame) < 2 || frame->data[1] != th->cid) {
 			DEBUGP("CID %u is not valid, we expected %u\n", 
-				xcvb->rx.data[1], th->cid);
+				frame->data[1], th->cid);
 			return 0;
 		}
 	}
 	return 1;
 }
 
+/* Presence check.  ISO 14443-4 Rule 12: an R(NAK) whose block number
+ * differs from the PICC's current one is answered with R(ACK), without
+ * changing the state of either side. */
 static int
-tcl_transceive(struct rfid_protocol_handle *h,
-		const unsigned char *tx_data, unsigned int tx_len,
-		unsigned char *rx_data, unsigned int *rx_len,
-		unsigned int timeout, unsigned int flags)
+tcl_presence(struct rfid_protocol_handle *h)
 {
+	struct tcl_handle *th = &h->priv.tcl;
+	struct rfid_buf frame, rx;
+	unsigned char pcb;
 	int ret;
 
-	struct rfid_xcvb xcvb;
-	struct tcl_tx_context tcl_ctx;
-	struct tcl_handle *th = &h->priv.tcl;
+	if (th->state != TCL_STATE_ESTABLISHED)
+		return -EINVAL;
 
-	unsigned char ack[10];
-	unsigned int ack_len;
+	rfid_buf_init(&frame);
+	rfid_buf_reserve(&frame, RFID_BUF_HEADROOM);
+	rfid_buf_init(&rx);
 
-	/* initialize context */
-	tcl_ctx.next_tx_byte = tcl_ctx.tx = tx_data;
-	tcl_ctx.next_rx_byte = tcl_ctx.rx = rx_data;
-	tcl_ctx.rx_len = *rx_len;
-	tcl_ctx.tx_len = tx_len;
-	tcl_ctx.h = h;
+	/* R(NAK), block number other than the one of our last block */
+	pcb = 0xb2 | (th->toggle ? 0x00 : 0x01);
+	if (th->flags & TCL_HANDLE_F_CID_USED) {
+		pcb |= TCL_PCB_CID_FOLLOWING;
+		*rfid_buf_push(&frame, 1) = th->cid & 0x0f;
+	}
+	*rfid_buf_push(&frame, 1) = pcb;
 
-	/* initialize xcvb */
-	xcvb.timeout = th->fwt;
+	ret = rfid_layer2_transceive_buf(h->l2h, l2_to_frame(h->l2h->l2->id),
+					 &frame, &rx, th->fwt, 0);
+	if (ret < 0 || rfid_buf_len(&rx) < 1)
+		return 0;
 
-tx_refill:
-	if (tcl_refill_xcvb(&xcvb, &tcl_ctx) < 0) {
-		ret = -1;
-		goto out;
-	}
+	if (!is_r_block(rx.data[0]) || !check_cid(th, &rx))
+		return 0;
+
+	return 1;
+}
 
-do_tx:
-	xcvb.rx.frame_len = sizeof(xcvb.rx.data);
-	ret = rfid_layer2_transceive(h->l2h, l2_to_frame(h->l2h->l2->id),
-				     xcvb.tx.data, xcvb.tx.frame_len,
-				     xcvb.rx.data, &xcvb.rx.frame_len,
-				     xcvb.timeout, 0);
+/* Evaluate the response 'rx' of the card.  Returns 1 if 'tx' now holds the
+ * next frame to send, with *fwt its frame waiting time, 0 if the exchange
+ * is complete, < 0 on error */
+static int
+tcl_handle_rx(struct tcl_tx_context *ctx, struct rfid_buf *tx,
+	      struct rfid_buf *rx, u_int64_t *fwt)
+{
+	struct rfid_protocol_handle *h = ctx->h;
+	struct tcl_handle *th = &h->priv.tcl;
+	unsigned char pcb;
+	int ret;
 
-	DEBUGP("l2 transceive finished\n");
-	if (ret < 0)
-		goto out;
+	if (rfid_buf_len(rx) < 1) {
+		DEBUGP("empty response\n");
+		return -EIO;
+	}
+	pcb = rx->data[0];
 
-	if (is_r_block(xcvb.rx.data[0])) {
+	if (is_r_block(pcb)) {
 		DEBUGP("R-Block\n");
 
-		if ((xcvb.rx.data[0] & 0x01) != h->priv.tcl.toggle) {
+		if ((pcb & 0x01) != h->priv.tcl.toggle) {
 			DEBUGP("response with wrong toggle bit\n");
-			goto out;
+			return 0;
 		}
 
 		/* Handle ACK frame in case of chaining */
-		if (!check_cid(th, &xcvb))
-			goto out;
+		if (!check_cid(th, rx))
+			return 0;
 
-		goto tx_refill;
-	} else if (is_s_block(xcvb.rx.data[0])) {
+		if (tcl_refill_frame(tx, ctx) < 0)
+			return -1;
+		*fwt = th->fwt;
+		return 1;
+	} else if (is_s_block(pcb)) {
 		unsigned char inf;
-		unsigned int prlg_len;
 
 		DEBUGP("S-Block\n");
 		/* Handle Wait Time Extension */
 		
-		if (!check_cid(th, &xcvb))
-			goto out;
+		if (!check_cid(th, rx))
+			return 0;
 
-		if (xcvb.rx.data[0] & TCL_PCB_CID_FOLLOWING) {
-			if (xcvb.rx.frame_len < 3) {
+		if (pcb & TCL_PCB_CID_FOLLOWING) {
+			if (rfid_buf_len(rx) < 3) {
 				DEBUGP("S-Block with CID but short len\n");
-				ret = -1;
-				goto out;
+				return -1;
+			}
+			inf = rx->data[2];
+		} else {
+			if (rfid_buf_len(rx) < 2) {
+				DEBUGP("S-Block but short len\n");
+				return -1;
 			}
-			inf = xcvb.rx.data[2];
-		} else
-			inf = xcvb.rx.data[1];
+			inf = rx->data[1];
+		}
 
-		if ((xcvb.rx.data[0] & 0x30) != 0x30) {
+		if ((pcb & 0x30) != 0x30) {
 			DEBUGP("S-Block but not WTX?\n");
-			ret = -1;
-			goto out;
+			return -1;
 		}
 		inf &= 0x3f;	/* only lower 6 bits code WTXM */
 		if (inf == 0 || (inf >= 60 && inf <= 63)) {
 			DEBUGP("WTXM %u is RFU!\n", inf);
-			ret = -1;
-			goto out;
+			return -1;
 		}
 		
-		fill_xcvb_wtxm(th, &xcvb, inf);
+		ret = tcl_fill_wtxm(th, tx, inf);
+		if (ret < 0)
+			return ret;
+		*fwt = th->fwt * inf;
 		/* start over with next transceive */
-		goto do_tx; 
-	} else if (is_i_block(xcvb.rx.data[0])) {
+		return 1;
+	} else if (is_i_block(pcb)) {
+		unsigned int hdr_len = 1;
 		unsigned int net_payload_len;
 		/* we're actually receiving payload data */
 
 		DEBUGP("I-Block: ");
 
-		if ((xcvb.rx.data[0] & 0x01) != h->priv.tcl.toggle) {
+		if ((pcb & 0x01) != h->priv.tcl.toggle) {
 			DEBUGP("response with wrong toggle bit\n");
-			goto out;
+			return 0;
 		}
 
-		xcvb.rx.hdr_len = 1;
+		if (!check_cid(th, rx))
+			return 0;
 
-		if (!check_cid(th, &xcvb))
-			goto out;
+		if (pcb & TCL_PCB_CID_FOLLOWING)
+			hdr_len++;
+		if (pcb & TCL_PCB_NAD_FOLLOWING)
+			hdr_len++;
 
-		if (xcvb.rx.data[0] & TCL_PCB_CID_FOLLOWING)
-			xcvb.rx.hdr_len++;
-		if (xcvb.rx.data[0] & TCL_PCB_NAD_FOLLOWING)
-			xcvb.rx.hdr_len++;
+		/* strip the prologue, leaving only the information field */
+		if (!rfid_buf_pull(rx, hdr_len)) {
+			DEBUGP("I-Block shorter than its prologue\n");
+			return -EIO;
+		}
 	
-		net_payload_len = xcvb.rx.frame_len - xcvb.rx.hdr_len;
+		net_payload_len = rfid_buf_len(rx);
 		DEBUGPC("%u bytes\n", net_payload_len);
-		memcpy(tcl_ctx.next_rx_byte, &xcvb.rx.data[xcvb.rx.hdr_len], 
-			net_payload_len);
-		tcl_ctx.next_rx_byte += net_payload_len;
+		if (ctx->next_rx_byte + net_payload_len >
+		    ctx->rx + ctx->rx_len) {
+			DEBUGP("rx buffer too small\n");
+			return -E2BIG;
+		}
+		memcpy(ctx->next_rx_byte, rx->data, net_payload_len);
+		ctx->next_rx_byte += net_payload_len;
 
-		if (xcvb.rx.data[0] & 0x10) {
+		if (pcb & 0x10) {
 			/* we're not the last frame in the chain, continue rx */
 			DEBUGP("not the last frame in the chain, continue\n");
-			ack_len = sizeof(ack);
-			tcl_build_prologue_r(th, xcvb.tx.data, &xcvb.tx.frame_len,						  0);
-			xcvb.timeout = th->fwt;
-			goto do_tx;
+			rfid_buf_init(tx);
+			rfid_buf_reserve(tx, RFID_BUF_HEADROOM);
+			ret = tcl_push_prologue_r(th, tx, 0);
+			if (ret < 0)
+				return ret;
+			*fwt = th->fwt;
+			return 1;
 		}
 	}
 
+	return 0;
+}
+
+static void
+tcl_ctx_init(struct tcl_tx_context *ctx, struct rfid_protocol_handle *h,
+	     const unsigned char *tx_data, unsigned int tx_len,
+	     unsigned char *rx_data, unsigned int rx_len)
+{
+	ctx->next_tx_byte = ctx->tx = tx_data;
+	ctx->next_rx_byte = ctx->rx = rx_data;
+	ctx->rx_len = rx_len;
+	ctx->tx_len = tx_len;
+	ctx->h = h;
+}
+
+static int
+tcl_transceive(struct rfid_protocol_handle *h,
+		const unsigned char *tx_data, unsigned int tx_len,
+		unsigned char *rx_data, unsigned int *rx_len,
+		unsigned int timeout, unsigned int flags)
+{
+	int ret;
+
+	struct rfid_buf *tx, *rx;
+	struct tcl_tx_context tcl_ctx;
+	struct tcl_handle *th = &h->priv.tcl;
+	u_int64_t fwt = th->fwt;
+
+	tcl_ctx_init(&tcl_ctx, h, tx_data, tx_len, rx_data, *rx_len);
+
+	tx = rfid_buf_alloc();
+	rx = rfid_buf_alloc();
+	if (!tx || !rx) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (tcl_refill_frame(tx, &tcl_ctx) < 0) {
+		ret = -1;
+		goto out;
+	}
+
+	do {
+		rfid_buf_init(rx);
+		ret = rfid_layer2_transceive_buf(h->l2h,
+						 l2_to_frame(h->l2h->l2->id),
+						 tx, rx, fwt, 0);
+
+		DEBUGP("l2 transceive finished\n");
+		if (ret < 0)
+			break;
+
+		ret = tcl_handle_rx(&tcl_ctx, tx, rx, &fwt);
+	} while (ret > 0);
+
 out:
+	rfid_buf_free(rx);
+	rfid_buf_free(tx);
 	*rx_len = tcl_ctx.next_rx_byte - tcl_ctx.rx;
 	return ret;
 }
 
+#ifdef ENABLE_ASYNC
+static void tcl_async_rx(int status, unsigned int rx_len, void *data);
+
+static int tcl_async_tx(struct rfid_protocol_handle *h, u_int64_t fwt)
+{
+	struct tcl_async *ta = &h->priv.tcl.async;
+
+	rfid_buf_init(&ta->rx);
+
+	return rfid_layer2_async_submit(h->l2h, l2_to_frame(h->l2h->l2->id),
+					ta->tx.data, rfid_buf_len(&ta->tx),
+					ta->rx.tail, rfid_buf_tailroom(&ta->rx),
+					fwt, 0, &tcl_async_rx, h);
+}
+
+/* called from rfid_reader_process_events() for every response */
+static void tcl_async_rx(int status, unsigned int rx_len, void *data)
+{
+	struct rfid_protocol_handle *h = data;
+	struct tcl_async *ta = &h->priv.tcl.async;
+	u_int64_t fwt;
+	int ret = status;
+
+	if (ret >= 0) {
+		rfid_buf_put(&ta->rx, rx_len);
+		ret = tcl_handle_rx(&ta->ctx, &ta->tx, &ta->rx, &fwt);
+		if (ret > 0) {
+			ret = tcl_async_tx(h, fwt);
+			if (ret == 0)
+				return;
+		}
+	}
+
+	ta->status = ret;
+	ta->busy = 0;
+}
+
+static int
+tcl_transceive_submit(struct rfid_protocol_handle *h,
+		      const unsigned char *tx_data, unsigned int tx_len,
+		      unsigned char *rx_data, unsigned int rx_len,
+		      unsigned int timeout, unsigned int flags)
+{
+	struct tcl_async *ta = &h->priv.tcl.async;
+	int ret;
+
+	if (ta->busy)
+		return -EBUSY;
+
+	tcl_ctx_init(&ta->ctx, h, tx_data, tx_len, rx_data, rx_len);
+
+	if (tcl_refill_frame(&ta->tx, &ta->ctx) < 0)
+		return -1;
+
+	ret = tcl_async_tx(h, h->priv.tcl.fwt);
+	if (ret < 0)
+		return ret;
+
+	ta->busy = 1;
+
+	return 0;
+}
+
+static int
+tcl_transceive_complete(struct rfid_protocol_handle *h, unsigned int *rx_len)
+{
+	struct tcl_async *ta = &h->priv.tcl.async;
+
+	if (ta->busy)
+		return -EINPROGRESS;
+
+	*rx_len = ta->ctx.next_rx_byte - ta->ctx.rx;
+
+	return ta->status;
+}
+#endif /* ENABLE_ASYNC */
+
+/* Execute a sequence of APDUs back-to-back, storing all responses in
+ * 'arena'.  Stops at the first APDU whose status word doesn't match its
+ * expectation.  Returns the number of APDUs that were executed and matched,
+ * i.e. apdus[ret] is the offending one if ret < num_apdus. *arena_len is
+ * updated to the number of bytes used. */
+int
+tcl_transceive_batch(struct rfid_protocol_handle *ph,
+		     struct rfid_tcl_apdu *apdus, unsigned int num_apdus,
+		     unsigned char *arena, unsigned int *arena_len,
+		     unsigned int timeout)
+{
+	unsigned int used = 0;
+	unsigned int i;
+	int ret;
+
+	if (ph->proto->id != RFID_PROTOCOL_TCL)
+		return -EINVAL;
+
+	for (i = 0; i < num_apdus; i++) {
+		apdus[i].resp_offset = 0;
+		apdus[i].resp_len = 0;
+		apdus[i].sw = 0;
+	}
+
+	for (i = 0; i < num_apdus; i++) {
+		struct rfid_tcl_apdu *apdu = &apdus[i];
+		unsigned int rx_len = *arena_len - used;
+
+		apdu->resp_offset = used;
+		ret = tcl_transceive(ph, apdu->cmd, apdu->cmd_len,
+				     arena + used, &rx_len, timeout, 0);
+		if (ret < 0) {
+			*arena_len = used;
+			return ret;
+		}
+
+		apdu->resp_len = rx_len;
+		used += rx_len;
+
+		if (rx_len < 2) {
+			DEBUGP("APDU %u: response without status word\n", i);
+			break;
+		}
+		apdu->sw = (arena[used-2] << 8) | arena[used-1];
+
+		if ((apdu->sw & apdu->sw_mask) != apdu->sw_expect) {
+			DEBUGP("APDU %u: SW %04x doesn't match %04x/%04x\n",
+				i, apdu->sw, apdu->sw_expect, apdu->sw_mask);
+			break;
+		}
+	}
+
+	*arena_len = used;
+
+	return i;
+}
+
 static struct rfid_protocol_handle *
 tcl_init(struct rfid_layer2_handle *l2h)
 {
@@ -811,7 +1003,12 @@ const struct rfid_protocol rfid_protocol_tcl = {
 		.init = &tcl_init,
 		.open = &tcl_connect,
 		.transceive = &tcl_transceive,
+#ifdef ENABLE_ASYNC
+		.transceive_submit = &tcl_transceive_submit,
+		.transceive_complete = &tcl_transceive_complete,
+#endif
 		.close = &tcl_deselect,
+		.presence = &tcl_presence,
 		.fini = &tcl_fini,
 		.getopt = &tcl_getopt,
 		.setopt = &tcl_setopt,
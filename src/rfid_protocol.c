@@ -23,6 +23,10 @@
 
 #include <librfid/rfid_layer2.h>
 #include <librfid/rfid_protocol.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_retry.h>
+
+#include "rfid_probes.h"
 
 static const struct rfid_protocol *rfid_protocols[] = {
 	[RFID_PROTOCOL_MIFARE_CLASSIC]	= &rfid_protocol_mfcl,
@@ -55,9 +59,20 @@ rfid_protocol_init(struct rfid_layer2_handle *l2h, unsigned int id)
 int
 rfid_protocol_open(struct rfid_protocol_handle *ph)
 {
-	if (ph->proto->fn.open)
-		return ph->proto->fn.open(ph);
-	return 0;
+	struct rfid_reader_handle *rh = ph->l2h->rh;
+	struct rfid_retry_op op;
+	int ret;
+
+	if (!ph->proto->fn.open)
+		return 0;
+
+	rfid_retry_begin(rh, &op, RFID_RETRY_OP_IDEMPOTENT);
+	do {
+		ret = ph->proto->fn.open(ph);
+	} while (rfid_retry_again(rh, &op, &ret));
+	rfid_retry_end(rh, &op);
+
+	return ret;
 }
 
 int
@@ -66,8 +81,23 @@ rfid_protocol_transceive(struct rfid_protocol_handle *ph,
 			 unsigned char *rx_buf, unsigned int *rx_len,
 			 unsigned int timeout, unsigned int flags)
 {
-	return ph->proto->fn.transceive(ph, tx_buf, len, rx_buf, rx_len,
-					timeout, flags);
+	struct rfid_reader_handle *rh = ph->l2h->rh;
+	struct rfid_retry_op op;
+	int ret;
+
+	/* not idempotent, the deadline covers all frames of the exchange */
+	rfid_retry_begin(rh, &op, 0);
+	do {
+		RFID_PROBE4(protocol__transceive__entry, ph, ph->proto->id,
+			    len, *rx_len);
+		ret = ph->proto->fn.transceive(ph, tx_buf, len, rx_buf,
+					       rx_len, timeout, flags);
+		RFID_PROBE4(protocol__transceive__return, ph, ph->proto->id,
+			    ret, ret < 0 ? 0 : *rx_len);
+	} while (rfid_retry_again(rh, &op, &ret));
+	rfid_retry_end(rh, &op);
+
+	return ret;
 }
 
 int
@@ -76,10 +106,23 @@ rfid_protocol_read(struct rfid_protocol_handle *ph,
 		   unsigned char *rx_data,
 		   unsigned int *rx_len)
 {
-	if (ph->proto->fn.read)
-		return ph->proto->fn.read(ph, page, rx_data, rx_len);
-	else
+	struct rfid_reader_handle *rh = ph->l2h->rh;
+	unsigned int len = *rx_len;
+	struct rfid_retry_op op;
+	int ret;
+
+	if (!ph->proto->fn.read)
 		return -EINVAL;
+
+	rfid_retry_begin(rh, &op, ph->proto->no_rw_retry ?
+					0 : RFID_RETRY_OP_IDEMPOTENT);
+	do {
+		*rx_len = len;
+		ret = ph->proto->fn.read(ph, page, rx_data, rx_len);
+	} while (rfid_retry_again(rh, &op, &ret));
+	rfid_retry_end(rh, &op);
+
+	return ret;
 }
 
 int
@@ -88,10 +131,21 @@ rfid_protocol_write(struct rfid_protocol_handle *ph,
 		   unsigned char *tx_data,
 		   unsigned int tx_len)
 {
-	if (ph->proto->fn.write)
-		return ph->proto->fn.write(ph, page, tx_data, tx_len);
-	else
+	struct rfid_reader_handle *rh = ph->l2h->rh;
+	struct rfid_retry_op op;
+	int ret;
+
+	if (!ph->proto->fn.write)
 		return -EINVAL;
+
+	rfid_retry_begin(rh, &op, ph->proto->no_rw_retry ?
+					0 : RFID_RETRY_OP_IDEMPOTENT);
+	do {
+		ret = ph->proto->fn.write(ph, page, tx_data, tx_len);
+	} while (rfid_retry_again(rh, &op, &ret));
+	rfid_retry_end(rh, &op);
+
+	return ret;
 }
 
 int rfid_protocol_fini(struct rfid_protocol_handle *ph)
@@ -107,14 +161,31 @@ rfid_protocol_close(struct rfid_protocol_handle *ph)
 	return 0;
 }
 
+/* Check whether the card is still present.  Protocols without a probe of
+ * their own fall back to the layer2 one.  Returns 1 if present, 0 if not */
+int
+rfid_protocol_presence(struct rfid_protocol_handle *ph)
+{
+	if (!ph->proto->fn.presence)
+		return rfid_layer2_presence(ph->l2h);
+
+	return ph->proto->fn.presence(ph);
+}
+
 int
 rfid_protocol_getopt(struct rfid_protocol_handle *ph, int optname,
 		     void *optval, unsigned int *optlen)
 {
 	if (optname >> 16 == 0) {
-		unsigned char *optchar = optval;
+		unsigned int *optuint = optval;
 
 		switch (optname) {
+		case RFID_OPT_PROTO_ID:
+			if (*optlen < sizeof(*optuint))
+				return -E2BIG;
+			*optlen = sizeof(*optuint);
+			*optuint = ph->proto->id;
+			break;
 		default:
 			return -EINVAL;
 			break;
@@ -19,12 +19,18 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include <librfid/rfid.h>
 #include <librfid/rfid_reader.h>
 #include <librfid/rfid_reader_cm5121.h>
 #include <librfid/rfid_reader_openpcd.h>
 #include <librfid/rfid_reader_spidev.h>
+#include <librfid/rfid_trace.h>
+#include <librfid/rfid_capture.h>
+#include <librfid/rfid_retry.h>
+#include <librfid/rfid_calibrate.h>
 
 static const struct rfid_reader *rfid_readers[] = {
 #ifdef HAVE_LIBUSB
@@ -42,6 +48,10 @@ struct rfid_reader_handle *
 rfid_reader_open(void *data, unsigned int id)
 {
 	const struct rfid_reader *p;
+	struct rfid_reader_handle *rh;
+#ifndef LIBRFID_FIRMWARE
+	const char *tuning;
+#endif
 
 	if (id >= ARRAY_SIZE(rfid_readers)) {
 		DEBUGP("unable to find matching reader\n");
@@ -52,7 +62,22 @@ rfid_reader_open(void *data, unsigned int id)
 	if (!p)
 		return NULL;
 
-	return p->open(data);
+	rh = p->open(data);
+	if (!rh)
+		return NULL;
+
+#ifdef ENABLE_TRACE
+	/* tracing is best effort, the reader works without */
+	rfid_trace_init(rh);
+#endif
+#ifndef LIBRFID_FIRMWARE
+	/* a saved calibration, see rfid_reader_calibrate() */
+	tuning = getenv("LIBRFID_TUNING");
+	if (tuning && rfid_reader_tuning_load(rh, tuning) < 0)
+		DEBUGP("can't load tuning from %s\n", tuning);
+#endif
+
+	return rh;
 }
 
 int
@@ -66,9 +91,30 @@ rfid_reader_transceive(struct rfid_reader_handle *rh,
 				      rx_len, timeout, flags);
 }
 
+int
+rfid_reader_wait_event(struct rfid_reader_handle *rh, unsigned int timeout_ms)
+{
+	if (!rh->reader->wait_event)
+		return -ENOTSUP;
+
+	return rh->reader->wait_event(rh, timeout_ms);
+}
+
 void
 rfid_reader_close(struct rfid_reader_handle *rh)
 {
+#ifdef ENABLE_ASYNC
+	rfid_reader_async_fini(rh);
+#endif
+#ifdef ENABLE_CAPTURE
+	rfid_capture_stop(rh);
+#endif
+#ifdef ENABLE_TRACE
+	rfid_trace_fini(rh);
+#endif
+#ifdef ENABLE_RETRY
+	rfid_retry_fini(rh);
+#endif
 	rh->reader->close(rh);
 }
 
@@ -76,11 +122,55 @@ int
 rfid_reader_getopt(struct rfid_reader_handle *rh, int optname,
 		   void *optval, unsigned int *optlen)
 {
+	switch (optname) {
+	case RFID_OPT_RDR_STATS:
+		if (!optval || !optlen || *optlen < sizeof(rh->stats))
+			return -EINVAL;
+		memcpy(optval, &rh->stats, sizeof(rh->stats));
+		*optlen = sizeof(rh->stats);
+		return 0;
+#ifdef ENABLE_TRACE
+	case RFID_OPT_RDR_TRACE:
+		if (!optval || !optlen ||
+		    *optlen < sizeof(struct rfid_trace_conf))
+			return -EINVAL;
+		*optlen = sizeof(struct rfid_trace_conf);
+		return rfid_trace_getconf(rh, optval);
+#endif
+#ifdef ENABLE_RETRY
+	case RFID_OPT_RDR_RETRY:
+		if (!optval || !optlen ||
+		    *optlen < sizeof(struct rfid_retry_policy))
+			return -EINVAL;
+		*optlen = sizeof(struct rfid_retry_policy);
+		rfid_retry_getconf(rh, optval);
+		return 0;
+#endif
+	}
+
 	return rh->reader->getopt(rh, optname, optval, optlen);
 }
 
 int rfid_reader_setopt(struct rfid_reader_handle *rh, int optname,
 		       const void *optval, unsigned int optlen)
 {
+	switch (optname) {
+	case RFID_OPT_RDR_STATS:
+		memset(&rh->stats, 0, sizeof(rh->stats));
+		return 0;
+#ifdef ENABLE_TRACE
+	case RFID_OPT_RDR_TRACE:
+		if (!optval || optlen < sizeof(struct rfid_trace_conf))
+			return -EINVAL;
+		return rfid_trace_setconf(rh, optval);
+#endif
+#ifdef ENABLE_RETRY
+	case RFID_OPT_RDR_RETRY:
+		if (!optval || optlen < sizeof(struct rfid_retry_policy))
+			return -EINVAL;
+		return rfid_retry_setconf(rh, optval);
+#endif
+	}
+
 	return rh->reader->setopt(rh, optname, optval, optlen);
 }
@@ -119,32 +119,64 @@ static int Read1ByteFromReg(struct rfid_asic_transport_handle *rath,
 	return -1;
 }
 
+/* The escape header is 7 bytes, the response has one status byte before the
+ * data.  With the CCID message size of most readers a whole FIFO transfer fits
+ * into one escape, smaller transports get it in pieces. */
+#define CM5121_ESC_HDR_LEN	7
+
+static unsigned int cm5121_max_chunk(struct rfid_asic_transport_handle *rath)
+{
+	size_t max = cm5121_source_max_xfer(rath);
+
+	if (max > SENDBUF_LEN)
+		max = SENDBUF_LEN;
+
+	return max - CM5121_ESC_HDR_LEN;
+}
+
 static int ReadNBytesFromFIFO(struct rfid_asic_transport_handle *rath,
 			      unsigned char num_bytes,
 			      unsigned char *buf)
 {
 	unsigned char sndbuf[SENDBUF_LEN];
-	unsigned char recvbuf[0x7f];
-	size_t retlen = sizeof(recvbuf);
+	unsigned char recvbuf[RECVBUF_LEN];
+	unsigned int max = cm5121_max_chunk(rath);
+	unsigned int len;
+	size_t retlen;
 
 	sndbuf[0] = 0x20;
 	sndbuf[1] = 0x00;
 	sndbuf[2] = 0x00;
 	sndbuf[3] = 0x00;
-	sndbuf[4] = num_bytes;
 	sndbuf[5] = 0x00;
 	sndbuf[6] = 0x02;
 
 	DEBUGR("num_bytes=%u: ", num_bytes);
-	if (PC_to_RDR_Escape(rath->data, sndbuf, 7, recvbuf, &retlen) == 0) {
-		DEBUGRC("%u [%s]\n", retlen,
-			rfid_hexdump(recvbuf+1, num_bytes));
-		memcpy(buf, recvbuf+1, num_bytes); // len == 0x7f
-		return 0;
-	}
-
-	DEBUGRC("ERROR\n");
-	return -1;
+	do {
+		len = num_bytes > max ? max : num_bytes;
+		sndbuf[4] = len;
+
+		retlen = sizeof(recvbuf);
+		if (PC_to_RDR_Escape(rath->data, sndbuf, CM5121_ESC_HDR_LEN,
+				     recvbuf, &retlen) != 0) {
+			DEBUGRC("ERROR\n");
+			return -1;
+		}
+		if (retlen < len + 1) {
+			DEBUGRC("short read (%u < %u)\n", (unsigned int)retlen,
+				len + 1);
+			return -EIO;
+		}
+		DEBUGRC("%u [%s] ", (unsigned int)retlen,
+			rfid_hexdump(recvbuf+1, len));
+
+		memcpy(buf, recvbuf+1, len);
+		buf += len;
+		num_bytes -= len;
+	} while (num_bytes);
+
+	DEBUGRC("OK\n");
+	return 0;
 }
 
 static int WriteNBytesToFIFO(struct rfid_asic_transport_handle *rath,
@@ -153,28 +185,38 @@ static int WriteNBytesToFIFO(struct rfid_asic_transport_handle *rath,
 			     unsigned char flags)
 {
 	unsigned char sndbuf[SENDBUF_LEN];
-	unsigned char recvbuf[0x7f];
-	size_t retlen = sizeof(recvbuf);
+	unsigned char recvbuf[RECVBUF_LEN];
+	unsigned int max = cm5121_max_chunk(rath);
+	unsigned int cur_len;
+	size_t retlen;
 
 	sndbuf[0] = 0x20;
 	sndbuf[1] = 0x00;
-	sndbuf[2] = len;
 	sndbuf[3] = 0x00;
 	sndbuf[4] = 0x00;
 	sndbuf[5] = flags;
 	sndbuf[6] = 0x02;
 
 	DEBUGR("%u [%s]: ", len, rfid_hexdump(bytes, len));
-
-	memcpy(sndbuf+7, bytes, len);
-
-	if (PC_to_RDR_Escape(rath->data, sndbuf, len+7, recvbuf, &retlen) == 0) {
-		DEBUGRC("OK (%u [%s])\n", retlen, rfid_hexdump(recvbuf, retlen));
-		return 0;
-	}
-
-	DEBUGRC("ERROR\n");
-	return -1;
+	do {
+		cur_len = len > max ? max : len;
+		sndbuf[2] = cur_len;
+		memcpy(sndbuf + CM5121_ESC_HDR_LEN, bytes, cur_len);
+
+		retlen = sizeof(recvbuf);
+		if (PC_to_RDR_Escape(rath->data, sndbuf,
+				     cur_len + CM5121_ESC_HDR_LEN,
+				     recvbuf, &retlen) != 0) {
+			DEBUGRC("ERROR\n");
+			return -1;
+		}
+		bytes += cur_len;
+		len -= cur_len;
+	} while (len);
+
+	DEBUGRC("OK (%u [%s])\n", (unsigned int)retlen,
+		rfid_hexdump(recvbuf, retlen));
+	return 0;
 }
 
 struct rfid_asic_transport cm5121_ccid = {
@@ -185,6 +227,7 @@ struct rfid_asic_transport cm5121_ccid = {
 			.reg_read 	= &Read1ByteFromReg,
 			.fifo_write	= &WriteNBytesToFIFO,
 			.fifo_read	= &ReadNBytesFromFIFO,
+			.wait_irq	= &cm5121_source_wait_irq,
 		},
 	},
 };
@@ -200,6 +243,33 @@ static int cm5121_enable_rc632(struct rfid_asic_transport_handle *rath)
 	return 0;
 }
 
+/* the latency down to the RC632 FIFO is too long to refill it during
+ * TX/RX */
+static const struct rfid_asic_rc632_impl cm5121_impl = {
+	.mtu	= 64,
+	.mru	= 64,
+	.iso14443a = {
+		.cw_conductance		= CM5121_CW_CONDUCTANCE,
+		.mod_conductance	= CM5121_MOD_CONDUCTANCE,
+		.bitphase		= CM5121_14443A_BITPHASE,
+		.threshold		= CM5121_14443A_THRESHOLD,
+		.rx_wait		= 0x06,
+	},
+	.iso14443b = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x04,
+		.bitphase		= CM5121_14443B_BITPHASE,
+		.threshold		= CM5121_14443B_THRESHOLD,
+		.rx_wait		= 0x03,
+	},
+	.iso15693 = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x21,
+		.bitphase		= 0xd0,
+		.threshold		= 0xed,
+	},
+};
+
 static struct rfid_reader_handle *
 cm5121_open(void *data)
 {
@@ -225,7 +295,7 @@ cm5121_open(void *data)
 	if (cm5121_enable_rc632(rath) < 0)
 		goto out_rath;
 
-	rh->ah = rc632_open(rath);
+	rh->ah = rc632_open(rath, &cm5121_impl);
 	if (!rh->ah) 
 		goto out_rath;
 
@@ -262,6 +332,9 @@ const struct rfid_reader rfid_reader_cm5121 = {
 	.getopt = &_rdr_rc632_getopt,
 	.setopt = &_rdr_rc632_setopt,
 	.transceive = &_rdr_rc632_transceive,
+	.transceive_submit = &_rdr_rc632_transceive_submit,
+	.transceive_complete = &_rdr_rc632_transceive_complete,
+	.wait_event = &_rdr_rc632_wait_event,
 	.init = &_rdr_rc632_l2_init,
 	.iso14443a = {
 		.transceive_sf = &_rdr_rc632_transceive_sf,
@@ -276,6 +349,7 @@ const struct rfid_reader rfid_reader_cm5121 = {
 	.mifare_classic = {
 		.setkey = &_rdr_rc632_mifare_setkey,
 		.setkey_ee = &_rdr_rc632_mifare_setkey_ee,
+		.load_keys_ee = &_rdr_rc632_mifare_load_keys_ee,
 		.auth = &_rdr_rc632_mifare_auth,
 	},
 };
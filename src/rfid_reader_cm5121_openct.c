@@ -1,6 +1,7 @@
 /* CM5121 backend for OpenCT virtual slot */
 
 #include <stdio.h>
+#include <errno.h>
 
 #include <librfid/rfid_asic.h>
 #include <openct/openct.h>
@@ -52,3 +53,15 @@ int cm5121_source_init(struct rfid_asic_transport_handle *rath)
 	return 0;
 }
 
+/* OpenCT doesn't tell us about its buffer sizes, be conservative */
+size_t cm5121_source_max_xfer(struct rfid_asic_transport_handle *rath)
+{
+	return 0x7f;
+}
+
+/* OpenCT doesn't pass the slot change notifications on */
+int cm5121_source_wait_irq(struct rfid_asic_transport_handle *rath,
+			   unsigned int timeout_ms)
+{
+	return -ENOTSUP;
+}
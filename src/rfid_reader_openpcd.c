@@ -5,9 +5,6 @@
  * The OpenPCD is an Atmel AT91SAM7Sxx based USB RFID reader.
  * It's CL RC632 is connected via SPI.  OpenPCD has multiple firmware
  * images.  This driver is for the "main_dumbreader" firmware.
- *
- * TODO:
- * - put hdl from static variable into asic transport or reader handle 
  */
 
 /*
@@ -37,6 +34,7 @@
 #include <librfid/rfid_reader_openpcd.h>
 #include <librfid/rfid_layer2.h>
 #include <librfid/rfid_protocol.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
 
 #include "rfid_reader_rc632_common.h"
 
@@ -47,11 +45,6 @@
 				    plus 10 bytes reserve */
 #define RECVBUF_LEN	SENDBUF_LEN
 
-static char snd_buf[SENDBUF_LEN];
-static char rcv_buf[RECVBUF_LEN];
-static struct openpcd_hdr *snd_hdr;
-static struct openpcd_hdr *rcv_hdr;
-
 #ifndef LIBRFID_FIRMWARE
 
 #ifdef  __MINGW32__
@@ -68,12 +61,23 @@ static struct openpcd_hdr *rcv_hdr;
 #define DEBUGR(x, args ...)	do {} while(0)
 #endif
 
-static struct usb_device *dev;
-static struct usb_dev_handle *hdl;
+/* per reader state, hangs off rath->data */
+struct openpcd_handle {
+	struct usb_dev_handle *hdl;
+	struct openpcd_hdr *snd_hdr;
+	struct openpcd_hdr *rcv_hdr;
+	char snd_buf[SENDBUF_LEN];
+	char rcv_buf[RECVBUF_LEN];
+	unsigned int librfid_cmds:1;	/* firmware has CMD_CLS_LIBRFID */
+};
 
-static int openpcd_send_command(u_int8_t cmd, u_int8_t reg, u_int8_t val,
-				u_int16_t len, const unsigned char *data)
+#define rh_to_opcd(rh)	((struct openpcd_handle *)(rh)->ah->rath->data)
+
+static int openpcd_send_command(struct openpcd_handle *oh, u_int8_t cmd,
+				u_int8_t reg, u_int8_t val, u_int16_t len,
+				const unsigned char *data)
 {
+	struct openpcd_hdr *snd_hdr = oh->snd_hdr;
 	int ret;
 	u_int16_t cur;
 
@@ -86,30 +90,32 @@ static int openpcd_send_command(u_int8_t cmd, u_int8_t reg, u_int8_t val,
 
 	cur = sizeof(*snd_hdr) + len;
 
-	return usb_bulk_write(hdl, OPENPCD_OUT_EP, (char *)snd_hdr, cur, 1000);
+	return usb_bulk_write(oh->hdl, OPENPCD_OUT_EP, (char *)snd_hdr, cur,
+			      1000);
 }
 
-static int openpcd_recv_reply(void)
+static int openpcd_recv_reply(struct openpcd_handle *oh)
 {
 	int ret;
 
-	ret = usb_bulk_read(hdl, OPENPCD_IN_EP, rcv_buf, sizeof(rcv_buf), 1000);
+	ret = usb_bulk_read(oh->hdl, OPENPCD_IN_EP, oh->rcv_buf,
+			    sizeof(oh->rcv_buf), 1000);
 
 	return ret;
 }
 
-static int openpcd_xcv(u_int8_t cmd, u_int8_t reg, u_int8_t val,
-			u_int16_t len, const unsigned char *data)
+static int openpcd_xcv(struct openpcd_handle *oh, u_int8_t cmd, u_int8_t reg,
+		       u_int8_t val, u_int16_t len, const unsigned char *data)
 {
 	int ret;
 	
-	ret = openpcd_send_command(cmd, reg, val, len, data);
+	ret = openpcd_send_command(oh, cmd, reg, val, len, data);
 	if (ret < 0)
 		return ret;
 	if (ret < sizeof(struct openpcd_hdr))
 		return -EINVAL;
 
-	return openpcd_recv_reply();
+	return openpcd_recv_reply(oh);
 }
 
 struct usb_id {
@@ -150,7 +156,7 @@ static int openpcd_reg_write(struct rfid_asic_transport_handle *rath,
 
 	DEBUGR("reg=0x%02x, val=%02x: ", reg, value);
 
-	ret = openpcd_xcv(OPENPCD_CMD_WRITE_REG, reg, value, 0, NULL);
+	ret = openpcd_xcv(rath->data, OPENPCD_CMD_WRITE_REG, reg, value, 0, NULL);
 	if (ret < 0)
 		DEBUGRC("ERROR sending command\n");
 	else
@@ -163,11 +169,12 @@ static int openpcd_reg_read(struct rfid_asic_transport_handle *rath,
 			    unsigned char reg,
 			    unsigned char *value)
 {
+	struct openpcd_handle *oh = rath->data;
 	int ret;	
 
 	DEBUGR("reg=0x%02x, ", reg);
 
-	ret = openpcd_xcv(OPENPCD_CMD_READ_REG, reg, 0, 0, NULL);
+	ret = openpcd_xcv(oh, OPENPCD_CMD_READ_REG, reg, 0, 0, NULL);
 	if (ret < 0) {
 		DEBUGRC("ERROR sending command\n");
 		return ret;
@@ -178,7 +185,7 @@ static int openpcd_reg_read(struct rfid_asic_transport_handle *rath,
 		return ret;
 	}
 
-	*value = rcv_hdr->val;
+	*value = oh->rcv_hdr->val;
 	DEBUGRC("val=%02x: OK\n", *value);
 
 	return ret;
@@ -188,20 +195,22 @@ static int openpcd_fifo_read(struct rfid_asic_transport_handle *rath,
 			     unsigned char num_bytes,
 			     unsigned char *buf)
 {
+	struct openpcd_handle *oh = rath->data;
 	int ret;
 
 	DEBUGR(" ");
 
-	ret = openpcd_xcv(OPENPCD_CMD_READ_FIFO, 0x00, num_bytes, 0, NULL);
+	ret = openpcd_xcv(oh, OPENPCD_CMD_READ_FIFO, 0x00, num_bytes, 0, NULL);
 	if (ret < 0) {
 		DEBUGRC("ERROR sending command\n");
 		return ret;
 	}
 	DEBUGRC("ret = %d\n", ret);
 
-	memcpy(buf, rcv_hdr->data, ret - sizeof(struct openpcd_hdr));
+	memcpy(buf, oh->rcv_hdr->data, ret - sizeof(struct openpcd_hdr));
 	DEBUGRC("len=%d val=%s: OK\n", ret - sizeof(struct openpcd_hdr),
-		rfid_hexdump(rcv_hdr->data, ret - sizeof(struct openpcd_hdr)));
+		rfid_hexdump(oh->rcv_hdr->data,
+			     ret - sizeof(struct openpcd_hdr)));
 
 	return ret;
 }
@@ -214,7 +223,7 @@ static int openpcd_fifo_write(struct rfid_asic_transport_handle *rath,
 	int ret;
 
 	DEBUGR("len=%u, data=%s\n", len, rfid_hexdump(bytes, len));
-	ret = openpcd_xcv(OPENPCD_CMD_WRITE_FIFO, 0, 0, len, bytes);
+	ret = openpcd_xcv(rath->data, OPENPCD_CMD_WRITE_FIFO, 0, 0, len, bytes);
 
 	return ret;
 }
@@ -233,12 +242,13 @@ const struct rfid_asic_transport openpcd_rat = {
 
 static int openpcd_get_api_version(struct rfid_reader_handle *rh, u_int8_t *version)
 {
+	struct openpcd_handle *oh = rh_to_opcd(rh);
 	int ret;
 	
 	// preset version result to zero
-	rcv_hdr->val=0;
+	oh->rcv_hdr->val=0;
     
-	ret = openpcd_xcv(OPENPCD_CMD_GET_API_VERSION, 0, 0, 0, NULL);
+	ret = openpcd_xcv(oh, OPENPCD_CMD_GET_API_VERSION, 0, 0, 0, NULL);
 	if (ret < 0) {
 		DEBUGPC("ERROR sending command [%i]\n", ret);
 		return ret;
@@ -249,7 +259,7 @@ static int openpcd_get_api_version(struct rfid_reader_handle *rh, u_int8_t *vers
 		return -EINVAL;
 	}
 
-	*version = rcv_hdr->val;
+	*version = oh->rcv_hdr->val;
 	
 	return ret;
 }
@@ -258,20 +268,23 @@ static int openpcd_get_environment(struct rfid_reader_handle *rh,
 				   unsigned char num_bytes,
 				   unsigned char *buf)
 {
+	struct openpcd_handle *oh = rh_to_opcd(rh);
 	int ret;
 
 	DEBUGP(" ");
 
-	ret = openpcd_xcv(OPENPCD_CMD_GET_ENVIRONMENT, 0x00, num_bytes, 0, NULL);
+	ret = openpcd_xcv(oh, OPENPCD_CMD_GET_ENVIRONMENT, 0x00, num_bytes,
+			  0, NULL);
 	if (ret < 0) {
 		DEBUGPC("ERROR sending command [%i]\n",ret);
 		return ret;
 	}
 	DEBUGPC("ret = %d\n", ret);
 
-	memcpy(buf, rcv_hdr->data, ret - sizeof(struct openpcd_hdr));
+	memcpy(buf, oh->rcv_hdr->data, ret - sizeof(struct openpcd_hdr));
 	DEBUGPC("len=%d val=%s: OK\n", ret - sizeof(struct openpcd_hdr),
-		rfid_hexdump(rcv_hdr->data, ret - sizeof(struct openpcd_hdr)));
+		rfid_hexdump(oh->rcv_hdr->data,
+			     ret - sizeof(struct openpcd_hdr)));
 
 	return ret;
 }
@@ -280,9 +293,10 @@ static int openpcd_set_environment(struct rfid_reader_handle *rh,
 				   unsigned char num_bytes,
 				   const unsigned char *buf)
 {
+	struct openpcd_handle *oh = rh_to_opcd(rh);
 	int ret;
 	
-	ret = openpcd_xcv(OPENPCD_CMD_SET_ENVIRONMENT, 0, 0, num_bytes, buf);
+	ret = openpcd_xcv(oh, OPENPCD_CMD_SET_ENVIRONMENT, 0, 0, num_bytes, buf);
 	if (ret < 0) {
 		DEBUGPC("ERROR sending command [%i]\n",ret);
 		return ret;
@@ -293,7 +307,90 @@ static int openpcd_set_environment(struct rfid_reader_handle *rh,
 		return -EINVAL;
 	}
 
-	return rcv_hdr->val;
+	return oh->rcv_hdr->val;
+}
+
+/* CMD_CLS_LIBRFID round trip, returns the length of the reply data or
+ * -ENOTSUP if the firmware can't do it */
+static int openpcd_librfid_xcv(struct openpcd_handle *oh, u_int8_t cmd,
+			       u_int8_t reg, u_int8_t val, u_int16_t len,
+			       const unsigned char *data)
+{
+	int ret;
+
+	if (!oh->librfid_cmds)
+		return -ENOTSUP;
+
+	ret = openpcd_xcv(oh, cmd, reg, val, len, data);
+	if (ret < 0)
+		return ret;
+	if (ret < sizeof(struct openpcd_hdr))
+		return -EIO;
+
+	if (oh->rcv_hdr->flags & OPENPCD_FLAG_ERROR) {
+		/* right API version, but a firmware without the command */
+		DEBUGP("command 0x%02x rejected, falling back\n", cmd);
+		oh->librfid_cmds = 0;
+		return -ENOTSUP;
+	}
+	if (oh->rcv_hdr->val)
+		return -oh->rcv_hdr->val;
+
+	return ret - sizeof(struct openpcd_hdr);
+}
+
+static int openpcd_14443a_select(struct rfid_reader_handle *rh,
+				 unsigned int wupa,
+				 struct iso14443a_atqa *atqa, u_int8_t *sak,
+				 unsigned char *uid, unsigned int *uid_len)
+{
+	struct openpcd_handle *oh = rh_to_opcd(rh);
+	struct openpcd_14443a_select *sel =
+			(struct openpcd_14443a_select *)oh->rcv_hdr->data;
+	int ret;
+
+	ret = openpcd_librfid_xcv(oh, OPENPCD_CMD_14443A_SELECT, 0, !!wupa,
+				  0, NULL);
+	if (ret >= 0 &&
+	    (ret < sizeof(*sel) || sel->uid_len > sizeof(sel->uid)))
+		ret = -EIO;
+	if (ret >= 0) {
+		memcpy(atqa, sel->atqa, sizeof(sel->atqa));
+		*sak = sel->sak;
+		memcpy(uid, sel->uid, sel->uid_len);
+		*uid_len = sel->uid_len;
+		ret = 0;
+	}
+
+	if (ret < 0)
+		_rdr_rc632_select_done(rh, wupa, ret, atqa, 0, uid, 0);
+	else
+		_rdr_rc632_select_done(rh, wupa, ret, atqa, *sak, uid,
+				       *uid_len);
+
+	return ret;
+}
+
+static int openpcd_mifare_auth_read(struct rfid_reader_handle *rh,
+				    u_int8_t cmd, u_int32_t serno,
+				    u_int8_t block, unsigned char *buf,
+				    unsigned int *len)
+{
+	struct openpcd_handle *oh = rh_to_opcd(rh);
+	int ret;
+
+	ret = openpcd_librfid_xcv(oh, OPENPCD_CMD_MIFARE_AUTH_READ, block, cmd,
+				  sizeof(serno), (unsigned char *)&serno);
+	if (ret >= 0) {
+		if (ret < *len)
+			*len = ret;
+		memcpy(buf, oh->rcv_hdr->data, *len);
+		ret = 0;
+	}
+
+	_rdr_rc632_auth_read_done(rh, cmd, serno, block, ret, buf, *len);
+
+	return ret;
 }
 
 static int openpcd_reset(struct rfid_reader_handle *rh)
@@ -301,7 +398,7 @@ static int openpcd_reset(struct rfid_reader_handle *rh)
 	int ret;
 
 	DEBUGP("reset ");
-	ret = openpcd_xcv(OPENPCD_CMD_RESET, 0, 0, 0, 0);
+	ret = openpcd_xcv(rh_to_opcd(rh), OPENPCD_CMD_RESET, 0, 0, 0, 0);
 
 	return ret;
 }
@@ -371,51 +468,82 @@ static int openpcd_getopt(struct rfid_reader_handle *rh, int optname,
 }
 
 
+/* USB round trips are too slow to refill the FIFO during TX/RX, the RF
+ * settings are the ones of the CM5121 */
+static const struct rfid_asic_rc632_impl openpcd_impl = {
+	.mtu	= 64,
+	.mru	= 64,
+	.iso14443a = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x3f,
+		.bitphase		= 0xa9,
+		.threshold		= 0xff,
+		.rx_wait		= 0x06,
+	},
+	.iso14443b = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x04,
+		.bitphase		= 0xad,
+		.threshold		= 0xff,
+		.rx_wait		= 0x03,
+	},
+	.iso15693 = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x21,
+		.bitphase		= 0xd0,
+		.threshold		= 0xed,
+	},
+};
+
 static struct rfid_reader_handle *
 openpcd_open(void *data)
 {
 	struct rfid_reader_handle *rh;
 	struct rfid_asic_transport_handle *rath;
+#ifndef LIBRFID_FIRMWARE
+	struct usb_device *dev;
+	struct openpcd_handle *oh;
 
-	snd_hdr = (struct openpcd_hdr *)snd_buf;
-	rcv_hdr = (struct openpcd_hdr *)rcv_buf;
+	oh = malloc(sizeof(*oh));
+	if (!oh)
+		return NULL;
+	memset(oh, 0, sizeof(*oh));
+	oh->snd_hdr = (struct openpcd_hdr *)oh->snd_buf;
+	oh->rcv_hdr = (struct openpcd_hdr *)oh->rcv_buf;
 
-#ifndef LIBRFID_FIRMWARE
 	usb_init();
 	if (usb_find_busses() < 0)
-		return NULL;
+		goto out_oh;
 	if (usb_find_devices() < 0) 
-		return NULL;
+		goto out_oh;
 	
 	dev = find_opcd_device();
 	if (!dev) {
 		DEBUGP("No matching USB device found\n");
-		return NULL;
+		goto out_oh;
 	}
 
-	hdl = usb_open(dev);
-	if (!hdl) {
+	oh->hdl = usb_open(dev);
+	if (!oh->hdl) {
 		DEBUGP("Can't open USB device\n");
-		return NULL;
+		goto out_oh;
 	}
 
-        if(usb_set_configuration(hdl, 1 ) < 0)
+        if(usb_set_configuration(oh->hdl, 1 ) < 0)
         {
             DEBUGP("setting config failed\n");
-            usb_close( hdl );
-            return NULL;
+            goto out_usb;
         }
 									
-	if (usb_claim_interface(hdl, 0) < 0) {
+	if (usb_claim_interface(oh->hdl, 0) < 0) {
 		DEBUGP("Can't claim interface\n");
-		usb_close(hdl);
-		return NULL;
+		goto out_usb;
 	}
 #endif
 
 	rh = malloc_reader_handle(sizeof(*rh));
 	if (!rh)
-		return NULL;
+		goto out_usb;
 	memset(rh, 0, sizeof(*rh));
 
 	rath = malloc_rat_handle(sizeof(*rath));
@@ -424,12 +552,27 @@ openpcd_open(void *data)
 	memset(rath, 0, sizeof(*rath));
 
 	rath->rat = &openpcd_rat;
+#ifndef LIBRFID_FIRMWARE
+	rath->data = oh;
+#endif
 	rh->reader = &rfid_reader_openpcd;
 
-	rh->ah = rc632_open(rath);
+	rh->ah = rc632_open(rath, &openpcd_impl);
 	if (!rh->ah) 
 		goto out_rath;
 
+#ifndef LIBRFID_FIRMWARE
+	{
+		u_int8_t api = 0;
+
+		if (openpcd_get_api_version(rh, &api) >= 0 &&
+		    api >= OPENPCD_API_LIBRFID)
+			oh->librfid_cmds = 1;
+		DEBUGP("firmware API version %u%s\n", api,
+		       oh->librfid_cmds ? ", offloading anticollision" : "");
+	}
+#endif
+
 	DEBUGP("returning %p\n", rh);
 	return rh;
 
@@ -437,7 +580,12 @@ out_rath:
 	free_rat_handle(rath);
 out_rh:
 	free_reader_handle(rh);
-
+out_usb:
+#ifndef LIBRFID_FIRMWARE
+	usb_close(oh->hdl);
+out_oh:
+	free(oh);
+#endif
 	return NULL;
 }
 
@@ -445,13 +593,17 @@ static void
 openpcd_close(struct rfid_reader_handle *rh)
 {
 	struct rfid_asic_transport_handle *rath = rh->ah->rath;
+#ifndef LIBRFID_FIRMWARE
+	struct openpcd_handle *oh = rath->data;
+#endif
 
 	rc632_close(rh->ah);
 	free_rat_handle(rath);
 	free_reader_handle(rh);
 
 #ifndef LIBRFID_FIRMWARE
-	usb_close(hdl);
+	usb_close(oh->hdl);
+	free(oh);
 #endif
 }
 
@@ -467,6 +619,8 @@ const struct rfid_reader rfid_reader_openpcd = {
 	.setopt = &_rdr_rc632_setopt,
 	.init = &_rdr_rc632_l2_init,
 	.transceive = &_rdr_rc632_transceive,
+	.transceive_submit = &_rdr_rc632_transceive_submit,
+	.transceive_complete = &_rdr_rc632_transceive_complete,
 	.l2_supported = (1 << RFID_LAYER2_ISO14443A) |
 			(1 << RFID_LAYER2_ISO14443B) |
 			(1 << RFID_LAYER2_ISO15693),
@@ -479,6 +633,9 @@ const struct rfid_reader rfid_reader_openpcd = {
 		.speed = RFID_14443A_SPEED_106K | RFID_14443A_SPEED_212K |
 			 RFID_14443A_SPEED_424K, //| RFID_14443A_SPEED_848K,
 		.set_speed = &_rdr_rc632_14443a_set_speed,
+#ifndef LIBRFID_FIRMWARE
+		.select = &openpcd_14443a_select,
+#endif
 	},
 	.iso15693 = {
 		.transceive_ac = &_rdr_rc632_iso15693_transceive_ac,
@@ -486,6 +643,10 @@ const struct rfid_reader rfid_reader_openpcd = {
 	.mifare_classic = {
 		.setkey = &_rdr_rc632_mifare_setkey,
 		.setkey_ee = &_rdr_rc632_mifare_setkey_ee,
+		.load_keys_ee = &_rdr_rc632_mifare_load_keys_ee,
 		.auth = &_rdr_rc632_mifare_auth,
+#ifndef LIBRFID_FIRMWARE
+		.auth_read = &openpcd_mifare_auth_read,
+#endif
 	},
 };
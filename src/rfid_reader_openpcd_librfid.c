@@ -0,0 +1,138 @@
+/* OpenPCD CMD_CLS_LIBRFID commands, reader side
+ *
+ * The firmware runs these with its own librfid, they are the other end of
+ * openpcd_14443a_select() and openpcd_mifare_auth_read() in
+ * rfid_reader_openpcd.c.  Nothing in here touches USB, so it's built
+ * everywhere and the tests can run it behind an emulated reader.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_reader_openpcd.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_layer2_iso14443a.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
+
+static int fw_14443a_select(struct rfid_reader_handle *rh,
+			    const struct openpcd_hdr *req,
+			    struct openpcd_hdr *resp, unsigned int *resp_len)
+{
+	struct openpcd_14443a_select *sel =
+			(struct openpcd_14443a_select *)resp->data;
+	struct rfid_layer2_handle *l2h;
+	int ret;
+
+	if (*resp_len < sizeof(*sel))
+		return -EINVAL;
+
+	l2h = rfid_layer2_init(rh, RFID_LAYER2_ISO14443A);
+	if (!l2h)
+		return -ENOMEM;
+	if (req->val)
+		l2h->flags |= RFID_OPT_LAYER2_WUP;
+
+	ret = rfid_layer2_open(l2h);
+	if (ret >= 0) {
+		memcpy(sel->atqa, &l2h->priv.iso14443a.atqa,
+		       sizeof(sel->atqa));
+		sel->sak = l2h->priv.iso14443a.sak;
+		sel->uid_len = l2h->uid_len;
+		memcpy(sel->uid, l2h->uid, l2h->uid_len);
+		*resp_len = sizeof(*sel);
+	}
+
+	/* no close, the PICC stays selected for the host */
+	rfid_layer2_fini(l2h);
+
+	return ret;
+}
+
+static int fw_mifare_auth_read(struct rfid_reader_handle *rh,
+			       const struct openpcd_hdr *req,
+			       unsigned int req_len,
+			       struct openpcd_hdr *resp,
+			       unsigned int *resp_len)
+{
+	unsigned char tx[2];
+	unsigned int rx_len = *resp_len;
+	u_int32_t serno;
+	int ret;
+
+	if (req_len < sizeof(*req) + sizeof(serno))
+		return -EINVAL;
+	memcpy(&serno, req->data, sizeof(serno));
+
+	ret = rh->reader->mifare_classic.auth(rh, req->val, serno, req->reg);
+	if (ret < 0)
+		return ret;
+
+	tx[0] = MIFARE_CL_CMD_READ;
+	tx[1] = req->reg;
+	ret = rh->reader->transceive(rh, RFID_MIFARE_FRAME, tx, sizeof(tx),
+				     resp->data, &rx_len, MIFARE_CL_READ_FWT,
+				     0);
+	if (ret < 0)
+		return ret;
+
+	if (rx_len == 1 && resp->data[0] == 0x04)
+		return -EPERM;
+
+	*resp_len = rx_len;
+
+	return 0;
+}
+
+int openpcd_librfid_cmd(struct rfid_reader_handle *rh,
+			const struct openpcd_hdr *req, unsigned int req_len,
+			struct openpcd_hdr *resp, unsigned int *resp_len)
+{
+	unsigned int len = *resp_len;
+	int ret;
+
+	resp->cmd = req->cmd;
+	resp->flags = 0;
+	resp->reg = req->reg;
+	*resp_len = 0;
+
+	switch (req->cmd) {
+	case OPENPCD_CMD_14443A_SELECT:
+		ret = fw_14443a_select(rh, req, resp, &len);
+		break;
+	case OPENPCD_CMD_MIFARE_AUTH_READ:
+		ret = fw_mifare_auth_read(rh, req, req_len, resp, &len);
+		break;
+	default:
+		resp->flags = OPENPCD_FLAG_ERROR;
+		resp->val = 0;
+		return -EINVAL;
+	}
+
+	if (ret < 0) {
+		resp->val = -ret;
+		return 0;
+	}
+
+	resp->val = 0;
+	*resp_len = len;
+
+	return 0;
+}
+
@@ -21,14 +21,62 @@
 
 
 #include <errno.h>
+#include <string.h>
 
 #include <librfid/rfid.h>
 #include <librfid/rfid_reader.h>
 #include <librfid/rfid_asic.h>
 #include <librfid/rfid_asic_rc632.h>
 #include <librfid/rfid_layer2.h>
+#include <librfid/rfid_layer2_iso14443a.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
+#include <librfid/rfid_trace.h>
+#include <librfid/rfid_capture.h>
 
 #include "rfid_reader_rc632_common.h"
+#include "rc632.h"
+
+/* RC632 error flags of the last frame as RFID_CAPTURE_F_* */
+static inline unsigned int
+rdr_capture_flags(struct rfid_reader_handle *rh)
+{
+	u_int8_t err = rh->ah->priv.rc632.err_flags;
+	unsigned int flags = 0;
+
+	if (err & RC632_ERR_FLAG_COL_ERR)
+		flags |= RFID_CAPTURE_F_COLLISION;
+	if (err & RC632_ERR_FLAG_PARITY_ERR)
+		flags |= RFID_CAPTURE_F_PARITY_ERR;
+	if (err & RC632_ERR_FLAG_FRAMING_ERR)
+		flags |= RFID_CAPTURE_F_FRAMING_ERR;
+	if (err & RC632_ERR_FLAG_CRC_ERR)
+		flags |= RFID_CAPTURE_F_CRC_ERR;
+
+	return flags;
+}
+
+static inline void
+rdr_capture_rx(struct rfid_reader_handle *rh, unsigned int event,
+	       unsigned int frametype, int ret, const void *rx_data,
+	       unsigned int rx_len)
+{
+	if (!rh->capture)
+		return;
+
+	rfid_capture(rh->capture, RFID_CAPTURE_PICC_TO_PCD, event, frametype,
+		     ret, rdr_capture_flags(rh), rx_data, ret < 0 ? 0 : rx_len);
+}
+
+static inline void
+rdr_count_rx(struct rfid_reader_handle *rh, int ret, unsigned int rx_len)
+{
+	if (ret < 0) {
+		rh->stats.transceive_err++;
+		if (ret == -ETIMEDOUT)
+			rh->stats.timeouts++;
+	} else
+		rh->stats.rx_bytes += rx_len;
+}
 
 int _rdr_rc632_transceive(struct rfid_reader_handle *rh,
 			  enum rfid_frametype frametype,
@@ -36,18 +84,82 @@ int _rdr_rc632_transceive(struct rfid_reader_handle *rh,
 			  unsigned char *rx_data, unsigned int *rx_len,
 			  u_int64_t timeout, unsigned int flags)
 {
-	return rh->ah->asic->priv.rc632.fn.transceive(rh->ah, frametype,
-						      tx_data, tx_len, 
-						      rx_data, rx_len,
-						      timeout, flags);
+	int ret;
+
+	rfid_trace(rh->trace, RFID_TRACE_TX, frametype, tx_data, tx_len);
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC, RFID_CAPTURE_EV_FRAME,
+		     frametype, 0, 0, tx_data, tx_len);
+	ret = rh->ah->asic->priv.rc632.fn.transceive(rh->ah, frametype,
+						     tx_data, tx_len, 
+						     rx_data, rx_len,
+						     timeout, flags);
+	rh->stats.transceive++;
+	rh->stats.tx_bytes += tx_len;
+	rdr_count_rx(rh, ret, *rx_len);
+	rfid_trace(rh->trace, RFID_TRACE_RX, ret, rx_data,
+		   ret < 0 ? 0 : *rx_len);
+	rdr_capture_rx(rh, RFID_CAPTURE_EV_FRAME, frametype, ret, rx_data,
+		       *rx_len);
+
+	return ret;
+}
+
+int _rdr_rc632_transceive_submit(struct rfid_reader_handle *rh,
+				 enum rfid_frametype frametype,
+				 const unsigned char *tx_data,
+				 unsigned int tx_len,
+				 u_int64_t timeout, unsigned int flags)
+{
+	rh->stats.transceive++;
+	rh->stats.tx_bytes += tx_len;
+	rfid_trace(rh->trace, RFID_TRACE_TX, frametype, tx_data, tx_len);
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC, RFID_CAPTURE_EV_FRAME,
+		     frametype, 0, 0, tx_data, tx_len);
+
+	return rh->ah->asic->priv.rc632.fn.transceive_submit(rh->ah, frametype,
+							     tx_data, tx_len,
+							     timeout, flags);
+}
+
+int _rdr_rc632_transceive_complete(struct rfid_reader_handle *rh,
+				   unsigned char *rx_data,
+				   unsigned int *rx_len)
+{
+	int ret;
+
+	ret = rh->ah->asic->priv.rc632.fn.transceive_complete(rh->ah, rx_data,
+							      rx_len);
+	if (ret != -EINPROGRESS) {
+		rdr_count_rx(rh, ret, *rx_len);
+		rfid_trace(rh->trace, RFID_TRACE_RX, ret, rx_data,
+			   ret < 0 ? 0 : *rx_len);
+		rdr_capture_rx(rh, RFID_CAPTURE_EV_FRAME,
+			       RFID_CAPTURE_FRAMETYPE_TX, ret, rx_data, *rx_len);
+	}
+
+	return ret;
 }
 
 int _rdr_rc632_transceive_sf(struct rfid_reader_handle *rh,
 			     unsigned char cmd, struct iso14443a_atqa *atqa)
 {
-	return rh->ah->asic->priv.rc632.fn.iso14443a.transceive_sf(rh->ah,
-								   cmd,
-								   atqa);
+	unsigned char tr[1 + sizeof(*atqa)];
+	int ret;
+
+	rh->stats.anticol++;
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC, RFID_CAPTURE_EV_REQ,
+		     RFID_14443A_FRAME_REGULAR, 0, 0, &cmd, 1);
+
+	ret = rh->ah->asic->priv.rc632.fn.iso14443a.transceive_sf(rh->ah,
+								  cmd,
+								  atqa);
+	tr[0] = cmd;
+	memcpy(tr + 1, atqa, sizeof(*atqa));
+	rfid_trace(rh->trace, RFID_TRACE_ANTICOL, ret, tr, sizeof(tr));
+	rdr_capture_rx(rh, RFID_CAPTURE_EV_REQ, RFID_14443A_FRAME_REGULAR, ret,
+		       atqa, sizeof(*atqa));
+
+	return ret;
 }
 
 int
@@ -55,8 +167,21 @@ _rdr_rc632_transceive_acf(struct rfid_reader_handle *rh,
 			  struct iso14443a_anticol_cmd *cmd,
 			  unsigned int *bit_of_col)
 {
-	return rh->ah->asic->priv.rc632.fn.iso14443a.transceive_acf(rh->ah,
-							 cmd, bit_of_col);
+	int ret;
+
+	rh->stats.anticol++;
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC,
+		     RFID_CAPTURE_EV_ANTICOL, RFID_14443A_FRAME_REGULAR, 0, 0,
+		     cmd, sizeof(*cmd));
+
+	ret = rh->ah->asic->priv.rc632.fn.iso14443a.transceive_acf(rh->ah,
+							cmd, bit_of_col);
+	rfid_trace(rh->trace, RFID_TRACE_ANTICOL, ret, cmd, sizeof(*cmd));
+	/* the command with the UID bits received so far */
+	rdr_capture_rx(rh, RFID_CAPTURE_EV_ANTICOL, RFID_14443A_FRAME_REGULAR,
+		       ret, cmd, sizeof(*cmd));
+
+	return ret;
 }
 
 int
@@ -66,9 +191,22 @@ _rdr_rc632_iso15693_transceive_ac(struct rfid_reader_handle *rh,
 				  struct iso15693_anticol_resp *resp,
 				  unsigned int *resp_len, char *bit_of_col)
 {
-	return 	rh->ah->asic->priv.rc632.fn.iso15693.transceive_ac(
+	int ret;
+
+	rh->stats.anticol++;
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC,
+		     RFID_CAPTURE_EV_15693_AC, RFID_15693_FRAME, 0, 0,
+		     acf, acf_len);
+
+	ret = rh->ah->asic->priv.rc632.fn.iso15693.transceive_ac(
 					rh->ah, acf, acf_len, resp, resp_len,
 					bit_of_col);
+	rfid_trace(rh->trace, RFID_TRACE_ANTICOL, ret, resp,
+		   ret < 0 ? 0 : *resp_len);
+	rdr_capture_rx(rh, RFID_CAPTURE_EV_15693_AC, RFID_15693_FRAME, ret,
+		       resp, *resp_len);
+
+	return ret;
 }
 
 
@@ -77,6 +215,7 @@ _rdr_rc632_14443a_set_speed(struct rfid_reader_handle *rh,
 			    unsigned int tx, unsigned int speed)
 {
 	u_int8_t rate;
+	int ret;
 	
 	DEBUGP("setting rate: ");
 	switch (speed) {
@@ -100,8 +239,12 @@ _rdr_rc632_14443a_set_speed(struct rfid_reader_handle *rh,
 		return -EINVAL;
 		break;
 	}
-	return rh->ah->asic->priv.rc632.fn.iso14443a.set_speed(rh->ah,
-								tx, rate);
+	ret = rh->ah->asic->priv.rc632.fn.iso14443a.set_speed(rh->ah,
+							       tx, rate);
+	if (ret == 0)
+		rfid_capture_speed(rh->capture, tx, 106 << rate);
+
+	return ret;
 }
 
 int
@@ -122,19 +265,140 @@ _rdr_rc632_mifare_setkey_ee(struct rfid_reader_handle *rh, unsigned int addr)
 	return rh->ah->asic->priv.rc632.fn.mifare_classic.setkey_ee(rh->ah, addr);
 }
 
+int
+_rdr_rc632_mifare_load_keys_ee(struct rfid_reader_handle *rh,
+			       struct mfcl_ee_key *keys, unsigned int num)
+{
+	return rh->ah->asic->priv.rc632.fn.mifare_classic.load_keys_ee(rh->ah,
+								keys, num);
+}
+
 int
 _rdr_rc632_mifare_auth(struct rfid_reader_handle *rh, u_int8_t cmd, 
 		   u_int32_t serno, u_int8_t block)
 {
-	return rh->ah->asic->priv.rc632.fn.mifare_classic.auth(rh->ah, 
+	unsigned char tr[6];
+	int ret;
+
+	if (rh->capture) {
+		tr[0] = cmd;
+		tr[1] = block;
+		memcpy(tr + 2, &serno, sizeof(serno));
+		rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC,
+			     RFID_CAPTURE_EV_MIFARE_AUTH, RFID_MIFARE_FRAME,
+			     0, 0, tr, sizeof(tr));
+	}
+
+	ret = rh->ah->asic->priv.rc632.fn.mifare_classic.auth(rh->ah, 
 							cmd, serno, block);
+	rdr_capture_rx(rh, RFID_CAPTURE_EV_MIFARE_AUTH, RFID_MIFARE_FRAME, ret,
+		       NULL, 0);
+
+	return ret;
+}
+
+/* Offloaded transactions (see iso14443a.select and mifare_classic.auth_read
+ * of struct rfid_reader) don't pass through the wrappers above.  Their
+ * frames are accounted for here after the fact, from the request and the
+ * result, so that stats, trace and capture still cover them. */
+
+void
+_rdr_rc632_select_done(struct rfid_reader_handle *rh, unsigned int wupa,
+		       int ret, const struct iso14443a_atqa *atqa, u_int8_t sak,
+		       const unsigned char *uid, unsigned int uid_len)
+{
+	unsigned char cmd = wupa ? ISO14443A_SF_CMD_WUPA : ISO14443A_SF_CMD_REQA;
+	unsigned char tr[1 + sizeof(*atqa) + 1 + 10];
+
+	if (ret == -ENOTSUP)
+		return;
+	if (ret < 0 || uid_len > 10)
+		uid_len = 0;
+
+	rh->stats.anticol++;
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC, RFID_CAPTURE_EV_REQ,
+		     RFID_14443A_FRAME_REGULAR, 0, 0, &cmd, 1);
+	rfid_capture(rh->capture, RFID_CAPTURE_PICC_TO_PCD, RFID_CAPTURE_EV_REQ,
+		     RFID_14443A_FRAME_REGULAR, ret, 0, atqa,
+		     ret < 0 ? 0 : sizeof(*atqa));
+
+	/* command, ATQA, SAK and UID of the selected PICC */
+	tr[0] = cmd;
+	memcpy(tr + 1, atqa, sizeof(*atqa));
+	tr[1 + sizeof(*atqa)] = sak;
+	memcpy(tr + 2 + sizeof(*atqa), uid, uid_len);
+	rfid_trace(rh->trace, RFID_TRACE_ANTICOL, ret, tr,
+		   ret < 0 ? 1 : 2 + sizeof(*atqa) + uid_len);
+	rfid_capture(rh->capture, RFID_CAPTURE_PICC_TO_PCD,
+		     RFID_CAPTURE_EV_ANTICOL, RFID_14443A_FRAME_REGULAR, ret, 0,
+		     tr + 1 + sizeof(*atqa), ret < 0 ? 0 : 1 + uid_len);
+}
+
+void
+_rdr_rc632_auth_read_done(struct rfid_reader_handle *rh, u_int8_t cmd,
+			  u_int32_t serno, u_int8_t block, int ret,
+			  const unsigned char *buf, unsigned int len)
+{
+	unsigned char tr[6];
+
+	if (ret == -ENOTSUP)
+		return;
+
+	if (rh->capture) {
+		tr[0] = cmd;
+		tr[1] = block;
+		memcpy(tr + 2, &serno, sizeof(serno));
+		rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC,
+			     RFID_CAPTURE_EV_MIFARE_AUTH, RFID_MIFARE_FRAME,
+			     0, 0, tr, sizeof(tr));
+	}
+
+	/* the READ frame that followed the authentication */
+	tr[0] = MIFARE_CL_CMD_READ;
+	tr[1] = block;
+	rfid_trace(rh->trace, RFID_TRACE_TX, RFID_MIFARE_FRAME, tr, 2);
+	rfid_capture(rh->capture, RFID_CAPTURE_PCD_TO_PICC, RFID_CAPTURE_EV_FRAME,
+		     RFID_MIFARE_FRAME, 0, 0, tr, 2);
+	rh->stats.transceive++;
+	rh->stats.tx_bytes += 2;
+	rdr_count_rx(rh, ret, len);
+	rfid_trace(rh->trace, RFID_TRACE_RX, ret, buf, ret < 0 ? 0 : len);
+	rfid_capture(rh->capture, RFID_CAPTURE_PICC_TO_PCD,
+		     RFID_CAPTURE_EV_FRAME, RFID_MIFARE_FRAME, ret, 0, buf,
+		     ret < 0 ? 0 : len);
+}
+
+int
+_rdr_rc632_wait_event(struct rfid_reader_handle *rh, unsigned int timeout_ms)
+{
+	struct rfid_asic_transport_handle *rath = rh->ah->rath;
+
+	if (!rath->rat->priv.rc632.fn.wait_irq)
+		return -ENOTSUP;
+
+	return rath->rat->priv.rc632.fn.wait_irq(rath, timeout_ms);
 }
 
 int
 _rdr_rc632_getopt(struct rfid_reader_handle *rh, int optname,
 		  void *optval, unsigned int *optlen)
 {
-	return -EINVAL;
+	const struct rfid_asic_rc632_impl_proto *t =
+					&rh->ah->priv.rc632.iso14443a;
+	struct rfid_reader_tuning *tuning = optval;
+
+	switch (optname) {
+	case RFID_OPT_RDR_TUNING:
+		if (!optval || !optlen || *optlen < sizeof(*tuning))
+			return -EINVAL;
+		tuning->mod_conductance = t->mod_conductance;
+		tuning->bitphase = t->bitphase;
+		tuning->threshold = t->threshold;
+		*optlen = sizeof(*tuning);
+		return 0;
+	default:
+		return -EINVAL;
+	}
 }
 
 int
@@ -142,12 +406,23 @@ _rdr_rc632_setopt(struct rfid_reader_handle *rh, int optname,
 		  const void *optval, unsigned int optlen)
 {
 	unsigned int *val = (unsigned int *)optval;
-
-	if (!optval || optlen < sizeof(*val))
-		return -EINVAL;
+	const struct rfid_reader_tuning *tuning = optval;
+	struct rfid_asic_rc632_impl_proto *t = &rh->ah->priv.rc632.iso14443a;
 
 	switch (optname) {
+	case RFID_OPT_RDR_TUNING:
+		if (!optval || optlen < sizeof(*tuning))
+			return -EINVAL;
+		/* 6 bit register */
+		if (tuning->mod_conductance > 0x3f)
+			return -EINVAL;
+		t->mod_conductance = tuning->mod_conductance;
+		t->bitphase = tuning->bitphase;
+		t->threshold = tuning->threshold;
+		return 0;
 	case RFID_OPT_RDR_RF_KILL:
+		if (!optval || optlen < sizeof(*val))
+			return -EINVAL;
 		if (*val)
 			return rh->ah->asic->priv.rc632.fn.rf_power(rh->ah, 0);
 		else
@@ -6,6 +6,14 @@ int _rdr_rc632_transceive(struct rfid_reader_handle *rh,
 			  const unsigned char *tx_data, unsigned int tx_len,
 			  unsigned char *rx_data, unsigned int *rx_len,
 			  u_int64_t timeout, unsigned int flags);
+int _rdr_rc632_transceive_submit(struct rfid_reader_handle *rh,
+				 enum rfid_frametype frametype,
+				 const unsigned char *tx_data,
+				 unsigned int tx_len,
+				 u_int64_t timeout, unsigned int flags);
+int _rdr_rc632_transceive_complete(struct rfid_reader_handle *rh,
+				   unsigned char *rx_data,
+				   unsigned int *rx_len);
 int _rdr_rc632_transceive_sf(struct rfid_reader_handle *rh,
 			     unsigned char cmd, struct iso14443a_atqa *atqa);
 int _rdr_rc632_transceive_acf(struct rfid_reader_handle *rh,
@@ -21,8 +29,19 @@ int _rdr_rc632_14443a_set_speed(struct rfid_reader_handle *rh, unsigned int tx,
 int _rdr_rc632_l2_init(struct rfid_reader_handle *rh, enum rfid_layer2_id l2);
 int _rdr_rc632_mifare_setkey(struct rfid_reader_handle *rh, const u_int8_t *key);
 int _rdr_rc632_mifare_setkey_ee(struct rfid_reader_handle *rh, const unsigned int addr);
+int _rdr_rc632_mifare_load_keys_ee(struct rfid_reader_handle *rh,
+				   struct mfcl_ee_key *keys, unsigned int num);
 int _rdr_rc632_mifare_auth(struct rfid_reader_handle *rh, u_int8_t cmd, 
 			   u_int32_t serno, u_int8_t block);
+void _rdr_rc632_select_done(struct rfid_reader_handle *rh, unsigned int wupa,
+			    int ret, const struct iso14443a_atqa *atqa,
+			    u_int8_t sak, const unsigned char *uid,
+			    unsigned int uid_len);
+void _rdr_rc632_auth_read_done(struct rfid_reader_handle *rh, u_int8_t cmd,
+			       u_int32_t serno, u_int8_t block, int ret,
+			       const unsigned char *buf, unsigned int len);
+int _rdr_rc632_wait_event(struct rfid_reader_handle *rh,
+			  unsigned int timeout_ms);
 int _rdr_rc632_getopt(struct rfid_reader_handle *rh, int optname,
 		      void *optval, unsigned int *optlen);
 int _rdr_rc632_setopt(struct rfid_reader_handle *rh, int optname,
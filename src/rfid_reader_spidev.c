@@ -44,35 +44,35 @@
 
 /* FIXME */
 #include "rc632.h"
-static int spidev_fd;
+/* address bytes of a read of up to 255 bytes, plus the trailing 0 */
+#define SENDBUF_LEN     (256+1)
 
-struct spi_ioc_transfer xfer[1];
-
-/* 256bytes max FSD/FSC, plus 1 bytes header, plus 10 bytes reserve */
-#define SENDBUF_LEN     (256+1+10)
-#define RECVBUF_LEN     SENDBUF_LEN
-static char snd_buf[SENDBUF_LEN];
-static char rcv_buf[RECVBUF_LEN];
+/* per reader state, hangs off rath->data.
+ *
+ * Every access is one SPI message of two transfers: the address byte(s)
+ * from snd_buf, and the data directly from or into the caller's buffer,
+ * which for frames is the rfid_buf the upper layers built them in.  The
+ * chip select stays asserted between the transfers of a message. */
+struct spidev_handle {
+	int fd;
+	struct spi_ioc_transfer xfer[2];
+	char snd_buf[SENDBUF_LEN];
+};
 
-static int spidev_read(unsigned char reg, unsigned char len,
-		       unsigned char *buf)
+static int spidev_xfer(struct spidev_handle *sh, unsigned char len,
+		       const unsigned char *tx, unsigned char *rx)
 {
 	int ret;
 
-	if (!len)
-		return -EINVAL;
-
-	snd_buf[0] = (reg<<1) | 0x80;
-	if (len > 1)
-		memset(&snd_buf[1], reg<<1 , len-1);
-	snd_buf[len] = 0;
+	sh->xfer[0].tx_buf = (__u64) sh->snd_buf;
+	sh->xfer[0].rx_buf = (__u64) NULL;
+	sh->xfer[0].len = 1;
 
-	/* prepare spi buffer */
-	xfer[0].tx_buf = (__u64) snd_buf;
-	xfer[0].rx_buf = (__u64) rcv_buf;
-	xfer[0].len = len + 1;
+	sh->xfer[1].tx_buf = (__u64) tx;
+	sh->xfer[1].rx_buf = (__u64) rx;
+	sh->xfer[1].len = len;
 
-	ret = ioctl(spidev_fd, SPI_IOC_MESSAGE(1), xfer);
+	ret = ioctl(sh->fd, SPI_IOC_MESSAGE(2), sh->xfer);
 	if (ret < 0) {
 		DEBUGPC("ERROR sending command\n");
 		return ret;
@@ -81,36 +81,34 @@ static int spidev_read(unsigned char reg, unsigned char len,
 		return -EINVAL;
 	}
 
-	memcpy(buf, &rcv_buf[1], len);
-
 	return len;
 }
 
-static int spidev_write(unsigned char reg, unsigned char len,
-		       const unsigned char *buf)
+static int spidev_read(struct spidev_handle *sh, unsigned char reg,
+		       unsigned char len, unsigned char *buf)
 {
-	int ret;
-
 	if (!len)
 		return -EINVAL;
 
-	snd_buf[0] = (reg << 1) & 0x7E;
-	memcpy(&snd_buf[1], buf, len);
+	/* the byte clocked in with the first address is discarded, the
+	 * data comes in with the following ones */
+	sh->snd_buf[0] = (reg<<1) | 0x80;
+	if (len > 1)
+		memset(&sh->snd_buf[1], reg<<1 , len-1);
+	sh->snd_buf[len] = 0;
 
-	/* prepare spi buffer */
-	xfer[0].tx_buf = (__u64) snd_buf;
-	xfer[0].rx_buf = (__u64) NULL;
-	xfer[0].len = len + 1;
+	return spidev_xfer(sh, len, (unsigned char *) &sh->snd_buf[1], buf);
+}
 
-	ret = ioctl(spidev_fd, SPI_IOC_MESSAGE(1), xfer);
-        if (ret < 0) {
-		DEBUGPC("ERROR sending command\n");
-		return ret;
-	}
-	else if (ret != len+1)
+static int spidev_write(struct spidev_handle *sh, unsigned char reg,
+			unsigned char len, const unsigned char *buf)
+{
+	if (!len)
 		return -EINVAL;
 
-	return len;
+	sh->snd_buf[0] = (reg << 1) & 0x7E;
+
+	return spidev_xfer(sh, len, buf, NULL);
 }
 
 static int spidev_reg_read(struct rfid_asic_transport_handle *rath,
@@ -118,7 +116,7 @@ static int spidev_reg_read(struct rfid_asic_transport_handle *rath,
 {
 	int ret;
 
-	ret = spidev_read(reg, 1, value);
+	ret = spidev_read(rath->data, reg, 1, value);
 	if (ret < 0)
 		return ret;
 	DEBUGP("%s reg = 0x%02x, val = 0x%02x\n", __FUNCTION__, reg, *value);
@@ -131,7 +129,7 @@ static int spidev_reg_write(struct rfid_asic_transport_handle *rath,
 {
 	int ret;
 
-	ret = spidev_write(reg, 1, &value);
+	ret = spidev_write(rath->data, reg, 1, &value);
         if (ret < 0)
 		return ret;
 
@@ -145,7 +143,7 @@ static int spidev_fifo_read(struct rfid_asic_transport_handle *rath,
 {
 	int ret;
 
-	ret = spidev_read(2, len, buf);
+	ret = spidev_read(rath->data, 2, len, buf);
 	if (ret < 0)
 		return ret;
 
@@ -161,7 +159,7 @@ static int spidev_fifo_write(struct rfid_asic_transport_handle *rath,
 {
 	int ret;
 
-	ret = spidev_write(2, len, buf);
+	ret = spidev_write(rath->data, 2, len, buf);
         if (ret < 0)
 		return ret;
 
@@ -183,10 +181,40 @@ struct rfid_asic_transport spidev_spi = {
 	},
 };
 
+/* Frames longer than the FIFO are sent by topping it up during TX as soon
+ * as there is room, see rc632_fifo_wait_space().  The transmitter only
+ * runs dry if the host stalls for the ~6ms it takes to send a full FIFO,
+ * and then the card doesn't answer the cut frame. */
+static const struct rfid_asic_rc632_impl spidev_impl = {
+	.mtu	= 128,
+	.mru	= 64,
+	.iso14443a = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x3f,
+		.bitphase		= 0xa9,
+		.threshold		= 0xff,
+		.rx_wait		= 0x06,
+	},
+	.iso14443b = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x04,
+		.bitphase		= 0xad,
+		.threshold		= 0xff,
+		.rx_wait		= 0x03,
+	},
+	.iso15693 = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x21,
+		.bitphase		= 0xd0,
+		.threshold		= 0xed,
+	},
+};
+
 static struct rfid_reader_handle *spidev_open(void *data)
 {
 	struct rfid_reader_handle *rh;
 	struct rfid_asic_transport_handle *rath;
+	struct spidev_handle *sh;
 	__u32 tmp;
 
 	/* open spi device */
@@ -194,76 +222,87 @@ static struct rfid_reader_handle *spidev_open(void *data)
 		DEBUGP("No device name\n");
 		return NULL;
 	}
-	if ((spidev_fd = open(data, O_RDWR)) < 0) {
-		DEBUGP("Unable to open:\n");
+
+	sh = malloc(sizeof(*sh));
+	if (!sh)
 		return NULL;
+	memset(sh, 0, sizeof(*sh));
+
+	if ((sh->fd = open(data, O_RDWR)) < 0) {
+		DEBUGP("Unable to open:\n");
+		goto out_sh;
 	}
 
-	rh = malloc(sizeof(*rh));
+	rh = malloc_reader_handle(sizeof(*rh));
 	if (!rh)
 		goto out_close_spi;
 
 	memset(rh, 0, sizeof(*rh));
 
-	rath = malloc(sizeof(*rath));
+	rath = malloc_rat_handle(sizeof(*rath));
 	if (!rath)
 		goto out_rh;
 	memset(rath, 0, sizeof(*rath));
 
 	rath->rat = &spidev_spi;
+	rath->data = sh;
 	rh->reader = &rfid_reader_spidev;
 
 	/* Configure spi device, MODE 0 */
 	tmp = SPI_MODE_0;
-	if (ioctl(spidev_fd, SPI_IOC_WR_MODE, &tmp) < 0)
+	if (ioctl(sh->fd, SPI_IOC_WR_MODE, &tmp) < 0)
 		goto out_rath;
 
 	/* MSB First */
 	tmp = 0;
-	if (ioctl(spidev_fd, SPI_IOC_WR_LSB_FIRST, &tmp) < 0)
+	if (ioctl(sh->fd, SPI_IOC_WR_LSB_FIRST, &tmp) < 0)
 		goto out_rath;
 
 	/* 8 bits per word */
 	tmp = 8;
-	if (ioctl(spidev_fd, SPI_IOC_WR_BITS_PER_WORD, &tmp) < 0)
+	if (ioctl(sh->fd, SPI_IOC_WR_BITS_PER_WORD, &tmp) < 0)
 		goto out_rath;
 
 	/* 1 MHz */
 	tmp = 1e6;
-	if (ioctl(spidev_fd, SPI_IOC_WR_MAX_SPEED_HZ, &tmp) < 0)
+	if (ioctl(sh->fd, SPI_IOC_WR_MAX_SPEED_HZ, &tmp) < 0)
 		goto out_rath;
 
 	/* turn on rc632 */
-	rh->ah = rc632_open(rath);
+	rh->ah = rc632_open(rath, &spidev_impl);
 	if (!rh->ah)
 		goto out_rath;
 
 	/* everything is ok, returning reader handler */
 	return rh;
 out_rath:
-	free(rath);
+	free_rat_handle(rath);
 out_rh:
-	free(rh);
+	free_reader_handle(rh);
 out_close_spi:
-	close(spidev_fd);
+	close(sh->fd);
+out_sh:
+	free(sh);
 	return NULL;
 }
 
 static void spidev_close(struct rfid_reader_handle *rh)
 {
 	struct rfid_asic_transport_handle *rath = rh->ah->rath;
+	struct spidev_handle *sh = rath->data;
 
 	if (rh->ah)
 		rc632_close(rh->ah);
 
-	if (spidev_fd > 0)
-		close(spidev_fd);
+	if (sh->fd > 0)
+		close(sh->fd);
+	free(sh);
 
 	if (rath)
-		free(rath);
+		free_rat_handle(rath);
 
 	if (rh)
-		free(rh);
+		free_reader_handle(rh);
 }
 
 struct rfid_reader rfid_reader_spidev = {
@@ -281,6 +320,8 @@ struct rfid_reader rfid_reader_spidev = {
 	.setopt = &_rdr_rc632_setopt,
 	.init = &_rdr_rc632_l2_init,
 	.transceive = &_rdr_rc632_transceive,
+	.transceive_submit = &_rdr_rc632_transceive_submit,
+	.transceive_complete = &_rdr_rc632_transceive_complete,
 	.iso14443a = {
 		.transceive_sf = &_rdr_rc632_transceive_sf,
 		.transceive_acf = &_rdr_rc632_transceive_acf,
@@ -295,6 +336,7 @@ struct rfid_reader rfid_reader_spidev = {
 	.mifare_classic = {
 		.setkey = &_rdr_rc632_mifare_setkey,
 		.setkey_ee = &_rdr_rc632_mifare_setkey_ee,
+		.load_keys_ee = &_rdr_rc632_mifare_load_keys_ee,
 		.auth = &_rdr_rc632_mifare_auth,
 	},
 };
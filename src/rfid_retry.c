@@ -0,0 +1,217 @@
+/* librfid - retry and deadline policy
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_asic.h>
+#include <librfid/rfid_retry.h>
+
+/* ISO14443-2: the field has to be off for at least 5ms for a reset, and
+ * the PICC gets 5ms to power up before the first command */
+#define RF_RESET_OFF_USEC	5000
+#define RF_RESET_ON_USEC	5000
+
+static u_int64_t retry_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned int retry_class(int ret)
+{
+	switch (-ret) {
+	case ETIMEDOUT:
+		return RFID_RETRY_TIMEOUT;
+	case EIO:
+	case ECOLLISION:
+		return RFID_RETRY_RF;
+	default:
+		return 0;
+	}
+}
+
+static void retry_rf_reset(struct rfid_reader_handle *rh)
+{
+	unsigned int val = 1;
+
+	if (rfid_reader_setopt(rh, RFID_OPT_RDR_RF_KILL, &val,
+			       sizeof(val)) < 0)
+		return;
+	usleep(RF_RESET_OFF_USEC);
+
+	val = 0;
+	rfid_reader_setopt(rh, RFID_OPT_RDR_RF_KILL, &val, sizeof(val));
+	usleep(RF_RESET_ON_USEC);
+
+	rh->stats.rf_resets++;
+}
+
+void __rfid_retry_begin(struct rfid_reader_handle *rh,
+			struct rfid_retry_op *op, unsigned int flags)
+{
+	struct rfid_retry *r = rh->retry;
+
+	/* nested operations run under the budget of the outer one */
+	if (r->depth++)
+		return;
+
+	op->outer = 1;
+	op->flags = flags;
+	op->tries = 1;
+	op->backoff = r->policy.backoff;
+
+	if (r->policy.deadline)
+		r->deadline = retry_now() +
+			      (u_int64_t)r->policy.deadline * 1000;
+	/* the ASIC cuts the timeout of every frame to it, also those the
+	 * layer2 sends straight to the reader during anticollision.  An
+	 * earlier one set by the scan plan still applies. */
+	if (rh->ah) {
+		r->outer_deadline = rh->ah->deadline;
+		if (r->outer_deadline &&
+		    (!r->deadline || r->outer_deadline < r->deadline))
+			r->deadline = r->outer_deadline;
+		rh->ah->deadline = r->deadline;
+	}
+}
+
+int __rfid_retry_again(struct rfid_reader_handle *rh,
+		       struct rfid_retry_op *op, int *ret)
+{
+	struct rfid_retry *r = rh->retry;
+	const struct rfid_retry_policy *p = &r->policy;
+	unsigned int delay = op->backoff;
+	u_int64_t now = 0;
+
+	if (r->deadline) {
+		now = retry_now();
+		if (now >= r->deadline) {
+			/* frames cut short by the deadline fail like any
+			 * other timeout, count them all the same */
+			r->missed = 1;
+			if (retry_class(*ret) & p->errors)
+				*ret = -ETIMEDOUT;
+			return 0;
+		}
+	}
+
+	if (!(retry_class(*ret) & p->errors))
+		return 0;
+
+	if (!(op->flags & RFID_RETRY_OP_IDEMPOTENT) || op->tries >= p->tries)
+		return 0;
+
+	/* no point in sleeping past the deadline */
+	if (r->deadline && now + delay >= r->deadline)
+		delay = r->deadline - now;
+
+	/* a field reset takes fixed time, skip it if that's not left */
+	if (p->rf_reset && (op->flags & RFID_RETRY_OP_RF_RESET) &&
+	    op->tries % p->rf_reset == 0 &&
+	    (!r->deadline ||
+	     now + RF_RESET_OFF_USEC + RF_RESET_ON_USEC < r->deadline))
+		retry_rf_reset(rh);
+	else if (delay)
+		usleep(delay);
+
+	op->tries++;
+	op->backoff *= 2;
+	if (op->backoff > p->backoff_max)
+		op->backoff = p->backoff_max;
+	rh->stats.retries++;
+
+	return 1;
+}
+
+void __rfid_retry_end(struct rfid_reader_handle *rh, struct rfid_retry_op *op)
+{
+	struct rfid_retry *r = rh->retry;
+
+	if (r->missed)
+		rh->stats.deadline_miss++;
+
+	r->depth = 0;
+	r->deadline = 0;
+	r->missed = 0;
+	if (rh->ah)
+		rh->ah->deadline = r->outer_deadline;
+}
+
+int __rfid_retry_timeout(struct rfid_reader_handle *rh, u_int64_t *timeout)
+{
+	struct rfid_retry *r = rh->retry;
+	u_int64_t now = retry_now();
+
+	if (now >= r->deadline) {
+		r->missed = 1;
+		return -ETIMEDOUT;
+	}
+
+	if (*timeout > r->deadline - now)
+		*timeout = r->deadline - now;
+
+	return 0;
+}
+
+int rfid_retry_setconf(struct rfid_reader_handle *rh,
+		       const struct rfid_retry_policy *policy)
+{
+	if (rh->retry && rh->retry->depth)
+		return -EBUSY;
+
+	if (!policy->deadline && policy->tries <= 1) {
+		rfid_retry_fini(rh);
+		return 0;
+	}
+
+	if (!rh->retry) {
+		rh->retry = malloc(sizeof(*rh->retry));
+		if (!rh->retry)
+			return -ENOMEM;
+		memset(rh->retry, 0, sizeof(*rh->retry));
+	}
+
+	rh->retry->policy = *policy;
+	if (rh->retry->policy.backoff_max < rh->retry->policy.backoff)
+		rh->retry->policy.backoff_max = rh->retry->policy.backoff;
+
+	return 0;
+}
+
+void rfid_retry_getconf(struct rfid_reader_handle *rh,
+			struct rfid_retry_policy *policy)
+{
+	if (rh->retry)
+		*policy = rh->retry->policy;
+	else
+		memset(policy, 0, sizeof(*policy));
+}
+
+void rfid_retry_fini(struct rfid_reader_handle *rh)
+{
+	free(rh->retry);
+	rh->retry = NULL;
+}
@@ -19,10 +19,152 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <string.h>
+#include <time.h>
+
 #include <librfid/rfid.h>
+#include <librfid/rfid_asic.h>
 #include <librfid/rfid_layer2.h>
 #include <librfid/rfid_reader.h>
 #include <librfid/rfid_protocol.h>
+#include <librfid/rfid_scan.h>
+#include <librfid/rfid_sighting.h>
+
+#include "rfid_probes.h"
+
+#define RFID_LAYER2_MAX 16
+#define RFID_PROTOCOL_MAX 16
+
+static int
+scan_entry_due(struct rfid_scan_plan *plan, struct rfid_scan_entry *e)
+{
+	if (!e->enabled)
+		return 0;
+
+	if (e->score >= RFID_SCAN_SCORE_COLD || e->interval <= 1)
+		return 1;
+
+	return (plan->cycle % e->interval) == 0;
+}
+
+static void scan_entry_account(struct rfid_scan_entry *e, int hit)
+{
+	e->probes++;
+	e->score -= e->score / 8;
+	if (hit) {
+		e->score += RFID_SCAN_SCORE_HIT;
+		e->hits++;
+	}
+}
+
+/* Limit what follows to 'timeout' msec (0: no limit) by handing a deadline
+ * to the ASIC, which cuts the timeout of every frame to it.  A retry policy
+ * of the reader runs within it, see __rfid_retry_begin(). */
+static void scan_deadline(struct rfid_reader_handle *rh, unsigned int timeout)
+{
+#ifdef ENABLE_RETRY
+	struct timespec ts;
+
+	if (!rh->ah)
+		return;
+	if (!timeout) {
+		rh->ah->deadline = 0;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rh->ah->deadline = (u_int64_t)ts.tv_sec * 1000000 +
+			   ts.tv_nsec / 1000 + (u_int64_t)timeout * 1000;
+#endif
+}
+
+/* stable insertion sort, highest score first */
+static void scan_entries_sort(struct rfid_scan_entry *e, unsigned int num)
+{
+	unsigned int i, j;
+
+	for (i = 1; i < num; i++) {
+		struct rfid_scan_entry tmp = e[i];
+
+		for (j = i; j > 0 && e[j-1].score < tmp.score; j--)
+			e[j] = e[j-1];
+		e[j] = tmp;
+	}
+}
+
+/* initialize a scan plan with all layer2s and protocols the reader
+ * supports, in the default (id) order */
+int rfid_scan_plan_init(struct rfid_scan_plan *plan,
+			struct rfid_reader_handle *rh)
+{
+	unsigned int i;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->flags = RFID_SCAN_F_ADAPTIVE;
+
+	for (i = 0; i < RFID_LAYER2_MAX; i++) {
+		struct rfid_scan_entry *e;
+
+		if (!(rh->reader->l2_supported & (1 << i)))
+			continue;
+		if (plan->num_l2 >= RFID_SCAN_PLAN_MAX)
+			break;
+
+		e = &plan->l2[plan->num_l2++];
+		e->id = i;
+		e->enabled = 1;
+		e->interval = RFID_SCAN_INTERVAL_COLD;
+		e->score = RFID_SCAN_SCORE_COLD;
+	}
+
+	for (i = 0; i < RFID_PROTOCOL_MAX; i++) {
+		struct rfid_scan_entry *e;
+
+		if (!(rh->reader->proto_supported & (1 << i)))
+			continue;
+		if (plan->num_proto >= RFID_SCAN_PLAN_MAX)
+			break;
+
+		e = &plan->proto[plan->num_proto++];
+		e->id = i;
+		e->enabled = 1;
+		e->score = RFID_SCAN_SCORE_COLD;
+	}
+
+	return 0;
+}
+
+static struct rfid_scan_entry *
+scan_entry_find(struct rfid_scan_entry *e, unsigned int num, unsigned int id)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (e[i].id == id)
+			return &e[i];
+	}
+
+	return NULL;
+}
+
+/* look up the entry of a given layer2 to modify enabled/interval/timeout */
+struct rfid_scan_entry *
+rfid_scan_plan_l2(struct rfid_scan_plan *plan, unsigned int l2)
+{
+	return scan_entry_find(plan->l2, plan->num_l2, l2);
+}
+
+struct rfid_scan_entry *
+rfid_scan_plan_proto(struct rfid_scan_plan *plan, unsigned int proto)
+{
+	return scan_entry_find(plan->proto, plan->num_proto, proto);
+}
+
+void rfid_scan_set_plan(struct rfid_reader_handle *rh,
+			struct rfid_scan_plan *plan)
+{
+	rh->scan_plan = plan;
+}
 
 static struct rfid_layer2_handle *
 rfid_layer2_scan1(struct rfid_reader_handle *rh, int l2)
@@ -36,20 +178,53 @@ rfid_layer2_scan1(struct rfid_reader_handle *rh, int l2)
 		if (rfid_layer2_open(l2h) < 0) {
 			rfid_layer2_fini(l2h);
 			return NULL;
-		} else 
-			return l2h;
+		}
+		rfid_sightings_feed(l2h);
+		return l2h;
 	}
 
 	return NULL;
 }
 
+static struct rfid_layer2_handle *
+rfid_layer2_scan_plan(struct rfid_reader_handle *rh,
+		      struct rfid_scan_plan *plan)
+{
+	struct rfid_layer2_handle *l2h = NULL;
+	unsigned int i;
+
+	plan->cycle++;
+
+	for (i = 0; i < plan->num_l2; i++) {
+		struct rfid_scan_entry *e = &plan->l2[i];
+
+		if (!scan_entry_due(plan, e))
+			continue;
+
+		DEBUGP("testing l2 %u\n", e->id);
+		scan_deadline(rh, e->timeout);
+		l2h = rfid_layer2_scan1(rh, e->id);
+		scan_deadline(rh, 0);
+		scan_entry_account(e, l2h != NULL);
+		if (l2h)
+			break;
+	}
+
+	if (plan->flags & RFID_SCAN_F_ADAPTIVE)
+		scan_entries_sort(plan->l2, plan->num_l2);
+
+	return l2h;
+}
+
 struct rfid_layer2_handle *
 rfid_layer2_scan(struct rfid_reader_handle *rh)
 {
 	struct rfid_layer2_handle *l2h;
 	int i;
 
-#define RFID_LAYER2_MAX 16
+	if (rh->scan_plan)
+		return rfid_layer2_scan_plan(rh, rh->scan_plan);
+
 	for (i = 0; i < RFID_LAYER2_MAX; i++) {
 		DEBUGP("testing l2 %u\n", i);
 		l2h = rfid_layer2_scan1(rh, i);
@@ -80,13 +255,45 @@ rfid_protocol_scan1(struct rfid_layer2_handle *l2h, int proto)
 	return NULL;
 }
 
+static struct rfid_protocol_handle *
+rfid_protocol_scan_plan(struct rfid_layer2_handle *l2h,
+			struct rfid_scan_plan *plan)
+{
+	struct rfid_protocol_handle *ph = NULL;
+	unsigned int i;
+
+	for (i = 0; i < plan->num_proto; i++) {
+		struct rfid_scan_entry *e = &plan->proto[i];
+
+		/* no 'cold' skipping here: probing a protocol the
+		 * layer2 doesn't support costs nothing */
+		if (!e->enabled || !(l2h->proto_supported & (1 << e->id)))
+			continue;
+
+		DEBUGP("testing proto %u\n", e->id);
+		scan_deadline(l2h->rh, e->timeout);
+		ph = rfid_protocol_scan1(l2h, e->id);
+		scan_deadline(l2h->rh, 0);
+		scan_entry_account(e, ph != NULL);
+		if (ph)
+			break;
+	}
+
+	if (plan->flags & RFID_SCAN_F_ADAPTIVE)
+		scan_entries_sort(plan->proto, plan->num_proto);
+
+	return ph;
+}
+
 struct rfid_protocol_handle *
 rfid_protocol_scan(struct rfid_layer2_handle *l2h)
 {
 	struct rfid_protocol_handle *ph;
 	int i;
 
-#define RFID_PROTOCOL_MAX 16
+	if (l2h->rh->scan_plan)
+		return rfid_protocol_scan_plan(l2h, l2h->rh->scan_plan);
+
 	for (i = 0; i < RFID_PROTOCOL_MAX; i++) {
 		DEBUGP("testing proto %u\n", i);
 		ph = rfid_protocol_scan1(l2h, i);
@@ -103,13 +310,23 @@ int rfid_scan(struct rfid_reader_handle *rh,
 	      struct rfid_layer2_handle **l2h,
 	      struct rfid_protocol_handle **ph)
 {
+	rh->stats.scans++;
+	RFID_PROBE1(scan__entry, rh);
+
 	*l2h = rfid_layer2_scan(rh);
-	if (!*l2h)
+	if (!*l2h) {
+		RFID_PROBE4(scan__return, rh, 0, -1, -1);
 		return 0;
-	
+	}
+
+	rh->stats.scan_hits++;
+
 	*ph = rfid_protocol_scan(*l2h);
-	if (!*ph)
+	if (!*ph) {
+		RFID_PROBE4(scan__return, rh, 2, (*l2h)->l2->id, -1);
 		return 2;
+	}
 
+	RFID_PROBE4(scan__return, rh, 3, (*l2h)->l2->id, (*ph)->proto->id);
 	return 3;
 }
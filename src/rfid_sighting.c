@@ -0,0 +1,315 @@
+/* librfid - UID sighting table
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_sighting.h>
+
+#define NIL	0xffffffff
+
+/* Linear probing at a load factor of at most 1/2.  The slots of present
+ * cards are also on a list in the order of their last sighting, so the
+ * ones to expire are always at its head. */
+struct sighting {
+	u_int32_t hash;
+	u_int32_t prev, next;		/* slot numbers, NIL */
+	u_int32_t count;
+	u_int64_t first_seen;
+	u_int64_t last_seen;
+	u_int8_t used;
+	u_int8_t layer2;
+	u_int8_t uid_len;
+	u_int8_t uid[10];
+};
+
+struct rfid_sightings {
+	pthread_mutex_t lock;
+	struct rfid_sighting_params params;
+	struct rfid_sighting_stats stats;
+
+	u_int32_t mask;			/* number of slots - 1 */
+	struct sighting *slot;
+	u_int32_t oldest, newest;	/* list by last sighting */
+
+	/* event ring, as large as the table */
+	unsigned int ev_head, ev_len;
+	struct rfid_sighting_event *ev;
+};
+
+static const struct rfid_sighting_params sighting_defaults = {
+	.max_uids	= 4096,
+	.window		= 1000,
+};
+
+static u_int64_t sighting_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a */
+static u_int32_t sighting_hash(unsigned int layer2, const unsigned char *uid,
+			       unsigned int uid_len)
+{
+	u_int32_t h = 2166136261u;
+	unsigned int i;
+
+	h = (h ^ layer2) * 16777619;
+	for (i = 0; i < uid_len; i++)
+		h = (h ^ uid[i]) * 16777619;
+
+	return h;
+}
+
+static void list_del(struct rfid_sightings *st, u_int32_t i)
+{
+	struct sighting *s = &st->slot[i];
+
+	if (s->prev != NIL)
+		st->slot[s->prev].next = s->next;
+	else
+		st->oldest = s->next;
+	if (s->next != NIL)
+		st->slot[s->next].prev = s->prev;
+	else
+		st->newest = s->prev;
+}
+
+static void list_add_tail(struct rfid_sightings *st, u_int32_t i)
+{
+	struct sighting *s = &st->slot[i];
+
+	s->prev = st->newest;
+	s->next = NIL;
+	if (st->newest != NIL)
+		st->slot[st->newest].next = i;
+	else
+		st->oldest = i;
+	st->newest = i;
+}
+
+static void sighting_event(struct rfid_sightings *st, unsigned int type,
+			   const struct sighting *s)
+{
+	struct rfid_sighting_event *ev;
+
+	if (st->ev_len > st->mask) {
+		st->stats.dropped++;
+		return;
+	}
+
+	ev = &st->ev[(st->ev_head + st->ev_len++) & st->mask];
+	ev->type = type;
+	ev->layer2 = s->layer2;
+	memcpy(ev->uid, s->uid, s->uid_len);
+	ev->uid_len = s->uid_len;
+	ev->first_seen = s->first_seen;
+	ev->last_seen = s->last_seen;
+	ev->count = s->count;
+}
+
+/* backward shift deletion: move later members of the probe sequence into
+ * the hole, so lookups never need tombstones */
+static void sighting_del(struct rfid_sightings *st, u_int32_t i)
+{
+	u_int32_t j = i, home;
+
+	list_del(st, i);
+
+	while (1) {
+		j = (j + 1) & st->mask;
+		if (!st->slot[j].used)
+			break;
+
+		/* stays if its home slot is cyclically within (i, j] */
+		home = st->slot[j].hash & st->mask;
+		if (((j - home) & st->mask) < ((j - i) & st->mask))
+			continue;
+
+		st->slot[i] = st->slot[j];
+		if (st->slot[i].prev != NIL)
+			st->slot[st->slot[i].prev].next = i;
+		else
+			st->oldest = i;
+		if (st->slot[i].next != NIL)
+			st->slot[st->slot[i].next].prev = i;
+		else
+			st->newest = i;
+		i = j;
+	}
+
+	st->slot[i].used = 0;
+	st->stats.present--;
+}
+
+static void sighting_expire(struct rfid_sightings *st, u_int64_t now)
+{
+	while (st->oldest != NIL) {
+		struct sighting *s = &st->slot[st->oldest];
+
+		if (now - s->last_seen < st->params.window)
+			break;
+
+		sighting_event(st, RFID_SIGHTING_DEPARTED, s);
+		st->stats.departures++;
+		sighting_del(st, st->oldest);
+	}
+}
+
+int rfid_sightings_add(struct rfid_sightings *st, unsigned int layer2,
+		       const unsigned char *uid, unsigned int uid_len)
+{
+	u_int32_t hash, i;
+	u_int64_t now;
+	struct sighting *s;
+	int ret = 0;
+
+	if (!uid_len || uid_len > sizeof(s->uid))
+		return -EINVAL;
+
+	hash = sighting_hash(layer2, uid, uid_len);
+	now = sighting_now();
+
+	pthread_mutex_lock(&st->lock);
+
+	sighting_expire(st, now);
+	st->stats.sightings++;
+
+	for (i = hash & st->mask; st->slot[i].used; i = (i + 1) & st->mask) {
+		s = &st->slot[i];
+		if (s->hash == hash && s->layer2 == layer2 &&
+		    s->uid_len == uid_len && !memcmp(s->uid, uid, uid_len)) {
+			s->last_seen = now;
+			s->count++;
+			list_del(st, i);
+			list_add_tail(st, i);
+			goto out;
+		}
+	}
+
+	if (st->stats.present >= st->params.max_uids) {
+		st->stats.full++;
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	s = &st->slot[i];
+	s->used = 1;
+	s->hash = hash;
+	s->layer2 = layer2;
+	s->uid_len = uid_len;
+	memcpy(s->uid, uid, uid_len);
+	s->first_seen = s->last_seen = now;
+	s->count = 1;
+	list_add_tail(st, i);
+
+	st->stats.present++;
+	st->stats.arrivals++;
+	sighting_event(st, RFID_SIGHTING_ARRIVED, s);
+	ret = 1;
+out:
+	pthread_mutex_unlock(&st->lock);
+	return ret;
+}
+
+int rfid_sightings_read_event(struct rfid_sightings *st,
+			      struct rfid_sighting_event *ev)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&st->lock);
+
+	sighting_expire(st, sighting_now());
+
+	if (st->ev_len) {
+		*ev = st->ev[st->ev_head];
+		st->ev_head = (st->ev_head + 1) & st->mask;
+		st->ev_len--;
+		ret = 1;
+	}
+
+	pthread_mutex_unlock(&st->lock);
+
+	return ret;
+}
+
+void rfid_sightings_get_stats(struct rfid_sightings *st,
+			      struct rfid_sighting_stats *stats)
+{
+	pthread_mutex_lock(&st->lock);
+	*stats = st->stats;
+	pthread_mutex_unlock(&st->lock);
+}
+
+void rfid_sightings_attach(struct rfid_reader_handle *rh,
+			   struct rfid_sightings *st)
+{
+	rh->sightings = st;
+}
+
+struct rfid_sightings *
+rfid_sightings_create(const struct rfid_sighting_params *params)
+{
+	struct rfid_sightings *st;
+	unsigned int num = 2;
+
+	st = malloc(sizeof(*st));
+	if (!st)
+		return NULL;
+	memset(st, 0, sizeof(*st));
+
+	st->params = params ? *params : sighting_defaults;
+	if (!st->params.max_uids)
+		st->params.max_uids = sighting_defaults.max_uids;
+	if (!st->params.window)
+		st->params.window = sighting_defaults.window;
+
+	while (num < st->params.max_uids * 2)
+		num <<= 1;
+
+	st->slot = calloc(num, sizeof(*st->slot));
+	st->ev = calloc(num, sizeof(*st->ev));
+	if (!st->slot || !st->ev) {
+		free(st->slot);
+		free(st->ev);
+		free(st);
+		return NULL;
+	}
+
+	st->mask = num - 1;
+	st->oldest = st->newest = NIL;
+	pthread_mutex_init(&st->lock, NULL);
+
+	return st;
+}
+
+void rfid_sightings_destroy(struct rfid_sightings *st)
+{
+	pthread_mutex_destroy(&st->lock);
+	free(st->slot);
+	free(st->ev);
+	free(st);
+}
@@ -0,0 +1,383 @@
+/* librfid - binary trace flight recorder
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_asic.h>
+#include <librfid/rfid_trace.h>
+
+/* all rings, for rfid_trace_dump_all().  Walked without the lock from the
+ * crash handler. */
+static struct rfid_trace *rfid_traces;
+static unsigned int rfid_trace_rings;
+static volatile int rfid_trace_lock;
+
+static int rfid_trace_crash_fd = -1;
+
+static void traces_lock(void)
+{
+	while (__sync_lock_test_and_set(&rfid_trace_lock, 1))
+		while (rfid_trace_lock)
+			;
+}
+
+static void traces_unlock(void)
+{
+	__sync_lock_release(&rfid_trace_lock);
+}
+
+static void trace_put(struct rfid_trace *tr, unsigned int type, int arg,
+		      u_int64_t ts, const unsigned char *data,
+		      unsigned int len, unsigned int total)
+{
+	u_int32_t seq = __atomic_fetch_add(&tr->head, 1, __ATOMIC_RELAXED);
+	struct rfid_trace_rec *r = &tr->rec[seq & (tr->num - 1)];
+
+	/* invalidate the record before touching it, see trace_get() */
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r->type = type;
+	r->len = len;
+	r->total = total;
+	r->arg = arg;
+	r->ts = ts;
+	memcpy(r->data, data, len);
+
+	__atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* copy record 'seq', fails if it has been (or is being) overwritten */
+static int trace_get(struct rfid_trace *tr, u_int32_t seq,
+		     struct rfid_trace_rec *out)
+{
+	struct rfid_trace_rec *r = &tr->rec[seq & (tr->num - 1)];
+
+	if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != seq + 1)
+		return -1;
+	memcpy(out, r, sizeof(*out));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq + 1)
+		return -1;
+
+	return 0;
+}
+
+void __rfid_trace(struct rfid_trace *tr, unsigned int type, int arg,
+		  const void *data, unsigned int len)
+{
+	const unsigned char *d = data;
+	unsigned int total = len, n;
+	struct timespec ts;
+	u_int64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	if (len > RFID_TRACE_FRAME_MAX)
+		len = RFID_TRACE_FRAME_MAX;
+
+	n = len > RFID_TRACE_DATA ? RFID_TRACE_DATA : len;
+	trace_put(tr, type, arg, ns, d, n, total);
+
+	/* the rest of a frame goes into continuation records */
+	while ((len -= n)) {
+		d += n;
+		n = len > RFID_TRACE_DATA ? RFID_TRACE_DATA : len;
+		trace_put(tr, RFID_TRACE_CONT, d - (const unsigned char *)data,
+			  ns, d, n, total);
+	}
+}
+
+static void trace_attach(struct rfid_reader_handle *rh, struct rfid_trace *tr)
+{
+	rh->trace = tr;
+	if (rh->ah)
+		rh->ah->trace = tr;
+}
+
+static int trace_register(struct rfid_reader_handle *rh, unsigned int records)
+{
+	struct rfid_trace *tr;
+	unsigned int num = 1;
+
+	if (records > RFID_TRACE_RECORDS_MAX)
+		return -EINVAL;
+	while (num < records)
+		num <<= 1;
+
+	tr = malloc(sizeof(*tr));
+	if (!tr)
+		return -ENOMEM;
+	memset(tr, 0, sizeof(*tr));
+
+	tr->rec = calloc(num, sizeof(*tr->rec));
+	if (!tr->rec) {
+		free(tr);
+		return -ENOMEM;
+	}
+	tr->num = num;
+	tr->mask = RFID_TRACE_MASK_DEFAULT;
+	tr->reader = rh->reader->id;
+
+	traces_lock();
+	tr->ring = rfid_trace_rings++;
+	tr->next = rfid_traces;
+	rfid_traces = tr;
+	traces_unlock();
+
+	trace_attach(rh, tr);
+
+	return 0;
+}
+
+int rfid_trace_init(struct rfid_reader_handle *rh)
+{
+	return trace_register(rh, RFID_TRACE_RECORDS);
+}
+
+void rfid_trace_fini(struct rfid_reader_handle *rh)
+{
+	struct rfid_trace *tr = rh->trace, **p;
+
+	if (!tr)
+		return;
+
+	trace_attach(rh, NULL);
+
+	traces_lock();
+	for (p = &rfid_traces; *p; p = &(*p)->next) {
+		if (*p == tr) {
+			*p = tr->next;
+			break;
+		}
+	}
+	traces_unlock();
+
+	free(tr->rec);
+	free(tr);
+}
+
+/* a new ring size drops the recorded history */
+int rfid_trace_setconf(struct rfid_reader_handle *rh,
+		       const struct rfid_trace_conf *conf)
+{
+	unsigned int num = 1;
+	int ret;
+
+	if (!conf->records) {
+		rfid_trace_fini(rh);
+		return 0;
+	}
+	if (conf->records > RFID_TRACE_RECORDS_MAX)
+		return -EINVAL;
+
+	while (num < conf->records)
+		num <<= 1;
+
+	if (!rh->trace || rh->trace->num != num) {
+		rfid_trace_fini(rh);
+		ret = trace_register(rh, num);
+		if (ret < 0)
+			return ret;
+	}
+	rh->trace->mask = conf->mask;
+
+	return 0;
+}
+
+int rfid_trace_getconf(struct rfid_reader_handle *rh,
+		       struct rfid_trace_conf *conf)
+{
+	struct rfid_trace *tr = rh->trace;
+
+	conf->records = tr ? tr->num : 0;
+	conf->mask = tr ? tr->mask : 0;
+
+	return 0;
+}
+
+int rfid_trace_snapshot(struct rfid_reader_handle *rh,
+			struct rfid_trace_rec *recs, unsigned int num)
+{
+	struct rfid_trace *tr = rh->trace;
+	u_int32_t head, seq;
+	unsigned int n = 0;
+
+	if (!tr)
+		return 0;
+
+	head = __atomic_load_n(&tr->head, __ATOMIC_ACQUIRE);
+	if (num > tr->num)
+		num = tr->num;
+	if (num > head)
+		num = head;
+
+	for (seq = head - num; seq != head; seq++) {
+		if (trace_get(tr, seq, &recs[n]) == 0)
+			n++;
+	}
+
+	return n;
+}
+
+/* async signal safe, so no allocations and stdio */
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int write_file_hdr(int fd, unsigned int num_rings)
+{
+	struct rfid_trace_file_hdr fh;
+
+	memset(&fh, 0, sizeof(fh));
+	memcpy(fh.magic, RFID_TRACE_MAGIC, sizeof(fh.magic));
+	fh.rec_size = sizeof(struct rfid_trace_rec);
+	fh.num_rings = num_rings;
+
+	return write_all(fd, &fh, sizeof(fh));
+}
+
+/* Records are copied in chunks.  The ring header needs the number of
+ * records up front, so records that can't be copied are written with
+ * seq 0 and skipped by the decoder. */
+static int write_ring(int fd, struct rfid_trace *tr)
+{
+	struct rfid_trace_ring_hdr rh;
+	struct rfid_trace_rec buf[32];
+	u_int32_t head, seq;
+	unsigned int num, n = 0;
+	int ret;
+
+	head = __atomic_load_n(&tr->head, __ATOMIC_ACQUIRE);
+	num = head < tr->num ? head : tr->num;
+
+	rh.ring = tr->ring;
+	rh.reader = tr->reader;
+	rh.num_recs = num;
+	rh.lost = head - num;
+	ret = write_all(fd, &rh, sizeof(rh));
+	if (ret < 0)
+		return ret;
+
+	for (seq = head - num; seq != head; seq++) {
+		if (trace_get(tr, seq, &buf[n]) < 0)
+			memset(&buf[n], 0, sizeof(buf[n]));
+		if (++n == sizeof(buf)/sizeof(buf[0])) {
+			ret = write_all(fd, buf, sizeof(buf));
+			if (ret < 0)
+				return ret;
+			n = 0;
+		}
+	}
+
+	return write_all(fd, buf, n * sizeof(buf[0]));
+}
+
+int rfid_trace_dump(struct rfid_reader_handle *rh, int fd)
+{
+	int ret;
+
+	if (!rh->trace)
+		return -ENOENT;
+
+	ret = write_file_hdr(fd, 1);
+	if (ret < 0)
+		return ret;
+
+	return write_ring(fd, rh->trace);
+}
+
+int rfid_trace_dump_all(int fd)
+{
+	struct rfid_trace *tr;
+	unsigned int num = 0;
+	int ret;
+
+	traces_lock();
+	for (tr = rfid_traces; tr; tr = tr->next)
+		num++;
+
+	ret = write_file_hdr(fd, num);
+	for (tr = rfid_traces; tr && ret == 0; tr = tr->next)
+		ret = write_ring(fd, tr);
+	traces_unlock();
+
+	return ret;
+}
+
+static const int rfid_trace_crash_signals[] = {
+	SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT,
+};
+
+static void trace_crash(int sig)
+{
+	struct rfid_trace *tr;
+
+	/* the lock may be held by the crashed thread */
+	if (write_file_hdr(rfid_trace_crash_fd, 0) == 0) {
+		for (tr = rfid_traces; tr; tr = tr->next)
+			if (write_ring(rfid_trace_crash_fd, tr) < 0)
+				break;
+	}
+
+	/* SA_RESETHAND restored the default action */
+	raise(sig);
+}
+
+int rfid_trace_crash_handler(int fd)
+{
+	struct sigaction sa;
+	unsigned int i;
+
+	rfid_trace_crash_fd = fd;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = trace_crash;
+	sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+
+	for (i = 0; i < sizeof(rfid_trace_crash_signals)/sizeof(int); i++) {
+		if (sigaction(rfid_trace_crash_signals[i], &sa, NULL) < 0)
+			return -errno;
+	}
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+/* librfid - emulated OpenPCD for the tests
+ *
+ * The libusb calls of rfid_reader_openpcd.c end up here.  Register and
+ * FIFO commands go straight to a simulated RC632 (rc632_sim.c), as the
+ * "main_dumbreader" firmware does over SPI.  CMD_CLS_LIBRFID commands are
+ * run by openpcd_librfid_cmd() with a second reader handle on the same
+ * chip, which is what the firmware's own librfid does.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_reader_openpcd.h>
+
+#include "usb.h"
+#include "openpcd_sim.h"
+
+static struct openpcd_sim *opcd_dev;
+
+static struct usb_device opcd_usb_dev = {
+	.descriptor = {
+		.idVendor	= OPENPCD_VENDOR_ID,
+		.idProduct	= OPENPCD_PRODUCT_ID,
+	},
+};
+
+static struct usb_bus opcd_usb_bus = {
+	.devices = &opcd_usb_dev,
+};
+
+/* the firmware */
+
+static void fw_reply(struct openpcd_sim *sim, const struct openpcd_hdr *req,
+		     u_int8_t flags, u_int8_t val, unsigned int len)
+{
+	struct openpcd_hdr *resp = (struct openpcd_hdr *)sim->reply;
+
+	resp->cmd = req->cmd;
+	resp->flags = flags;
+	resp->reg = req->reg;
+	resp->val = val;
+	sim->reply_len = sizeof(*resp) + len;
+
+	if (flags & OPENPCD_FLAG_ERROR)
+		sim->rejected++;
+}
+
+static void fw_command(struct openpcd_sim *sim, const struct openpcd_hdr *req,
+		       unsigned int len)
+{
+	struct openpcd_hdr *resp = (struct openpcd_hdr *)sim->reply;
+	unsigned int data_len = len - sizeof(*req);
+	unsigned int resp_len;
+
+	sim->cmds++;
+
+	switch (req->cmd) {
+	case OPENPCD_CMD_GET_API_VERSION:
+		fw_reply(sim, req, 0, sim->api_version, 0);
+		return;
+	case OPENPCD_CMD_RESET:
+		fw_reply(sim, req, 0, 0, 0);
+		return;
+	case OPENPCD_CMD_WRITE_REG:
+		rc632_sim_reg_write(&sim->chip, req->reg, req->val);
+		fw_reply(sim, req, 0, 0, 0);
+		return;
+	case OPENPCD_CMD_READ_REG:
+		fw_reply(sim, req, 0, rc632_sim_reg_read(&sim->chip, req->reg),
+			 0);
+		return;
+	case OPENPCD_CMD_WRITE_FIFO:
+		rc632_sim_fifo_write(&sim->chip, req->data, data_len);
+		fw_reply(sim, req, 0, 0, 0);
+		return;
+	case OPENPCD_CMD_READ_FIFO:
+		if (req->val > sizeof(sim->reply) - sizeof(*resp))
+			break;
+		rc632_sim_fifo_read(&sim->chip, resp->data, req->val);
+		fw_reply(sim, req, 0, 0, req->val);
+		return;
+	}
+
+	if (OPENPCD_CMD_CLS(req->cmd) == OPENPCD_CMD_CLS_LIBRFID &&
+	    sim->librfid_cmds) {
+		sim->librfid_calls++;
+		resp_len = sizeof(sim->reply) - sizeof(*resp);
+		if (openpcd_librfid_cmd(sim->fw_rh, req, len, resp,
+					&resp_len) < 0)
+			sim->rejected++;
+		sim->reply_len = sizeof(*resp) + resp_len;
+		return;
+	}
+
+	fw_reply(sim, req, OPENPCD_FLAG_ERROR, 0, 0);
+}
+
+int openpcd_sim_init(struct openpcd_sim *sim, u_int32_t uid,
+		     u_int8_t api_version, unsigned int librfid_cmds)
+{
+	memset(sim, 0, sizeof(*sim));
+	rc632_sim_init(&sim->chip, uid);
+	sim->api_version = api_version;
+	sim->librfid_cmds = librfid_cmds;
+
+	sim->fw_rh = rc632_sim_open(&sim->chip);
+	if (!sim->fw_rh)
+		return -ENOMEM;
+
+	opcd_dev = sim;
+
+	return 0;
+}
+
+void openpcd_sim_fini(struct openpcd_sim *sim)
+{
+	rfid_reader_close(sim->fw_rh);
+	if (opcd_dev == sim)
+		opcd_dev = NULL;
+}
+
+/* libusb */
+
+void usb_init(void)
+{
+}
+
+int usb_find_busses(void)
+{
+	return 1;
+}
+
+int usb_find_devices(void)
+{
+	return 1;
+}
+
+struct usb_bus *usb_get_busses(void)
+{
+	return opcd_dev ? &opcd_usb_bus : NULL;
+}
+
+usb_dev_handle *usb_open(struct usb_device *dev)
+{
+	return (usb_dev_handle *)opcd_dev;
+}
+
+int usb_close(usb_dev_handle *dev)
+{
+	return 0;
+}
+
+int usb_set_configuration(usb_dev_handle *dev, int configuration)
+{
+	return 0;
+}
+
+int usb_claim_interface(usb_dev_handle *dev, int interface)
+{
+	return 0;
+}
+
+int usb_bulk_write(usb_dev_handle *dev, int ep, const char *bytes, int size,
+		   int timeout)
+{
+	struct openpcd_sim *sim = (struct openpcd_sim *)dev;
+
+	if (ep != OPENPCD_OUT_EP || size < sizeof(struct openpcd_hdr))
+		return -EINVAL;
+
+	fw_command(sim, (const struct openpcd_hdr *)bytes, size);
+
+	return size;
+}
+
+int usb_bulk_read(usb_dev_handle *dev, int ep, char *bytes, int size,
+		  int timeout)
+{
+	struct openpcd_sim *sim = (struct openpcd_sim *)dev;
+	unsigned int len = sim->reply_len;
+
+	if (ep != OPENPCD_IN_EP || !len)
+		return -ETIMEDOUT;
+	if (len > size)
+		len = size;
+
+	memcpy(bytes, sim->reply, len);
+	sim->reply_len = 0;
+
+	return len;
+}
@@ -0,0 +1,38 @@
+#ifndef _OPENPCD_SIM_H
+#define _OPENPCD_SIM_H
+
+/* An emulated OpenPCD: the dumb reader USB protocol on top of a simulated
+ * RC632, and the CMD_CLS_LIBRFID commands run by librfid "inside" it. */
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_reader_openpcd.h>
+
+#include "rc632_sim.h"
+
+struct openpcd_sim {
+	struct rc632_sim chip;
+	/* the firmware's own librfid reader on the same chip */
+	struct rfid_reader_handle *fw_rh;
+
+	u_int8_t api_version;		/* OPENPCD_CMD_GET_API_VERSION */
+	unsigned int librfid_cmds;	/* firmware has CMD_CLS_LIBRFID */
+
+	/* reply to the last command, for usb_bulk_read() */
+	u_int8_t reply[4 + 256];
+	unsigned int reply_len;
+
+	/* for the tests to check */
+	unsigned int cmds;		/* commands over USB */
+	unsigned int librfid_calls;	/* ... of which CMD_CLS_LIBRFID */
+	unsigned int rejected;		/* ... answered with FLAG_ERROR */
+};
+
+/* Power up an OpenPCD with a card of 'uid' in its field, running a
+ * firmware of 'api_version' that has CMD_CLS_LIBRFID or not.  It is the
+ * one usb_get_busses() finds, until the next call. */
+int openpcd_sim_init(struct openpcd_sim *sim, u_int32_t uid,
+		     u_int8_t api_version, unsigned int librfid_cmds);
+void openpcd_sim_fini(struct openpcd_sim *sim);
+
+#endif /* _OPENPCD_SIM_H */
@@ -0,0 +1,728 @@
+/* librfid - simulated RC632 reader for the tests
+ *
+ * The register interface of the chip, the FIFO, its EEPROM and crypto1 key
+ * buffer, and a Mifare Classic 1K card in the field.  Commands complete
+ * as soon as the host looks at the chip again, so there is no timing and
+ * no RF: frames are handed to the card as they are, without CRC, parity or
+ * encryption, and the card answers them or lets the timer run out.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_asic.h>
+#include <librfid/rfid_asic_rc632.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_layer2_iso14443a.h>
+#include <librfid/rfid_protocol.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
+#include <librfid/rfid_trace.h>
+
+#include "rfid_reader_rc632_common.h"
+#include "rc632.h"
+#include "rc632_sim.h"
+
+#define SIM_IRQ_MASK	0x3f
+#define SIM_ERR_MASK	0x7f
+
+/* the card */
+
+static void card_reset(struct rc632_sim_card *card)
+{
+	card->state = RC632_SIM_CARD_IDLE;
+	card->write_block = -1;
+}
+
+static int card_block_ok(struct rc632_sim_card *card, u_int8_t block)
+{
+	return block < RC632_SIM_BLOCKS && block / 4 == card->auth_sector;
+}
+
+/* a regular frame to a selected card, returns the length of the answer or
+ * -1 if there is none */
+static int card_frame(struct rc632_sim_card *card, const u_int8_t *f,
+		      unsigned int len, u_int8_t *resp)
+{
+	if (len == 2 && f[0] == 0x50 && f[1] == 0x00) {
+		/* HLTA */
+		card->state = RC632_SIM_CARD_HALT;
+		return -1;
+	}
+
+	if (card->state != RC632_SIM_CARD_AUTH)
+		goto out_idle;
+
+	if (card->write_block >= 0) {
+		if (len != 16)
+			goto out_idle;
+		memcpy(card->block[card->write_block], f, 16);
+		card->write_block = -1;
+		resp[0] = MIFARE_CL_RESP_ACK;
+		return 1;
+	}
+
+	if (len == 2 && f[0] == MIFARE_CL_CMD_READ) {
+		if (!card_block_ok(card, f[1]))
+			goto out_nak;
+		memcpy(resp, card->block[f[1]], 16);
+		return 16;
+	}
+
+	if (len == 2 && f[0] == MIFARE_CL_CMD_WRITE16) {
+		/* block 0 is the manufacturer block */
+		if (!card_block_ok(card, f[1]) || f[1] == 0)
+			goto out_nak;
+		card->write_block = f[1];
+		resp[0] = MIFARE_CL_RESP_ACK;
+		return 1;
+	}
+
+out_nak:
+	card_reset(card);
+	resp[0] = 0x04;
+	return 1;
+
+out_idle:
+	/* anything unexpected ends the session */
+	card_reset(card);
+	return -1;
+}
+
+/* anticollision and select, cascade level 1 only */
+static int card_select(struct rc632_sim_card *card, const u_int8_t *f,
+		       unsigned int len, u_int8_t *resp)
+{
+	u_int8_t bcc = card->uid[0] ^ card->uid[1] ^ card->uid[2] ^
+		       card->uid[3];
+
+	if (f[0] != ISO14443A_AC_SEL_CODE_CL1)
+		return -1;
+
+	if (len == 2 && f[1] == 0x20) {
+		memcpy(resp, card->uid, 4);
+		resp[4] = bcc;
+		return 5;
+	}
+
+	if (len == 7 && f[1] == 0x70 && !memcmp(&f[2], card->uid, 4) &&
+	    f[6] == bcc) {
+		card->state = RC632_SIM_CARD_ACTIVE;
+		resp[0] = card->sak;
+		return 1;
+	}
+
+	return -1;
+}
+
+static int card_rx(struct rc632_sim *sim, u_int8_t *resp)
+{
+	struct rc632_sim_card *card = &sim->card;
+	const u_int8_t *f = sim->tx;
+	unsigned int len = sim->tx_len;
+
+	sim->frames++;
+
+	if (!card->present || !len ||
+	    !(sim->reg[RC632_REG_TX_CONTROL] &
+	      (RC632_TXCTRL_TX1_RF_EN | RC632_TXCTRL_TX2_RF_EN)))
+		return -1;
+
+	/* 7 bit short frame */
+	if ((sim->reg[RC632_REG_BIT_FRAMING] & 0x07) == 7 && len == 1) {
+		switch (card->state) {
+		case RC632_SIM_CARD_HALT:
+			if (f[0] != ISO14443A_SF_CMD_WUPA)
+				return -1;
+			/* fall through */
+		case RC632_SIM_CARD_IDLE:
+		case RC632_SIM_CARD_READY:
+			if (f[0] != ISO14443A_SF_CMD_REQA &&
+			    f[0] != ISO14443A_SF_CMD_WUPA)
+				return -1;
+			card->state = RC632_SIM_CARD_READY;
+			memcpy(resp, card->atqa, 2);
+			return 2;
+		default:
+			/* not for a selected card, which goes back to IDLE */
+			card_reset(card);
+			return -1;
+		}
+	}
+
+	switch (card->state) {
+	case RC632_SIM_CARD_READY:
+		return card_select(card, f, len, resp);
+	case RC632_SIM_CARD_ACTIVE:
+	case RC632_SIM_CARD_AUTH:
+		return card_frame(card, f, len, resp);
+	}
+
+	return -1;
+}
+
+/* the chip */
+
+static void sim_irq(struct rc632_sim *sim, u_int8_t bits)
+{
+	sim->reg[RC632_REG_INTERRUPT_RQ] |= bits;
+}
+
+static void sim_idle(struct rc632_sim *sim)
+{
+	sim->reg[RC632_REG_COMMAND] = RC632_CMD_IDLE;
+	sim_irq(sim, RC632_INT_IDLE);
+}
+
+/* the card doesn't answer: the command waits until the timer expires,
+ * which it has done by the time the host checks */
+static void sim_no_answer(struct rc632_sim *sim)
+{
+	sim->timer_pending = 1;
+}
+
+/* the transmitter ran out of data, the frame is complete */
+static void sim_tx_end(struct rc632_sim *sim)
+{
+	u_int8_t resp[RC632_SIM_FIFO_LEN];
+	int len;
+
+	sim->tx_active = 0;
+	sim->tx_pending = 0;
+	sim_irq(sim, RC632_INT_TX);
+
+	len = card_rx(sim, resp);
+	if (sim->reg[RC632_REG_COMMAND] == RC632_CMD_TRANSMIT) {
+		sim_idle(sim);
+		return;
+	}
+
+	if (len < 0) {
+		sim_no_answer(sim);
+		return;
+	}
+
+	memcpy(sim->fifo, resp, len);
+	sim->fifo_len = len;
+	sim_irq(sim, RC632_INT_RX);
+	sim_idle(sim);
+}
+
+static unsigned int sim_fifo_pull(struct rc632_sim *sim, u_int8_t *buf,
+				  unsigned int len)
+{
+	if (len > sim->fifo_len)
+		len = sim->fifo_len;
+
+	memcpy(buf, sim->fifo, len);
+	memmove(sim->fifo, sim->fifo + len, sim->fifo_len - len);
+	sim->fifo_len -= len;
+
+	return len;
+}
+
+static void sim_fifo_push(struct rc632_sim *sim, const u_int8_t *buf,
+			  unsigned int len)
+{
+	if (sim->tx_active) {
+		/* the transmitter takes it from the FIFO as it goes */
+		if (sim->tx_pending + len > RC632_SIM_FIFO_LEN ||
+		    sim->tx_len + len > sizeof(sim->tx)) {
+			sim->fifo_overflows++;
+			sim->reg[RC632_REG_ERROR_FLAG] |=
+						RC632_ERR_FLAG_FIFO_OVERFLOW;
+			return;
+		}
+		memcpy(sim->tx + sim->tx_len, buf, len);
+		sim->tx_len += len;
+		sim->tx_pending += len;
+		return;
+	}
+
+	if (sim->fifo_len + len > RC632_SIM_FIFO_LEN) {
+		sim->fifo_overflows++;
+		sim->reg[RC632_REG_ERROR_FLAG] |= RC632_ERR_FLAG_FIFO_OVERFLOW;
+		len = RC632_SIM_FIFO_LEN - sim->fifo_len;
+	}
+	memcpy(sim->fifo + sim->fifo_len, buf, len);
+	sim->fifo_len += len;
+}
+
+/* 12 byte coded key to 6 bytes, see rc632_mifare_transform_key() */
+static int sim_decode_key(const u_int8_t *coded, u_int8_t *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < 12; i++) {
+		if ((coded[i] >> 4) != (~coded[i] & 0x0f))
+			return -1;
+	}
+	for (i = 0; i < 6; i++)
+		key[i] = (coded[i * 2] & 0x0f) << 4 | (coded[i * 2 + 1] & 0x0f);
+
+	return 0;
+}
+
+static void sim_load_key(struct rc632_sim *sim, const u_int8_t *coded,
+			 unsigned int len)
+{
+	sim->key_valid = 0;
+	if (len < 12 || sim_decode_key(coded, sim->key) < 0) {
+		sim->reg[RC632_REG_ERROR_FLAG] |= RC632_ERR_FLAG_KEY_ERR;
+		return;
+	}
+	sim->key_valid = 1;
+}
+
+static void sim_authent1(struct rc632_sim *sim)
+{
+	struct rc632_sim_card *card = &sim->card;
+	u_int8_t acmd[6];
+
+	sim->auth1_ok = 0;
+	if (sim_fifo_pull(sim, acmd, sizeof(acmd)) != sizeof(acmd) ||
+	    (card->state != RC632_SIM_CARD_ACTIVE &&
+	     card->state != RC632_SIM_CARD_AUTH) ||
+	    (acmd[0] != RFID_CMD_MIFARE_AUTH1A &&
+	     acmd[0] != RFID_CMD_MIFARE_AUTH1B) ||
+	    acmd[1] >= RC632_SIM_BLOCKS || memcmp(&acmd[2], card->uid, 4)) {
+		sim_no_answer(sim);
+		return;
+	}
+
+	card->state = RC632_SIM_CARD_ACTIVE;
+	card->auth_sector = acmd[1] / 4;
+	card->auth_key_b = acmd[0] == RFID_CMD_MIFARE_AUTH1B;
+	sim->auth1_ok = 1;
+	sim_idle(sim);
+}
+
+static void sim_authent2(struct rc632_sim *sim)
+{
+	struct rc632_sim_card *card = &sim->card;
+	const u_int8_t *trailer = card->block[card->auth_sector * 4 + 3];
+	const u_int8_t *key = card->auth_key_b ? trailer + 10 : trailer;
+
+	if (sim->auth1_ok && sim->key_valid && !memcmp(sim->key, key, 6)) {
+		sim->reg[RC632_REG_CONTROL] |= RC632_CONTROL_CRYPTO1_ON;
+		card->state = RC632_SIM_CARD_AUTH;
+	} else {
+		sim->reg[RC632_REG_CONTROL] &= ~RC632_CONTROL_CRYPTO1_ON;
+		card_reset(card);
+	}
+	sim->auth1_ok = 0;
+	sim_idle(sim);
+}
+
+static void sim_write_e2(struct rc632_sim *sim)
+{
+	u_int8_t buf[RC632_SIM_FIFO_LEN];
+	unsigned int len, addr;
+
+	len = sim_fifo_pull(sim, buf, sizeof(buf));
+	addr = buf[0] | buf[1] << 8;
+	if (len < 2 || addr < 0x10 || addr + len - 2 > RC632_SIM_EE_LEN) {
+		sim->reg[RC632_REG_ERROR_FLAG] |= RC632_ERR_FLAG_ACCESS_ERR;
+		return;
+	}
+	memcpy(sim->ee + addr, buf + 2, len - 2);
+	/* WriteE2 runs until it is stopped with Idle */
+	sim->reg[RC632_REG_SECONDARY_STATUS] |= RC632_SEC_ST_E2_READY;
+}
+
+static void sim_read_e2(struct rc632_sim *sim)
+{
+	u_int8_t buf[3];
+	unsigned int addr;
+
+	if (sim_fifo_pull(sim, buf, sizeof(buf)) != sizeof(buf))
+		return;
+	addr = buf[0] | buf[1] << 8;
+	/* the key area can't be read */
+	if (addr + buf[2] > RC632_SIM_EE_LEN ||
+	    addr + buf[2] > MIFARE_CL_EE_KEY_BASE) {
+		sim->reg[RC632_REG_ERROR_FLAG] |= RC632_ERR_FLAG_ACCESS_ERR;
+		sim_idle(sim);
+		return;
+	}
+	sim_fifo_push(sim, sim->ee + addr, buf[2]);
+	sim_idle(sim);
+}
+
+static void sim_command(struct rc632_sim *sim, u_int8_t cmd)
+{
+	u_int8_t buf[RC632_SIM_FIFO_LEN];
+	unsigned int len, addr;
+
+	sim->tx_active = 0;
+	sim->timer_pending = 0;
+
+	sim->reg[RC632_REG_COMMAND] = cmd;
+	if (cmd != RC632_CMD_IDLE)
+		sim->reg[RC632_REG_ERROR_FLAG] = 0;
+	sim->reg[RC632_REG_SECONDARY_STATUS] &= ~RC632_SEC_ST_E2_READY;
+
+	switch (cmd) {
+	case RC632_CMD_IDLE:
+		break;
+	case RC632_CMD_TRANSMIT:
+	case RC632_CMD_TRANSCEIVE:
+		sim->tx_len = sim_fifo_pull(sim, sim->tx, RC632_SIM_FIFO_LEN);
+		sim->tx_pending = sim->tx_len;
+		sim->tx_active = 1;
+		break;
+	case RC632_CMD_LOAD_KEY:
+		len = sim_fifo_pull(sim, buf, sizeof(buf));
+		sim_load_key(sim, buf, len);
+		sim_idle(sim);
+		break;
+	case RC632_CMD_LOAD_KEY_E2:
+		if (sim_fifo_pull(sim, buf, 2) != 2)
+			addr = RC632_SIM_EE_LEN;
+		else
+			addr = buf[0] | buf[1] << 8;
+		if (addr + 12 > RC632_SIM_EE_LEN)
+			sim_load_key(sim, NULL, 0);
+		else
+			sim_load_key(sim, sim->ee + addr, 12);
+		sim_idle(sim);
+		break;
+	case RC632_CMD_WRITE_E2:
+		sim_write_e2(sim);
+		break;
+	case RC632_CMD_READ_E2:
+		sim_read_e2(sim);
+		break;
+	case RC632_CMD_AUTHENT1:
+		sim_authent1(sim);
+		break;
+	case RC632_CMD_AUTHENT2:
+		sim_authent2(sim);
+		break;
+	case RC632_CMD_RECEIVE:
+		/* no card talks on its own */
+		sim_no_answer(sim);
+		break;
+	default:
+		sim_idle(sim);
+		break;
+	}
+}
+
+static u_int8_t sim_primary_status(struct rc632_sim *sim)
+{
+	u_int8_t stat = 0;
+
+	if (sim->reg[RC632_REG_ERROR_FLAG] & SIM_ERR_MASK)
+		stat |= RC632_STAT_ERR;
+	if (sim->reg[RC632_REG_INTERRUPT_RQ] &
+	    sim->reg[RC632_REG_INTERRUPT_EN] & SIM_IRQ_MASK)
+		stat |= RC632_STAT_IRQ;
+
+	return stat;
+}
+
+static void sim_reg_write(struct rc632_sim *sim, u_int8_t reg, u_int8_t val)
+{
+	switch (reg) {
+	case RC632_REG_FIFO_DATA:
+		sim_fifo_push(sim, &val, 1);
+		return;
+	case RC632_REG_COMMAND:
+		sim_command(sim, val & 0x3f);
+		return;
+	}
+
+	/* anything else ends the frame being sent */
+	if (sim->tx_active)
+		sim_tx_end(sim);
+
+	switch (reg) {
+	case RC632_REG_INTERRUPT_EN:
+	case RC632_REG_INTERRUPT_RQ:
+		if (val & RC632_INT_SET)
+			sim->reg[reg] |= val & 0x7f;
+		else
+			sim->reg[reg] &= ~val;
+		break;
+	case RC632_REG_CONTROL:
+		if (val & RC632_CONTROL_FIFO_FLUSH)
+			sim->fifo_len = 0;
+		sim->reg[reg] = val & ~RC632_CONTROL_FIFO_FLUSH;
+		break;
+	case RC632_REG_TX_CONTROL:
+		sim->reg[reg] = val;
+		/* no field, no card */
+		if (!(val & (RC632_TXCTRL_TX1_RF_EN|RC632_TXCTRL_TX2_RF_EN)))
+			card_reset(&sim->card);
+		break;
+	case RC632_REG_PRIMARY_STATUS:
+	case RC632_REG_FIFO_LENGTH:
+	case RC632_REG_SECONDARY_STATUS:
+	case RC632_REG_ERROR_FLAG:
+	case RC632_REG_COLL_POS:
+		/* read only */
+		break;
+	default:
+		if (reg < sizeof(sim->reg))
+			sim->reg[reg] = val;
+		break;
+	}
+}
+
+static u_int8_t sim_reg_read(struct rc632_sim *sim, u_int8_t reg)
+{
+	u_int8_t val;
+
+	if (reg == RC632_REG_FIFO_LENGTH) {
+		if (!sim->tx_active)
+			return sim->fifo_len;
+		/* what was in the FIFO is sent by the time we look again */
+		val = sim->tx_pending;
+		sim->tx_pending = 0;
+		return val;
+	}
+
+	if (sim->tx_active)
+		sim_tx_end(sim);
+	if (sim->timer_pending) {
+		sim->timer_pending = 0;
+		sim_irq(sim, RC632_INT_TIMER);
+	}
+
+	switch (reg) {
+	case RC632_REG_FIFO_DATA:
+		val = 0;
+		sim_fifo_pull(sim, &val, 1);
+		return val;
+	case RC632_REG_PRIMARY_STATUS:
+		return sim_primary_status(sim);
+	}
+
+	if (reg >= sizeof(sim->reg))
+		return 0;
+
+	return sim->reg[reg];
+}
+
+/* the bus of the chip, for the transport below and emulated readers */
+
+void rc632_sim_reg_write(struct rc632_sim *sim, u_int8_t reg, u_int8_t val)
+{
+	sim_reg_write(sim, reg, val);
+}
+
+u_int8_t rc632_sim_reg_read(struct rc632_sim *sim, u_int8_t reg)
+{
+	return sim_reg_read(sim, reg);
+}
+
+void rc632_sim_fifo_write(struct rc632_sim *sim, const u_int8_t *buf,
+			  unsigned int len)
+{
+	sim_fifo_push(sim, buf, len);
+}
+
+void rc632_sim_fifo_read(struct rc632_sim *sim, u_int8_t *buf,
+			 unsigned int len)
+{
+	unsigned int got;
+
+	if (sim->tx_active)
+		sim_tx_end(sim);
+
+	got = sim_fifo_pull(sim, buf, len);
+	memset(buf + got, 0, len - got);
+}
+
+/* the transport */
+
+static int sim_rat_reg_write(struct rfid_asic_transport_handle *rath,
+			     u_int8_t reg, u_int8_t value)
+{
+	rc632_sim_reg_write(rath->data, reg, value);
+
+	return 1;
+}
+
+static int sim_rat_reg_read(struct rfid_asic_transport_handle *rath,
+			    u_int8_t reg, u_int8_t *value)
+{
+	*value = rc632_sim_reg_read(rath->data, reg);
+
+	return 1;
+}
+
+static int sim_rat_fifo_write(struct rfid_asic_transport_handle *rath,
+			      u_int8_t len, const u_int8_t *buf,
+			      u_int8_t flags)
+{
+	rc632_sim_fifo_write(rath->data, buf, len);
+
+	return len;
+}
+
+static int sim_rat_fifo_read(struct rfid_asic_transport_handle *rath,
+			     u_int8_t len, u_int8_t *buf)
+{
+	rc632_sim_fifo_read(rath->data, buf, len);
+
+	return len;
+}
+
+static const struct rfid_asic_transport sim_rat = {
+	.name = "simulated RC632",
+	.priv.rc632 = {
+		.fn = {
+			.reg_write	= &sim_rat_reg_write,
+			.reg_read	= &sim_rat_reg_read,
+			.fifo_write	= &sim_rat_fifo_write,
+			.fifo_read	= &sim_rat_fifo_read,
+		},
+	},
+};
+
+/* the reader */
+
+static const struct rfid_asic_rc632_impl sim_impl = {
+	.mtu	= 128,
+	.mru	= 64,
+	.iso14443a = {
+		.cw_conductance		= 0x3f,
+		.mod_conductance	= 0x3f,
+		.bitphase		= 0xa9,
+		.threshold		= 0xff,
+		.rx_wait		= 0x06,
+	},
+};
+
+static struct rfid_reader_handle *sim_open(void *data)
+{
+	struct rfid_reader_handle *rh;
+	struct rfid_asic_transport_handle *rath;
+
+	rh = malloc_reader_handle(sizeof(*rh));
+	if (!rh)
+		return NULL;
+	memset(rh, 0, sizeof(*rh));
+
+	rath = malloc_rat_handle(sizeof(*rath));
+	if (!rath)
+		goto out_rh;
+	memset(rath, 0, sizeof(*rath));
+
+	rath->rat = &sim_rat;
+	rath->data = data;
+	rh->reader = &rc632_sim_reader;
+
+	rh->ah = rc632_open(rath, &sim_impl);
+	if (!rh->ah)
+		goto out_rath;
+
+	return rh;
+
+out_rath:
+	free_rat_handle(rath);
+out_rh:
+	free_reader_handle(rh);
+	return NULL;
+}
+
+static void sim_close(struct rfid_reader_handle *rh)
+{
+	struct rfid_asic_transport_handle *rath = rh->ah->rath;
+
+	rc632_close(rh->ah);
+	free_rat_handle(rath);
+	free_reader_handle(rh);
+}
+
+const struct rfid_reader rc632_sim_reader = {
+	.name = "simulated RC632 reader",
+	.id = RFID_READER_SPIDEV,
+	.open = &sim_open,
+	.close = &sim_close,
+	.l2_supported = (1 << RFID_LAYER2_ISO14443A),
+	.proto_supported = (1 << RFID_PROTOCOL_MIFARE_CLASSIC),
+	.getopt = &_rdr_rc632_getopt,
+	.setopt = &_rdr_rc632_setopt,
+	.init = &_rdr_rc632_l2_init,
+	.transceive = &_rdr_rc632_transceive,
+	.transceive_submit = &_rdr_rc632_transceive_submit,
+	.transceive_complete = &_rdr_rc632_transceive_complete,
+	.iso14443a = {
+		.transceive_sf = &_rdr_rc632_transceive_sf,
+		.transceive_acf = &_rdr_rc632_transceive_acf,
+		.speed = RFID_14443A_SPEED_106K,
+		.set_speed = &_rdr_rc632_14443a_set_speed,
+	},
+	.mifare_classic = {
+		.setkey = &_rdr_rc632_mifare_setkey,
+		.setkey_ee = &_rdr_rc632_mifare_setkey_ee,
+		.load_keys_ee = &_rdr_rc632_mifare_load_keys_ee,
+		.auth = &_rdr_rc632_mifare_auth,
+	},
+};
+
+void rc632_sim_init(struct rc632_sim *sim, u_int32_t uid)
+{
+	struct rc632_sim_card *card = &sim->card;
+	unsigned int i;
+
+	memset(sim, 0, sizeof(*sim));
+
+	card->present = 1;
+	memcpy(card->uid, &uid, sizeof(card->uid));
+	card->atqa[0] = 0x04;
+	card->atqa[1] = 0x00;
+	card->sak = 0x08;
+
+	/* manufacturer block: UID, BCC, SAK, ATQA */
+	memcpy(card->block[0], card->uid, 4);
+	card->block[0][4] = card->uid[0] ^ card->uid[1] ^ card->uid[2] ^
+			    card->uid[3];
+	card->block[0][5] = card->sak;
+	memcpy(&card->block[0][6], card->atqa, 2);
+
+	/* sector trailers: key A, transport access bits, key B */
+	for (i = 3; i < RC632_SIM_BLOCKS; i += 4) {
+		memset(card->block[i], 0xff, 16);
+		card->block[i][6] = 0xff;
+		card->block[i][7] = 0x07;
+		card->block[i][8] = 0x80;
+		card->block[i][9] = 0x69;
+	}
+
+	card_reset(card);
+}
+
+struct rfid_reader_handle *rc632_sim_open(struct rc632_sim *sim)
+{
+	struct rfid_reader_handle *rh;
+
+	rh = rc632_sim_reader.open(sim);
+	if (!rh)
+		return NULL;
+
+	/* as rfid_reader_open() does */
+	rfid_trace_init(rh);
+
+	return rh;
+}
@@ -0,0 +1,77 @@
+#ifndef _RC632_SIM_H
+#define _RC632_SIM_H
+
+/* A simulated RC632 behind a simulated transport, with one ISO14443A
+ * Mifare Classic 1K card in its field.  Only as much of the chip is
+ * emulated as the rc632 driver uses with a Mifare Classic, see
+ * rc632_sim.c. */
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+
+#define RC632_SIM_FIFO_LEN	64
+#define RC632_SIM_EE_LEN	512
+#define RC632_SIM_BLOCKS	64		/* Mifare Classic 1K */
+
+enum rc632_sim_card_state {
+	RC632_SIM_CARD_IDLE,
+	RC632_SIM_CARD_READY,
+	RC632_SIM_CARD_ACTIVE,
+	RC632_SIM_CARD_AUTH,		/* Crypto1 session up */
+	RC632_SIM_CARD_HALT,
+};
+
+struct rc632_sim_card {
+	unsigned int present;
+	u_int8_t uid[4];
+	u_int8_t atqa[2];
+	u_int8_t sak;
+	u_int8_t block[RC632_SIM_BLOCKS][16];
+
+	unsigned int state;		/* enum rc632_sim_card_state */
+	unsigned int auth_sector;
+	unsigned int auth_key_b;	/* AUTHENT1 asked for key B */
+	int write_block;		/* WRITE waiting for its data, or -1 */
+};
+
+struct rc632_sim {
+	u_int8_t reg[0x40];
+	u_int8_t fifo[RC632_SIM_FIFO_LEN];
+	unsigned int fifo_len;
+	u_int8_t ee[RC632_SIM_EE_LEN];
+
+	u_int8_t key[6];		/* crypto1 key buffer */
+	unsigned int key_valid;
+	unsigned int auth1_ok;		/* AUTHENT1 answered by the card */
+	unsigned int timer_pending;	/* no answer, the timer will expire */
+
+	/* frame of the running TRANSMIT or TRANSCEIVE */
+	unsigned int tx_active;
+	u_int8_t tx[256];
+	unsigned int tx_len;
+	unsigned int tx_pending;	/* in the FIFO, not sent yet */
+
+	struct rc632_sim_card card;
+
+	/* for the tests to check */
+	unsigned int frames;		/* frames sent to the card */
+	unsigned int fifo_overflows;
+};
+
+extern const struct rfid_reader rc632_sim_reader;
+
+/* a 1K card with transport keys (all 0xff) and UID 'uid' in the field */
+void rc632_sim_init(struct rc632_sim *sim, u_int32_t uid);
+
+/* register and FIFO access, as the host sees it over SPI or USB */
+void rc632_sim_reg_write(struct rc632_sim *sim, u_int8_t reg, u_int8_t val);
+u_int8_t rc632_sim_reg_read(struct rc632_sim *sim, u_int8_t reg);
+void rc632_sim_fifo_write(struct rc632_sim *sim, const u_int8_t *buf,
+			  unsigned int len);
+void rc632_sim_fifo_read(struct rc632_sim *sim, u_int8_t *buf,
+			 unsigned int len);
+
+/* rfid_reader_open() for the simulated reader */
+struct rfid_reader_handle *rc632_sim_open(struct rc632_sim *sim);
+
+#endif /* _RC632_SIM_H */
@@ -0,0 +1,188 @@
+/* librfid - OpenPCD driver against an emulated reader
+ *
+ * rfid_reader_openpcd.c is built into the test and talks to openpcd_sim.c
+ * instead of a USB device.  The same card session is run against a
+ * firmware with CMD_CLS_LIBRFID, one with an older API version and one
+ * that claims the API version but rejects the commands: the results and
+ * the reader statistics have to come out the same, only the number of USB
+ * round trips differs.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_reader_openpcd.h>
+#include <librfid/rfid_scan.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
+
+#include "openpcd_sim.h"
+
+#define TEST_UID	0x04a1b2c3
+#define TEST_BLOCK	5
+
+struct firmware {
+	const char *name;
+	u_int8_t api_version;
+	unsigned int librfid_cmds;
+	unsigned int offload;		/* CMD_CLS_LIBRFID used */
+};
+
+static const struct firmware firmwares[] = {
+	{ "librfid firmware", OPENPCD_API_LIBRFID, 1, 1 },
+	{ "old firmware", OPENPCD_API_LIBRFID - 1, 0, 0 },
+	{ "firmware without CMD_CLS_LIBRFID", OPENPCD_API_LIBRFID, 0, 0 },
+};
+
+static struct openpcd_sim sim;
+
+static const char *session(struct rfid_reader_handle *rh,
+			   const struct firmware *fw, int *ret)
+{
+	struct rfid_layer2_handle *l2h;
+	struct rfid_protocol_handle *ph;
+	struct rfid_reader_stats before, after;
+	unsigned char buf[MIFARE_CL_PAGE_SIZE];
+	unsigned int len;
+	const char *err = NULL;
+
+	*ret = rfid_scan(rh, &l2h, &ph);
+	if (*ret != 3)
+		return "scan";
+
+	if (l2h->uid_len != 4 || memcmp(l2h->uid, sim.chip.card.uid, 4)) {
+		err = "uid";
+		goto out;
+	}
+	if (!rh->stats.anticol) {
+		err = "anticollision not counted";
+		goto out;
+	}
+
+	*ret = mfcl_set_key(ph, (unsigned char *)"\xff\xff\xff\xff\xff\xff");
+	if (*ret < 0) {
+		err = "set key";
+		goto out;
+	}
+
+	/* one READ frame, whether the firmware or the host ran it */
+	before = rh->stats;
+	len = sizeof(buf);
+	*ret = mfcl_auth_read(ph, RFID_CMD_MIFARE_AUTH1A, TEST_BLOCK, buf,
+			      &len);
+	after = rh->stats;
+	if (*ret < 0 || len != sizeof(buf) ||
+	    memcmp(buf, sim.chip.card.block[TEST_BLOCK], sizeof(buf))) {
+		err = "auth_read";
+		goto out;
+	}
+	if (after.transceive != before.transceive + 1 ||
+	    after.tx_bytes != before.tx_bytes + 2 ||
+	    after.rx_bytes != before.rx_bytes + sizeof(buf)) {
+		err = "auth_read stats";
+		goto out;
+	}
+
+	/* the card rejects the key and drops out */
+	*ret = mfcl_set_key(ph, (unsigned char *)MIFARE_CL_KEYB_DEFAULT);
+	if (*ret < 0) {
+		err = "set key";
+		goto out;
+	}
+	len = sizeof(buf);
+	*ret = mfcl_auth_read(ph, RFID_CMD_MIFARE_AUTH1A, TEST_BLOCK, buf,
+			      &len);
+	if (*ret != -EACCES) {
+		err = "auth_read with the wrong key";
+		goto out;
+	}
+
+	if (fw->offload ? sim.librfid_calls != 3 : sim.librfid_calls != 0) {
+		*ret = sim.librfid_calls;
+		err = "CMD_CLS_LIBRFID commands";
+	}
+
+out:
+	rfid_protocol_close(ph);
+	rfid_protocol_fini(ph);
+	rfid_layer2_close(l2h);
+	rfid_layer2_fini(l2h);
+
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	struct rfid_reader_handle *rh;
+	const struct firmware *fw;
+	unsigned int i, cmds[ARRAY_SIZE(firmwares)];
+	const char *err;
+	int ret, rc = 0;
+
+	rfid_init();
+
+	for (i = 0; i < ARRAY_SIZE(firmwares); i++) {
+		fw = &firmwares[i];
+
+		if (openpcd_sim_init(&sim, TEST_UID, fw->api_version,
+				     fw->librfid_cmds) < 0) {
+			fprintf(stderr, "%s: can't set up the reader\n",
+				fw->name);
+			return 1;
+		}
+		memset(sim.chip.card.block[TEST_BLOCK], 0x40 + i,
+		       MIFARE_CL_PAGE_SIZE);
+
+		rh = rfid_reader_openpcd.open(NULL);
+		if (!rh) {
+			fprintf(stderr, "%s: open failed\n", fw->name);
+			openpcd_sim_fini(&sim);
+			return 1;
+		}
+
+		err = session(rh, fw, &ret);
+		if (err) {
+			fprintf(stderr, "%s: %s failed (%d)\n", fw->name, err,
+				ret);
+			rc = 1;
+		}
+		/* only the one that claims to have it may refuse once */
+		if (sim.rejected != (fw->api_version >= OPENPCD_API_LIBRFID &&
+				     !fw->librfid_cmds)) {
+			fprintf(stderr, "%s: %u commands rejected\n", fw->name,
+				sim.rejected);
+			rc = 1;
+		}
+		cmds[i] = sim.cmds;
+
+		rfid_reader_close(rh);
+		openpcd_sim_fini(&sim);
+	}
+
+	if (!rc && cmds[0] >= cmds[1]) {
+		fprintf(stderr, "offloading took %u USB commands, the host "
+			"side %u\n", cmds[0], cmds[1]);
+		rc = 1;
+	}
+
+	return rc;
+}
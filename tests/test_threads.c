@@ -0,0 +1,279 @@
+/* librfid - several readers driven from their own threads at once
+ *
+ * Every thread opens a simulated reader (rc632_sim.c) with its own card,
+ * and keeps scanning, authenticating, writing and reading it.  Built with
+ * -fsanitize=thread if the compiler has it, so that any state the library
+ * shares between readers shows up as a data race.
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_scan.h>
+#include <librfid/rfid_layer2.h>
+#include <librfid/rfid_protocol.h>
+#include <librfid/rfid_protocol_mifare_classic.h>
+#include <librfid/rfid_trace.h>
+#include <librfid/rfid_buf.h>
+
+#include "rc632_sim.h"
+
+#define NUM_READERS	4
+#define NUM_ROUNDS	16
+
+struct reader_thread {
+	pthread_t thread;
+	unsigned int n;
+	struct rc632_sim sim;
+	struct rfid_reader_stats stats;
+	const char *err;
+	int ret;
+};
+
+/* a pool buffer of every reader thread, for the next thread to free */
+static struct rfid_buf *pool_buf[NUM_READERS];
+static pthread_barrier_t barrier;
+
+static void card_close(struct rfid_layer2_handle *l2h,
+		       struct rfid_protocol_handle *ph)
+{
+	rfid_protocol_close(ph);
+	rfid_protocol_fini(ph);
+	rfid_layer2_close(l2h);
+	rfid_layer2_fini(l2h);
+}
+
+static const char *one_round(struct rfid_reader_handle *rh,
+			     struct reader_thread *t, unsigned int round,
+			     int *ret)
+{
+	struct rfid_layer2_handle *l2h;
+	struct rfid_protocol_handle *ph;
+	unsigned char wr[MIFARE_CL_PAGE_SIZE], rd[MIFARE_CL_PAGE_SIZE];
+	unsigned int len, block = 4 + round % 3;
+	unsigned int rf_kill;
+	const char *err = NULL;
+
+	*ret = rfid_scan(rh, &l2h, &ph);
+	if (*ret != 3)
+		return "scan";
+
+	if (l2h->uid_len != 4 || memcmp(l2h->uid, t->sim.card.uid, 4)) {
+		err = "uid";
+		goto out;
+	}
+
+	*ret = mfcl_set_key(ph, (unsigned char *)MIFARE_CL_KEYB_DEFAULT);
+	if (*ret < 0) {
+		err = "set key";
+		goto out;
+	}
+	*ret = mfcl_auth(ph, RFID_CMD_MIFARE_AUTH1A, block);
+	if (*ret != -EACCES) {
+		err = "auth with the wrong key";
+		goto out;
+	}
+
+	/* the card dropped out with the failed auth */
+	card_close(l2h, ph);
+	*ret = rfid_scan(rh, &l2h, &ph);
+	if (*ret != 3)
+		return "scan after failed auth";
+
+	*ret = mfcl_set_key(ph, (unsigned char *)"\xff\xff\xff\xff\xff\xff");
+	if (*ret < 0) {
+		err = "set key";
+		goto out;
+	}
+	*ret = mfcl_auth(ph, RFID_CMD_MIFARE_AUTH1A, block);
+	if (*ret < 0) {
+		err = "auth";
+		goto out;
+	}
+
+	memset(wr, t->n, sizeof(wr));
+	wr[0] = round;
+	*ret = rfid_protocol_write(ph, block, wr, sizeof(wr));
+	if (*ret < 0) {
+		err = "write";
+		goto out;
+	}
+
+	len = sizeof(rd);
+	*ret = rfid_protocol_read(ph, block, rd, &len);
+	if (*ret < 0 || len != sizeof(rd) || memcmp(rd, wr, sizeof(wr))) {
+		err = "read back";
+		goto out;
+	}
+
+	/* the card reports what the library wrote */
+	if (memcmp(t->sim.card.block[block], wr, sizeof(wr))) {
+		err = "card contents";
+		goto out;
+	}
+
+	/* authenticated for another sector, then auth + read in one go */
+	len = sizeof(rd);
+	*ret = mfcl_auth_read(ph, RFID_CMD_MIFARE_AUTH1B, 0, rd, &len);
+	if (*ret < 0 || len != sizeof(rd) ||
+	    memcmp(rd, t->sim.card.block[0], sizeof(rd))) {
+		err = "auth_read";
+		goto out;
+	}
+
+out:
+	card_close(l2h, ph);
+
+	/* cycle the field, which wakes the halted card up again */
+	rf_kill = 1;
+	rfid_reader_setopt(rh, RFID_OPT_RDR_RF_KILL, &rf_kill, sizeof(rf_kill));
+	rf_kill = 0;
+	rfid_reader_setopt(rh, RFID_OPT_RDR_RF_KILL, &rf_kill, sizeof(rf_kill));
+
+	return err;
+}
+
+/* A pool buffer freed by another thread has to be refused, it would end
+ * up in the wrong pool.  Returns an error or NULL */
+static const char *buf_pool(struct reader_thread *t)
+{
+	struct rfid_buf *b[RFID_BUF_POOL_SIZE + 1], *other;
+	const char *err = NULL;
+	unsigned int i;
+
+	pool_buf[t->n] = rfid_buf_alloc();
+	pthread_barrier_wait(&barrier);
+
+	other = pool_buf[(t->n + 1) % NUM_READERS];
+	if (other)
+		rfid_buf_free(other);
+
+	/* the whole pool, and one more from the heap */
+	for (i = 0; i < ARRAY_SIZE(b); i++) {
+		b[i] = rfid_buf_alloc();
+		if (!b[i])
+			err = "rfid_buf_alloc";
+		else if (b[i] == other)
+			err = "rfid_buf_free of another thread's buffer";
+		else
+			memset(rfid_buf_put(b[i], RFID_BUF_DATALEN), t->n,
+			       RFID_BUF_DATALEN);
+	}
+	for (i = 0; i < ARRAY_SIZE(b); i++) {
+		if (b[i] != other)
+			rfid_buf_free(b[i]);
+	}
+
+	pthread_barrier_wait(&barrier);
+	rfid_buf_free(pool_buf[t->n]);
+
+	return err;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader_thread *t = arg;
+	struct rfid_reader_handle *rh;
+	struct rfid_trace_conf tc;
+	const char *err;
+	unsigned int i, len;
+
+	rh = rc632_sim_open(&t->sim);
+	if (!rh)
+		t->err = "open";
+
+	if (rh) {
+		/* every reader has its own trace ring */
+		tc.mask = RFID_TRACE_MASK_DEFAULT;
+		tc.records = 256;
+		rfid_reader_setopt(rh, RFID_OPT_RDR_TRACE, &tc, sizeof(tc));
+
+		for (i = 0; i < NUM_ROUNDS && !t->err; i++)
+			t->err = one_round(rh, t, i, &t->ret);
+	}
+
+	/* all threads take part, or the others wait forever */
+	err = buf_pool(t);
+	if (!t->err)
+		t->err = err;
+
+	if (rh) {
+		len = sizeof(t->stats);
+		rfid_reader_getopt(rh, RFID_OPT_RDR_STATS, &t->stats, &len);
+		rfid_reader_close(rh);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct reader_thread *t;
+	unsigned int i;
+	int ret = 0;
+
+	t = calloc(NUM_READERS, sizeof(*t));
+	if (!t)
+		return 1;
+
+	rfid_init();
+	pthread_barrier_init(&barrier, NULL, NUM_READERS);
+
+	for (i = 0; i < NUM_READERS; i++) {
+		t[i].n = i;
+		rc632_sim_init(&t[i].sim, 0x10203040 + i);
+		if (pthread_create(&t[i].thread, NULL, reader_thread, &t[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < NUM_READERS; i++)
+		pthread_join(t[i].thread, NULL);
+
+	for (i = 0; i < NUM_READERS; i++) {
+		if (t[i].err) {
+			fprintf(stderr, "reader %u: %s failed (%d)\n", i,
+				t[i].err, t[i].ret);
+			ret = 1;
+			continue;
+		}
+		if (t[i].sim.fifo_overflows) {
+			fprintf(stderr, "reader %u: FIFO overflow\n", i);
+			ret = 1;
+		}
+		if (t[i].stats.scans != 2 * NUM_ROUNDS ||
+		    t[i].stats.scan_hits != 2 * NUM_ROUNDS ||
+		    !t[i].stats.transceive) {
+			fprintf(stderr, "reader %u: stats %u scans, %u hits, "
+				"%u frames\n", i, t[i].stats.scans,
+				t[i].stats.scan_hits, t[i].stats.transceive);
+			ret = 1;
+		}
+	}
+
+	pthread_barrier_destroy(&barrier);
+	free(t);
+
+	return ret;
+}
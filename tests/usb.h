@@ -0,0 +1,43 @@
+#ifndef _TESTS_USB_H
+#define _TESTS_USB_H
+
+/* The part of the libusb-0.1 API that rfid_reader_openpcd.c uses, in front
+ * of the system one, so that the driver talks to the emulated OpenPCD in
+ * openpcd_sim.c instead of a USB device. */
+
+#include <sys/types.h>
+
+struct usb_dev_handle;
+typedef struct usb_dev_handle usb_dev_handle;
+
+struct usb_device_descriptor {
+	u_int16_t idVendor;
+	u_int16_t idProduct;
+};
+
+struct usb_device {
+	struct usb_device *next;
+	struct usb_device_descriptor descriptor;
+};
+
+struct usb_bus {
+	struct usb_bus *next;
+	struct usb_device *devices;
+};
+
+void usb_init(void);
+int usb_find_busses(void);
+int usb_find_devices(void);
+struct usb_bus *usb_get_busses(void);
+
+usb_dev_handle *usb_open(struct usb_device *dev);
+int usb_close(usb_dev_handle *dev);
+int usb_set_configuration(usb_dev_handle *dev, int configuration);
+int usb_claim_interface(usb_dev_handle *dev, int interface);
+
+int usb_bulk_write(usb_dev_handle *dev, int ep, const char *bytes, int size,
+		   int timeout);
+int usb_bulk_read(usb_dev_handle *dev, int ep, char *bytes, int size,
+		  int timeout);
+
+#endif /* _TESTS_USB_H */
@@ -24,6 +24,7 @@
 
 #ifndef __MINGW32__
 #include <libgen.h>
+#include <poll.h>
 #endif
 
 #define _GNU_SOURCE
@@ -43,122 +44,18 @@
 #include <librfid/rfid_protocol_tagit.h>
 #include <librfid/rfid_protocol_icode.h>
 #include <librfid/rfid_protocol_tcl.h>
+#include <librfid/rfid_iso7816.h>
+#ifndef __MINGW32__
+#include <librfid/rfid_monitor.h>
+#include <librfid/rfid_calibrate.h>
+#endif
 
 #include "librfid-tool.h"
 
 
-static int select_mf(void)
-{
-	unsigned char cmd[] = { 0x00, 0xa4, 0x00, 0x00, 0x02, 0x3f, 0x00, 0x00 };
-	unsigned char ret[256];
-	unsigned int rlen = sizeof(ret);
-
-	int rv;
-
-	rv = rfid_protocol_transceive(ph, cmd, sizeof(cmd), ret, &rlen, 0, 0);
-	if (rv < 0)
-		return rv;
-
-	printf("%d: [%s]\n", rlen, hexdump(ret, rlen));
-
-	return 0;
-}
-
-
-static int iso7816_get_challenge(unsigned char len)
-{
-	unsigned char cmd[] = { 0x00, 0x84, 0x00, 0x00, 0x08 };
-	unsigned char ret[256];
-	unsigned int rlen = sizeof(ret);
-
-	cmd[4] = len;
-
-	int rv;
-
-	rv = rfid_protocol_transceive(ph, cmd, sizeof(cmd), ret, &rlen, 0, 0);
-	if (rv < 0)
-		return rv;
-
-	printf("%d: [%s]\n", rlen, hexdump(ret, rlen));
-
-	return 0;
-}
-
-int
-iso7816_select_application(void)
-{
-	unsigned char cmd[] = { 0x00, 0xa4, 0x04, 0x0c, 0x07,
-		       0xa0, 0x00, 0x00, 0x02, 0x47, 0x10, 0x01 };
-	unsigned char resp[7];
-	unsigned int rlen = sizeof(resp);
-
-	int rv;
-
-	rv = rfid_protocol_transceive(ph, cmd, sizeof(cmd), resp, &rlen, 0, 0);
-	if (rv < 0)
-		return rv;
-
-	/* FIXME: parse response */
-	printf("%s\n", hexdump(resp, rlen));
-
-	return 0;
-}
-
-int
-iso7816_select_ef(u_int16_t fid)
-{
-	unsigned char cmd[7] = { 0x00, 0xa4, 0x02, 0x0c, 0x02, 0x00, 0x00 };
-	unsigned char resp[7];
-	unsigned int rlen = sizeof(resp);
-
-	int rv;
-
-	cmd[5] = (fid >> 8) & 0xff;
-	cmd[6] = fid & 0xff;
-
-	rv = rfid_protocol_transceive(ph, cmd, sizeof(cmd), resp, &rlen, 0, 0);
-	if (rv < 0)
-		return rv;
-
-	/* FIXME: parse response */
-	printf("%s\n", hexdump(resp, rlen));
-
-	return 0;
-}
-
-int
-iso7816_read_binary(unsigned char *buf, unsigned int *len)
-{
-	unsigned char cmd[] = { 0x00, 0xb0, 0x00, 0x00, 0x00 };
-	unsigned char resp[256];
-	unsigned int rlen = sizeof(resp);
-
-	int rv;
-
-	rv = rfid_protocol_transceive(ph, cmd, sizeof(cmd), resp, &rlen, 0, 0);
-	if (rv < 0)
-		return rv;
-
-	printf("%s\n", hexdump(resp, rlen));
-
-	/* FIXME: parse response, determine whether we need additional reads */
-
-	/* FIXME: copy 'len' number of response bytes to 'buf' */
-	return 0;
-}
-
-/* wrapper function around SELECT EF and READ BINARY */
-int
-iso7816_read_ef(u_int16_t fid, unsigned char *buf, unsigned int *len)
-{
-	int rv;
-
-	rv = iso7816_select_ef(fid);
-	if (rv < 0)
-		return rv;
-
-	return iso7816_read_binary(buf, len);
-}
+static const unsigned char passport_aid[] = {
+	0xa0, 0x00, 0x00, 0x02, 0x47, 0x10, 0x01
+};
 
 /* mifare ultralight helpers */
 int
@@ -411,6 +308,27 @@ static int l2_by_name(const char *name)
 	return -1;
 }
 
+static struct rfid_scan_plan scan_plan;
+static unsigned int scan_timeout;
+
+/* probe the most frequently seen card types first, and only 'layer2' if
+ * one was given */
+static void scan_plan_setup(int layer2)
+{
+	unsigned int i;
+
+	rfid_scan_plan_init(&scan_plan, rh);
+	for (i = 0; i < scan_plan.num_l2; i++) {
+		if (layer2 >= 0 && scan_plan.l2[i].id != layer2)
+			scan_plan.l2[i].enabled = 0;
+		scan_plan.l2[i].timeout = scan_timeout;
+	}
+	for (i = 0; i < scan_plan.num_proto; i++)
+		scan_plan.proto[i].timeout = scan_timeout;
+
+	rfid_scan_set_plan(rh, &scan_plan);
+}
+
 static int do_scan(int first)
 {
 	int rc;
@@ -470,7 +388,7 @@ static int do_scan(int first)
 
 static void do_endless_scan()
 {
-	int rc;
+	int rc, present;
 	int first = 1;
 
 	while (1) {
@@ -478,6 +396,14 @@ static void do_endless_scan()
 			putc('\n', stdout);
 		printf("==> doing %s scan\n", first ? "first" : "successive");
 		rc = do_scan(first);
+		if (rc >= 2) {
+			/* wait until the card is removed */
+			while ((present = rc >= 3 ? rfid_protocol_presence(ph) :
+					      rfid_layer2_presence(l2h)) == 1)
+				usleep(100*1000);
+			if (present == 0)
+				printf("card removed\n");
+		}
 		if (rc >= 3) {
 			printf("closing proto\n");
 			rfid_protocol_close(ph);
@@ -491,6 +417,112 @@ static void do_endless_scan()
 	}
 }
 
+#ifndef __MINGW32__
+static void do_monitor(void)
+{
+	struct rfid_monitor_params params = {
+		.flags			= RFID_MONITOR_F_EVENTFD |
+					  RFID_MONITOR_F_RF_KILL,
+		.scan_interval		= 100,
+		.presence_interval	= 100,
+		.idle_after		= 5000,
+		.idle_interval		= 500,
+	};
+	struct rfid_monitor *mon;
+	struct rfid_monitor_event ev;
+	struct pollfd pfd;
+
+	mon = rfid_monitor_create(rh, &params);
+	if (!mon || rfid_monitor_start(mon) < 0) {
+		fprintf(stderr, "error starting monitor\n");
+		return;
+	}
+
+	pfd.fd = rfid_monitor_get_fd(mon);
+	pfd.events = POLLIN;
+
+	while (poll(&pfd, 1, -1) >= 0) {
+		while (rfid_monitor_read_event(mon, &ev)) {
+			printf("%lu.%06lu card %s: %s, layer2 %s",
+				(unsigned long) ev.tv.tv_sec,
+				(unsigned long) ev.tv.tv_usec,
+				ev.type == RFID_MONITOR_EV_ARRIVED ?
+					"arrived" : "removed",
+				hexdump(ev.uid, ev.uid_len),
+				l2_names[ev.layer2]);
+			if (ev.protocol >= 0)
+				printf(", protocol %s", proto_names[ev.protocol]);
+			printf("\n");
+		}
+	}
+
+	rfid_monitor_destroy(mon);
+}
+#endif
+
+static const char *tuning_file;
+
+/* open the reader with the tuning saved in the -T file, if one was given */
+static int tool_reader_init(void)
+{
+	int rc;
+
+	if (reader_init() < 0)
+		return -1;
+	if (!tuning_file)
+		return 0;
+
+	rc = rfid_reader_tuning_load(rh, tuning_file);
+	if (rc < 0) {
+		fprintf(stderr, "can't load tuning from %s: %s\n", tuning_file,
+			strerror(-rc));
+		rfid_reader_close(rh);
+		return -1;
+	}
+	printf("tuning loaded from %s\n", tuning_file);
+
+	return 0;
+}
+
+static void print_calib(const struct rfid_calib_result *res, void *data)
+{
+	printf("mod_conductance 0x%02x bitphase 0x%02x threshold 0x%02x: "
+	       "%u/%u selects", res->tuning.mod_conductance,
+	       res->tuning.bitphase, res->tuning.threshold, res->ok,
+	       res->rounds);
+	if (res->ok)
+		printf(", %u usec", res->latency);
+	printf("\n");
+}
+
+static void do_calibrate(unsigned int rounds)
+{
+	struct rfid_calib_result best;
+	int rc;
+
+	printf("leave a single ISO14443A card on the reader\n");
+
+	rc = rfid_reader_calibrate(rh, rounds, &best, &print_calib, NULL);
+	if (rc < 0) {
+		fprintf(stderr, "calibration failed: %s\n", strerror(-rc));
+		return;
+	}
+
+	printf("best: mod_conductance 0x%02x bitphase 0x%02x threshold 0x%02x "
+	       "(%u/%u selects, %u usec)\n", best.tuning.mod_conductance,
+	       best.tuning.bitphase, best.tuning.threshold, best.ok,
+	       best.rounds, best.latency);
+
+	if (!tuning_file)
+		return;
+	rc = rfid_reader_tuning_save(rh, tuning_file);
+	if (rc < 0)
+		fprintf(stderr, "can't save tuning to %s: %s\n", tuning_file,
+			strerror(-rc));
+	else
+		printf("tuning saved to %s\n", tuning_file);
+}
+
 static void do_regdump(void)
 {
 	u_int8_t buffer[0xff];
@@ -608,11 +640,15 @@ static struct option original_opts[] = {
 	{ "protocol", 1, 0, 'p' },
 	{ "scan", 0, 0, 's' },
 	{ "scan-loop", 0, 0, 'S' },
+	{ "scan-timeout", 1, 0, 't' },
 	{ "dump", 0, 0, 'd' },
 	{ "enum", 0, 0, 'e' },
 	{ "read", 1, 0, 'r' },
     { "write", 1, 0, 'w'},
 	{ "enum-loop", 1, 0, 'E' },
+	{ "monitor", 0, 0, 'm' },
+	{ "calibrate", 1, 0, 'C' },
+	{ "tuning", 1, 0, 'T' },
 	{0, 0, 0, 0}
 };
 
@@ -685,11 +721,17 @@ static void help(void)
 {
 	printf( " -s	--scan		scan until first RFID tag is found\n"
 		" -S	--scan-loop	endless scanning loop\n"
+		" -t	--scan-timeout	<ms> give up on a card type after that long\n"
 		" -p	--protocol	{tcl,mifare-ultralight,mifare-classic,tagit,icode}\n"
 		" -l	--layer2	{iso14443a,iso14443b,iso15693,icode1}\n"
+		"			(before -s/-S: only scan for that one)\n"
 		" -d	--dump		dump rc632 registers\n"
 		" -e	--enum		enumerate all tag's in field \n"
 		" -E	--enum-loop	<delay> (ms) enumerate endless\n"
+		" -m	--monitor	report card arrival / removal\n"
+		" -C	--calibrate	<rounds> calibrate the antenna to an iso14443a card\n"
+		" -T	--tuning	<file> before other options: load the tuning\n"
+		"			from <file>, or save it there with -C\n"
 		" -r	--read		<secror> read iso15693 sector \n\t\t\t(-1:0-255 stop on error, -2: 0-255 no stop)\n"
         " -w	--write		<sector> write to iso15693 sector data: 01:02:03:04\n"
 		" -h	--help\n");
@@ -699,7 +741,7 @@ int main(int argc, char **argv)
 {
 	int rc;
 	char buf[0x100];
-	int i, len, protocol = -1, layer2 = -1;
+	int i, protocol = -1, layer2 = -1;
 
 #ifdef  __MINGW32__
 	program_name = argv[0];
@@ -716,7 +758,7 @@ int main(int argc, char **argv)
 
 	while (1) {
 		int c, option_index = 0;
-		c = getopt_long(argc, argv, "hp:l:sSdeE:r:w:", opts, &option_index);
+		c = getopt_long(argc, argv, "hp:l:sSt:deE:r:w:mC:T:", opts, &option_index);
 		if (c == -1)
 			break;
 
@@ -724,7 +766,7 @@ int main(int argc, char **argv)
         case 'w':
             //hexread(key, optarg, strlen(optarg));
             i = strtol(optarg, NULL, 10);
-			if (reader_init() < 0)
+			if (tool_reader_init() < 0)
 				exit(1);
             layer2 = RFID_LAYER2_ISO15693;
             iso15693_write(rh,layer2,i,"\x1\x2\x3\x4",4);
@@ -733,7 +775,7 @@ int main(int argc, char **argv)
             break;
 		case 'r':
             i = strtol(optarg, NULL, 10);
-			if (reader_init() < 0)
+			if (tool_reader_init() < 0)
 				exit(1);
 			//if (layer2 < 0)
             layer2 = RFID_LAYER2_ISO15693;
@@ -744,7 +786,7 @@ int main(int argc, char **argv)
 		case 'E':
 			i = strtol(optarg, NULL, 10);
 
-			if (reader_init() < 0)
+			if (tool_reader_init() < 0)
 				exit(1);
 			if (layer2<0)
 				layer2 = RFID_LAYER2_ISO14443A;
@@ -754,7 +796,7 @@ int main(int argc, char **argv)
 			exit(0);
 			break;
 		case 'e':
-			if (reader_init() < 0)
+			if (tool_reader_init() < 0)
 				exit(1);
 			if (layer2 < 0)
 				layer2 = RFID_LAYER2_ISO14443A;
@@ -762,25 +804,51 @@ int main(int argc, char **argv)
 			rfid_reader_close(rh);
 			exit(0);
 			break;
-		case 'd':
+		case 'C':
+			i = strtol(optarg, NULL, 10);
+			/* calibrating to save to the -T file, don't load it */
 			if (reader_init() < 0)
 				exit(1);
+			do_calibrate(i > 0 ? i : 10);
+			rfid_reader_close(rh);
+			exit(0);
+			break;
+		case 'd':
+			if (tool_reader_init() < 0)
+				exit(1);
 			do_regdump();
 			rfid_reader_close(rh);
 			break;
 		case 's':
-			if (reader_init() < 0)
+			if (tool_reader_init() < 0)
 				exit(1);
+			scan_plan_setup(layer2);
 			do_scan(0);
 			rfid_reader_close(rh);
 			exit(0);
 			break;
 		case 'S':
-			if (reader_init() < 0)
+			if (tool_reader_init() < 0)
 				exit(1);
+			scan_plan_setup(layer2);
 			do_endless_scan();
 			exit(0);
 			break;
+#ifndef __MINGW32__
+		case 'm':
+			if (tool_reader_init() < 0)
+				exit(1);
+			do_monitor();
+			rfid_reader_close(rh);
+			exit(0);
+			break;
+#endif
+		case 't':
+			scan_timeout = strtoul(optarg, NULL, 10);
+			break;
+		case 'T':
+			tuning_file = optarg;
+			break;
 		case 'p':
 			protocol = proto_by_name(optarg);
 			if (protocol < 0) {
@@ -823,7 +891,7 @@ int main(int argc, char **argv)
 		exit(2);
 	}
 
-	if (reader_init() < 0)
+	if (tool_reader_init() < 0)
 		exit(1);
 
 
@@ -839,59 +907,67 @@ int main(int argc, char **argv)
 
 	switch (protocol) {
 
-	case RFID_PROTOCOL_TCL:
+	case RFID_PROTOCOL_TCL: {
+		struct iso7816_handle *ih;
+		unsigned int rlen;
+
 		printf("Protocol T=CL\n");
 		/* we've established T=CL at this point */
+		ih = iso7816_init(ph);
+		if (!ih) {
+			printf("error initializing ISO7816 layer\n");
+			break;
+		}
+
 		printf("selecting Master File\n");
-		rc = select_mf();
-		if (rc < 0) {
+		/* not every card has an MF, the passport doesn't need one */
+		rc = iso7816_select_mf(ih);
+		if (rc == -ENOENT)
+			printf("card has no MF\n");
+		else if (rc < 0) {
 			printf("error selecting MF\n");
-			break;
+			goto tcl_out;
 		}
 
 		printf("Getting random challenge, length 255\n");
-		rc = iso7816_get_challenge(0xff);
+		rc = iso7816_get_challenge(ih, (unsigned char *) buf, 0xff);
 		if (rc < 0) {
 			printf("error getting random challenge\n");
-			break;
+			goto tcl_out;
 		}
+		printf("%d: [%s]\n", rc, hexdump(buf, rc));
 
 		printf("selecting Passport application\n");
-		rc = iso7816_select_application();
+		rc = iso7816_select_application(ih, passport_aid,
+						sizeof(passport_aid));
 		if (rc < 0) {
 			printf("error selecting passport application\n");
-			break;
+			goto tcl_out;
 		}
 
-		printf("selecting EF 0x1e\n");
-		rc = iso7816_select_ef(0x011e);
+		printf("reading EF 0x1e\n");
+		rlen = sizeof(buf);
+		rc = iso7816_read_ef(ih, 0x011e, (unsigned char *) buf, &rlen,
+				     0);
 		if (rc < 0) {
-			printf("error selecting EF 0x1e\n");
-			break;
+			printf("error reading EF 0x1e\n");
+			goto tcl_out;
 		}
+		printf("%u: [%s]\n", rlen, hexdump(buf, rlen));
 
-		printf("selecting EF 0x01\n");
-		rc = iso7816_select_ef(0x0101);
+		printf("reading EF 0x01\n");
+		rlen = sizeof(buf);
+		rc = iso7816_read_ef(ih, 0x0101, (unsigned char *) buf, &rlen,
+				     0);
 		if (rc < 0) {
-			printf("error selecting EF 0x01\n");
-			break;
-		}
-
-		while (1) {
-			printf("reading EF1\n");
-			len = sizeof(buf);
-			printf("reading ef\n");
-			rc = iso7816_read_binary(buf, &len);
-			if (rc < 0) {
-				printf("error reading EF\n");
-				break;
-			}
+			printf("error reading EF 0x01\n");
+			goto tcl_out;
 		}
-#if 0
-		for (i = 0; i < 4; i++)
-			iso7816_get_challenge(0xff);
-#endif
+		printf("%u: [%s]\n", rlen, hexdump(buf, rlen));
+tcl_out:
+		iso7816_fini(ih);
 		break;
+		}
 	case RFID_PROTOCOL_MIFARE_UL:
 		printf("Protocol Mifare Ultralight\n");
 		mifare_ulight_read(ph);
@@ -0,0 +1,274 @@
+/* librfid-trace - decode librfid trace dumps
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define _GNU_SOURCE
+#include <getopt.h>
+
+#include <librfid/rfid.h>
+#include <librfid/rfid_reader.h>
+#include <librfid/rfid_trace.h>
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+static const char *type_names[] = {
+	[RFID_TRACE_TX]		= "TX",
+	[RFID_TRACE_RX]		= "RX",
+	[RFID_TRACE_CONT]	= "CONT",
+	[RFID_TRACE_ANTICOL]	= "ANTICOL",
+	[RFID_TRACE_REG_WRITE]	= "REG_WR",
+	[RFID_TRACE_REG_READ]	= "REG_RD",
+	[RFID_TRACE_TIMEOUT]	= "TIMEOUT",
+	[RFID_TRACE_ERROR]	= "ERROR",
+};
+
+static const char *frame_names[] = {
+	[RFID_14443A_FRAME_REGULAR]	= "14443A",
+	[RFID_14443B_FRAME_REGULAR]	= "14443B",
+	[RFID_MIFARE_FRAME]		= "MIFARE",
+	[RFID_15693_FRAME]		= "15693",
+	[RFID_15693_FRAME_ICODE1]	= "ICODE1",
+};
+
+static const char *reader_names[] = {
+	[RFID_READER_CM5121]	= "CM5121",
+	[RFID_READER_PEGODA]	= "Pegoda",
+	[RFID_READER_OPENPCD]	= "OpenPCD",
+	[RFID_READER_SPIDEV]	= "spidev",
+};
+
+static int absolute;
+
+/* frame that is being reassembled from TX/RX + CONT records */
+static struct {
+	struct rfid_trace_rec rec;
+	unsigned char data[RFID_TRACE_FRAME_MAX];
+	unsigned int len;
+} frame;
+
+static const char *name(const char **names, unsigned int num, unsigned int i)
+{
+	if (i < num && names[i])
+		return names[i];
+	return "?";
+}
+
+static void print_ts(u_int64_t ts, u_int64_t start)
+{
+	if (!absolute)
+		ts -= start;
+	printf("%6llu.%06llu ", (unsigned long long)(ts / 1000000000),
+	       (unsigned long long)(ts % 1000000000) / 1000);
+}
+
+static void print_hex(const unsigned char *d, unsigned int len)
+{
+	while (len--)
+		printf(" %02x", *d++);
+}
+
+static void flush_frame(u_int64_t start)
+{
+	struct rfid_trace_rec *r = &frame.rec;
+
+	if (!r->seq)
+		return;
+
+	print_ts(r->ts, start);
+	if (r->type == RFID_TRACE_TX)
+		printf("TX  %-7s", name(frame_names, ARRAY_SIZE(frame_names),
+					 r->arg));
+	else if (r->arg < 0)
+		printf("RX  %-7s", strerror(-r->arg));
+	else
+		printf("RX  %-7s", "ok");
+	printf(" (%3u)", r->total);
+	print_hex(frame.data, frame.len);
+	if (frame.len < r->total)
+		printf(" ...");
+	printf("\n");
+
+	r->seq = 0;
+}
+
+static void print_rec(struct rfid_trace_rec *r, u_int64_t start)
+{
+	if (r->type == RFID_TRACE_CONT) {
+		/* drop it if the start of the frame was overwritten */
+		if (!frame.rec.seq || r->arg != (int)frame.len)
+			return;
+		if (r->len > sizeof(r->data) ||
+		    r->len > sizeof(frame.data) - frame.len) {
+			fprintf(stderr, "bad continuation record\n");
+			return;
+		}
+		memcpy(frame.data + frame.len, r->data, r->len);
+		frame.len += r->len;
+		return;
+	}
+
+	flush_frame(start);
+
+	switch (r->type) {
+	case RFID_TRACE_TX:
+	case RFID_TRACE_RX:
+		if (r->len > sizeof(r->data)) {
+			fprintf(stderr, "bad frame record\n");
+			return;
+		}
+		frame.rec = *r;
+		memcpy(frame.data, r->data, r->len);
+		frame.len = r->len;
+		return;
+	}
+
+	if (r->len > sizeof(r->data))
+		r->len = sizeof(r->data);
+
+	print_ts(r->ts, start);
+	printf("%-11s ", name(type_names, ARRAY_SIZE(type_names), r->type));
+
+	switch (r->type) {
+	case RFID_TRACE_ANTICOL:
+		printf("%d", r->arg);
+		print_hex(r->data, r->len);
+		break;
+	case RFID_TRACE_REG_WRITE:
+	case RFID_TRACE_REG_READ:
+		printf("reg 0x%02x = 0x%02x", (r->arg >> 8) & 0xff,
+		       r->arg & 0xff);
+		break;
+	case RFID_TRACE_TIMEOUT:
+		if (r->arg)
+			printf("after %d usec", r->arg);
+		break;
+	case RFID_TRACE_ERROR:
+		printf("flags 0x%02x", r->arg);
+		break;
+	default:
+		printf("arg %d", r->arg);
+		print_hex(r->data, r->len);
+		break;
+	}
+	printf("\n");
+}
+
+static int decode_ring(FILE *f, unsigned int rec_size)
+{
+	struct rfid_trace_ring_hdr rh;
+	struct rfid_trace_rec r;
+	u_int64_t start = 0;
+	unsigned int i;
+
+	if (fread(&rh, sizeof(rh), 1, f) != 1)
+		return 0;
+
+	printf("ring %u, %s reader, %u records, %u older ones lost\n",
+	       rh.ring, name(reader_names, ARRAY_SIZE(reader_names),
+			     rh.reader), rh.num_recs, rh.lost);
+
+	memset(&frame, 0, sizeof(frame));
+	for (i = 0; i < rh.num_recs; i++) {
+		if (fread(&r, rec_size, 1, f) != 1) {
+			fprintf(stderr, "truncated dump\n");
+			return -1;
+		}
+		/* overwritten while dumping */
+		if (!r.seq)
+			continue;
+		if (!start)
+			start = r.ts;
+		print_rec(&r, start);
+	}
+	flush_frame(start);
+	printf("\n");
+
+	return 1;
+}
+
+static void help(void)
+{
+	printf(" -a	--absolute	print absolute CLOCK_MONOTONIC timestamps\n"
+	       " -h	--help\n");
+}
+
+static struct option opts[] = {
+	{ "absolute", 0, 0, 'a' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	struct rfid_trace_file_hdr fh;
+	FILE *f = stdin;
+	unsigned int i;
+	int ret;
+
+	while (1) {
+		int c, option_index = 0;
+
+		c = getopt_long(argc, argv, "ah", opts, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'a':
+			absolute = 1;
+			break;
+		case 'h':
+		default:
+			fprintf(stderr, "usage: %s [options] [dumpfile]\n",
+				argv[0]);
+			help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	if (optind < argc) {
+		f = fopen(argv[optind], "rb");
+		if (!f) {
+			fprintf(stderr, "%s: %s\n", argv[optind],
+				strerror(errno));
+			exit(1);
+		}
+	}
+
+	if (fread(&fh, sizeof(fh), 1, f) != 1 ||
+	    memcmp(fh.magic, RFID_TRACE_MAGIC, sizeof(fh.magic))) {
+		fprintf(stderr, "not a librfid trace dump\n");
+		exit(1);
+	}
+	if (fh.rec_size != sizeof(struct rfid_trace_rec)) {
+		fprintf(stderr, "unsupported record size %u\n", fh.rec_size);
+		exit(1);
+	}
+
+	/* crash dumps don't know the number of rings */
+	for (i = 0; !fh.num_rings || i < fh.num_rings; i++) {
+		ret = decode_ring(f, fh.rec_size);
+		if (ret <= 0)
+			break;
+	}
+
+	exit(ret < 0 ? 1 : 0);
+}
@@ -0,0 +1,75 @@
+-- Wireshark dissector for librfid pcapng captures (LINKTYPE_USER0),
+-- see include/librfid/rfid_capture.h.
+--
+--   wireshark -X lua_script:librfid.lua capture.pcapng
+
+local p = Proto("librfid", "librfid RF frame")
+
+local dirs = { [0] = "PCD->PICC", [1] = "PICC->PCD" }
+local events = {
+	[0] = "Frame", [1] = "REQA/WUPA", [2] = "Anticollision",
+	[3] = "ISO15693 inventory", [4] = "Mifare authentication",
+}
+local frametypes = {
+	[0] = "ISO14443A", [1] = "ISO14443B", [2] = "Mifare",
+	[3] = "ISO15693", [4] = "ICODE1",
+}
+
+local f = p.fields
+f.version = ProtoField.uint8("librfid.version", "Version")
+f.dir = ProtoField.uint8("librfid.dir", "Direction", base.DEC, dirs)
+f.event = ProtoField.uint8("librfid.event", "Event", base.DEC, events)
+f.frametype = ProtoField.uint8("librfid.frametype", "Frame type",
+			       base.DEC, frametypes)
+f.kbps = ProtoField.uint16("librfid.kbps", "Bit rate (kbit/s)")
+f.flags = ProtoField.uint8("librfid.flags", "Error flags", base.HEX)
+f.collision = ProtoField.bool("librfid.flags.collision", "Collision", 8,
+			      nil, 0x01)
+f.parity = ProtoField.bool("librfid.flags.parity", "Parity error", 8,
+			   nil, 0x02)
+f.framing = ProtoField.bool("librfid.flags.framing", "Framing error", 8,
+			    nil, 0x04)
+f.crc = ProtoField.bool("librfid.flags.crc", "CRC error", 8, nil, 0x08)
+f.status = ProtoField.int32("librfid.status", "Status")
+f.data = ProtoField.bytes("librfid.data", "Data")
+
+function p.dissector(buf, pinfo, tree)
+	if buf:len() < 12 then
+		return 0
+	end
+
+	local dir = buf(1, 1):uint()
+	local status = buf(8, 4):int()
+
+	pinfo.cols.protocol = "librfid"
+	pinfo.cols.src = dir == 0 and "PCD" or "PICC"
+	pinfo.cols.dst = dir == 0 and "PICC" or "PCD"
+
+	local t = tree:add(p, buf(0, 12))
+	t:add(f.version, buf(0, 1))
+	t:add(f.dir, buf(1, 1))
+	t:add(f.event, buf(2, 1))
+	t:add(f.frametype, buf(3, 1))
+	t:add(f.kbps, buf(4, 2))
+	local fl = t:add(f.flags, buf(6, 1))
+	fl:add(f.collision, buf(6, 1))
+	fl:add(f.parity, buf(6, 1))
+	fl:add(f.framing, buf(6, 1))
+	fl:add(f.crc, buf(6, 1))
+	t:add(f.status, buf(8, 4))
+
+	local info = (events[buf(2, 1):uint()] or "?") .. " " ..
+		     (frametypes[buf(3, 1):uint()] or "?")
+	if buf:len() > 12 then
+		tree:add(f.data, buf(12))
+		info = info .. " " .. tostring(buf(12):bytes())
+	end
+	if dir == 1 and status < 0 then
+		info = info .. " [error " .. status .. "]"
+	end
+	pinfo.cols.info = info
+
+	return buf:len()
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, p)